@@ -20,6 +20,7 @@
 
 #include "APRSReader.h"
 #include "Timer.h"
+#include "Clock.h"
 #include "Log.h"
 
 #include <cstdio>
@@ -28,28 +29,6 @@
 #include <cctype>
 #include <time.h>
 
-#if defined(_WIN32) || defined(_WIN64)
-static const unsigned __int64 epoch = ((unsigned __int64)116444736000000000ULL);
-
-int gettimeofday(struct timeval * tp, struct timezone * tzp)
-{
-	FILETIME    file_time;
-	SYSTEMTIME  system_time;
-	ULARGE_INTEGER ularge;
-
-	GetSystemTime(&system_time);
-	SystemTimeToFileTime(&system_time, &file_time);
-	ularge.LowPart = file_time.dwLowDateTime;
-	ularge.HighPart = file_time.dwHighDateTime;
-
-	tp->tv_sec = (long)((ularge.QuadPart - epoch) / 10000000L);
-	tp->tv_usec = (long)(system_time.wMilliseconds * 1000);
-	return 0;
-}
-#else
-#include <sys/time.h>
-#endif
-
 const unsigned int APRS_TIMEOUT = 10U;
 
 CAPRSReader::CAPRSReader(std::string ApiKey,int refres_time) :
@@ -59,6 +38,7 @@ m_cs(),
 m_stop(false),
 m_new_callsign(false),
 m_refres_time(refres_time),
+m_mutex(),
 m_lat_table(),
 m_lon_table(),
 m_time_table()
@@ -80,12 +60,17 @@ void CAPRSReader::entry()
 
 	while (!m_stop) {
 		
-		while(!m_new_callsign)
+		while(!m_new_callsign && !m_stop)
 			sleep(1000U);
-		
+
+		if (m_stop)
+			break;
+
 		load_call();
 		
+		m_mutex.lock();
 		m_new_callsign = false;
+		m_mutex.unlock();
 	}
 
 	LogMessage("Stopped the APRS Reader lookup thread");
@@ -94,6 +79,8 @@ void CAPRSReader::entry()
 void CAPRSReader::stop()
 {
 	m_stop = true;
+
+	wait();
 }
 
 void CAPRSReader::formatGPS(unsigned char *buffer, int latitude, int longitude)
@@ -175,7 +162,6 @@ void CAPRSReader::formatGPS(unsigned char *buffer, int latitude, int longitude)
 
 bool CAPRSReader::load_call() 
 {
-	struct timeval timeinfo;
 	unsigned long epoch;
 
 	int longitude = 0;
@@ -185,11 +171,16 @@ bool CAPRSReader::load_call()
 	int nDataLength;
 	std::string website_HTML;
 
+	// The sessions look callsigns up while this one is being fetched
+	m_mutex.lock();
+	std::string cs = m_cs;
+	m_mutex.unlock();
+
 	// get information
 	// LogMessage("Searching %s", callsign.c_str());
 	// website url
-	std::string url = "/api/get?name=" + m_cs + "-Y," + m_cs + "-7," + m_cs + "-8," + m_cs + "-9,";
-	url = url + m_cs + "-14," + m_cs + "&what=loc&apikey=" + m_ApiKey + "&format=json";
+	std::string url = "/api/get?name=" + cs + "-Y," + cs + "-7," + cs + "-8," + cs + "-9,";
+	url = url + cs + "-14," + cs + "&what=loc&apikey=" + m_ApiKey + "&format=json";
 	//HTTP GET
 	std::string get_http = "GET " + url + " HTTP/1.1\r\nHost: api.aprs.fi\r\nUser-Agent: YSF2DMR/0.12\r\n\r\n";		
 	CTCPSocket sockfd("api.aprs.fi", 80);
@@ -213,14 +204,12 @@ bool CAPRSReader::load_call()
 				tmp_str[8] = 0;
 				//LogMessage("Latitude: %s", tmp_str);
 				latitude = (int)(atof(tmp_str) * 1000);
-				m_lat_table[m_cs] = latitude;
 			}
 			if (i > 5 && buffer[i - 4] == '\"' && buffer[i - 3] == 'l' && buffer[i - 2] == 'n' && buffer[i - 1] == 'g' && buffer[i] == '\"'){
 				::memcpy(tmp_str,buffer + i + 3, 8U);
 				tmp_str[8] = 0;
 				//LogMessage("Longitude: %s", tmp_str);
 				longitude = (int)(atof(tmp_str) * 1000);
-				m_lon_table[m_cs] = longitude;
 			}
 			
 			if ((latitude != 0) && (longitude != 0))
@@ -232,18 +221,26 @@ bool CAPRSReader::load_call()
 
 	sockfd.close();
 
-	gettimeofday(&timeinfo, 0);
-	epoch = timeinfo.tv_sec;
-	m_time_table[m_cs] = epoch;
+	epoch = (unsigned int)(CClock::get()->realtime() / 1000000ULL);
+
+	// Only a complete position is kept, anything less counts as not found
+	if (latitude == 0 || longitude == 0) {
+		latitude  = 0;
+		longitude = 0;
+	}
+
+	m_mutex.lock();
+	m_lat_table[cs]  = latitude;
+	m_lon_table[cs]  = longitude;
+	m_time_table[cs] = epoch;
+	m_mutex.unlock();
 
 	if (latitude == 0 || longitude == 0) {
-		m_lat_table[m_cs] = 0;
-		m_lon_table[m_cs] = 0;
-		LogMessage("GPS Position of %s not found", m_cs.c_str());
+		LogMessage("GPS Position of %s not found", cs.c_str());
 		return false;
 	}
 	else {
-		LogMessage("GPS Position of %s Lat: %0.3f, Lon: %0.3f", m_cs.c_str(), (float)latitude / 1000.0, (float)longitude / 1000.0);
+		LogMessage("GPS Position of %s Lat: %0.3f, Lon: %0.3f", cs.c_str(), (float)latitude / 1000.0, (float)longitude / 1000.0);
 		return true;
 	}
 }
@@ -251,9 +248,10 @@ bool CAPRSReader::load_call()
 bool CAPRSReader::findCall(std::string cs, int *latitude, int *longitude)
 {
 	bool not_found = false;
-	struct timeval timeinfo;
 	unsigned int epoch, tempo;
 
+	m_mutex.lock();
+
 	try {
 		*latitude = m_lat_table.at(cs);
 	} catch (...) {
@@ -267,6 +265,8 @@ bool CAPRSReader::findCall(std::string cs, int *latitude, int *longitude)
 	}
 
 	if (m_new_callsign) {
+		m_mutex.unlock();
+
 		if (not_found)
 			return false;
 		else if ((*latitude != 0) && (*longitude != 0))
@@ -278,11 +278,11 @@ bool CAPRSReader::findCall(std::string cs, int *latitude, int *longitude)
 	if (not_found) {
 		m_new_callsign = true;
 		m_cs = cs;
+		m_mutex.unlock();
 		return false;
 	}
 	else {
-		gettimeofday(&timeinfo, 0);
-		epoch = timeinfo.tv_sec;
+		epoch = (unsigned int)(CClock::get()->realtime() / 1000000ULL);
 		tempo = m_time_table.at(cs);
 
 		if (epoch > (tempo + m_refres_time)) {
@@ -291,6 +291,8 @@ bool CAPRSReader::findCall(std::string cs, int *latitude, int *longitude)
 			m_cs = cs;
 		}
 
+		m_mutex.unlock();
+
 		if ((*latitude != 0) && (*longitude != 0))
 			return true;
 		else
@@ -45,6 +45,7 @@ private:
 	bool m_stop;
 	bool m_new_callsign;
 	unsigned int  m_refres_time;
+	CMutex        m_mutex;
 	std::unordered_map<std::string, int> m_lat_table;
 	std::unordered_map<std::string, int> m_lon_table;
 	std::unordered_map<std::string, unsigned int> m_time_table;
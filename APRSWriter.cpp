@@ -27,10 +27,10 @@
 #include <cstring>
 #include <cmath>
 
-CAPRSWriter::CAPRSWriter(const std::string& callsign, const std::string& suffix, const std::string& password, const std::string& address, unsigned int port) :
+CAPRSWriter::CAPRSWriter(CTimerWheel& wheel, const std::string& callsign, const std::string& suffix, const std::string& password, const std::string& address, unsigned int port) :
 m_thread(NULL),
 m_enabled(false),
-m_idTimer(1000U, 20U * 60U),		// 20 minutes
+m_idTimer(wheel, 20U * 60U),		// 20 minutes
 m_callsign(callsign),
 m_txFrequency(0U),
 m_rxFrequency(0U),
@@ -50,6 +50,11 @@ m_desc()
 	}
 
 	m_thread = new CAPRSWriterThread(m_callsign, password, address, port);
+
+	m_idTimer.setCallback([this] {
+		//sendIdFrames();
+		m_idTimer.start();
+	});
 }
 
 CAPRSWriter::~CAPRSWriter()
@@ -137,18 +142,9 @@ void CAPRSWriter::write(const unsigned char* source, const char* type, unsigned
 	m_thread->write(output);
 }
 
-void CAPRSWriter::clock(unsigned int ms)
-{
-	m_idTimer.clock(ms);
-
-	if (m_idTimer.hasExpired()) {
-		//sendIdFrames();
-		m_idTimer.start();
-	}
-}
-
 void CAPRSWriter::close()
 {
+	m_idTimer.stop();
 	m_thread->stop();
 }
 
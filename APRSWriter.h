@@ -22,13 +22,13 @@
 #define	APRSWriter_H
 
 #include "APRSWriterThread.h"
-#include "Timer.h"
+#include "TimerWheel.h"
 
 #include <string>
 
 class CAPRSWriter {
 public:
-	CAPRSWriter(const std::string& callsign, const std::string& suffix, const std::string& password, const std::string& address, unsigned int port);
+	CAPRSWriter(CTimerWheel& wheel, const std::string& callsign, const std::string& suffix, const std::string& password, const std::string& address, unsigned int port);
 	~CAPRSWriter();
 
 	bool open();
@@ -37,14 +37,12 @@ public:
 
 	void write(const unsigned char* source, const char* type, unsigned char radio, float latitude, float longitude, unsigned int tg_qrv);
 
-	void clock(unsigned int ms);
-
 	void close();
 
 private:
 	CAPRSWriterThread* m_thread;
 	bool               m_enabled;
-	CTimer             m_idTimer;
+	CWheelTimer        m_idTimer;
 	std::string        m_callsign;
 	unsigned int       m_txFrequency;
 	unsigned int       m_rxFrequency;
@@ -0,0 +1,228 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Checks the stream arbitration with two overlapping calls on slot 2, once
+// for each policy:
+//
+//   make arbtest && ./arbtest
+//
+// The DMR network runs against a simulated master on a virtual clock. Call
+// A starts first and call B starts while A is still going. The frames read
+// from the network, as a session reads them, have to make up whole calls:
+// each one from a single source, ending with a terminator before the next
+// starts. The calls heard, and whether each one started with its header,
+// have to match the policy.
+
+#include "DMRNetwork.h"
+#include "Simulation.h"
+#include "TimerWheel.h"
+#include "Clock.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+const unsigned int SRC_A    = 1111111U;
+const unsigned int SRC_B    = 2222222U;
+const unsigned int STREAM_A = 0xAAAA0001U;
+const unsigned int STREAM_B = 0xBBBB0002U;
+const unsigned int DST_ID   = 91U;
+
+// Voice frames in each call, B starts halfway through the frame after this one of A
+const unsigned int CALL_VOICE = 30U;
+const unsigned int B_START    = 12U;
+
+const unsigned long long FRAME_TIME = 60000ULL;
+const unsigned long long START_TIME = 2000000ULL;
+const unsigned long long END_TIME   = 6000000ULL;
+
+class CArbCall {
+public:
+	unsigned int m_srcId;
+	bool         m_header;
+	unsigned int m_voice;
+	bool         m_ended;
+	bool         m_mixed;
+};
+
+class CArbFrame {
+public:
+	unsigned long long         m_time;
+	std::vector<unsigned char> m_data;
+};
+
+static std::vector<unsigned char> makeFrame(unsigned char seqNo, unsigned int srcId, unsigned int streamId, unsigned char flags)
+{
+	std::vector<unsigned char> data(55U, 0x00U);
+
+	::memcpy(&data[0U], "DMRD", 4U);
+	data[4U]  = seqNo;
+	data[5U]  = srcId >> 16;
+	data[6U]  = srcId >> 8;
+	data[7U]  = srcId >> 0;
+	data[8U]  = DST_ID >> 16;
+	data[9U]  = DST_ID >> 8;
+	data[10U] = DST_ID >> 0;
+	data[15U] = 0x80U | flags;
+	data[16U] = streamId >> 24;
+	data[17U] = streamId >> 16;
+	data[18U] = streamId >> 8;
+	data[19U] = streamId >> 0;
+
+	return data;
+}
+
+static void addCall(std::vector<CArbFrame>& frames, unsigned long long start, unsigned int srcId, unsigned int streamId)
+{
+	CArbFrame frame;
+
+	frame.m_time = start;
+	frame.m_data = makeFrame(0U, srcId, streamId, 0x20U | DT_VOICE_LC_HEADER);
+	frames.push_back(frame);
+
+	for (unsigned int i = 0U; i < CALL_VOICE; i++) {
+		unsigned int n = i % 6U;
+
+		frame.m_time = start + (i + 1U) * FRAME_TIME;
+		frame.m_data = makeFrame(i + 1U, srcId, streamId, n == 0U ? 0x10U : n);
+		frames.push_back(frame);
+	}
+
+	frame.m_time = start + (CALL_VOICE + 1U) * FRAME_TIME;
+	frame.m_data = makeFrame(CALL_VOICE + 1U, srcId, streamId, 0x20U | DT_TERMINATOR_WITH_LC);
+	frames.push_back(frame);
+}
+
+static bool run(CVirtualClock& clock, const char* name, ARB_POLICY policy, const std::vector<unsigned int>& priorityIds, const std::vector<unsigned int>& expected)
+{
+	FILE* output = ::fopen("/dev/null", "w");
+	if (output == NULL)
+		return false;
+
+	CTimerWheel wheel;
+
+	CSimTransport master("dmr", true, output, clock);
+	master.setPeer(CUDPSocket::lookup("127.0.0.1"), 62031U);
+
+	CDMRNetwork network(wheel, "127.0.0.1", 62031U, 62032U, 1234567U, "PASSWORD", false, "arbtest", false, true, true, HWT_MMDVM, 500U);
+	network.setTransport(&master);
+	network.setArbitration(policy, priorityIds);
+	network.enable(true);
+	network.open();
+
+	std::vector<CArbFrame> frames;
+	addCall(frames, START_TIME, SRC_A, STREAM_A);
+	addCall(frames, START_TIME + B_START * FRAME_TIME + FRAME_TIME / 2ULL, SRC_B, STREAM_B);
+
+	std::vector<CArbCall> calls;
+	bool inCall = false;
+
+	unsigned long long base = clock.monotonic();
+	for (unsigned long long now = 0ULL; now < END_TIME; now += 1000ULL) {
+		clock.advanceTo(base + now);
+
+		for (std::vector<CArbFrame>::const_iterator it = frames.begin(); it != frames.end(); ++it) {
+			if (it->m_time == now && network.isConnected())
+				master.add(it->m_data);
+		}
+
+		wheel.clock();
+		network.clock();
+
+		CDMRData data;
+		while (network.read(2U, data)) {
+			if (data.isMissing())
+				continue;
+
+			unsigned char type = data.getDataType();
+
+			if (!inCall) {
+				if (type == DT_TERMINATOR_WITH_LC)
+					continue;
+
+				CArbCall call;
+				call.m_srcId  = data.getSrcId();
+				call.m_header = type == DT_VOICE_LC_HEADER;
+				call.m_voice  = 0U;
+				call.m_ended  = false;
+				call.m_mixed  = false;
+				calls.push_back(call);
+				inCall = true;
+			}
+
+			CArbCall& call = calls.back();
+			if (data.getSrcId() != call.m_srcId)
+				call.m_mixed = true;
+
+			if (type == DT_VOICE || type == DT_VOICE_SYNC)
+				call.m_voice++;
+
+			// As the session does at the end of each call
+			if (type == DT_TERMINATOR_WITH_LC) {
+				call.m_ended = true;
+				inCall = false;
+				network.endOfStream(2U);
+			}
+		}
+	}
+
+	network.close();
+	::fclose(output);
+
+	bool ok = calls.size() == expected.size();
+	for (unsigned int i = 0U; ok && i < calls.size(); i++)
+		ok = calls[i].m_srcId == expected[i] && calls[i].m_header && calls[i].m_ended && !calls[i].m_mixed;
+
+	::fprintf(stdout, "%-10s %-4s", name, ok ? "ok" : "FAIL");
+	for (std::vector<CArbCall>::const_iterator it = calls.begin(); it != calls.end(); ++it)
+		::fprintf(stdout, "  %u: %s%u voice%s%s", it->m_srcId, it->m_header ? "header, " : "", it->m_voice, it->m_ended ? ", end" : "", it->m_mixed ? ", MIXED" : "");
+	::fprintf(stdout, "\n");
+
+	return ok;
+}
+
+int main(int, char**)
+{
+	CVirtualClock clock(1546300800000000ULL);
+	CClock::set(&clock);
+
+	// Only the warnings are shown
+	::LogInitialise(".", "arbtest", 0U, 4U);
+
+	std::vector<unsigned int> none;
+	std::vector<unsigned int> first(1U, SRC_A);
+	std::vector<unsigned int> second(1U, SRC_B);
+
+	std::vector<unsigned int> onlyA(1U, SRC_A);
+	std::vector<unsigned int> both;
+	both.push_back(SRC_A);
+	both.push_back(SRC_B);
+
+	bool ok = run(clock, "hold", ARB_HOLD, none, onlyA);
+	ok = run(clock, "last", ARB_LAST_HEARD, none, both) && ok;
+	ok = run(clock, "priority", ARB_PRIORITY, second, both) && ok;
+	ok = run(clock, "priority", ARB_PRIORITY, first, onlyA) && ok;
+
+	::LogFinalise();
+
+	CClock::set(NULL);
+
+	return ok ? 0 : 1;
+}
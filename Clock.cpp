@@ -0,0 +1,165 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "Clock.h"
+
+#include <cstdio>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+static CSystemClock s_systemClock;
+
+static CClock* s_clock = &s_systemClock;
+
+CClock::~CClock()
+{
+}
+
+CClock* CClock::get()
+{
+	return s_clock;
+}
+
+void CClock::set(CClock* clock)
+{
+	s_clock = (clock != NULL) ? clock : &s_systemClock;
+}
+
+CSystemClock::CSystemClock()
+{
+}
+
+CSystemClock::~CSystemClock()
+{
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+
+unsigned long long CSystemClock::monotonic()
+{
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER now;
+	::QueryPerformanceCounter(&now);
+
+	return (unsigned long long)(now.QuadPart / frequency.QuadPart) * 1000000ULL + (unsigned long long)((now.QuadPart % frequency.QuadPart) * 1000000ULL / frequency.QuadPart);
+}
+
+unsigned long long CSystemClock::realtime()
+{
+	// FILETIME counts 100 ns intervals from 1601
+	FILETIME fileTime;
+	::GetSystemTimeAsFileTime(&fileTime);
+
+	ULARGE_INTEGER now;
+	now.LowPart  = fileTime.dwLowDateTime;
+	now.HighPart = fileTime.dwHighDateTime;
+
+	return (now.QuadPart - 116444736000000000ULL) / 10ULL;
+}
+
+void CSystemClock::sleep(unsigned int ms)
+{
+	::Sleep(ms);
+}
+
+#else
+
+unsigned long long CSystemClock::monotonic()
+{
+	struct timespec now;
+	::clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000ULL + now.tv_nsec / 1000ULL;
+}
+
+unsigned long long CSystemClock::realtime()
+{
+	struct timeval now;
+	::gettimeofday(&now, NULL);
+
+	return now.tv_sec * 1000000ULL + now.tv_usec;
+}
+
+void CSystemClock::sleep(unsigned int ms)
+{
+	::usleep(ms * 1000);
+}
+
+#endif
+
+CVirtualClock::CVirtualClock(unsigned long long epoch) :
+m_mutex(),
+m_cond(),
+m_now(0ULL),
+m_epoch(epoch),
+m_released(false)
+{
+}
+
+CVirtualClock::~CVirtualClock()
+{
+}
+
+unsigned long long CVirtualClock::monotonic()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_now;
+}
+
+unsigned long long CVirtualClock::realtime()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_epoch + m_now;
+}
+
+void CVirtualClock::sleep(unsigned int ms)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	unsigned long long until = m_now + ms * 1000ULL;
+
+	m_cond.wait(lock, [this, until] { return m_released || m_now >= until; });
+}
+
+void CVirtualClock::advanceTo(unsigned long long time)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (time > m_now) {
+		m_now = time;
+		m_cond.notify_all();
+	}
+}
+
+void CVirtualClock::release()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_released = true;
+	m_cond.notify_all();
+}
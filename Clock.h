@@ -0,0 +1,83 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(CLOCK_H)
+#define	CLOCK_H
+
+#include <mutex>
+#include <condition_variable>
+
+// The source of time for everything that measures or waits for it. The
+// gateway normally runs on the system clock, a simulation installs a
+// CVirtualClock before anything else is created.
+class CClock {
+public:
+	virtual ~CClock();
+
+	// Monotonic time in microseconds
+	virtual unsigned long long monotonic() = 0;
+
+	// Wall clock time in microseconds since the Unix epoch
+	virtual unsigned long long realtime() = 0;
+
+	virtual void sleep(unsigned int ms) = 0;
+
+	static CClock* get();
+
+	// NULL goes back to the system clock
+	static void set(CClock* clock);
+};
+
+class CSystemClock : public CClock {
+public:
+	CSystemClock();
+	virtual ~CSystemClock();
+
+	virtual unsigned long long monotonic();
+	virtual unsigned long long realtime();
+
+	virtual void sleep(unsigned int ms);
+};
+
+// Time only moves when the owner advances it. Threads other than the owner
+// that sleep are held until the virtual time has caught up, so they keep in
+// step with the simulation however fast it runs.
+class CVirtualClock : public CClock {
+public:
+	CVirtualClock(unsigned long long epoch);
+	virtual ~CVirtualClock();
+
+	virtual unsigned long long monotonic();
+	virtual unsigned long long realtime();
+
+	virtual void sleep(unsigned int ms);
+
+	void advanceTo(unsigned long long time);
+
+	// Let every sleeper go, for shutting down
+	void release();
+
+private:
+	std::mutex              m_mutex;
+	std::condition_variable m_cond;
+	unsigned long long      m_now;
+	unsigned long long      m_epoch;
+	bool                    m_released;
+};
+
+#endif
@@ -33,13 +33,46 @@ enum SECTION {
   SECTION_INFO,
   SECTION_YSF_NETWORK,
   SECTION_DMR_NETWORK,
+  SECTION_DMR_TARGET,
   SECTION_DMRID_LOOKUP,
   SECTION_LOG,
-  SECTION_APRS_FI
+  SECTION_APRS_FI,
+  SECTION_REALTIME,
+  SECTION_WATCHDOG,
+  SECTION_SCHEDULER
 };
 
+CDMRTargetConf::CDMRTargetConf(const std::string& name) :
+m_name(name),
+m_address(),
+m_port(62031U),
+m_local(0U),
+m_password(),
+m_options(),
+m_id(0U),
+m_slot(2U),
+m_dstId(9U),
+m_pc(false),
+m_xlxModule()
+{
+}
+
+bool CDMRTargetConf::operator==(const CDMRTargetConf& conf) const
+{
+  return m_name == conf.m_name && m_address == conf.m_address && m_port == conf.m_port && m_local == conf.m_local &&
+    m_password == conf.m_password && m_options == conf.m_options && m_id == conf.m_id && m_slot == conf.m_slot &&
+    m_dstId == conf.m_dstId && m_pc == conf.m_pc && m_xlxModule == conf.m_xlxModule;
+}
+
+bool CDMRTargetConf::operator!=(const CDMRTargetConf& conf) const
+{
+  return !(*this == conf);
+}
+
 CConf::CConf(const std::string& file) :
 m_file(file),
+m_session(),
+m_sessions(),
 m_callsign(),
 m_suffix(),
 m_dstAddress(),
@@ -62,6 +95,10 @@ m_ysfDT1(),
 m_ysfDT2(),
 m_ysfRadioID("*****"),
 m_daemon(false),
+m_fanOut(),
+m_fanOutOpen(false),
+m_shards(0U),
+m_shardKey("address"),
 m_rxFrequency(0U),
 m_txFrequency(0U),
 m_power(0U),
@@ -75,6 +112,7 @@ m_dmrId(0U),
 m_dmrXLXFile(),
 m_dmrXLXModule(),
 m_dmrXLXReflector(950U),
+m_dmrXLXMirrors(),
 m_dmrDstId(9990U),
 m_dmrPC(true),
 m_dmrNetworkAddress(),
@@ -88,8 +126,15 @@ m_dmrNetworkJitter(500U),
 m_dmrNetworkEnableUnlink(true),
 m_dmrNetworkIDUnlink(4000U),
 m_dmrNetworkPCUnlink(false),
+m_dmrNetworkSlot(2U),
+m_dmrNetworkArbitration("hold"),
+m_dmrNetworkPriorityIds(),
+m_dmrNetworkStandby(),
+m_dmrNetworkFailoverTime(1000U),
+m_dmrTargets(),
 m_dmrIdLookupFile(),
 m_dmrIdLookupTime(0U),
+m_dmrIdLookupImage(),
 m_logDisplayLevel(0U),
 m_logFileLevel(0U),
 m_logFilePath(),
@@ -101,7 +146,21 @@ m_aprsPassword(),
 m_aprsCallsign(),
 m_aprsAPIKey(),
 m_aprsRefresh(120),
-m_aprsDescription()
+m_aprsDescription(),
+m_realTimeEnabled(false),
+m_realTimePriority(50U),
+m_realTimeMainCPU(-1),
+m_realTimeYSFNetworkCPU(-1),
+m_realTimeDMRNetworkCPU(-1),
+m_realTimeLockMemory(true),
+m_realTimeBusyPoll(0U),
+m_realTimeIOUring(false),
+m_realTimeWorkerCPU(-1),
+m_realTimeConverterCPU(-1),
+m_watchdogLoopBudget(50U),
+m_schedulerWorkers(0),
+m_schedulerBalance(1000U),
+m_schedulerConverter(false)
 {
 }
 
@@ -110,6 +169,37 @@ CConf::~CConf()
 }
 
 bool CConf::read()
+{
+  m_sessions.clear();
+
+  std::vector<std::string> names;
+  if (!read(std::string(), names))
+    return false;
+
+  // Each session starts from everything above the first [Session] line
+  for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+    for (std::vector<CConf>::const_iterator it2 = m_sessions.begin(); it2 != m_sessions.end(); ++it2) {
+      if (it2->m_session == *it) {
+        ::fprintf(stderr, "There is more than one [Session %s] in %s\n", it->c_str(), m_file.c_str());
+        return false;
+      }
+    }
+
+    CConf session(*this);
+    session.m_session = *it;
+    session.m_sessions.clear();
+
+    std::vector<std::string> dummy;
+    if (!session.read(*it, dummy))
+      return false;
+
+    m_sessions.push_back(session);
+  }
+
+  return true;
+}
+
+bool CConf::read(const std::string& session, std::vector<std::string>& names)
 {
   FILE* fp = ::fopen(m_file.c_str(), "rt");
   if (fp == NULL) {
@@ -118,12 +208,38 @@ bool CConf::read()
   }
 
   SECTION section = SECTION_NONE;
+  unsigned int target = 0U;
+
+  // Only the lines above the first [Session], or those of the given session
+  bool skip = !session.empty();
 
   char buffer[BUFFER_SIZE];
   while (::fgets(buffer, BUFFER_SIZE, fp) != NULL) {
     if (buffer[0U] == '#')
       continue;
 
+    if (::strncmp(buffer, "[Session", 8U) == 0) {
+      std::string name = buffer + 8U;
+      name = name.substr(0U, name.find(']'));
+      name.erase(0U, name.find_first_not_of(" \t"));
+      name.erase(name.find_last_not_of(" \t") + 1U);
+
+      if (name.empty() || name.find_first_of(" \t.") != std::string::npos) {
+        ::fprintf(stderr, "A [Session] in %s needs a name without spaces or dots\n", m_file.c_str());
+        ::fclose(fp);
+        return false;
+      }
+
+      names.push_back(name);
+
+      skip    = name != session;
+      section = SECTION_NONE;
+      continue;
+    }
+
+    if (skip)
+      continue;
+
     if (buffer[0U] == '[') {
       if (::strncmp(buffer, "[Info]", 6U) == 0)
 		  section = SECTION_INFO;
@@ -131,12 +247,40 @@ bool CConf::read()
         section = SECTION_YSF_NETWORK;
 	  else if (::strncmp(buffer, "[DMR Network]", 13U) == 0)
 		  section = SECTION_DMR_NETWORK;
+	  else if (::strncmp(buffer, "[DMR Target", 11U) == 0) {
+		  std::string name = buffer + 11U;
+		  name = name.substr(0U, name.find(']'));
+		  name.erase(0U, name.find_first_not_of(" \t"));
+		  name.erase(name.find_last_not_of(" \t") + 1U);
+
+		  if (name.empty()) {
+			  ::fprintf(stderr, "A [DMR Target] in %s needs a name\n", m_file.c_str());
+			  ::fclose(fp);
+			  return false;
+		  }
+
+		  // A session may change a target it inherits by naming it again
+		  for (target = 0U; target < m_dmrTargets.size(); target++) {
+			  if (m_dmrTargets.at(target).m_name == name)
+				  break;
+		  }
+		  if (target == m_dmrTargets.size())
+			  m_dmrTargets.push_back(CDMRTargetConf(name));
+
+		  section = SECTION_DMR_TARGET;
+	  }
 	  else if (::strncmp(buffer, "[DMR Id Lookup]", 15U) == 0)
 		  section = SECTION_DMRID_LOOKUP;
 	  else if (::strncmp(buffer, "[Log]", 5U) == 0)
 		  section = SECTION_LOG;
 	  else if (::strncmp(buffer, "[aprs.fi]", 5U) == 0)
 		  section = SECTION_APRS_FI;	  
+	  else if (::strncmp(buffer, "[RealTime]", 10U) == 0)
+		  section = SECTION_REALTIME;
+	  else if (::strncmp(buffer, "[Watchdog]", 10U) == 0)
+		  section = SECTION_WATCHDOG;
+	  else if (::strncmp(buffer, "[Scheduler]", 11U) == 0)
+		  section = SECTION_SCHEDULER;
 	  else
         section = SECTION_NONE;
 
@@ -188,6 +332,16 @@ bool CConf::read()
 			m_wiresXMakeUpper = ::atoi(value) == 1;
 		else if (::strcmp(key, "Daemon") == 0)
 			m_daemon = ::atoi(value) == 1;
+		else if (::strcmp(key, "FanOut") == 0) {
+			m_fanOut.clear();
+			while ((t = strtok_r(value, ", ", &value)) != NULL)
+				m_fanOut.push_back(t);
+		} else if (::strcmp(key, "FanOutOpen") == 0)
+			m_fanOutOpen = ::atoi(value) == 1;
+		else if (::strcmp(key, "Shards") == 0)
+			m_shards = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "ShardKey") == 0)
+			m_shardKey = value;
 		else if (::strcmp(key, "RadioID") == 0)
 			m_ysfRadioID = value;
  		else if (::strcmp(key, "FICHCallsign") == 0)
@@ -207,9 +361,11 @@ bool CConf::read()
  		else if (::strcmp(key, "FICHSQLCode") == 0)
  			m_fichSQLCode = ::atoi(value);
 		else if (::strcmp(key, "DT1") == 0){
+			m_ysfDT1.clear();
  			while ((t = strtok_r(value, ",", &value)) != NULL)
 				m_ysfDT1.push_back(::atoi(t));
  		} else if (::strcmp(key, "DT2") == 0){
+			m_ysfDT2.clear();
  			while ((t = strtok_r(value, ",", &value)) != NULL)
 				m_ysfDT2.push_back(::atoi(t));
  		}
@@ -244,6 +400,11 @@ bool CConf::read()
 		}
 		else if (::strcmp(key, "XLXReflector") == 0)
 			m_dmrXLXReflector = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "XLXMirrors") == 0) {
+			m_dmrXLXMirrors.clear();
+			while ((t = strtok_r(value, ", ", &value)) != NULL)
+				m_dmrXLXMirrors.push_back((unsigned int)::atoi(t));
+		}
 		else if (::strcmp(key, "StartupDstId") == 0)
 			m_dmrDstId = (unsigned int)::atoi(value);
 		else if (::strcmp(key, "StartupPC") == 0)
@@ -272,11 +433,49 @@ bool CConf::read()
 			m_dmrNetworkPCUnlink = ::atoi(value) == 1;
 		else if (::strcmp(key, "TGListFile") == 0)
 			m_dmrTGListFile = value;
+		else if (::strcmp(key, "Slot") == 0)
+			m_dmrNetworkSlot = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "Arbitration") == 0)
+			m_dmrNetworkArbitration = value;
+		else if (::strcmp(key, "PriorityIds") == 0) {
+			m_dmrNetworkPriorityIds.clear();
+			while ((t = strtok_r(value, ", ", &value)) != NULL)
+				m_dmrNetworkPriorityIds.push_back((unsigned int)::atoi(t));
+		} else if (::strcmp(key, "Standby") == 0) {
+			m_dmrNetworkStandby.clear();
+			while ((t = strtok_r(value, ", ", &value)) != NULL)
+				m_dmrNetworkStandby.push_back(t);
+		} else if (::strcmp(key, "FailoverTime") == 0)
+			m_dmrNetworkFailoverTime = (unsigned int)::atoi(value);
+	} else if (section == SECTION_DMR_TARGET) {
+		CDMRTargetConf& conf = m_dmrTargets.at(target);
+		if (::strcmp(key, "Address") == 0)
+			conf.m_address = value;
+		else if (::strcmp(key, "Port") == 0)
+			conf.m_port = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "Local") == 0)
+			conf.m_local = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "Password") == 0)
+			conf.m_password = value;
+		else if (::strcmp(key, "Options") == 0)
+			conf.m_options = value;
+		else if (::strcmp(key, "Id") == 0)
+			conf.m_id = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "Slot") == 0)
+			conf.m_slot = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "DstId") == 0)
+			conf.m_dstId = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "PC") == 0)
+			conf.m_pc = ::atoi(value) == 1;
+		else if (::strcmp(key, "XLXModule") == 0)
+			conf.m_xlxModule = value;
 	} else if (section == SECTION_DMRID_LOOKUP) {
 		if (::strcmp(key, "File") == 0)
 			m_dmrIdLookupFile = value;
 		else if (::strcmp(key, "Time") == 0)
 			m_dmrIdLookupTime = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "Image") == 0)
+			m_dmrIdLookupImage = value;
 		if (::strcmp(key, "DropUnknown") == 0)
 			m_dmrDropUnknown = ::atoi(value) == 1;
 	} else if (section == SECTION_LOG) {
@@ -308,6 +507,37 @@ bool CConf::read()
 			m_aprsRefresh = (unsigned int)::atoi(value);		
 		else if (::strcmp(key, "Description") == 0)
 			m_aprsDescription = value;	
+	} else if (section == SECTION_REALTIME) {
+		if (::strcmp(key, "Enable") == 0)
+			m_realTimeEnabled = ::atoi(value) == 1;
+		else if (::strcmp(key, "Priority") == 0)
+			m_realTimePriority = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "MainCPU") == 0)
+			m_realTimeMainCPU = ::atoi(value);
+		else if (::strcmp(key, "YSFNetworkCPU") == 0)
+			m_realTimeYSFNetworkCPU = ::atoi(value);
+		else if (::strcmp(key, "DMRNetworkCPU") == 0)
+			m_realTimeDMRNetworkCPU = ::atoi(value);
+		else if (::strcmp(key, "LockMemory") == 0)
+			m_realTimeLockMemory = ::atoi(value) == 1;
+		else if (::strcmp(key, "BusyPoll") == 0)
+			m_realTimeBusyPoll = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "IOUring") == 0)
+			m_realTimeIOUring = ::atoi(value) == 1;
+		else if (::strcmp(key, "WorkerCPU") == 0)
+			m_realTimeWorkerCPU = ::atoi(value);
+		else if (::strcmp(key, "ConverterCPU") == 0)
+			m_realTimeConverterCPU = ::atoi(value);
+	} else if (section == SECTION_WATCHDOG) {
+		if (::strcmp(key, "LoopBudget") == 0)
+			m_watchdogLoopBudget = (unsigned int)::atoi(value);
+	} else if (section == SECTION_SCHEDULER) {
+		if (::strcmp(key, "Workers") == 0)
+			m_schedulerWorkers = ::atoi(value);
+		else if (::strcmp(key, "Balance") == 0)
+			m_schedulerBalance = (unsigned int)::atoi(value);
+		else if (::strcmp(key, "Converter") == 0)
+			m_schedulerConverter = ::atoi(value) == 1;
 	}
   }
 
@@ -316,6 +546,19 @@ bool CConf::read()
   return true;
 }
 
+std::string CConf::getSessionName() const
+{
+  return m_session;
+}
+
+std::vector<CConf> CConf::getSessions() const
+{
+  if (m_sessions.empty())
+    return std::vector<CConf>(1U, *this);
+
+  return m_sessions;
+}
+
 std::string CConf::getCallsign() const
 {
   return m_callsign;
@@ -371,6 +614,26 @@ bool CConf::getDaemon() const
 	return m_daemon;
 }
 
+std::vector<std::string> CConf::getFanOut() const
+{
+	return m_fanOut;
+}
+
+bool CConf::getFanOutOpen() const
+{
+	return m_fanOutOpen;
+}
+
+unsigned int CConf::getShards() const
+{
+	return m_shards;
+}
+
+std::string CConf::getShardKey() const
+{
+	return m_shardKey;
+}
+
 unsigned char CConf::getFICHCallSign() const
 {
  	return m_fichCallSign;
@@ -491,6 +754,11 @@ unsigned int CConf::getDMRXLXReflector() const
 	return m_dmrXLXReflector;
 }
 
+std::vector<unsigned int> CConf::getDMRXLXMirrors() const
+{
+	return m_dmrXLXMirrors;
+}
+
 unsigned int CConf::getDMRDstId() const
 {
 	return m_dmrDstId;
@@ -541,6 +809,76 @@ std::string CConf::getAPRSDescription() const
 	return m_aprsDescription;
 }
 
+bool CConf::getRealTimeEnabled() const
+{
+	return m_realTimeEnabled;
+}
+
+unsigned int CConf::getRealTimePriority() const
+{
+	return m_realTimePriority;
+}
+
+int CConf::getRealTimeMainCPU() const
+{
+	return m_realTimeMainCPU;
+}
+
+int CConf::getRealTimeYSFNetworkCPU() const
+{
+	return m_realTimeYSFNetworkCPU;
+}
+
+int CConf::getRealTimeDMRNetworkCPU() const
+{
+	return m_realTimeDMRNetworkCPU;
+}
+
+bool CConf::getRealTimeLockMemory() const
+{
+	return m_realTimeLockMemory;
+}
+
+unsigned int CConf::getRealTimeBusyPoll() const
+{
+	return m_realTimeBusyPoll;
+}
+
+bool CConf::getRealTimeIOUring() const
+{
+	return m_realTimeIOUring;
+}
+
+int CConf::getRealTimeWorkerCPU() const
+{
+	return m_realTimeWorkerCPU;
+}
+
+int CConf::getRealTimeConverterCPU() const
+{
+	return m_realTimeConverterCPU;
+}
+
+unsigned int CConf::getWatchdogLoopBudget() const
+{
+	return m_watchdogLoopBudget;
+}
+
+int CConf::getSchedulerWorkers() const
+{
+	return m_schedulerWorkers;
+}
+
+unsigned int CConf::getSchedulerBalance() const
+{
+	return m_schedulerBalance;
+}
+
+bool CConf::getSchedulerConverter() const
+{
+	return m_schedulerConverter;
+}
+
 std::string CConf::getDMRNetworkAddress() const
 {
 	return m_dmrNetworkAddress;
@@ -591,6 +929,31 @@ unsigned int CConf::getDMRNetworkIDUnlink() const
 	return m_dmrNetworkIDUnlink;
 }
 
+unsigned int CConf::getDMRNetworkSlot() const
+{
+	return m_dmrNetworkSlot;
+}
+
+std::string CConf::getDMRNetworkArbitration() const
+{
+	return m_dmrNetworkArbitration;
+}
+
+std::vector<unsigned int> CConf::getDMRNetworkPriorityIds() const
+{
+	return m_dmrNetworkPriorityIds;
+}
+
+std::vector<std::string> CConf::getDMRNetworkStandby() const
+{
+	return m_dmrNetworkStandby;
+}
+
+unsigned int CConf::getDMRNetworkFailoverTime() const
+{
+	return m_dmrNetworkFailoverTime;
+}
+
 bool CConf::getDMRNetworkPCUnlink() const
 {
 	return m_dmrNetworkPCUnlink;
@@ -601,6 +964,11 @@ std::string CConf::getDMRTGListFile() const
 	return m_dmrTGListFile;
 }
 
+std::vector<CDMRTargetConf> CConf::getDMRTargets() const
+{
+	return m_dmrTargets;
+}
+
 std::string CConf::getDMRIdLookupFile() const
 {
 	return m_dmrIdLookupFile;
@@ -611,6 +979,11 @@ unsigned int CConf::getDMRIdLookupTime() const
 	return m_dmrIdLookupTime;
 }
 
+std::string CConf::getDMRIdLookupImage() const
+{
+	return m_dmrIdLookupImage;
+}
+
 bool CConf::getDMRDropUnknown() const
 {
 	return m_dmrDropUnknown;
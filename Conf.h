@@ -24,6 +24,29 @@
 #include <string>
 #include <vector>
 
+// A [DMR Target name] section, one more master or reflector that is sent
+// the calls from YSF
+class CDMRTargetConf
+{
+public:
+  CDMRTargetConf(const std::string& name);
+
+  bool operator==(const CDMRTargetConf& conf) const;
+  bool operator!=(const CDMRTargetConf& conf) const;
+
+  std::string  m_name;
+  std::string  m_address;
+  unsigned int m_port;
+  unsigned int m_local;
+  std::string  m_password;
+  std::string  m_options;
+  unsigned int m_id;			// 0 for the Id of the session
+  unsigned int m_slot;
+  unsigned int m_dstId;
+  bool         m_pc;
+  std::string  m_xlxModule;		// Linked to on login, in place of DstId
+};
+
 class CConf
 {
 public:
@@ -32,6 +55,12 @@ public:
 
   bool read();
 
+  // Every [Session name] line starts one more bridge, set up by the lines
+  // that follow it on top of everything above the first [Session]. Without
+  // any, the whole file is the one session.
+  std::vector<CConf> getSessions() const;
+  std::string  getSessionName() const;
+
   // The YSF Network section
   std::string  getCallsign() const;
   std::string  getSuffix() const;
@@ -55,6 +84,11 @@ public:
   std::vector<unsigned char> getYsfDT2();
   std::string  getYsfRadioID();
   bool          getDaemon() const;
+  // host:port of each YSF reflector or hotspot that also gets the calls
+  std::vector<std::string> getFanOut() const;
+  bool         getFanOutOpen() const;
+  unsigned int getShards() const;
+  std::string  getShardKey() const;
 
   // The Info section
   unsigned int getRxFrequency() const;
@@ -72,6 +106,7 @@ public:
   std::string  getDMRXLXFile() const;
   std::string  getDMRXLXModule() const;
   unsigned int getDMRXLXReflector() const;
+  std::vector<unsigned int> getDMRXLXMirrors() const;
   unsigned int getDMRDstId() const;
   bool         getDMRPC() const;
   std::string  getDMRNetworkAddress() const;
@@ -85,11 +120,22 @@ public:
   bool         getDMRNetworkEnableUnlink() const;
   unsigned int getDMRNetworkIDUnlink() const;
   bool         getDMRNetworkPCUnlink() const;
+  // Sessions logged in to the same master with the same Id share the login,
+  // one on each slot
+  unsigned int getDMRNetworkSlot() const;
+  // hold, priority or last, with the source Ids in order for priority
+  std::string  getDMRNetworkArbitration() const;
+  std::vector<unsigned int> getDMRNetworkPriorityIds() const;
+  std::vector<std::string> getDMRNetworkStandby() const;
+  unsigned int getDMRNetworkFailoverTime() const;
   std::string  getDMRTGListFile() const;
+  // Each [DMR Target] after the [DMR Network] is sent the same calls
+  std::vector<CDMRTargetConf> getDMRTargets() const;
 
   // The DMR Id section
   std::string  getDMRIdLookupFile() const;
   unsigned int getDMRIdLookupTime() const;
+  std::string  getDMRIdLookupImage() const;
   bool         getDMRDropUnknown() const;
 
   // The Log section
@@ -108,8 +154,30 @@ public:
   unsigned int getAPRSRefresh() const;
   std::string  getAPRSDescription() const;
 
+  // The RealTime section
+  bool         getRealTimeEnabled() const;
+  unsigned int getRealTimePriority() const;
+  int          getRealTimeMainCPU() const;
+  int          getRealTimeYSFNetworkCPU() const;
+  int          getRealTimeDMRNetworkCPU() const;
+  bool         getRealTimeLockMemory() const;
+  unsigned int getRealTimeBusyPoll() const;
+  bool         getRealTimeIOUring() const;
+  int          getRealTimeWorkerCPU() const;
+  int          getRealTimeConverterCPU() const;
+
+  // The Watchdog section
+  unsigned int getWatchdogLoopBudget() const;
+
+  // The Scheduler section
+  int          getSchedulerWorkers() const;
+  unsigned int getSchedulerBalance() const;
+  bool         getSchedulerConverter() const;
+
 private:
   std::string  m_file;
+  std::string  m_session;
+  std::vector<CConf> m_sessions;
   std::string  m_callsign;
   std::string  m_suffix;
   std::string  m_dstAddress;
@@ -132,6 +200,10 @@ private:
   std::vector<unsigned char> m_ysfDT2;
   std::string  m_ysfRadioID;
   bool         m_daemon;
+  std::vector<std::string> m_fanOut;
+  bool         m_fanOutOpen;
+  unsigned int m_shards;
+  std::string  m_shardKey;
 
   unsigned int m_rxFrequency;
   unsigned int m_txFrequency;
@@ -147,6 +219,7 @@ private:
   std::string  m_dmrXLXFile;
   std::string  m_dmrXLXModule;
   unsigned int m_dmrXLXReflector;
+  std::vector<unsigned int> m_dmrXLXMirrors;
   unsigned int m_dmrDstId;
   bool         m_dmrPC;
   std::string  m_dmrNetworkAddress;
@@ -160,10 +233,17 @@ private:
   bool         m_dmrNetworkEnableUnlink;
   unsigned int m_dmrNetworkIDUnlink;
   bool         m_dmrNetworkPCUnlink;
+  unsigned int m_dmrNetworkSlot;
+  std::string  m_dmrNetworkArbitration;
+  std::vector<unsigned int> m_dmrNetworkPriorityIds;
+  std::vector<std::string> m_dmrNetworkStandby;
+  unsigned int m_dmrNetworkFailoverTime;
   std::string  m_dmrTGListFile;
+  std::vector<CDMRTargetConf> m_dmrTargets;
 
   std::string  m_dmrIdLookupFile;
   unsigned int m_dmrIdLookupTime;
+  std::string  m_dmrIdLookupImage;
   bool         m_dmrDropUnknown;
 
   unsigned int m_logDisplayLevel;
@@ -179,6 +259,25 @@ private:
   std::string  m_aprsAPIKey;
   unsigned int m_aprsRefresh;
   std::string  m_aprsDescription;
+
+  bool         m_realTimeEnabled;
+  unsigned int m_realTimePriority;
+  int          m_realTimeMainCPU;
+  int          m_realTimeYSFNetworkCPU;
+  int          m_realTimeDMRNetworkCPU;
+  bool         m_realTimeLockMemory;
+  unsigned int m_realTimeBusyPoll;
+  bool         m_realTimeIOUring;
+  int          m_realTimeWorkerCPU;
+  int          m_realTimeConverterCPU;
+
+  unsigned int m_watchdogLoopBudget;
+
+  int          m_schedulerWorkers;
+  unsigned int m_schedulerBalance;
+  bool         m_schedulerConverter;
+
+  bool read(const std::string& session, std::vector<std::string>& names);
 };
 
 #endif
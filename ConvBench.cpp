@@ -0,0 +1,431 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Checks the table driven AMBE conversion against the bit by bit code it
+// replaced and times both:
+//
+//   make convbench && ./convbench [frames]
+//
+// Random DMR frames and YSF VCHs go through both, one AMBE frame at a
+// time and then whole DMR and YSF payloads through CModeConv, and every
+// output has to match. The batch conversions are checked the same way, one
+// to eight frames at a time and all at once, with and without AVX2. The
+// tables have the AMBE frames converted per second each way by one core.
+
+#include "ModeConv.h"
+#include "Golay24128.h"
+#include "YSFDefines.h"
+#include "StopWatch.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+const unsigned char BIT_MASK_TABLE[] = {0x80U, 0x40U, 0x20U, 0x10U, 0x08U, 0x04U, 0x02U, 0x01U};
+
+#define WRITE_BIT(p,i,b) p[(i)>>3] = (b) ? (p[(i)>>3] | BIT_MASK_TABLE[(i)&7]) : (p[(i)>>3] & ~BIT_MASK_TABLE[(i)&7])
+#define READ_BIT(p,i)    (p[(i)>>3] & BIT_MASK_TABLE[(i)&7])
+
+const unsigned int DMR_A_TABLE[] = {0U,  4U,  8U, 12U, 16U, 20U, 24U, 28U, 32U, 36U, 40U, 44U,
+									48U, 52U, 56U, 60U, 64U, 68U,  1U,  5U,  9U, 13U, 17U, 21U};
+const unsigned int DMR_B_TABLE[] = {25U, 29U, 33U, 37U, 41U, 45U, 49U, 53U, 57U, 61U, 65U, 69U,
+									 2U,  6U, 10U, 14U, 18U, 22U, 26U, 30U, 34U, 38U, 42U};
+const unsigned int DMR_C_TABLE[] = {46U, 50U, 54U, 58U, 62U, 66U, 70U,  3U,  7U, 11U, 15U, 19U, 23U,
+									27U, 31U, 35U, 39U, 43U, 47U, 51U, 55U, 59U, 63U, 67U, 71U};
+
+const unsigned int INTERLEAVE_TABLE_26_4[] = {
+	0U, 4U,  8U, 12U, 16U, 20U, 24U, 28U, 32U, 36U, 40U, 44U, 48U, 52U, 56U, 60U, 64U, 68U, 72U, 76U, 80U, 84U, 88U, 92U, 96U, 100U,
+	1U, 5U,  9U, 13U, 17U, 21U, 25U, 29U, 33U, 37U, 41U, 45U, 49U, 53U, 57U, 61U, 65U, 69U, 73U, 77U, 81U, 85U, 89U, 93U, 97U, 101U,
+	2U, 6U, 10U, 14U, 18U, 22U, 26U, 30U, 34U, 38U, 42U, 46U, 50U, 54U, 58U, 62U, 66U, 70U, 74U, 78U, 82U, 86U, 90U, 94U, 98U, 102U,
+	3U, 7U, 11U, 15U, 19U, 23U, 27U, 31U, 35U, 39U, 43U, 47U, 51U, 55U, 59U, 63U, 67U, 71U, 75U, 79U, 83U, 87U, 91U, 95U, 99U, 103U};
+
+const unsigned char WHITENING_DATA[] = {0x93U, 0xD7U, 0x51U, 0x21U, 0x9CU, 0x2FU, 0x6CU, 0xD0U, 0xEFU, 0x0FU,
+										0xF8U, 0x3DU, 0xF1U, 0x73U, 0x20U, 0x94U, 0xEDU, 0x1EU, 0x7CU, 0xD8U};
+
+// The AMBE scrambling sequence for each value of A, built the way the
+// DMR standard gives it rather than copied from ModeConv.cpp
+unsigned int PRNG_TABLE[4096U];
+
+static void makePRNG()
+{
+	for (unsigned int u = 0U; u < 4096U; u++) {
+		unsigned int p = 16U * u;
+		unsigned int r = 0U;
+		for (unsigned int i = 0U; i < 24U; i++) {
+			p = (173U * p + 13849U) % 65536U;
+			r = (r << 1) | (p >> 15);
+		}
+		PRNG_TABLE[u] = r;
+	}
+}
+
+// The conversion as it was, from putDMR and putAMBE2YSF
+static void referenceDMR(const unsigned char* bytes, unsigned char* ysfFrame)
+{
+	unsigned int a = 0U;
+	unsigned int MASK = 0x800000U;
+	for (unsigned int i = 0U; i < 24U; i++, MASK >>= 1) {
+		if (READ_BIT(bytes, DMR_A_TABLE[i]))
+			a |= MASK;
+	}
+
+	unsigned int b = 0U;
+	MASK = 0x400000U;
+	for (unsigned int i = 0U; i < 23U; i++, MASK >>= 1) {
+		if (READ_BIT(bytes, DMR_B_TABLE[i]))
+			b |= MASK;
+	}
+
+	unsigned int dat_c = 0U;
+	MASK = 0x1000000U;
+	for (unsigned int i = 0U; i < 25U; i++, MASK >>= 1) {
+		if (READ_BIT(bytes, DMR_C_TABLE[i]))
+			dat_c |= MASK;
+	}
+
+	unsigned char vch[13U];
+	::memset(vch, 0U, 13U);
+	::memset(ysfFrame, 0, 13U);
+
+	unsigned int dat_a = a >> 12;
+
+	b ^= (PRNG_TABLE[dat_a] >> 1);
+
+	unsigned int dat_b = b >> 11;
+
+	for (unsigned int i = 0U; i < 12U; i++) {
+		bool s = (dat_a << (20U + i)) & 0x80000000U;
+		WRITE_BIT(vch, 3*i + 0U, s);
+		WRITE_BIT(vch, 3*i + 1U, s);
+		WRITE_BIT(vch, 3*i + 2U, s);
+	}
+
+	for (unsigned int i = 0U; i < 12U; i++) {
+		bool s = (dat_b << (20U + i)) & 0x80000000U;
+		WRITE_BIT(vch, 3*(i + 12U) + 0U, s);
+		WRITE_BIT(vch, 3*(i + 12U) + 1U, s);
+		WRITE_BIT(vch, 3*(i + 12U) + 2U, s);
+	}
+
+	for (unsigned int i = 0U; i < 3U; i++) {
+		bool s = (dat_c << (7U + i)) & 0x80000000U;
+		WRITE_BIT(vch, 3*(i + 24U) + 0U, s);
+		WRITE_BIT(vch, 3*(i + 24U) + 1U, s);
+		WRITE_BIT(vch, 3*(i + 24U) + 2U, s);
+	}
+
+	for (unsigned int i = 0U; i < 22U; i++) {
+		bool s = (dat_c << (10U + i)) & 0x80000000U;
+		WRITE_BIT(vch, i + 81U, s);
+	}
+
+	WRITE_BIT(vch, 103U, 0U);
+
+	for (unsigned int i = 0U; i < 13U; i++)
+		vch[i] ^= WHITENING_DATA[i];
+
+	for (unsigned int i = 0U; i < 104U; i++) {
+		unsigned int n = INTERLEAVE_TABLE_26_4[i];
+		bool s = READ_BIT(vch, i);
+		WRITE_BIT(ysfFrame, n, s);
+	}
+}
+
+// From putYSF and putAMBE2DMR
+static void referenceYSF(const unsigned char* data, unsigned char* v_dmr)
+{
+	unsigned char vch[13U];
+	unsigned int dat_a = 0U;
+	unsigned int dat_b = 0U;
+	unsigned int dat_c = 0U;
+
+	for (unsigned int i = 0U; i < 104U; i++) {
+		unsigned int n = INTERLEAVE_TABLE_26_4[i];
+		bool s = READ_BIT(data, n);
+		WRITE_BIT(vch, i, s);
+	}
+
+	for (unsigned int i = 0U; i < 13U; i++)
+		vch[i] ^= WHITENING_DATA[i];
+
+	for (unsigned int i = 0U; i < 12U; i++) {
+		dat_a <<= 1U;
+		if (READ_BIT(vch, 3U*i + 1U))
+			dat_a |= 0x01U;
+	}
+
+	for (unsigned int i = 0U; i < 12U; i++) {
+		dat_b <<= 1U;
+		if (READ_BIT(vch, 3U*(i + 12U) + 1U))
+			dat_b |= 0x01U;
+	}
+
+	for (unsigned int i = 0U; i < 3U; i++) {
+		dat_c <<= 1U;
+		if (READ_BIT(vch, 3U*(i + 24U) + 1U))
+			dat_c |= 0x01U;
+	}
+
+	for (unsigned int i = 0U; i < 22U; i++) {
+		dat_c <<= 1U;
+		if (READ_BIT(vch, i + 81U))
+			dat_c |= 0x01U;
+	}
+
+	unsigned int a = CGolay24128::encode24128(dat_a);
+	unsigned int p = PRNG_TABLE[dat_a] >> 1;
+	unsigned int b = CGolay24128::encode23127(dat_b) >> 1;
+	b ^= p;
+
+	unsigned int MASK = 0x800000U;
+	for (unsigned int i = 0U; i < 24U; i++, MASK >>= 1)
+		WRITE_BIT(v_dmr, DMR_A_TABLE[i], a & MASK);
+
+	MASK = 0x400000U;
+	for (unsigned int i = 0U; i < 23U; i++, MASK >>= 1)
+		WRITE_BIT(v_dmr, DMR_B_TABLE[i], b & MASK);
+
+	MASK = 0x1000000U;
+	for (unsigned int i = 0U; i < 25U; i++, MASK >>= 1)
+		WRITE_BIT(v_dmr, DMR_C_TABLE[i], dat_c & MASK);
+}
+
+static void fill(std::vector<unsigned char>& data)
+{
+	for (std::vector<unsigned char>::iterator it = data.begin(); it != data.end(); ++it)
+		*it = (unsigned char)(::rand() >> 7);
+}
+
+static bool check(unsigned int frames, bool simd)
+{
+	std::vector<unsigned char> dmr(frames * 9U);
+	std::vector<unsigned char> ysf(frames * 13U);
+	fill(dmr);
+	fill(ysf);
+
+	unsigned int errors = 0U;
+
+	for (unsigned int i = 0U; i < frames; i++) {
+		unsigned char out1[13U], out2[13U];
+		referenceDMR(&dmr[i * 9U], out1);
+		CModeConv::convertDMR(&dmr[i * 9U], out2);
+		if (::memcmp(out1, out2, 13U) != 0)
+			errors++;
+
+		referenceYSF(&ysf[i * 13U], out1);
+		CModeConv::convertYSF(&ysf[i * 13U], out2);
+		if (::memcmp(out1, out2, 9U) != 0)
+			errors++;
+	}
+
+	// Batches of every size up to a full AVX2 step and then everything at once
+	std::vector<unsigned char> expectedYSF(frames * 13U), expectedDMR(frames * 9U);
+	for (unsigned int i = 0U; i < frames; i++) {
+		referenceDMR(&dmr[i * 9U], &expectedYSF[i * 13U]);
+		referenceYSF(&ysf[i * 13U], &expectedDMR[i * 9U]);
+	}
+
+	std::vector<unsigned char> outYSF(frames * 13U), outDMR(frames * 9U);
+	for (unsigned int i = 0U, n = 1U; i < frames; i += n, n = n % 8U + 1U) {
+		unsigned int count = frames - i < n ? frames - i : n;
+		CModeConv::convertDMRtoYSF(&dmr[i * 9U], count, &outYSF[i * 13U]);
+		CModeConv::convertYSFtoDMR(&ysf[i * 13U], count, &outDMR[i * 9U]);
+	}
+
+	if (outYSF != expectedYSF || outDMR != expectedDMR)
+		errors++;
+
+	CModeConv::convertDMRtoYSF(&dmr[0U], frames, &outYSF[0U]);
+	CModeConv::convertYSFtoDMR(&ysf[0U], frames, &outDMR[0U]);
+
+	if (outYSF != expectedYSF || outDMR != expectedDMR)
+		errors++;
+
+	// Whole payloads, for the DMR frame split by the sync on the way in and the
+	// VCH offsets
+	CModeConv conv;
+	unsigned int payloads = frames / 15U;
+	for (unsigned int i = 0U; i < payloads; i++) {
+		unsigned char expected[15U * 13U];
+
+		for (unsigned int j = 0U; j < 5U; j++) {
+			unsigned char payload[33U];
+			for (unsigned int k = 0U; k < 33U; k++)
+				payload[k] = (unsigned char)(::rand() >> 7);
+			conv.putDMR(payload);
+
+			unsigned char frame[9U];
+			::memcpy(frame, payload + 9U, 4U);
+			frame[4U] = (payload[13U] & 0xF0U) | (payload[19U] & 0x0FU);
+			::memcpy(frame + 5U, payload + 20U, 4U);
+
+			referenceDMR(payload, expected + (3U * j + 0U) * 13U);
+			referenceDMR(frame, expected + (3U * j + 1U) * 13U);
+			referenceDMR(payload + 24U, expected + (3U * j + 2U) * 13U);
+		}
+
+		for (unsigned int j = 0U; j < 3U; j++) {
+			unsigned char data[155U];
+			conv.getYSF(data);
+
+			for (unsigned int k = 0U; k < 5U; k++) {
+				if (::memcmp(data + YSF_SYNC_LENGTH_BYTES + YSF_FICH_LENGTH_BYTES + 5U + k * 18U, expected + (5U * j + k) * 13U, 13U) != 0)
+					errors++;
+			}
+		}
+
+		for (unsigned int j = 0U; j < 3U; j++) {
+			unsigned char data[155U];
+			for (unsigned int k = 0U; k < 155U; k++)
+				data[k] = (unsigned char)(::rand() >> 7);
+			conv.putYSF(data);
+
+			for (unsigned int k = 0U; k < 5U; k++)
+				referenceYSF(data + YSF_SYNC_LENGTH_BYTES + YSF_FICH_LENGTH_BYTES + 5U + k * 18U, expected + (5U * j + k) * 9U);
+		}
+
+		for (unsigned int j = 0U; j < 5U; j++) {
+			const CTaggedFrame<9U>* dmrFrames[3U];
+			conv.peekDMR(dmrFrames);
+
+			for (unsigned int k = 0U; k < 3U; k++) {
+				if (::memcmp(dmrFrames[k]->m_data, expected + (3U * j + k) * 9U, 9U) != 0)
+					errors++;
+			}
+
+			conv.popDMR();
+		}
+	}
+
+	if (errors > 0U) {
+		::fprintf(stderr, "convbench: %u conversions differ from the bit by bit code%s\n", errors, simd ? " with AVX2" : "");
+		return false;
+	}
+
+	::fprintf(stdout, "%u AMBE frames each way and %u payloads match the bit by bit code%s\n", frames, 8U * payloads, simd ? " with AVX2" : "");
+
+	return true;
+}
+
+static double rate(void (*convert)(const unsigned char*, unsigned char*), const std::vector<unsigned char>& in, unsigned int inLength, unsigned int outLength)
+{
+	unsigned int frames = in.size() / inLength;
+	std::vector<unsigned char> out(frames * outLength);
+
+	// The best of a few runs, with the first warming the caches
+	double best = 0.0;
+	for (unsigned int run = 0U; run < 5U; run++) {
+		unsigned long long start = CStopWatch::monotonic();
+
+		for (unsigned int i = 0U; i < frames; i++)
+			convert(&in[i * inLength], &out[i * outLength]);
+
+		unsigned long long elapsed = CStopWatch::monotonic() - start;
+		double perSecond = elapsed > 0ULL ? double(frames) * 1000000.0 / double(elapsed) : 0.0;
+		if (perSecond > best)
+			best = perSecond;
+	}
+
+	return best;
+}
+
+static double rate(void (*convert)(const unsigned char*, unsigned int, unsigned char*), const std::vector<unsigned char>& in, unsigned int inLength, unsigned int outLength)
+{
+	unsigned int frames = in.size() / inLength;
+	std::vector<unsigned char> out(frames * outLength);
+
+	double best = 0.0;
+	for (unsigned int run = 0U; run < 5U; run++) {
+		unsigned long long start = CStopWatch::monotonic();
+
+		convert(&in[0U], frames, &out[0U]);
+
+		unsigned long long elapsed = CStopWatch::monotonic() - start;
+		double perSecond = elapsed > 0ULL ? double(frames) * 1000000.0 / double(elapsed) : 0.0;
+		if (perSecond > best)
+			best = perSecond;
+	}
+
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int frames = 1000000U;
+
+	if (argc > 1)
+		frames = (unsigned int)::atoi(argv[1]);
+
+	if (frames < 15U) {
+		::fprintf(stderr, "Usage: convbench [frames, at least 15]\n");
+		return 1;
+	}
+
+	::LogInitialise(".", "convbench", 0U, 4U);
+
+	makePRNG();
+
+	CModeConv::setSIMD(false);
+	bool ok = check(frames, false);
+
+	bool simd = CModeConv::setSIMD(true);
+	if (ok && simd)
+		ok = check(frames, true);
+	else if (!simd)
+		::fprintf(stdout, "No AVX2 on this CPU, the batches are converted a frame at a time\n");
+
+	if (ok) {
+		std::vector<unsigned char> dmr(frames * 9U);
+		std::vector<unsigned char> ysf(frames * 13U);
+		fill(dmr);
+		fill(ysf);
+
+		double oldDMR = rate(referenceDMR, dmr, 9U, 13U);
+		double newDMR = rate(CModeConv::convertDMR, dmr, 9U, 13U);
+		double oldYSF = rate(referenceYSF, ysf, 13U, 9U);
+		double newYSF = rate(CModeConv::convertYSF, ysf, 13U, 9U);
+
+		::fprintf(stdout, "\n%-12s %16s %16s %8s\n", "AMBE frames", "bit by bit/s", "tables/s", "speedup");
+		::fprintf(stdout, "%-12s %16.0f %16.0f %7.1fx\n", "DMR to YSF", oldDMR, newDMR, newDMR / oldDMR);
+		::fprintf(stdout, "%-12s %16.0f %16.0f %7.1fx\n", "YSF to DMR", oldYSF, newYSF, newYSF / oldYSF);
+
+		CModeConv::setSIMD(false);
+		double batchDMR = rate(CModeConv::convertDMRtoYSF, dmr, 9U, 13U);
+		double batchYSF = rate(CModeConv::convertYSFtoDMR, ysf, 13U, 9U);
+
+		if (simd) {
+			CModeConv::setSIMD(true);
+			double simdDMR = rate(CModeConv::convertDMRtoYSF, dmr, 9U, 13U);
+			double simdYSF = rate(CModeConv::convertYSFtoDMR, ysf, 13U, 9U);
+
+			::fprintf(stdout, "\n%-12s %16s %16s %8s\n", "Batches", "frame at a time/s", "AVX2/s", "speedup");
+			::fprintf(stdout, "%-12s %16.0f %16.0f %7.1fx\n", "DMR to YSF", batchDMR, simdDMR, simdDMR / batchDMR);
+			::fprintf(stdout, "%-12s %16.0f %16.0f %7.1fx\n", "YSF to DMR", batchYSF, simdYSF, simdYSF / batchYSF);
+		} else {
+			::fprintf(stdout, "\n%-12s %16s\n", "Batches", "frame at a time/s");
+			::fprintf(stdout, "%-12s %16.0f\n", "DMR to YSF", batchDMR);
+			::fprintf(stdout, "%-12s %16.0f\n", "YSF to DMR", batchYSF);
+		}
+	}
+
+	::LogFinalise();
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include "ConvertThread.h"
+#include "Log.h"
+
+#include <cstdint>
+#include <cassert>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+CConvertThread::CConvertThread() :
+CThread(),
+m_priority(0U),
+m_cpu(-1),
+m_loop(),
+m_wakeFd(-1),
+m_started(false),
+m_mutex(),
+m_sessions(),
+m_woken(false),
+m_stop(false),
+m_passes(0U)
+{
+#if defined(__linux__)
+	m_wakeFd = ::eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_wakeFd < 0)
+		LogError("Converter, cannot create an eventfd, err: %d", errno);
+#endif
+}
+
+CConvertThread::~CConvertThread()
+{
+#if defined(__linux__)
+	if (m_wakeFd >= 0)
+		::close(m_wakeFd);
+#endif
+}
+
+void CConvertThread::setScheduling(unsigned int priority, int cpu)
+{
+	m_priority = priority;
+	m_cpu      = cpu;
+}
+
+bool CConvertThread::start()
+{
+	if (!m_loop.open())
+		return false;
+
+	m_loop.watch(m_wakeFd);
+
+	m_started = run();
+
+	return m_started;
+}
+
+void CConvertThread::add(CYSF2DMR* session)
+{
+	assert(session != NULL);
+
+	m_mutex.lock();
+	m_sessions.push_back(session);
+	m_mutex.unlock();
+
+	wake();
+}
+
+void CConvertThread::stop()
+{
+	m_stop = true;
+
+	wake();
+
+	if (m_started)
+		wait();
+
+	m_started = false;
+
+	m_loop.close();
+}
+
+void CConvertThread::entry()
+{
+	CThread::setAffinity(m_cpu);
+
+	if (m_priority > 0U)
+		CThread::setPriority(m_priority);
+
+	LogMessage("Started the converter");
+
+	while (!m_stop) {
+		m_loop.wait();
+
+#if defined(__linux__)
+		// A wake up that has not been written yet is cleared on the next pass
+		if (m_woken.exchange(false)) {
+			uint64_t value;
+			if (::read(m_wakeFd, &value, sizeof(uint64_t)) < 0) {
+				if (errno != EAGAIN)
+					LogError("Converter, error reading the eventfd, err: %d", errno);
+				m_woken = true;
+			}
+		}
+#endif
+
+		if (m_stop)
+			break;
+
+		m_mutex.lock();
+
+		for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+			::LogSetContext((*it)->getName().empty() ? NULL : (*it)->getName().c_str());
+			(*it)->convert();
+		}
+
+		m_mutex.unlock();
+
+		::LogSetContext(NULL);
+
+		m_passes++;
+	}
+
+	LogMessage("Stopped the converter, %u passes", m_passes);
+}
+
+void CConvertThread::wake()
+{
+#if defined(__linux__)
+	// Only the first wake up since the thread last looked needs the system call
+	if (m_woken.exchange(true))
+		return;
+
+	uint64_t value = 1U;
+	if (::write(m_wakeFd, &value, sizeof(uint64_t)) < 0)
+		LogError("Converter, error writing the eventfd, err: %d", errno);
+#endif
+}
@@ -0,0 +1,68 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#if !defined(CONVERTTHREAD_H)
+#define	CONVERTTHREAD_H
+
+#include "EventLoop.h"
+#include "YSF2DMR.h"
+#include "Thread.h"
+#include "Mutex.h"
+
+#include <atomic>
+#include <vector>
+
+// Runs the AMBE conversion stages of the sessions on a thread of its own, so
+// that it can have a core to itself while the main loop or the workers do
+// the networks, the framing and the pacing. The decode stages wake it when
+// they have queued voice frames, and it converts all that is waiting in
+// every session before it sleeps again. The assembly stages pick the frames
+// up at their next deadline.
+class CConvertThread : public CThread {
+public:
+	CConvertThread();
+	virtual ~CConvertThread();
+
+	// A priority of 0 and a CPU of -1 leave the default scheduling
+	void setScheduling(unsigned int priority, int cpu);
+
+	bool start();
+
+	// From any thread, the session then converts here until stop()
+	void add(CYSF2DMR* session);
+
+	// From any thread, there are voice frames waiting
+	void wake();
+
+	void stop();
+
+	virtual void entry();
+
+private:
+	unsigned int           m_priority;
+	int                    m_cpu;
+	CEventLoop             m_loop;
+	int                    m_wakeFd;
+	bool                   m_started;
+	CMutex                 m_mutex;
+	std::vector<CYSF2DMR*> m_sessions;		// Under m_mutex
+	std::atomic<bool>      m_woken;
+	std::atomic<bool>      m_stop;
+	unsigned int           m_passes;
+};
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "DMRAssembler.h"
+#include "DMRSlotType.h"
+#include "DMRFullLC.h"
+#include "DMREMB.h"
+#include "Defines.h"
+#include "DMRLC.h"
+#include "Sync.h"
+
+#include <cassert>
+#include <cstring>
+
+CDMRAssembler::CDMRAssembler() :
+m_slot(2U),
+m_colorCode(1U),
+m_count(0U),
+m_embeddedLC(),
+m_burst()
+{
+}
+
+CDMRAssembler::~CDMRAssembler()
+{
+}
+
+void CDMRAssembler::setSlot(unsigned int slotNo)
+{
+	assert(slotNo == 1U || slotNo == 2U);
+
+	m_slot = slotNo;
+}
+
+void CDMRAssembler::setColorCode(unsigned int colorCode)
+{
+	m_colorCode = colorCode;
+}
+
+void CDMRAssembler::setHeader(CDMRData& data, unsigned int srcId, unsigned int dstId, FLCO flco, unsigned char n) const
+{
+	data.setSlotNo(m_slot);
+	data.setSrcId(srcId);
+	data.setDstId(dstId);
+	data.setFLCO(flco);
+	data.setN(n);
+	data.setSeqNo(m_count);
+	data.setBER(0U);
+	data.setRSSI(0U);
+}
+
+bool CDMRAssembler::assemble(unsigned int tag, const CTaggedFrame<9U>* const* frames, unsigned int srcId, unsigned int dstId, FLCO flco, CSPSCQueue<CDMRData>& queue)
+{
+	assert(frames != NULL);
+
+	unsigned char* frame = m_burst;
+	bool ok = true;
+
+	if (tag == TAG_HEADER) {
+		CDMRData data;
+		m_count = 0U;
+
+		setHeader(data, srcId, dstId, flco, 0U);
+		data.setDataType(DT_VOICE_LC_HEADER);
+
+		// Add sync
+		CSync::addDMRDataSync(frame, 0);
+
+		// Add SlotType
+		CDMRSlotType slotType;
+		slotType.setColorCode(m_colorCode);
+		slotType.setDataType(DT_VOICE_LC_HEADER);
+		slotType.getData(frame);
+
+		// Full LC
+		CDMRLC dmrLC = CDMRLC(flco, srcId, dstId);
+		CDMRFullLC fullLC;
+		fullLC.encode(dmrLC, frame, DT_VOICE_LC_HEADER);
+		m_embeddedLC.setLC(dmrLC);
+
+		data.setData(frame);
+
+		for (unsigned int i = 0U; i < 3U; i++) {
+			data.setSeqNo(m_count);
+			ok = queue.push(data) && ok;
+			m_count++;
+		}
+	} else if (tag == TAG_EOT) {
+		CDMRData data;
+		unsigned int n = (m_count - 3U) % 6U;
+		unsigned int fill = (6U - n);
+
+		if (n) {
+			for (unsigned int i = 0U; i < fill; i++) {
+				CDMREMB emb;
+				CDMRData silence;
+
+				setHeader(silence, srcId, dstId, flco, n);
+				silence.setDataType(DT_VOICE);
+
+				::memcpy(frame, DMR_SILENCE_DATA, DMR_FRAME_LENGTH_BYTES);
+
+				// Generate the Embedded LC
+				unsigned char lcss = m_embeddedLC.getData(frame, n);
+
+				// Generate the EMB
+				emb.setColorCode(m_colorCode);
+				emb.setLCSS(lcss);
+				emb.getData(frame);
+
+				silence.setData(frame);
+				ok = queue.push(silence) && ok;
+
+				n++;
+				m_count++;
+			}
+		}
+
+		setHeader(data, srcId, dstId, flco, n);
+		data.setDataType(DT_TERMINATOR_WITH_LC);
+
+		// Add sync
+		CSync::addDMRDataSync(frame, 0);
+
+		// Add SlotType
+		CDMRSlotType slotType;
+		slotType.setColorCode(m_colorCode);
+		slotType.setDataType(DT_TERMINATOR_WITH_LC);
+		slotType.getData(frame);
+
+		// Full LC
+		CDMRLC dmrLC = CDMRLC(flco, srcId, dstId);
+		CDMRFullLC fullLC;
+		fullLC.encode(dmrLC, frame, DT_TERMINATOR_WITH_LC);
+
+		data.setData(frame);
+		ok = queue.push(data) && ok;
+	} else if (tag == TAG_DATA) {
+		CDMREMB emb;
+		CDMRData data;
+		unsigned int n = (m_count - 3U) % 6U;
+
+		setHeader(data, srcId, dstId, flco, n);
+
+		::memcpy(frame, frames[0U]->m_data, 9U);
+
+		// The second frame goes either side of the sync
+		const unsigned char* second = frames[1U]->m_data;
+		::memcpy(frame + 9U, second, 4U);
+		frame[13U] = second[4U] & 0xF0U;
+		frame[19U] = second[4U] & 0x0FU;
+		::memcpy(frame + 20U, second + 5U, 4U);
+
+		::memcpy(frame + 24U, frames[2U]->m_data, 9U);
+
+		if (!n) {
+			data.setDataType(DT_VOICE_SYNC);
+			// Add sync
+			CSync::addDMRAudioSync(frame, 0U);
+			// Prepare Full LC data
+			CDMRLC dmrLC = CDMRLC(flco, srcId, dstId);
+			// Configure the Embedded LC
+			m_embeddedLC.setLC(dmrLC);
+		} else {
+			data.setDataType(DT_VOICE);
+			// Generate the Embedded LC
+			unsigned char lcss = m_embeddedLC.getData(frame, n);
+			// Generate the EMB
+			emb.setColorCode(m_colorCode);
+			emb.setLCSS(lcss);
+			emb.getData(frame);
+		}
+
+		data.setData(frame);
+		ok = queue.push(data) && ok;
+
+		m_count++;
+	}
+
+	return ok;
+}
@@ -0,0 +1,59 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(DMRASSEMBLER_H)
+#define	DMRASSEMBLER_H
+
+#include "DMRDefines.h"
+#include "DMREmbeddedData.h"
+#include "DMRData.h"
+#include "FrameRing.h"
+#include "SPSCQueue.h"
+
+// Most bursts one frame gives, the terminator after five bursts of silence
+const unsigned int DMR_ASSEMBLER_BURSTS = 6U;
+
+// Wraps the AMBE of the frames from CModeConv::peekDMR() in the bursts of
+// one DMR call: the voice LC header, the voice superframes with their sync,
+// EMB and embedded LC, and the terminator. Each destination has its own, so
+// that one conversion can go out under several LCs.
+class CDMRAssembler {
+public:
+	CDMRAssembler();
+	~CDMRAssembler();
+
+	void setSlot(unsigned int slotNo);
+	void setColorCode(unsigned int colorCode);
+
+	// The AMBE is read from the three frames of a burst where they lie, the
+	// second one either side of the sync, and only the tag of a header or EOT.
+	// A header gives three bursts, and the terminator first fills out the
+	// superframe. False if the queue had no room for one of them
+	bool assemble(unsigned int tag, const CTaggedFrame<9U>* const* frames, unsigned int srcId, unsigned int dstId, FLCO flco, CSPSCQueue<CDMRData>& queue);
+
+private:
+	unsigned int     m_slot;
+	unsigned int     m_colorCode;
+	unsigned int     m_count;
+	CDMREmbeddedData m_embeddedLC;
+	unsigned char    m_burst[DMR_FRAME_LENGTH_BYTES];
+
+	void setHeader(CDMRData& data, unsigned int srcId, unsigned int dstId, FLCO flco, unsigned char n) const;
+};
+
+#endif
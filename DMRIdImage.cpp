@@ -0,0 +1,441 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "DMRIdImage.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <unordered_map>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const char     DMRIDIMAGE_MAGIC[]  = "DMID";
+const uint32_t DMRIDIMAGE_VERSION  = 1U;
+const uint32_t DMRIDIMAGE_EMPTY    = 0xFFFFFFFFU;
+
+CDMRIdImage::CDMRIdImage() :
+m_data(NULL),
+m_size(0U),
+m_device(0ULL),
+m_inode(0ULL),
+m_header(NULL),
+m_ids(NULL),
+m_callsigns(NULL),
+m_buckets(NULL),
+m_strings(NULL)
+{
+}
+
+CDMRIdImage::~CDMRIdImage()
+{
+	unmap();
+}
+
+bool CDMRIdImage::map(const std::string& path)
+{
+	unmap();
+
+#if !defined(_WIN32) && !defined(_WIN64)
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(CDMRIdImageHeader)) {
+		::close(fd);
+		return false;
+	}
+
+	void* data = ::mmap(NULL, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) {
+		LogWarning("Cannot map the Id lookup image - %s, err: %d", path.c_str(), errno);
+		return false;
+	}
+
+	m_data   = (unsigned char*)data;
+	m_size   = size_t(st.st_size);
+	m_device = (unsigned long long)st.st_dev;
+	m_inode  = (unsigned long long)st.st_ino;
+
+	const CDMRIdImageHeader* header = (const CDMRIdImageHeader*)m_data;
+
+	size_t size = sizeof(CDMRIdImageHeader) + size_t(header->m_ids) * 2U * sizeof(uint32_t) +
+		size_t(header->m_buckets) * sizeof(CDMRIdImageBucket) + size_t(header->m_stringsSize);
+
+	if (::memcmp(header->m_magic, DMRIDIMAGE_MAGIC, 4U) != 0 || header->m_version != DMRIDIMAGE_VERSION ||
+		header->m_buckets == 0U || (header->m_buckets & (header->m_buckets - 1U)) != 0U ||
+		header->m_stringsSize == 0U || size != m_size || m_data[m_size - 1U] != 0x00U) {
+		LogWarning("The Id lookup image is not valid - %s", path.c_str());
+		unmap();
+		return false;
+	}
+
+	const uint32_t* ids              = (const uint32_t*)(m_data + sizeof(CDMRIdImageHeader));
+	const uint32_t* callsigns        = ids + header->m_ids;
+	const CDMRIdImageBucket* buckets = (const CDMRIdImageBucket*)(callsigns + header->m_ids);
+
+	// The strings end with the image, so a callsign that starts inside them
+	// has its NUL inside them too
+	bool valid = true;
+	for (uint32_t i = 0U; i < header->m_ids && valid; i++)
+		valid = callsigns[i] < header->m_stringsSize;
+	for (uint32_t i = 0U; i < header->m_buckets && valid; i++)
+		valid = buckets[i].m_callsign == DMRIDIMAGE_EMPTY || buckets[i].m_callsign < header->m_stringsSize;
+
+	if (!valid) {
+		LogWarning("The Id lookup image has a callsign outside its strings - %s", path.c_str());
+		unmap();
+		return false;
+	}
+
+	m_header    = header;
+	m_ids       = ids;
+	m_callsigns = callsigns;
+	m_buckets   = buckets;
+	m_strings   = (const char*)(m_buckets + header->m_buckets);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CDMRIdImage::unmap()
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (m_data != NULL)
+		::munmap(m_data, m_size);
+#endif
+
+	m_data      = NULL;
+	m_size      = 0U;
+	m_device    = 0ULL;
+	m_inode     = 0ULL;
+	m_header    = NULL;
+	m_ids       = NULL;
+	m_callsigns = NULL;
+	m_buckets   = NULL;
+	m_strings   = NULL;
+}
+
+bool CDMRIdImage::isMapped() const
+{
+	return m_header != NULL;
+}
+
+bool CDMRIdImage::isCurrent(const std::string& source) const
+{
+	if (m_header == NULL)
+		return false;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+	struct stat st;
+	if (::stat(source.c_str(), &st) != 0)
+		return false;
+
+	return uint64_t(st.st_size) == m_header->m_sourceSize && int64_t(st.st_mtime) == m_header->m_sourceTime;
+#else
+	return false;
+#endif
+}
+
+bool CDMRIdImage::isReplaced(const std::string& path) const
+{
+	if (m_header == NULL)
+		return false;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+	struct stat st;
+	if (::stat(path.c_str(), &st) != 0)
+		return false;
+
+	return (unsigned long long)st.st_ino != m_inode || (unsigned long long)st.st_dev != m_device;
+#else
+	return false;
+#endif
+}
+
+uint64_t CDMRIdImage::getGeneration() const
+{
+	return m_header != NULL ? m_header->m_generation : 0ULL;
+}
+
+unsigned int CDMRIdImage::getCount() const
+{
+	return m_header != NULL ? m_header->m_ids : 0U;
+}
+
+int CDMRIdImage::find(unsigned int id) const
+{
+	if (m_header == NULL)
+		return -1;
+
+	unsigned int lo = 0U;
+	unsigned int hi = m_header->m_ids;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2U;
+		if (m_ids[mid] < id)
+			lo = mid + 1U;
+		else
+			hi = mid;
+	}
+
+	if (lo < m_header->m_ids && m_ids[lo] == id)
+		return int(lo);
+
+	return -1;
+}
+
+bool CDMRIdImage::findCS(unsigned int id, std::string& callsign) const
+{
+	int n = find(id);
+	if (n < 0)
+		return false;
+
+	callsign = m_strings + m_callsigns[n];
+
+	return true;
+}
+
+bool CDMRIdImage::exists(unsigned int id) const
+{
+	return find(id) >= 0;
+}
+
+unsigned int CDMRIdImage::findID(const std::string& callsign) const
+{
+	if (m_header == NULL)
+		return 0U;
+
+	uint32_t mask = m_header->m_buckets - 1U;
+
+	// A damaged image may have no empty bucket to end a miss
+	uint32_t n = hash(callsign.c_str()) & mask;
+	for (uint32_t probes = 0U; probes < m_header->m_buckets; probes++, n = (n + 1U) & mask) {
+		const CDMRIdImageBucket& bucket = m_buckets[n];
+		if (bucket.m_callsign == DMRIDIMAGE_EMPTY)
+			return 0U;
+
+		if (::strcmp(m_strings + bucket.m_callsign, callsign.c_str()) == 0)
+			return bucket.m_id;
+	}
+
+	return 0U;
+}
+
+uint32_t CDMRIdImage::hash(const char* callsign)
+{
+	assert(callsign != NULL);
+
+	// FNV-1a
+	uint32_t h = 2166136261U;
+	for (const unsigned char* p = (const unsigned char*)callsign; *p != 0x00U; p++) {
+		h ^= *p;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static uint32_t addString(std::string& strings, std::unordered_map<std::string, uint32_t>& offsets, const std::string& text)
+{
+	std::unordered_map<std::string, uint32_t>::const_iterator it = offsets.find(text);
+	if (it != offsets.end())
+		return it->second;
+
+	uint32_t offset = uint32_t(strings.size());
+	strings.append(text.c_str(), text.size() + 1U);
+	offsets[text] = offset;
+
+	return offset;
+}
+
+bool CDMRIdImage::build(const std::string& source, const std::string& path, uint64_t generation)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	FILE* fp = ::fopen(source.c_str(), "rt");
+	if (fp == NULL) {
+		LogWarning("Cannot open the Id lookup file - %s", source.c_str());
+		return false;
+	}
+
+	struct stat st;
+	if (::fstat(::fileno(fp), &st) != 0) {
+		::fclose(fp);
+		return false;
+	}
+
+	// Parsed as the private tables are, the last line for an Id or a
+	// callsign wins
+	std::unordered_map<unsigned int, std::string> table;
+	std::unordered_map<std::string, unsigned int> cstable;
+
+	char buffer[100U];
+	while (::fgets(buffer, 100U, fp) != NULL) {
+		if (buffer[0U] == '#')
+			continue;
+
+		char* p1 = ::strtok(buffer, " \t\r\n");
+		char* p2 = ::strtok(NULL, " \t\r\n");
+
+		if (p1 != NULL && p2 != NULL) {
+			unsigned int id = (unsigned int)::atoi(p1);
+			for (char* p = p2; *p != 0x00U; p++)
+				*p = ::toupper(*p);
+
+			table[id] = std::string(p2);
+			cstable[p2] = id;
+		}
+	}
+
+	::fclose(fp);
+
+	if (table.empty())
+		return false;
+
+	std::vector<uint32_t> ids;
+	ids.reserve(table.size());
+	for (std::unordered_map<unsigned int, std::string>::const_iterator it = table.begin(); it != table.end(); ++it)
+		ids.push_back(it->first);
+	std::sort(ids.begin(), ids.end());
+
+	std::string strings;
+	std::unordered_map<std::string, uint32_t> offsets;
+
+	std::vector<uint32_t> callsigns;
+	callsigns.reserve(ids.size());
+	for (std::vector<uint32_t>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+		callsigns.push_back(addString(strings, offsets, table[*it]));
+
+	// At most half full, so that a miss ends quickly
+	uint32_t count = 16U;
+	while (count < cstable.size() * 2U)
+		count *= 2U;
+
+	std::vector<CDMRIdImageBucket> buckets(count);
+	for (std::vector<CDMRIdImageBucket>::iterator it = buckets.begin(); it != buckets.end(); ++it) {
+		it->m_callsign = DMRIDIMAGE_EMPTY;
+		it->m_id       = 0U;
+	}
+
+	for (std::unordered_map<std::string, unsigned int>::const_iterator it = cstable.begin(); it != cstable.end(); ++it) {
+		uint32_t n = hash(it->first.c_str()) & (count - 1U);
+		while (buckets[n].m_callsign != DMRIDIMAGE_EMPTY)
+			n = (n + 1U) & (count - 1U);
+
+		buckets[n].m_callsign = addString(strings, offsets, it->first);
+		buckets[n].m_id       = it->second;
+	}
+
+	CDMRIdImageHeader header;
+	::memset(&header, 0x00U, sizeof(CDMRIdImageHeader));
+	::memcpy(header.m_magic, DMRIDIMAGE_MAGIC, 4U);
+	header.m_version     = DMRIDIMAGE_VERSION;
+	header.m_generation  = generation;
+	header.m_sourceSize  = uint64_t(st.st_size);
+	header.m_sourceTime  = int64_t(st.st_mtime);
+	header.m_ids         = uint32_t(ids.size());
+	header.m_buckets     = count;
+	header.m_stringsSize = uint32_t(strings.size());
+
+	// Written beside the old image and renamed over it, a gateway that has
+	// the old one mapped keeps it until it moves to the new one
+	std::string temp = path + ".XXXXXX";
+	std::vector<char> name(temp.begin(), temp.end());
+	name.push_back('\0');
+
+	int fd = ::mkstemp(&name[0U]);
+	if (fd < 0) {
+		LogWarning("Cannot create the Id lookup image - %s, err: %d", path.c_str(), errno);
+		return false;
+	}
+
+	FILE* out = ::fdopen(fd, "wb");
+	if (out == NULL) {
+		::close(fd);
+		::unlink(&name[0U]);
+		return false;
+	}
+
+	bool ok = ::fwrite(&header, sizeof(CDMRIdImageHeader), 1U, out) == 1U &&
+		::fwrite(&ids[0U], sizeof(uint32_t), ids.size(), out) == ids.size() &&
+		::fwrite(&callsigns[0U], sizeof(uint32_t), callsigns.size(), out) == callsigns.size() &&
+		::fwrite(&buckets[0U], sizeof(CDMRIdImageBucket), buckets.size(), out) == buckets.size() &&
+		::fwrite(strings.data(), 1U, strings.size(), out) == strings.size();
+
+	ok = ::fchmod(fd, 0644) == 0 && ok;
+	ok = ::fclose(out) == 0 && ok;
+
+	if (!ok || ::rename(&name[0U], path.c_str()) != 0) {
+		LogWarning("Cannot write the Id lookup image - %s, err: %d", path.c_str(), errno);
+		::unlink(&name[0U]);
+		return false;
+	}
+
+	LogInfo("Built generation %llu of the Id lookup image %s, %u Ids", (unsigned long long)generation, path.c_str(), header.m_ids);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+int CDMRIdImage::lock(const std::string& path)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	std::string name = path + ".lock";
+
+	int fd = ::open(name.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return -1;
+
+	if (::flock(fd, LOCK_EX) != 0) {
+		::close(fd);
+		return -1;
+	}
+
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+void CDMRIdImage::unlock(int fd)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (fd >= 0) {
+		::flock(fd, LOCK_UN);
+		::close(fd);
+	}
+#endif
+}
@@ -0,0 +1,94 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(DMRIDIMAGE_H)
+#define	DMRIDIMAGE_H
+
+#include <cstdint>
+#include <string>
+
+// A read-only image of the Id lookup file, built once and mapped by every
+// gateway on the host. Ids are sorted for a binary search, callsigns are
+// found through an open addressed hash index, and both point into one
+// block of NUL terminated strings.
+struct CDMRIdImageHeader {
+	char          m_magic[4U];
+	uint32_t      m_version;
+	uint64_t      m_generation;		// One more than the image it replaced
+	uint64_t      m_sourceSize;		// Of the text file it was built from
+	int64_t       m_sourceTime;
+	uint32_t      m_ids;
+	uint32_t      m_buckets;		// A power of two
+	uint32_t      m_stringsSize;
+	uint32_t      m_reserved;
+};
+
+struct CDMRIdImageBucket {
+	uint32_t      m_callsign;		// Offset in the strings, or DMRIDIMAGE_EMPTY
+	uint32_t      m_id;
+};
+
+class CDMRIdImage {
+public:
+	CDMRIdImage();
+	~CDMRIdImage();
+
+	// Map the image at path, false if there is none or it is not valid
+	bool map(const std::string& path);
+	void unmap();
+
+	bool isMapped() const;
+
+	// Whether it was built from the text file as it is now
+	bool isCurrent(const std::string& source) const;
+	// Whether path now holds a different image than the one mapped
+	bool isReplaced(const std::string& path) const;
+
+	uint64_t     getGeneration() const;
+	unsigned int getCount() const;
+
+	bool         findCS(unsigned int id, std::string& callsign) const;
+	unsigned int findID(const std::string& callsign) const;
+	bool         exists(unsigned int id) const;
+
+	// Parse the text file and swap the result in at path, with a rename so
+	// that a reader sees either the old image or the new one
+	static bool build(const std::string& source, const std::string& path, uint64_t generation);
+
+	// Keeps the other gateways from building at the same time, -1 if the
+	// lock cannot be had
+	static int  lock(const std::string& path);
+	static void unlock(int fd);
+
+private:
+	unsigned char*            m_data;
+	size_t                    m_size;
+	unsigned long long        m_device;
+	unsigned long long        m_inode;
+	const CDMRIdImageHeader*  m_header;
+	const uint32_t*           m_ids;
+	const uint32_t*           m_callsigns;
+	const CDMRIdImageBucket*  m_buckets;
+	const char*               m_strings;
+
+	int find(unsigned int id) const;
+
+	static uint32_t hash(const char* callsign);
+};
+
+#endif
@@ -21,32 +21,49 @@
 #include "Timer.h"
 #include "Log.h"
 
+#include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cctype>
 
-CDMRLookup::CDMRLookup(const std::string& filename, unsigned int reloadTime) :
+CDMRLookup::CDMRLookup(const std::string& filename, unsigned int reloadTime, const std::string& image) :
 CThread(),
 m_filename(filename),
 m_reloadTime(reloadTime),
 m_table(),
 m_cstable(),
+m_imageFile(image),
+m_image(NULL),
 m_mutex(),
-m_stop(false)
+m_stop(false),
+m_running(false)
 {
 }
 
 CDMRLookup::~CDMRLookup()
 {
+	delete m_image;
 }
 
 bool CDMRLookup::read()
 {
-	bool ret = load();
+	bool ret = false;
 
-	if (m_reloadTime > 0U)
+	if (!m_imageFile.empty()) {
+		ret = loadImage();
+		if (!ret)
+			LogWarning("Cannot use the shared Id lookup image, loading the Ids into this process");
+	}
+
+	if (!ret)
+		ret = load();
+
+	// A shared image is watched for another gateway replacing it
+	if (m_reloadTime > 0U || m_image != NULL) {
 		run();
+		m_running = true;
+	}
 
 	return ret;
 }
@@ -56,16 +73,23 @@ void CDMRLookup::entry()
 	LogInfo("Started the DMR Id lookup reload thread");
 
 	CTimer timer(1U, 3600U * m_reloadTime);
-	timer.start();
+	if (m_reloadTime > 0U)
+		timer.start();
 
 	while (!m_stop) {
 		sleep(1000U);
 
 		timer.clock();
 		if (timer.hasExpired()) {
-			load();
+			if (m_image != NULL)
+				loadImage();
+			else
+				load();
 			timer.start();
 		}
+
+		if (m_image != NULL)
+			follow();
 	}
 
 	LogInfo("Stopped the DMR Id lookup reload thread");
@@ -73,7 +97,7 @@ void CDMRLookup::entry()
 
 void CDMRLookup::stop()
 {
-	if (m_reloadTime == 0U) {
+	if (!m_running) {
 		delete this;
 		return;
 	}
@@ -81,6 +105,8 @@ void CDMRLookup::stop()
 	m_stop = true;
 
 	wait();
+
+	delete this;
 }
 
 std::string CDMRLookup::findCS(unsigned int id)
@@ -92,12 +118,20 @@ std::string CDMRLookup::findCS(unsigned int id)
 
 	m_mutex.lock();
 
-	try {
-		callsign = m_table.at(id);
-	} catch (...) {
-		char text[10U];
-		::sprintf(text, "%u", id);
-		callsign = std::string(text);
+	if (m_image != NULL) {
+		if (!m_image->findCS(id, callsign)) {
+			char text[10U];
+			::sprintf(text, "%u", id);
+			callsign = std::string(text);
+		}
+	} else {
+		try {
+			callsign = m_table.at(id);
+		} catch (...) {
+			char text[10U];
+			::sprintf(text, "%u", id);
+			callsign = std::string(text);
+		}
 	}
 
 	m_mutex.unlock();
@@ -111,10 +145,14 @@ unsigned int CDMRLookup::findID(std::string cs)
 
 	m_mutex.lock();
 
-	try {
-		dmrID = m_cstable.at(cs);
-	} catch (...) {
-		dmrID = 0U;
+	if (m_image != NULL) {
+		dmrID = m_image->findID(cs);
+	} else {
+		try {
+			dmrID = m_cstable.at(cs);
+		} catch (...) {
+			dmrID = 0U;
+		}
 	}
 
 	m_mutex.unlock();
@@ -126,7 +164,7 @@ bool CDMRLookup::exists(unsigned int id)
 {
 	m_mutex.lock();
 
-	bool found = m_table.count(id) == 1U;
+	bool found = m_image != NULL ? m_image->exists(id) : m_table.count(id) == 1U;
 
 	m_mutex.unlock();
 
@@ -176,4 +214,75 @@ bool CDMRLookup::load()
 	LogInfo("Loaded %u Ids to the callsign lookup table", size);
 
 	return true;
-}
\ No newline at end of file
+}
+bool CDMRLookup::loadImage()
+{
+	// Nothing to do while the image mapped is the one built from the file as it is now
+	if (m_image != NULL && !m_image->isReplaced(m_imageFile) && m_image->isCurrent(m_filename))
+		return true;
+
+	CDMRIdImage* image = new CDMRIdImage;
+
+	if (!image->map(m_imageFile) || !image->isCurrent(m_filename)) {
+		int fd = CDMRIdImage::lock(m_imageFile);
+
+		// Another gateway may have built it while this one waited for the lock
+		bool mapped = image->map(m_imageFile);
+		if (!mapped || !image->isCurrent(m_filename)) {
+			uint64_t generation = image->getGeneration() + 1ULL;
+			image->unmap();
+
+			CDMRIdImage::build(m_filename, m_imageFile, generation);
+
+			// An old image is still better than none if the build failed
+			mapped = image->map(m_imageFile);
+		}
+
+		CDMRIdImage::unlock(fd);
+
+		if (!mapped) {
+			delete image;
+			return m_image != NULL;
+		}
+	}
+
+	LogInfo("Mapped generation %llu of the Id lookup image %s, %u Ids", (unsigned long long)image->getGeneration(), m_imageFile.c_str(), image->getCount());
+
+	swap(image);
+
+	return true;
+}
+
+void CDMRLookup::follow()
+{
+	if (!m_image->isReplaced(m_imageFile))
+		return;
+
+	CDMRIdImage* image = new CDMRIdImage;
+	if (!image->map(m_imageFile)) {
+		delete image;
+		return;
+	}
+
+	LogInfo("Moved to generation %llu of the Id lookup image %s, %u Ids", (unsigned long long)image->getGeneration(), m_imageFile.c_str(), image->getCount());
+
+	swap(image);
+}
+
+void CDMRLookup::swap(CDMRIdImage* image)
+{
+	assert(image != NULL);
+
+	m_mutex.lock();
+
+	CDMRIdImage* old = m_image;
+	m_image = image;
+
+	// The private tables are not needed once there is an image
+	std::unordered_map<unsigned int, std::string>().swap(m_table);
+	std::unordered_map<std::string, unsigned int>().swap(m_cstable);
+
+	m_mutex.unlock();
+
+	delete old;
+}
@@ -20,6 +20,7 @@
 #ifndef	DMRLookup_H
 #define	DMRLookup_H
 
+#include "DMRIdImage.h"
 #include "Thread.h"
 #include "Mutex.h"
 
@@ -28,7 +29,9 @@
 
 class CDMRLookup : public CThread {
 public:
-	CDMRLookup(const std::string& filename, unsigned int reloadTime);
+	// With an image path the tables are shared with the other gateways on
+	// the host through that file, rather than loaded into this process
+	CDMRLookup(const std::string& filename, unsigned int reloadTime, const std::string& image = "");
 	virtual ~CDMRLookup();
 
 	bool read();
@@ -47,10 +50,16 @@ private:
 	unsigned int                                  m_reloadTime;
 	std::unordered_map<unsigned int, std::string> m_table;
 	std::unordered_map<std::string, unsigned int> m_cstable;
+	std::string                                   m_imageFile;
+	CDMRIdImage*                                  m_image;
 	CMutex                                        m_mutex;
 	bool                                          m_stop;
+	bool                                          m_running;
 
 	bool load();
+	bool loadImage();
+	void follow();
+	void swap(CDMRIdImage* image);
 };
 
 #endif
@@ -17,6 +17,9 @@
  */
 
 #include "DMRNetwork.h"
+#include "DMRSlotType.h"
+#include "DMRFullLC.h"
+#include "Sync.h"
 
 #include "StopWatch.h"
 #include "SHA256.h"
@@ -30,27 +33,230 @@
 const unsigned int BUFFER_LENGTH = 500U;
 
 const unsigned int HOMEBREW_DATA_PACKET_LENGTH = 55U;
-
-CDMRNetwork::CDMRNetwork(const std::string& address, unsigned int port, unsigned int local, unsigned int id, const std::string& password, bool duplex, const char* version, bool debug, bool slot1, bool slot2, HW_TYPE hwType, unsigned int jitter) :
-m_address(),
+const unsigned int HOMEBREW_DATA_HEADER_LENGTH = 20U;
+
+// The shortest time between pings when there are standbys, in ms
+const unsigned int MASTER_PING_MIN = 100U;
+
+// Pings in a row a master may miss before it is given up on, with no loss
+// measured and then one more for each 10% of the pings lost
+const unsigned int MASTER_MISSES   = 2U;
+
+// During a call the active master is pinged once a frame, or every two
+// round trips when that is longer, and traffic moves to a standby once it
+// has missed answering two pings in a row. The frames it sends count as
+// answers. A call with no frames for CALL_TIMEOUT ms has ended without a
+// terminator.
+const unsigned int CALL_FRAME_TIME = 60U;
+const unsigned int CALL_MISSES     = 2U;
+const unsigned int CALL_TIMEOUT    = 1000U;
+
+// Resending a login step, in ms: three round trips, or a second before the
+// first has been measured, doubled on each resend up to the old fixed time
+const unsigned int LOGIN_RESEND_MIN     = 100U;
+const unsigned int LOGIN_RESEND_INITIAL = 1000U;
+const unsigned int LOGIN_RESEND_MAX     = 10000U;
+
+// Connection attempts after the first, in ms, doubled each time and
+// randomised over the upper half of the range
+const unsigned int RECONNECT_BASE = 500U;
+const unsigned int RECONNECT_MAX  = 30000U;
+
+CDMRMaster::CDMRMaster(CTimerWheel& wheel, const in_addr& address, unsigned int port) :
+m_address(address),
 m_port(port),
+m_name(),
+m_status(WAITING_CONNECT),
+m_retryTimer(wheel, 10U),
+m_timeoutTimer(wheel, 60U),
+m_silenceTimer(wheel),
+m_lastHeard(0ULL),
+m_pingTime(0ULL),
+m_rtt(0U),
+m_history(0U),
+m_pings(0U),
+m_stepTime(0ULL),
+m_resends(0U),
+m_attempts(0U)
+{
+	char name[30U];
+	::sprintf(name, "%s:%u", ::inet_ntoa(address), port);
+	m_name = name;
+
+	::memset(m_salt, 0x00U, sizeof(m_salt));
+}
+
+void CDMRMaster::pingSent()
+{
+	unsigned long long now = CStopWatch::monotonic();
+
+	// The last ping went unanswered
+	if (m_pingTime != 0ULL) {
+		m_history = (m_history << 1) | 1U;
+		if (m_pings < 32U)
+			m_pings++;
+	}
+
+	m_pingTime = now;
+}
+
+void CDMRMaster::pongReceived()
+{
+	if (m_pingTime == 0ULL)
+		return;
+
+	unsigned int rtt = (unsigned int)(CStopWatch::monotonic() - m_pingTime);
+	m_pingTime = 0ULL;
+
+	m_rtt = m_rtt == 0U ? rtt : (7U * m_rtt + rtt) / 8U;
+
+	m_history <<= 1;
+	if (m_pings < 32U)
+		m_pings++;
+}
+
+void CDMRMaster::stepSent(bool resend)
+{
+	// Only a step that was sent once gives a round trip time
+	if (resend) {
+		m_resends++;
+		m_stepTime = 0ULL;
+	} else {
+		m_resends  = 0U;
+		m_stepTime = CStopWatch::monotonic();
+	}
+}
+
+void CDMRMaster::stepAnswered()
+{
+	if (m_stepTime == 0ULL)
+		return;
+
+	unsigned int rtt = (unsigned int)(CStopWatch::monotonic() - m_stepTime);
+	m_stepTime = 0ULL;
+
+	m_rtt = m_rtt == 0U ? rtt : (7U * m_rtt + rtt) / 8U;
+}
+
+unsigned int CDMRMaster::getResendTime() const
+{
+	unsigned int ms = m_rtt == 0U ? LOGIN_RESEND_INITIAL : (3U * m_rtt) / 1000U;
+	if (ms < LOGIN_RESEND_MIN)
+		ms = LOGIN_RESEND_MIN;
+
+	for (unsigned int i = 0U; i < m_resends && ms < LOGIN_RESEND_MAX; i++)
+		ms *= 2U;
+
+	return ms < LOGIN_RESEND_MAX ? ms : LOGIN_RESEND_MAX;
+}
+
+unsigned int CDMRMaster::nextAttempt()
+{
+	if (m_attempts++ == 0U)
+		return 1U;
+
+	unsigned int ms = RECONNECT_BASE;
+	for (unsigned int i = 1U; i < m_attempts && ms < RECONNECT_MAX; i++)
+		ms *= 2U;
+	if (ms > RECONNECT_MAX)
+		ms = RECONNECT_MAX;
+
+	// Gateways that lost the same master do not all come back at once
+	return ms / 2U + (unsigned int)::rand() % (ms / 2U + 1U);
+}
+
+void CDMRMaster::connected()
+{
+	m_attempts = 0U;
+}
+
+unsigned int CDMRMaster::getRTT() const
+{
+	return m_rtt;
+}
+
+unsigned int CDMRMaster::getLoss() const
+{
+	if (m_pings == 0U)
+		return 0U;
+
+	uint32_t history = m_pings < 32U ? m_history & ((1U << m_pings) - 1U) : m_history;
+
+	unsigned int lost = 0U;
+	for (; history != 0U; history &= history - 1U)
+		lost++;
+
+	return (lost * 100U) / m_pings;
+}
+
+unsigned int CDMRMaster::getPingTime(unsigned int failoverTime) const
+{
+	// Two round trips apart, so that each ping is normally answered before the next
+	unsigned int ms = (2U * m_rtt) / 1000U;
+	if (ms < MASTER_PING_MIN)
+		ms = MASTER_PING_MIN;
+
+	return ms < failoverTime / 3U ? ms : failoverTime / 3U;
+}
+
+unsigned int CDMRMaster::getSilenceTime(unsigned int failoverTime) const
+{
+	if (m_rtt == 0U)
+		return failoverTime;
+
+	unsigned int misses = MASTER_MISSES + getLoss() / 10U;
+	unsigned int ms = (misses + 1U) * getPingTime(failoverTime) + m_rtt / 1000U;
+
+	return ms < failoverTime ? ms : failoverTime;
+}
+
+unsigned int CDMRMaster::getCallPingTime() const
+{
+	unsigned int ms = (2U * m_rtt) / 1000U;
+
+	return ms > CALL_FRAME_TIME ? ms : CALL_FRAME_TIME;
+}
+
+unsigned int CDMRMaster::getCallSilenceTime() const
+{
+	return CALL_MISSES * getCallPingTime() + m_rtt / 1000U;
+}
+
+unsigned long long CDMRMaster::getScore() const
+{
+	// Not measured yet, after any that have been
+	unsigned long long rtt = m_rtt == 0U ? 10000000ULL : m_rtt;
+
+	// A lost ping counts as much as doubling the round trip time
+	return rtt * (100ULL + 2ULL * getLoss());
+}
+
+CDMRNetwork::CDMRNetwork(CTimerWheel& wheel, const std::string& address, unsigned int port, unsigned int local, unsigned int id, const std::string& password, bool duplex, const char* version, bool debug, bool slot1, bool slot2, HW_TYPE hwType, unsigned int jitter) :
+m_masters(),
+m_active(NULL),
+m_wheel(wheel),
+m_failoverTime(1000U),
+m_callTimer(wheel),
+m_calls(0U),
+m_callHeard(0ULL),
+m_opened(false),
 m_id(NULL),
 m_password(password),
 m_duplex(duplex),
 m_version(version),
 m_debug(debug),
 m_socket(local),
+m_thread(m_socket, "DMR Network"),
 m_enabled(false),
 m_slot1(slot1),
 m_slot2(slot2),
 m_delayBuffers(NULL),
+m_arbiters(NULL),
 m_hwType(hwType),
-m_status(WAITING_CONNECT),
-m_retryTimer(1000U, 10U),
-m_timeoutTimer(1000U, 60U),
+m_handedOver(false),
 m_buffer(NULL),
-m_salt(NULL),
 m_streamId(NULL),
+m_lastHeader(NULL),
 m_options(),
 m_callsign(),
 m_rxFrequency(0U),
@@ -71,17 +277,22 @@ m_beacon(false)
 	assert(!password.empty());
 	assert(jitter > 0U);
 
-	m_address = CUDPSocket::lookup(address);
+	addMaster(CUDPSocket::lookup(address), port);
 
 	m_buffer        = new unsigned char[BUFFER_LENGTH];
-	m_salt          = new unsigned char[sizeof(uint32_t)];
 	m_id            = new uint8_t[4U];
 	m_streamId      = new uint32_t[2U];
+	m_lastHeader    = new unsigned char[3U * HOMEBREW_DATA_HEADER_LENGTH];
 
 	m_delayBuffers  = new CDelayBuffer*[3U];
 
-	m_delayBuffers[1U] = new CDelayBuffer("DMR Slot 1", HOMEBREW_DATA_PACKET_LENGTH, DMR_SLOT_TIME, jitter, debug);
-	m_delayBuffers[2U] = new CDelayBuffer("DMR Slot 2", HOMEBREW_DATA_PACKET_LENGTH, DMR_SLOT_TIME, jitter, debug);
+	m_delayBuffers[1U] = new CDelayBuffer(wheel, "DMR Slot 1", HOMEBREW_DATA_PACKET_LENGTH, DMR_SLOT_TIME, jitter, debug);
+	m_delayBuffers[2U] = new CDelayBuffer(wheel, "DMR Slot 2", HOMEBREW_DATA_PACKET_LENGTH, DMR_SLOT_TIME, jitter, debug);
+
+	m_arbiters  = new CStreamArbiter*[3U];
+
+	m_arbiters[1U] = new CStreamArbiter("DMR Slot 1");
+	m_arbiters[2U] = new CStreamArbiter("DMR Slot 2");
 
 	m_id[0U] = id >> 24;
 	m_id[1U] = id >> 16;
@@ -93,19 +304,30 @@ m_beacon(false)
 
 	m_streamId[0U] = ::rand() + 1U;
 	m_streamId[1U] = ::rand() + 1U;
+
+	m_callTimer.setCallback([this] { callSilenceExpired(); });
 }
 
 CDMRNetwork::~CDMRNetwork()
 {
+	m_thread.stop();
+
+	for (std::vector<CDMRMaster*>::iterator it = m_masters.begin(); it != m_masters.end(); ++it)
+		delete *it;
+
 	delete m_delayBuffers[1U];
 	delete m_delayBuffers[2U];
 
+	delete m_arbiters[1U];
+	delete m_arbiters[2U];
+
 	delete[] m_buffer;
-	delete[] m_salt;
 	delete[] m_streamId;
+	delete[] m_lastHeader;
 	delete[] m_id;
 
 	delete[] m_delayBuffers;
+	delete[] m_arbiters;
 }
 
 void CDMRNetwork::setOptions(const std::string& options)
@@ -113,6 +335,48 @@ void CDMRNetwork::setOptions(const std::string& options)
 	m_options = options;
 }
 
+CDMRMaster* CDMRNetwork::addMaster(const in_addr& address, unsigned int port)
+{
+	CDMRMaster* master = new CDMRMaster(m_wheel, address, port);
+
+	master->m_retryTimer.setCallback([this, master] { retryExpired(*master); });
+	master->m_timeoutTimer.setCallback([this, master] { timeoutExpired(*master); });
+	master->m_silenceTimer.setCallback([this, master] { silenceExpired(*master); });
+
+	m_masters.push_back(master);
+
+	return master;
+}
+
+void CDMRNetwork::addStandby(const std::string& address, unsigned int port)
+{
+	assert(!address.empty());
+	assert(port > 0U);
+
+	in_addr addr = CUDPSocket::lookup(address);
+	if (addr.s_addr == INADDR_NONE)
+		return;
+
+	addMaster(addr, port);
+}
+
+void CDMRNetwork::setFailoverTime(unsigned int ms)
+{
+	m_failoverTime = ms;
+}
+
+void CDMRNetwork::setRealTime(unsigned int priority, int cpu, unsigned int busyPoll, bool ioUring)
+{
+	m_thread.setScheduling(priority, cpu);
+	m_thread.setIOUring(ioUring);
+	m_socket.setBusyPoll(busyPoll);
+}
+
+void CDMRNetwork::setTransport(CUDPTransport* transport)
+{
+	m_socket.setTransport(transport);
+}
+
 void CDMRNetwork::setConfig(const std::string& callsign, unsigned int rxFrequency, unsigned int txFrequency, unsigned int power, unsigned int colorCode, float latitude, float longitude, int height, const std::string& location, const std::string& description, const std::string& url)
 {
 	m_callsign    = callsign;
@@ -132,74 +396,177 @@ bool CDMRNetwork::open()
 {
 	LogMessage("DMR, Opening DMR Network");
 
-	m_status = WAITING_CONNECT;
-	m_timeoutTimer.stop();
-	m_retryTimer.start();
+	if (m_masters.size() > 1U) {
+		for (std::vector<CDMRMaster*>::const_iterator it = m_masters.begin() + 1U; it != m_masters.end(); ++it)
+			LogMessage("DMR, Standby master %s", (*it)->m_name.c_str());
+	}
+
+	m_active = NULL;
+
+	for (std::vector<CDMRMaster*>::iterator it = m_masters.begin(); it != m_masters.end(); ++it) {
+		(*it)->m_status = WAITING_CONNECT;
+		(*it)->m_timeoutTimer.stop();
+		(*it)->m_silenceTimer.stop();
+		reconnect(**it);
+	}
 
 	return true;
 }
 
-void CDMRNetwork::enable(bool enabled)
+void CDMRNetwork::handOver(CUpgrade& upgrade)
 {
-	m_enabled = enabled;
+	m_thread.detach();
+
+	// Only the active login is handed over, the standbys log in again
+	CDMRMaster* master = m_active != NULL ? m_active : m_masters.front();
+
+	uint32_t salt;
+	::memcpy(&salt, master->m_salt, sizeof(uint32_t));
+
+	upgrade.setFd("dmr", m_socket.getFd());
+	upgrade.set("dmr.master", master->m_name);
+	upgrade.set("dmr.id", (m_id[0U] << 24) | (m_id[1U] << 16) | (m_id[2U] << 8) | (m_id[3U] << 0));
+	upgrade.set("dmr.status", (unsigned long long)master->m_status);
+	upgrade.set("dmr.salt", salt);
+	upgrade.set("dmr.stream1", m_streamId[0U]);
+	upgrade.set("dmr.stream2", m_streamId[1U]);
+
+	m_handedOver = true;
 }
 
-bool CDMRNetwork::read(CDMRData& data)
+void CDMRNetwork::resume()
 {
-	if (m_status != RUNNING)
+	m_handedOver = false;
+
+	if (m_opened)
+		m_thread.attach();
+}
+
+bool CDMRNetwork::takeOver(CUpgrade& upgrade)
+{
+	int fd = upgrade.getFd("dmr");
+	if (fd < 0)
+		return open();
+
+	m_socket.setFd(fd);
+
+	CDMRMaster* master = NULL;
+	for (std::vector<CDMRMaster*>::const_iterator it = m_masters.begin(); it != m_masters.end(); ++it) {
+		if ((*it)->m_name == upgrade.get("dmr.master"))
+			master = *it;
+	}
+
+	unsigned int id = (m_id[0U] << 24) | (m_id[1U] << 16) | (m_id[2U] << 8) | (m_id[3U] << 0);
+
+	// Only a completed login is worth keeping
+	if (master == NULL || upgrade.getInt("dmr.id") != id || upgrade.getInt("dmr.status") != RUNNING) {
+		m_socket.close();
+		return open();
+	}
+
+	LogMessage("DMR, Taking over the login to the master %s", master->m_name.c_str());
+
+	if (!m_socket.open())
 		return false;
 
-	for (unsigned int slotNo = 1U; slotNo <= 2U; slotNo++) {
-		unsigned int length = 0U;
-		B_STATUS status = BS_NO_DATA;
+	m_thread.attach();
+	if (!m_thread.start())
+		return false;
 
-		status = m_delayBuffers[slotNo]->getData(m_buffer, length);
+	m_opened = true;
 
-		if (status != BS_NO_DATA) {
-			unsigned char seqNo = m_buffer[4U];
+	uint32_t salt = uint32_t(upgrade.getInt("dmr.salt"));
+	::memcpy(master->m_salt, &salt, sizeof(uint32_t));
 
-			unsigned int srcId = (m_buffer[5U] << 16) | (m_buffer[6U] << 8) | (m_buffer[7U] << 0);
+	m_streamId[0U] = uint32_t(upgrade.getInt("dmr.stream1"));
+	m_streamId[1U] = uint32_t(upgrade.getInt("dmr.stream2"));
 
-			unsigned int dstId = (m_buffer[8U] << 16) | (m_buffer[9U] << 8) | (m_buffer[10U] << 0);
+	// The others log in from scratch on the socket that was handed over
+	for (std::vector<CDMRMaster*>::iterator it = m_masters.begin(); it != m_masters.end(); ++it) {
+		(*it)->m_status = WAITING_CONNECT;
+		(*it)->m_timeoutTimer.stop();
+		if (*it != master)
+			reconnect(**it);
+	}
 
-			FLCO flco = (m_buffer[15U] & 0x40U) == 0x40U ? FLCO_USER_USER : FLCO_GROUP;
+	master->connected();
+	master->m_status = RUNNING;
+	master->m_timeoutTimer.start();
+	heard(*master);
+	startRetry(*master);
 
-			data.setSeqNo(seqNo);
-			data.setSlotNo(slotNo);
-			data.setSrcId(srcId);
-			data.setDstId(dstId);
-			data.setFLCO(flco);
-			data.setMissing(status == BS_MISSING);
+	m_active = master;
 
-			bool dataSync = (m_buffer[15U] & 0x20U) == 0x20U;
-			bool voiceSync = (m_buffer[15U] & 0x10U) == 0x10U;
+	return true;
+}
 
-			if (dataSync) {
-				unsigned char dataType = m_buffer[15U] & 0x0FU;
-				data.setData(m_buffer + 20U);
-				data.setDataType(dataType);
-				data.setN(0U);
-			} else if (voiceSync) {
-				data.setData(m_buffer + 20U);
-				data.setDataType(DT_VOICE_SYNC);
-				data.setN(0U);
-			} else {
-				unsigned char n = m_buffer[15U] & 0x0FU;
-				data.setData(m_buffer + 20U);
-				data.setDataType(DT_VOICE);
-				data.setN(n);
-			}
+void CDMRNetwork::enable(bool enabled)
+{
+	m_enabled = enabled;
+}
 
+bool CDMRNetwork::read(CDMRData& data)
+{
+	for (unsigned int slotNo = 1U; slotNo <= 2U; slotNo++) {
+		if (read(slotNo, data))
 			return true;
-		}
 	}
 
 	return false;
 }
 
+bool CDMRNetwork::read(unsigned int slotNo, CDMRData& data)
+{
+	assert(slotNo == 1U || slotNo == 2U);
+
+	if (!isConnected())
+		return false;
+
+	unsigned int length = 0U;
+	B_STATUS status = m_delayBuffers[slotNo]->getData(m_buffer, length);
+	if (status == BS_NO_DATA)
+		return false;
+
+	unsigned char seqNo = m_buffer[4U];
+
+	unsigned int srcId = (m_buffer[5U] << 16) | (m_buffer[6U] << 8) | (m_buffer[7U] << 0);
+
+	unsigned int dstId = (m_buffer[8U] << 16) | (m_buffer[9U] << 8) | (m_buffer[10U] << 0);
+
+	FLCO flco = (m_buffer[15U] & 0x40U) == 0x40U ? FLCO_USER_USER : FLCO_GROUP;
+
+	data.setSeqNo(seqNo);
+	data.setSlotNo(slotNo);
+	data.setSrcId(srcId);
+	data.setDstId(dstId);
+	data.setFLCO(flco);
+	data.setMissing(status == BS_MISSING);
+
+	bool dataSync = (m_buffer[15U] & 0x20U) == 0x20U;
+	bool voiceSync = (m_buffer[15U] & 0x10U) == 0x10U;
+
+	if (dataSync) {
+		unsigned char dataType = m_buffer[15U] & 0x0FU;
+		data.setData(m_buffer + 20U);
+		data.setDataType(dataType);
+		data.setN(0U);
+	} else if (voiceSync) {
+		data.setData(m_buffer + 20U);
+		data.setDataType(DT_VOICE_SYNC);
+		data.setN(0U);
+	} else {
+		unsigned char n = m_buffer[15U] & 0x0FU;
+		data.setData(m_buffer + 20U);
+		data.setDataType(DT_VOICE);
+		data.setN(n);
+	}
+
+	return true;
+}
+
 bool CDMRNetwork::write(const CDMRData& data)
 {
-	if (m_status != RUNNING)
+	if (!isConnected())
 		return false;
 
 	unsigned char buffer[HOMEBREW_DATA_PACKET_LENGTH];
@@ -267,12 +634,14 @@ bool CDMRNetwork::write(const CDMRData& data)
 	for (unsigned int i = 0U; i < count; i++)
 		write(buffer, HOMEBREW_DATA_PACKET_LENGTH);
 
+	callFrame(slotNo, dataType == DT_TERMINATOR_WITH_LC);
+
 	return true;
 }
 
 bool CDMRNetwork::writePosition(unsigned int id, const unsigned char* data)
 {
-	if (m_status != RUNNING)
+	if (!isConnected())
 		return false;
 
 	unsigned char buffer[20U];
@@ -292,7 +661,7 @@ bool CDMRNetwork::writePosition(unsigned int id, const unsigned char* data)
 
 bool CDMRNetwork::writeTalkerAlias(unsigned int id, unsigned char type, const unsigned char* data)
 {
-	if (m_status != RUNNING)
+	if (!isConnected())
 		return false;
 
 	unsigned char buffer[20U];
@@ -316,160 +685,395 @@ void CDMRNetwork::close()
 {
 	LogMessage("DMR, Closing DMR Network");
 
-	if (m_status == RUNNING) {
-		unsigned char buffer[9U];
-		::memcpy(buffer + 0U, "RPTCL", 5U);
-		::memcpy(buffer + 5U, m_id, 4U);
-		write(buffer, 9U);
-	}
+	for (std::vector<CDMRMaster*>::iterator it = m_masters.begin(); it != m_masters.end(); ++it) {
+		CDMRMaster* master = *it;
 
-	m_socket.close();
-
-	m_retryTimer.stop();
-	m_timeoutTimer.stop();
-}
+		// The new process of an upgrade carries on with the active login
+		if (master->m_status == RUNNING && !(m_handedOver && master == m_active)) {
+			unsigned char buffer[9U];
+			::memcpy(buffer + 0U, "RPTCL", 5U);
+			::memcpy(buffer + 5U, m_id, 4U);
+			write(*master, buffer, 9U);
+		}
 
-void CDMRNetwork::clock(unsigned int ms)
-{
-	m_delayBuffers[1U]->clock(ms);
-	m_delayBuffers[2U]->clock(ms);
+		master->m_status = WAITING_CONNECT;
+		master->m_retryTimer.stop();
+		master->m_timeoutTimer.stop();
+		master->m_silenceTimer.stop();
+	}
 
-	if (m_status == WAITING_CONNECT) {
-		m_retryTimer.clock(ms);
-		if (m_retryTimer.isRunning() && m_retryTimer.hasExpired()) {
-			bool ret = m_socket.open();
-			if (ret) {
-				ret = writeLogin();
-				if (!ret)
-					return;
+	m_active = NULL;
 
-				m_status = WAITING_LOGIN;
-				m_timeoutTimer.start();
-			}
+	m_callTimer.stop();
+	m_calls = 0U;
 
-			m_retryTimer.start();
-		}
+	closeSocket();
+}
 
+void CDMRNetwork::clock()
+{
+	if (!m_opened)
 		return;
-	}
 
-	in_addr address;
-	unsigned int port;
-	int length = m_socket.read(m_buffer, BUFFER_LENGTH, address, port);
-	if (length < 0) {
+	if (m_thread.hasFailed()) {
 		LogError("DMR, Socket has failed, retrying connection to the master");
 		close();
 		open();
 		return;
 	}
 
-	// if (m_debug && length > 0)
-	//	CUtils::dump(1U, "Network Received", m_buffer, length);
+	CUDPDatagram datagram;
+	while (m_opened && m_thread.read(datagram)) {
+		CDMRMaster* master = NULL;
+		for (std::vector<CDMRMaster*>::const_iterator it = m_masters.begin(); it != m_masters.end(); ++it) {
+			if ((*it)->m_address.s_addr == datagram.m_address.s_addr && (*it)->m_port == datagram.m_port) {
+				master = *it;
+				break;
+			}
+		}
+
+		if (master == NULL || master->m_status == WAITING_CONNECT)
+			continue;
+
+		unsigned int length = datagram.m_length;
+		::memcpy(m_buffer, datagram.m_data, length);
+
+		// if (m_debug)
+		//	CUtils::dump(1U, "Network Received", m_buffer, length);
 
-	if (length > 0 && m_address.s_addr == address.s_addr && m_port == port) {
 		if (::memcmp(m_buffer, "DMRD", 4U) == 0) {
-			if (m_enabled) {
+			heard(*master);
+
+			// A standby is only listened to once the traffic moves to it
+			if (m_enabled && master == m_active) {
 				if (m_debug)
 					CUtils::dump(1U, "Network Received", m_buffer, length);
 				receiveData(m_buffer, length);
+
+				bool end = (m_buffer[15U] & 0x20U) == 0x20U && (m_buffer[15U] & 0x0FU) == DT_TERMINATOR_WITH_LC;
+				callFrame((m_buffer[15U] & 0x80U) == 0x80U ? 2U : 1U, end);
 			}
 		} else if (::memcmp(m_buffer, "MSTNAK",  6U) == 0) {
-			if (m_status == RUNNING) {
-				LogWarning("DMR, Login to the master has failed, retrying login ...");
-				m_status = WAITING_LOGIN;
-				m_timeoutTimer.start();
-				m_retryTimer.start();
+			if (master->m_status == RUNNING) {
+				LogWarning("DMR, Login to the master %s has failed, retrying login ...", master->m_name.c_str());
+				writeLogin(*master);
+				master->stepSent(false);
+				master->m_status = WAITING_LOGIN;
+				master->m_silenceTimer.stop();
+				master->m_timeoutTimer.start();
+				startRetry(*master);
+
+				if (master == m_active)
+					failOver("the login was refused");
 			} else {
 				/* Once the modem death spiral has been prevented in Modem.cpp
 				   the Network sometimes times out and reaches here.
 				   We want it to reconnect so... */
-				LogError("DMR, Login to the master has failed, retrying network ...");
-				close();
-				open();
-				return;
+				LogError("DMR, Login to the master %s has failed, retrying network ...", master->m_name.c_str());
+				restart(*master, "the login was refused");
 			}
 		} else if (::memcmp(m_buffer, "RPTACK",  6U) == 0) {
-			switch (m_status) {
+			if (master->m_status != RUNNING)
+				master->stepAnswered();
+
+			switch (master->m_status) {
 				case WAITING_LOGIN:
 					LogDebug("DMR, Sending authorisation");
-					::memcpy(m_salt, m_buffer + 6U, sizeof(uint32_t));
-					writeAuthorisation();
-					m_status = WAITING_AUTHORISATION;
-					m_timeoutTimer.start();
-					m_retryTimer.start();
+					::memcpy(master->m_salt, m_buffer + 6U, sizeof(uint32_t));
+					writeAuthorisation(*master);
+					master->stepSent(false);
+					master->m_status = WAITING_AUTHORISATION;
+					master->m_timeoutTimer.start();
+					startRetry(*master);
 					break;
 				case WAITING_AUTHORISATION:
 					LogDebug("DMR, Sending configuration");
-					writeConfig();
-					m_status = WAITING_CONFIG;
-					m_timeoutTimer.start();
-					m_retryTimer.start();
+					writeConfig(*master);
+					master->stepSent(false);
+					master->m_status = WAITING_CONFIG;
+					master->m_timeoutTimer.start();
+					startRetry(*master);
 					break;
 				case WAITING_CONFIG:
 					if (m_options.empty()) {
-						LogMessage("DMR, Logged into the master successfully");
-						m_status = RUNNING;
+						loggedIn(*master);
 					} else {
 						LogDebug("DMR, Sending options");
-						writeOptions();
-						m_status = WAITING_OPTIONS;
+						writeOptions(*master);
+						master->stepSent(false);
+						master->m_status = WAITING_OPTIONS;
+						master->m_timeoutTimer.start();
+						startRetry(*master);
 					}
-					m_timeoutTimer.start();
-					m_retryTimer.start();
 					break;
 				case WAITING_OPTIONS:
-					LogMessage("DMR, Logged into the master successfully");
-					m_status = RUNNING;
-					m_timeoutTimer.start();
-					m_retryTimer.start();
+					loggedIn(*master);
 					break;
 				default:
 					break;
 			}
 		} else if (::memcmp(m_buffer, "MSTCL",   5U) == 0) {
-			LogError("DMR, Master is closing down");
-			close();
-			open();
+			LogError("DMR, Master %s is closing down", master->m_name.c_str());
+			restart(*master, "the master closed down");
 		} else if (::memcmp(m_buffer, "MSTPONG", 7U) == 0) {
-			m_timeoutTimer.start();
+			master->m_timeoutTimer.start();
+			master->pongReceived();
+			heard(*master);
 		} else if (::memcmp(m_buffer, "RPTSBKN", 7U) == 0) {
-			m_beacon = true;
+			if (master == m_active)
+				m_beacon = true;
 		} else {
 			CUtils::dump("Unknown packet from the master", m_buffer, length);
 		}
 	}
+}
 
-	m_retryTimer.clock(ms);
-	if (m_retryTimer.isRunning() && m_retryTimer.hasExpired()) {
-		switch (m_status) {
-			case WAITING_LOGIN:
-				writeLogin();
-				break;
-			case WAITING_AUTHORISATION:
-				writeAuthorisation();
-				break;
-			case WAITING_OPTIONS:
-				writeOptions();
-				break;
-			case WAITING_CONFIG:
-				writeConfig();
-				break;
-			case RUNNING:
-				writePing();
-				break;
-			default:
-				break;
-		}
+void CDMRNetwork::retryExpired(CDMRMaster& master)
+{
+	switch (master.m_status) {
+		case WAITING_CONNECT:
+			if (!m_opened && m_socket.open()) {
+				m_thread.attach();
+				m_thread.start();
+				m_opened = true;
+			}
 
-		m_retryTimer.start();
+			if (m_opened && writeLogin(master)) {
+				master.stepSent(false);
+				master.m_status = WAITING_LOGIN;
+				master.m_timeoutTimer.start();
+			}
+			break;
+		case WAITING_LOGIN:
+			writeLogin(master);
+			master.stepSent(true);
+			break;
+		case WAITING_AUTHORISATION:
+			writeAuthorisation(master);
+			master.stepSent(true);
+			break;
+		case WAITING_OPTIONS:
+			writeOptions(master);
+			master.stepSent(true);
+			break;
+		case WAITING_CONFIG:
+			writeConfig(master);
+			master.stepSent(true);
+			break;
+		case RUNNING:
+			writePing(master);
+			break;
+		default:
+			break;
 	}
 
-	m_timeoutTimer.clock(ms);
-	if (m_timeoutTimer.isRunning() && m_timeoutTimer.hasExpired()) {
-		LogError("DMR, Connection to the master has timed out, retrying connection");
-		close();
-		open();
+	startRetry(master);
+}
+
+void CDMRNetwork::startRetry(CDMRMaster& master)
+{
+	if (master.m_status == RUNNING && m_masters.size() > 1U && &master == m_active && isInCall())
+		master.m_retryTimer.start(0U, master.getCallPingTime());
+	else if (master.m_status == RUNNING && m_masters.size() > 1U)
+		master.m_retryTimer.start(0U, master.getPingTime(m_failoverTime));
+	else if (master.m_status == RUNNING)
+		master.m_retryTimer.start(10U);
+	else if (master.m_status == WAITING_CONNECT)
+		reconnect(master);
+	else
+		master.m_retryTimer.start(0U, master.getResendTime());
+}
+
+void CDMRNetwork::reconnect(CDMRMaster& master)
+{
+	unsigned int ms = master.nextAttempt();
+	if (ms > 1U)
+		LogMessage("DMR, Connecting to the master %s again in %u ms", master.m_name.c_str(), ms);
+
+	master.m_retryTimer.start(0U, ms);
+}
+
+void CDMRNetwork::timeoutExpired(CDMRMaster& master)
+{
+	LogError("DMR, Connection to the master %s has timed out, retrying connection", master.m_name.c_str());
+	restart(master, "the connection timed out");
+}
+
+void CDMRNetwork::silenceExpired(CDMRMaster& master)
+{
+	unsigned int ms = (unsigned int)((CStopWatch::monotonic() - master.m_lastHeard) / 1000ULL);
+
+	char reason[50U];
+	::sprintf(reason, "no answer for %u ms", ms);
+
+	LogWarning("DMR, Master %s has not answered for %u ms, retrying login", master.m_name.c_str(), ms);
+	restart(master, reason);
+}
+
+void CDMRNetwork::heard(CDMRMaster& master)
+{
+	master.m_lastHeard = CStopWatch::monotonic();
+
+	if (master.m_status == RUNNING && m_masters.size() > 1U)
+		master.m_silenceTimer.start(0U, master.getSilenceTime(m_failoverTime));
+
+	if (&master == m_active && isInCall())
+		m_callTimer.start(0U, master.getCallSilenceTime());
+}
+
+void CDMRNetwork::callSilenceExpired()
+{
+	if (m_active == NULL || !isInCall())
+		return;
+
+	// Only moved when there is somewhere to go, the master stays logged in
+	// and its pings decide whether it is lost
+	bool standby = false;
+	for (std::vector<CDMRMaster*>::const_iterator it = m_masters.begin(); it != m_masters.end(); ++it) {
+		if (*it != m_active && (*it)->m_status == RUNNING)
+			standby = true;
 	}
+
+	if (!standby)
+		return;
+
+	CDMRMaster* from = m_active;
+
+	unsigned int ms = (unsigned int)((CStopWatch::monotonic() - from->m_lastHeard) / 1000ULL);
+
+	char reason[50U];
+	::sprintf(reason, "no answer for %u ms during a call", ms);
+
+	LogWarning("DMR, Master %s has not answered for %u ms during a call", from->m_name.c_str(), ms);
+	failOver(reason);
+
+	// Back to the pings between calls
+	startRetry(*from);
+}
+
+void CDMRNetwork::callFrame(unsigned int slotNo, bool end)
+{
+	if (m_masters.size() == 1U || m_active == NULL)
+		return;
+
+	bool inCall = isInCall();
+
+	if (end)
+		m_calls &= ~(1U << slotNo);
+	else
+		m_calls |= 1U << slotNo;
+
+	m_callHeard = CStopWatch::monotonic();
+
+	// Onto the frame grid straight away rather than at the next idle ping,
+	// counting from when the master was last heard
+	if (!inCall && m_calls != 0U) {
+		unsigned int silence = m_active->getCallSilenceTime();
+		unsigned int ms      = (unsigned int)((m_callHeard - m_active->m_lastHeard) / 1000ULL);
+
+		m_callTimer.start(0U, ms < silence ? silence - ms : 1U);
+		startRetry(*m_active);
+	} else if (m_calls == 0U) {
+		m_callTimer.stop();
+	}
+}
+
+bool CDMRNetwork::isInCall()
+{
+	if (m_calls != 0U && CStopWatch::monotonic() - m_callHeard > CALL_TIMEOUT * 1000ULL) {
+		m_calls = 0U;
+		m_callTimer.stop();
+	}
+
+	return m_calls != 0U;
+}
+
+void CDMRNetwork::loggedIn(CDMRMaster& master)
+{
+	LogMessage("DMR, Logged into the master %s successfully", master.m_name.c_str());
+
+	master.connected();
+	master.m_status = RUNNING;
+	master.m_timeoutTimer.start();
+	startRetry(master);
+	heard(master);
+
+	if (m_active == NULL) {
+		m_active = &master;
+		if (m_masters.size() > 1U)
+			LogMessage("DMR, Master %s is active", master.m_name.c_str());
+	}
+}
+
+void CDMRNetwork::restart(CDMRMaster& master, const char* reason)
+{
+	assert(reason != NULL);
+
+	if (master.m_status == RUNNING) {
+		unsigned char buffer[9U];
+		::memcpy(buffer + 0U, "RPTCL", 5U);
+		::memcpy(buffer + 5U, m_id, 4U);
+		write(master, buffer, 9U);
+	}
+
+	master.m_status = WAITING_CONNECT;
+	master.m_timeoutTimer.stop();
+	master.m_silenceTimer.stop();
+	reconnect(master);
+
+	if (&master == m_active)
+		failOver(reason);
+
+	// With no other login left the socket is opened again, as it has always been
+	bool connecting = false;
+	for (std::vector<CDMRMaster*>::const_iterator it = m_masters.begin(); it != m_masters.end(); ++it) {
+		if ((*it)->m_status != WAITING_CONNECT)
+			connecting = true;
+	}
+
+	if (!connecting)
+		closeSocket();
+}
+
+void CDMRNetwork::failOver(const char* reason)
+{
+	assert(reason != NULL);
+	assert(m_active != NULL);
+
+	unsigned long long start = CStopWatch::monotonic();
+
+	CDMRMaster* from = m_active;
+	m_active = NULL;
+
+	for (std::vector<CDMRMaster*>::const_iterator it = m_masters.begin(); it != m_masters.end(); ++it) {
+		CDMRMaster* master = *it;
+		if (master == from || master->m_status != RUNNING)
+			continue;
+
+		if (m_active == NULL || master->getScore() < m_active->getScore())
+			m_active = master;
+	}
+
+	if (m_masters.size() == 1U)
+		return;
+
+	if (m_active == NULL) {
+		LogWarning("DMR, Master %s is lost, %s, and no standby is logged in", from->m_name.c_str(), reason);
+		m_callTimer.stop();
+		return;
+	}
+
+	// A call carries on through the new master on the frame grid
+	if (isInCall()) {
+		m_callTimer.start(0U, m_active->getCallSilenceTime());
+		startRetry(*m_active);
+	}
+
+	unsigned long long now = CStopWatch::monotonic();
+
+	LogMessage("DMR, Failed over from master %s to %s, %s, last heard %llu ms ago, switched in %llu us",
+		from->m_name.c_str(), m_active->m_name.c_str(), reason, (now - from->m_lastHeard) / 1000ULL, now - start);
+	LogMessage("DMR, Master %s has an rtt of %.1f ms and %u%% loss", m_active->m_name.c_str(), float(m_active->getRTT()) / 1000.0F, m_active->getLoss());
 }
 
 void CDMRNetwork::reset(unsigned int slotNo)
@@ -485,9 +1089,51 @@ void CDMRNetwork::reset(unsigned int slotNo)
 	}
 }
 
+void CDMRNetwork::endOfStream(unsigned int slotNo)
+{
+	assert(slotNo == 1U || slotNo == 2U);
+
+	if (!m_arbiters[slotNo]->isHeld()) {
+		reset(slotNo);
+		return;
+	}
+
+	if (slotNo == 1U)
+		m_streamId[0U] = ::rand() + 1U;
+	else
+		m_streamId[1U] = ::rand() + 1U;
+}
+
+void CDMRNetwork::setJitter(unsigned int jitter)
+{
+	m_delayBuffers[1U]->setJitter(jitter);
+	m_delayBuffers[2U]->setJitter(jitter);
+}
+
+void CDMRNetwork::setArbitration(ARB_POLICY policy, const std::vector<unsigned int>& priorityIds)
+{
+	m_arbiters[1U]->setPolicy(policy, priorityIds);
+	m_arbiters[2U]->setPolicy(policy, priorityIds);
+}
+
 bool CDMRNetwork::isConnected() const
 {
-	return m_status == RUNNING;
+	return m_active != NULL && m_active->m_status == RUNNING;
+}
+
+unsigned int CDMRNetwork::getRTT() const
+{
+	return isConnected() ? m_active->getRTT() : 0U;
+}
+
+bool CDMRNetwork::hasData() const
+{
+	return m_thread.hasData();
+}
+
+int CDMRNetwork::getFd() const
+{
+	return m_thread.getFd();
 }
 
 void CDMRNetwork::receiveData(const unsigned char* data, unsigned int length)
@@ -507,26 +1153,72 @@ void CDMRNetwork::receiveData(const unsigned char* data, unsigned int length)
 	if (slotNo == 2U && !m_slot2)
 		return;
 
+	// Only one stream at a time goes on to the delay buffer and the conversion
+	unsigned int streamId = (data[16U] << 24) | (data[17U] << 16) | (data[18U] << 8) | (data[19U] << 0);
+	unsigned int srcId    = (data[5U] << 16) | (data[6U] << 8) | (data[7U] << 0);
+	bool end = (data[15U] & 0x20U) == 0x20U && (data[15U] & 0x0FU) == DT_TERMINATOR_WITH_LC;
+
+	bool preempted;
+	if (!m_arbiters[slotNo]->accept(streamId, srcId, end, preempted))
+		return;
+
+	// What is queued belongs to the stream that lost the slot, it is replaced
+	// by a terminator so that its call ends before this one starts
+	if (preempted) {
+		m_delayBuffers[slotNo]->reset();
+		addTerminator(slotNo);
+	}
+
 	m_delayBuffers[slotNo]->addData(data, length);
 
+	::memcpy(m_lastHeader + slotNo * HOMEBREW_DATA_HEADER_LENGTH, data, HOMEBREW_DATA_HEADER_LENGTH);
 }
 
-bool CDMRNetwork::writeLogin()
+void CDMRNetwork::addTerminator(unsigned int slotNo)
+{
+	unsigned char buffer[HOMEBREW_DATA_PACKET_LENGTH];
+	::memset(buffer, 0x00U, HOMEBREW_DATA_PACKET_LENGTH);
+
+	// The stream, the source and the destination of the last frame queued
+	::memcpy(buffer, m_lastHeader + slotNo * HOMEBREW_DATA_HEADER_LENGTH, HOMEBREW_DATA_HEADER_LENGTH);
+	buffer[4U]++;
+	buffer[15U] = (buffer[15U] & 0xC0U) | 0x20U | DT_TERMINATOR_WITH_LC;
+
+	unsigned int srcId = (buffer[5U] << 16) | (buffer[6U] << 8) | (buffer[7U] << 0);
+	unsigned int dstId = (buffer[8U] << 16) | (buffer[9U] << 8) | (buffer[10U] << 0);
+	FLCO flco = (buffer[15U] & 0x40U) == 0x40U ? FLCO_USER_USER : FLCO_GROUP;
+
+	CDMRLC lc(flco, srcId, dstId);
+
+	CDMRFullLC fullLC;
+	fullLC.encode(lc, buffer + 20U, DT_TERMINATOR_WITH_LC);
+
+	CDMRSlotType slotType;
+	slotType.setColorCode(m_colorCode);
+	slotType.setDataType(DT_TERMINATOR_WITH_LC);
+	slotType.getData(buffer + 20U);
+
+	CSync::addDMRDataSync(buffer + 20U, m_duplex);
+
+	m_delayBuffers[slotNo]->addData(buffer, HOMEBREW_DATA_PACKET_LENGTH);
+}
+
+bool CDMRNetwork::writeLogin(CDMRMaster& master)
 {
 	unsigned char buffer[8U];
 
 	::memcpy(buffer + 0U, "RPTL", 4U);
 	::memcpy(buffer + 4U, m_id, 4U);
 
-	return write(buffer, 8U);
+	return write(master, buffer, 8U);
 }
 
-bool CDMRNetwork::writeAuthorisation()
+bool CDMRNetwork::writeAuthorisation(CDMRMaster& master)
 {
 	size_t size = m_password.size();
 
 	unsigned char* in = new unsigned char[size + sizeof(uint32_t)];
-	::memcpy(in, m_salt, sizeof(uint32_t));
+	::memcpy(in, master.m_salt, sizeof(uint32_t));
 	for (size_t i = 0U; i < size; i++)
 		in[i + sizeof(uint32_t)] = m_password.at(i);
 
@@ -539,10 +1231,10 @@ bool CDMRNetwork::writeAuthorisation()
 
 	delete[] in;
 
-	return write(out, 40U);
+	return write(master, out, 40U);
 }
 
-bool CDMRNetwork::writeOptions()
+bool CDMRNetwork::writeOptions(CDMRMaster& master)
 {
 	char buffer[300U];
 
@@ -550,10 +1242,10 @@ bool CDMRNetwork::writeOptions()
 	::memcpy(buffer + 4U, m_id, 4U);
 	::strcpy(buffer + 8U, m_options.c_str());
 
-	return write((unsigned char*)buffer, (unsigned int)m_options.length() + 8U);
+	return write(master, (unsigned char*)buffer, (unsigned int)m_options.length() + 8U);
 }
 
-bool CDMRNetwork::writeConfig()
+bool CDMRNetwork::writeConfig(CDMRMaster& master)
 {
 	const char* software;
 	char slots = '0';
@@ -624,17 +1316,19 @@ bool CDMRNetwork::writeConfig()
 		m_rxFrequency, m_txFrequency, power, m_colorCode, latitude, longitude, height, m_location.c_str(),
 		m_description.c_str(), slots, m_url.c_str(), m_version, software);
 
-	return write((unsigned char*)buffer, 302U);
+	return write(master, (unsigned char*)buffer, 302U);
 }
 
-bool CDMRNetwork::writePing()
+bool CDMRNetwork::writePing(CDMRMaster& master)
 {
 	unsigned char buffer[11U];
 
 	::memcpy(buffer + 0U, "RPTPING", 7U);
 	::memcpy(buffer + 7U, m_id, 4U);
 
-	return write(buffer, 11U);
+	master.pingSent();
+
+	return write(master, buffer, 11U);
 }
 
 bool CDMRNetwork::wantsBeacon()
@@ -654,13 +1348,26 @@ bool CDMRNetwork::write(const unsigned char* data, unsigned int length)
 	// if (m_debug)
 	//	CUtils::dump(1U, "Network Transmitted", data, length);
 
-	bool ret = m_socket.write(data, length, m_address, m_port);
-	if (!ret) {
-		LogError("DMR, Socket has failed when writing data to the master, retrying connection");
-		m_socket.close();
-		open();
+	if (m_active == NULL)
 		return false;
-	}
 
-	return true;
+	return write(*m_active, data, length);
+}
+
+bool CDMRNetwork::write(CDMRMaster& master, const unsigned char* data, unsigned int length)
+{
+	assert(data != NULL);
+	assert(length > 0U);
+
+	// Socket errors are reported back through m_thread.hasFailed()
+	return m_thread.write(data, length, master.m_address, master.m_port);
+}
+
+void CDMRNetwork::closeSocket()
+{
+	m_thread.detach();
+
+	m_socket.close();
+
+	m_opened = false;
 }
@@ -19,30 +19,122 @@
 #if !defined(DMRNetwork_H)
 #define	DMRNetwork_H
 
+#include "StreamArbiter.h"
 #include "DelayBuffer.h"
+#include "Upgrade.h"
 #include "UDPSocket.h"
-#include "Timer.h"
+#include "UDPThread.h"
+#include "TimerWheel.h"
 #include "DMRData.h"
 #include "Defines.h"
 
 #include <string>
+#include <vector>
 #include <cstdint>
 
+enum DMR_LOGIN_STATUS {
+	WAITING_CONNECT,
+	WAITING_LOGIN,
+	WAITING_AUTHORISATION,
+	WAITING_CONFIG,
+	WAITING_OPTIONS,
+	RUNNING
+};
+
+// One master the gateway logs into. With standbys every master stays
+// logged in, and the pings measure how quickly each of them answers
+class CDMRMaster {
+public:
+	CDMRMaster(CTimerWheel& wheel, const in_addr& address, unsigned int port);
+
+	in_addr            m_address;
+	unsigned int       m_port;
+	std::string        m_name;
+	DMR_LOGIN_STATUS   m_status;
+	unsigned char      m_salt[4U];
+	CWheelTimer        m_retryTimer;
+	CWheelTimer        m_timeoutTimer;
+	CWheelTimer        m_silenceTimer;		// Only with standbys
+	unsigned long long m_lastHeard;
+
+	void pingSent();
+	void pongReceived();
+
+	// A login step going out, again when resent, and its RPTACK
+	void stepSent(bool resend);
+	void stepAnswered();
+	// When to resend the current login step, in ms
+	unsigned int getResendTime() const;
+
+	// How long to wait before the next connection attempt, in ms, the
+	// first is straight away and the others back off
+	unsigned int nextAttempt();
+	// After a completed login
+	void connected();
+
+	// Smoothed round trip time in us, 0 before the first answer
+	unsigned int getRTT() const;
+	// Of the last 32 pings, in percent
+	unsigned int getLoss() const;
+	// Between pings and how long it may be silent, in ms, from the round
+	// trip time and the loss, and never more than the failover time allows
+	unsigned int getPingTime(unsigned int failoverTime) const;
+	unsigned int getSilenceTime(unsigned int failoverTime) const;
+	// The same for the active master during a call, on the frame grid when
+	// the round trip time allows
+	unsigned int getCallPingTime() const;
+	unsigned int getCallSilenceTime() const;
+	// Lower is better, for picking the master to fail over to
+	unsigned long long getScore() const;
+
+private:
+	unsigned long long m_pingTime;		// Of the ping not yet answered
+	unsigned int       m_rtt;
+	uint32_t           m_history;		// A set bit for each ping lost
+	unsigned int       m_pings;
+	unsigned long long m_stepTime;		// Of the login step not yet answered, 0 once resent
+	unsigned int       m_resends;		// Of the current login step
+	unsigned int       m_attempts;		// Connection attempts since the last login
+};
+
 class CDMRNetwork
 {
 public:
-	CDMRNetwork(const std::string& address, unsigned int port, unsigned int local, unsigned int id, const std::string& password, bool duplex, const char* version, bool debug, bool slot1, bool slot2, HW_TYPE hwType, unsigned int jitter);
+	CDMRNetwork(CTimerWheel& wheel, const std::string& address, unsigned int port, unsigned int local, unsigned int id, const std::string& password, bool duplex, const char* version, bool debug, bool slot1, bool slot2, HW_TYPE hwType, unsigned int jitter);
 	~CDMRNetwork();
 
 	void setOptions(const std::string& options);
 
+	// Another master to log into as a hot standby, traffic moves to the
+	// best of them once the active master has missed a few pings in a row,
+	// more when it has been losing them, and at most failoverTime ms after
+	// it was last heard, call before open()
+	void addStandby(const std::string& address, unsigned int port);
+	void setFailoverTime(unsigned int ms);
+
 	void setConfig(const std::string& callsign, unsigned int rxFrequency, unsigned int txFrequency, unsigned int power, unsigned int colorCode, float latitude, float longitude, int height, const std::string& location, const std::string& description, const std::string& url);
 
+	// Scheduling of the I/O thread, SO_BUSY_POLL time and the io_uring backend, call before open()
+	void setRealTime(unsigned int priority, int cpu, unsigned int busyPoll, bool ioUring);
+
+	// Use an in-memory transport instead of a socket, call before open()
+	void setTransport(CUDPTransport* transport);
+
 	bool open();
 
+	// Stops reading and passes the socket and the login to the new process
+	void handOver(CUpgrade& upgrade);
+	// Carries on after a failed hand over
+	void resume();
+	// Carries on with the login of the old process if it was to the same
+	// master, otherwise opens as usual
+	bool takeOver(CUpgrade& upgrade);
+
 	void enable(bool enabled);
 
 	bool read(CDMRData& data);
+	// Only the frames of one slot, when each slot has a bridge of its own
+	bool read(unsigned int slotNo, CDMRData& data);
 
 	bool write(const CDMRData& data);
 
@@ -52,44 +144,57 @@ public:
 
 	bool wantsBeacon();
 
-	void clock(unsigned int ms);
+	// Process the datagrams from the I/O thread, the login and keepalive timers run from the wheel
+	void clock();
 
 	void reset(unsigned int slotNo);
+	// The same after the end of a call on the slot, but the frames of a
+	// stream that has already taken the slot stay queued
+	void endOfStream(unsigned int slotNo);
+
+	void setJitter(unsigned int jitter);
+
+	// Which of the overlapping streams on a slot gets through
+	void setArbitration(ARB_POLICY policy, const std::vector<unsigned int>& priorityIds);
 
 	bool isConnected() const;
+	// Of the pings to the active master in us, 0 when not logged in
+	unsigned int getRTT() const;
 
 	void close();
 
+	int  getFd() const;
+
+	// Datagrams waiting for clock() or read(), without a system call
+	bool hasData() const;
+
 private: 
-	in_addr         m_address;
-	unsigned int    m_port;
+	std::vector<CDMRMaster*> m_masters;
+	CDMRMaster*     m_active;
+	CTimerWheel&    m_wheel;
+	unsigned int    m_failoverTime;
+	CWheelTimer     m_callTimer;		// Only with standbys, while a call goes through the active master
+	unsigned int    m_calls;			// A bit for each slot with a call
+	unsigned long long m_callHeard;		// The last frame of a call either way
+	bool            m_opened;
 	uint8_t*        m_id;
 	std::string     m_password;
 	bool            m_duplex;
 	const char*     m_version;
 	bool            m_debug;
 	CUDPSocket      m_socket;
+	CUDPThread      m_thread;
 	bool            m_enabled;
 	bool            m_slot1;
 	bool            m_slot2;
 	CDelayBuffer**  m_delayBuffers;
+	CStreamArbiter** m_arbiters;
 	HW_TYPE         m_hwType;
+	bool            m_handedOver;
 
-	enum STATUS {
-		WAITING_CONNECT,
-		WAITING_LOGIN,
-		WAITING_AUTHORISATION,
-		WAITING_CONFIG,
-		WAITING_OPTIONS,
-		RUNNING
-	};
-
-	STATUS         m_status;
-	CTimer         m_retryTimer;
-	CTimer         m_timeoutTimer;
 	unsigned char* m_buffer;
-	unsigned char* m_salt;
 	uint32_t*      m_streamId;
+	unsigned char* m_lastHeader;		// Of the last frame queued on each slot
 
 	std::string    m_options;
 
@@ -107,15 +212,37 @@ private:
 
 	bool           m_beacon;
 
-	bool writeLogin();
-	bool writeAuthorisation();
-	bool writeOptions();
-	bool writeConfig();
-	bool writePing();
+	bool writeLogin(CDMRMaster& master);
+	bool writeAuthorisation(CDMRMaster& master);
+	bool writeOptions(CDMRMaster& master);
+	bool writeConfig(CDMRMaster& master);
+	bool writePing(CDMRMaster& master);
 
 	bool write(const unsigned char* data, unsigned int length);
+	bool write(CDMRMaster& master, const unsigned char* data, unsigned int length);
+
+	void closeSocket();
+
+	void retryExpired(CDMRMaster& master);
+	void timeoutExpired(CDMRMaster& master);
+	void silenceExpired(CDMRMaster& master);
+	void callSilenceExpired();
+
+	void startRetry(CDMRMaster& master);
+	void reconnect(CDMRMaster& master);
+	void heard(CDMRMaster& master);
+	void loggedIn(CDMRMaster& master);
+	// Log in to the master again, moving the traffic off it first
+	void restart(CDMRMaster& master, const char* reason);
+	void failOver(const char* reason);
+	// A frame of a call to or from the active master
+	void callFrame(unsigned int slotNo, bool end);
+	bool isInCall();
+
+	CDMRMaster* addMaster(const in_addr& address, unsigned int port);
 
 	void receiveData(const unsigned char* data, unsigned int length);
+	void addTerminator(unsigned int slotNo);
 };
 
 #endif
@@ -0,0 +1,211 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "DMRTarget.h"
+#include "Defines.h"
+#include "Version.h"
+#include "Log.h"
+
+#include <cassert>
+#include <cstring>
+#include <cctype>
+
+// A few frames more than the catch up of the session
+const unsigned int TARGET_QUEUE_LENGTH = 16U;
+
+CDMRTarget::CDMRTarget(CTimerWheel& wheel, const CDMRTargetConf& conf, unsigned int id, unsigned int colorCode, unsigned int periodMS, unsigned int maxCatchUp, unsigned int jitter, bool debug) :
+m_name(conf.m_name),
+m_network(NULL),
+m_assembler(),
+m_pacer("DMR pacer " + conf.m_name, periodMS, maxCatchUp),
+m_frames(TARGET_QUEUE_LENGTH, "DMR target"),
+m_txQueue(64U, "DMR target egress"),
+m_slot(conf.m_slot),
+m_dstId(conf.m_dstId),
+m_flco(conf.m_pc ? FLCO_USER_USER : FLCO_GROUP),
+m_xlx(!conf.m_xlxModule.empty()),
+m_linked(false),
+m_inCall(false),
+m_fd(-1)
+{
+	if (m_slot != 1U && m_slot != 2U)
+		m_slot = 2U;
+
+	if (m_xlx) {
+		m_dstId = 4000U + ::toupper(conf.m_xlxModule[0U]) - 64U;
+		m_flco  = FLCO_GROUP;
+	}
+
+	// Slot 2 alone logs in as a simplex hotspot, slot 1 as a duplex repeater
+	m_network = new CDMRNetwork(wheel, conf.m_address, conf.m_port, conf.m_local, id, conf.m_password, m_slot == 1U, VERSION, debug, m_slot == 1U, m_slot == 2U, HWT_MMDVM, jitter);
+
+	if (!conf.m_options.empty())
+		m_network->setOptions(conf.m_options);
+
+	m_assembler.setSlot(m_slot);
+	m_assembler.setColorCode(colorCode);
+}
+
+CDMRTarget::~CDMRTarget()
+{
+	delete m_network;
+}
+
+CDMRNetwork& CDMRTarget::getNetwork()
+{
+	return *m_network;
+}
+
+bool CDMRTarget::open()
+{
+	m_linked = false;
+
+	// Left disabled, so that the calls from the master are dropped as they arrive
+	return m_network->open();
+}
+
+void CDMRTarget::close()
+{
+	m_network->close();
+
+	m_linked = false;
+	m_inCall = false;
+
+	CDMRTargetFrame frame;
+	while (m_frames.pop(frame))
+		;
+
+	CDMRData data;
+	while (m_txQueue.pop(data))
+		;
+}
+
+void CDMRTarget::watch(CEventLoop& loop)
+{
+	if (m_network->getFd() != m_fd) {
+		m_fd = m_network->getFd();
+		loop.watch(m_fd);
+	}
+}
+
+void CDMRTarget::unwatch(CEventLoop& loop)
+{
+	loop.unwatch(m_fd);
+	m_fd = -1;
+}
+
+bool CDMRTarget::put(unsigned int tag, const CTaggedFrame<9U>* const* frames, unsigned int srcId)
+{
+	assert(frames != NULL);
+
+	CDMRTargetFrame item;
+	item.m_tag   = tag;
+	item.m_srcId = srcId;
+
+	unsigned int n = tag == TAG_DATA ? 3U : 1U;
+	for (unsigned int i = 0U; i < n; i++)
+		item.m_frames[i] = *frames[i];
+
+	return m_frames.push(item);
+}
+
+void CDMRTarget::clock()
+{
+	m_network->clock();
+
+	// Each call is paced from its first frame on this target's own schedule
+	if (!m_inCall) {
+		if (m_frames.isEmpty())
+			return;
+
+		m_pacer.start();
+		m_inCall = true;
+	}
+
+	// A frame is only made into bursts when the egress queue can take them all
+	while (m_inCall && m_pacer.isDue() && m_txQueue.hasSpace(DMR_ASSEMBLER_BURSTS)) {
+		CDMRTargetFrame frame;
+		if (!m_frames.pop(frame)) {
+			m_pacer.skip();
+			continue;
+		}
+
+		if (frame.m_tag == TAG_HEADER)
+			m_network->reset(m_slot);
+
+		const CTaggedFrame<9U>* frames[3U] = { &frame.m_frames[0U], &frame.m_frames[1U], &frame.m_frames[2U] };
+		m_assembler.assemble(frame.m_tag, frames, frame.m_srcId, m_dstId, m_flco, m_txQueue);
+
+		m_pacer.next();
+
+		if (frame.m_tag == TAG_EOT) {
+			m_pacer.logStats();
+			m_inCall = false;
+		}
+	}
+
+	CDMRData data;
+	while (m_txQueue.pop(data))
+		m_network->write(data);
+}
+
+bool CDMRTarget::isLinkDue()
+{
+	if (!m_xlx)
+		return false;
+
+	if (!m_network->isConnected()) {
+		m_linked = false;
+		return false;
+	}
+
+	if (m_linked)
+		return false;
+
+	m_linked = true;
+
+	return true;
+}
+
+unsigned int CDMRTarget::getDstId() const
+{
+	return m_dstId;
+}
+
+unsigned long long CDMRTarget::getDeadline() const
+{
+	if (!m_inCall && m_frames.isEmpty())
+		return ~0ULL;
+
+	return m_pacer.getDeadline();
+}
+
+bool CDMRTarget::hasData() const
+{
+	return m_network->hasData();
+}
+
+bool CDMRTarget::isIdle() const
+{
+	return !m_inCall && m_frames.isEmpty() && m_txQueue.isEmpty();
+}
+
+const std::string& CDMRTarget::getName() const
+{
+	return m_name;
+}
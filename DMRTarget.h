@@ -0,0 +1,96 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(DMRTARGET_H)
+#define	DMRTARGET_H
+
+#include "DMRAssembler.h"
+#include "DMRNetwork.h"
+#include "FramePacer.h"
+#include "TimerWheel.h"
+#include "EventLoop.h"
+#include "SPSCQueue.h"
+#include "Conf.h"
+
+#include <string>
+
+class CDMRTargetFrame {
+public:
+	unsigned char    m_tag;
+	unsigned int     m_srcId;
+	CTaggedFrame<9U> m_frames[3U];
+};
+
+// One more master or reflector that is sent the calls from YSF. The session
+// converts each frame once and hands the AMBE to every target, which puts
+// its own LC and embedded data around it and paces it out over its own
+// login. Nothing is taken from the master but the login itself.
+class CDMRTarget {
+public:
+	CDMRTarget(CTimerWheel& wheel, const CDMRTargetConf& conf, unsigned int id, unsigned int colorCode, unsigned int periodMS, unsigned int maxCatchUp, unsigned int jitter, bool debug);
+	~CDMRTarget();
+
+	// Set up the login on it before open()
+	CDMRNetwork& getNetwork();
+
+	bool open();
+	void close();
+
+	// Adds the socket to the loop, only when it is new to it
+	void watch(CEventLoop& loop);
+	void unwatch(CEventLoop& loop);
+
+	// A frame from CModeConv::peekDMR() and the source of its call, false if
+	// the target is too far behind to take it. The AMBE is kept until the
+	// frame is due here, the ring slots are free again once this returns
+	bool put(unsigned int tag, const CTaggedFrame<9U>* const* frames, unsigned int srcId);
+
+	// Runs the login and sends the bursts that are due
+	void clock();
+
+	// True once for each login to an XLX reflector, the module is then to be linked
+	bool isLinkDue();
+
+	unsigned int getDstId() const;
+
+	unsigned long long getDeadline() const;
+
+	bool hasData() const;
+
+	// Nothing queued or being paced out
+	bool isIdle() const;
+
+	const std::string& getName() const;
+
+private:
+	std::string                 m_name;
+	CDMRNetwork*                m_network;
+	CDMRAssembler               m_assembler;
+	CFramePacer                 m_pacer;
+	CSPSCQueue<CDMRTargetFrame> m_frames;
+	CSPSCQueue<CDMRData>        m_txQueue;
+	unsigned int                m_slot;
+	unsigned int                m_dstId;
+	FLCO                        m_flco;
+	bool                        m_xlx;
+	bool                        m_linked;
+	bool                        m_inCall;
+	int                         m_fd;
+};
+
+#endif
@@ -64,4 +64,15 @@ enum B_STATUS {
 	BS_MISSING
 };
 
+enum ARB_POLICY {
+	ARB_HOLD,
+	ARB_PRIORITY,
+	ARB_LAST_HEARD
+};
+
+enum SHARD_KEY {
+	SHARD_ADDRESS,
+	SHARD_CALLSIGN
+};
+
 #endif
@@ -25,12 +25,12 @@
 #include <cassert>
 #include <cstring>
 
-CDelayBuffer::CDelayBuffer(const std::string& name, unsigned int blockSize, unsigned int blockTime, unsigned int jitterTime, bool debug) :
+CDelayBuffer::CDelayBuffer(CTimerWheel& wheel, const std::string& name, unsigned int blockSize, unsigned int blockTime, unsigned int jitterTime, bool debug) :
 m_name(name),
 m_blockSize(blockSize),
 m_blockTime(blockTime),
 m_debug(debug),
-m_timer(1000U, 0U, jitterTime),
+m_timer(wheel, 0U, jitterTime),
 m_stopWatch(),
 m_running(false),
 m_buffer(5000U, name.c_str()),
@@ -45,6 +45,8 @@ m_lastDataValid(false)
 
 	m_lastData = new unsigned char[m_blockSize];
 
+	m_timer.setCallback([this] { jitterExpired(); });
+
 	reset();
 }
 
@@ -147,13 +149,17 @@ void CDelayBuffer::reset()
 	m_running = false;
 }
 
-void CDelayBuffer::clock(unsigned int ms)
+void CDelayBuffer::setJitter(unsigned int jitterTime)
 {
-	m_timer.clock(ms);
-	if (m_timer.isRunning() && m_timer.hasExpired()) {
-		if (!m_running) {
-			m_stopWatch.start();
-			m_running = true;
-		}
+	assert(jitterTime > 0U);
+
+	m_timer.setTimeout(0U, jitterTime);
+}
+
+void CDelayBuffer::jitterExpired()
+{
+	if (!m_running) {
+		m_stopWatch.start();
+		m_running = true;
 	}
 }
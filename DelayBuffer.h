@@ -22,13 +22,13 @@
 #include "RingBuffer.h"
 #include "StopWatch.h"
 #include "Defines.h"
-#include "Timer.h"
+#include "TimerWheel.h"
 
 #include <string>
 
 class CDelayBuffer {
 public:
-	CDelayBuffer(const std::string& name, unsigned int blockSize, unsigned int blockTime, unsigned int jitterTime, bool debug);
+	CDelayBuffer(CTimerWheel& wheel, const std::string& name, unsigned int blockSize, unsigned int blockTime, unsigned int jitterTime, bool debug);
 	~CDelayBuffer();
 
 	bool addData(const unsigned char* data, unsigned int length);
@@ -37,14 +37,15 @@ public:
 
 	void reset();
 
-	void clock(unsigned int ms);
+	// Takes effect from the next stream
+	void setJitter(unsigned int jitterTime);
 
 private:
 	std::string  m_name;
 	unsigned int m_blockSize;
 	unsigned int m_blockTime;
 	bool         m_debug;
-	CTimer       m_timer;
+	CWheelTimer  m_timer;
 	CStopWatch   m_stopWatch;
 	bool         m_running;
 	CRingBuffer<unsigned char> m_buffer;
@@ -53,6 +54,8 @@ private:
 	unsigned char* m_lastData;
 	unsigned int   m_lastDataLength;
 	bool           m_lastDataValid;
+
+	void jitterExpired();
 };
 
 #endif
@@ -0,0 +1,228 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "EventLoop.h"
+#include "StopWatch.h"
+#include "Thread.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+const unsigned int MAX_EVENTS = 10U;
+
+CEventLoop::CEventLoop() :
+m_fd(-1),
+m_timerFds(),
+m_deadlines(),
+m_wakeups(0U)
+{
+}
+
+CEventLoop::~CEventLoop()
+{
+}
+
+bool CEventLoop::open()
+{
+#if defined(__linux__)
+	m_fd = ::epoll_create1(EPOLL_CLOEXEC);
+	if (m_fd < 0) {
+		LogError("Cannot create the epoll set, err: %d", errno);
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+void CEventLoop::watch(int fd)
+{
+#if defined(__linux__)
+	if (m_fd < 0 || fd < 0)
+		return;
+
+	// A closed socket leaves the set by itself, so adding it again after a
+	// reopen is the only case where this succeeds
+	struct epoll_event ev;
+	::memset(&ev, 0x00, sizeof(struct epoll_event));
+	ev.events  = EPOLLIN;
+	ev.data.fd = fd;
+
+	if (::epoll_ctl(m_fd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno != EEXIST)
+		LogError("Cannot add a socket to the epoll set, err: %d", errno);
+#endif
+}
+
+void CEventLoop::unwatch(int fd)
+{
+#if defined(__linux__)
+	if (m_fd < 0 || fd < 0)
+		return;
+
+	if (::epoll_ctl(m_fd, EPOLL_CTL_DEL, fd, NULL) < 0 && errno != ENOENT)
+		LogError("Cannot remove a socket from the epoll set, err: %d", errno);
+#endif
+}
+
+int CEventLoop::addTimer()
+{
+	int timer = int(m_deadlines.size());
+
+	m_deadlines.push_back(0ULL);
+
+#if defined(__linux__)
+	// Without an epoll set nothing would wait on it
+	int fd = -1;
+	if (m_fd >= 0) {
+		fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (fd < 0)
+			LogError("Cannot create a timerfd, err: %d", errno);
+	}
+
+	m_timerFds.push_back(fd);
+
+	struct epoll_event ev;
+	::memset(&ev, 0x00, sizeof(struct epoll_event));
+	ev.events  = EPOLLIN;
+	ev.data.fd = fd;
+
+	if (m_fd >= 0 && fd >= 0 && ::epoll_ctl(m_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		LogError("Cannot add a timerfd to the epoll set, err: %d", errno);
+#endif
+
+	return timer;
+}
+
+void CEventLoop::setTimer(int timer, unsigned long long deadline)
+{
+	assert(timer >= 0 && (unsigned int)timer < m_deadlines.size());
+
+	if (m_deadlines[timer] == deadline)
+		return;
+
+	m_deadlines[timer] = deadline;
+
+#if defined(__linux__)
+	int fd = m_timerFds[timer];
+	if (fd < 0)
+		return;
+
+	// A zero it_value disarms the timer
+	if (deadline == 0ULL)
+		deadline = 1ULL;
+
+	struct itimerspec spec;
+	::memset(&spec, 0x00, sizeof(struct itimerspec));
+	if (deadline != NO_DEADLINE) {
+		spec.it_value.tv_sec  = deadline / 1000000ULL;
+		spec.it_value.tv_nsec = (deadline % 1000000ULL) * 1000ULL;
+	}
+
+	if (::timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+		LogError("Cannot set a timerfd, err: %d", errno);
+#endif
+}
+
+void CEventLoop::wait()
+{
+	m_wakeups++;
+
+#if defined(__linux__)
+	if (m_fd >= 0) {
+		struct epoll_event events[MAX_EVENTS];
+
+		int n = ::epoll_wait(m_fd, events, MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno != EINTR)
+				LogError("Error returned from epoll_wait, err: %d", errno);
+			return;
+		}
+
+		// Drain the fired timers so that they do not stay readable. They are one
+		// shot, so the count is at most one, and the callers tell what is due
+		// from their deadlines rather than from it
+		for (int i = 0; i < n; i++) {
+			for (std::vector<int>::const_iterator it = m_timerFds.begin(); it != m_timerFds.end(); ++it) {
+				if (events[i].data.fd == *it) {
+					uint64_t count;
+					if (::read(*it, &count, sizeof(uint64_t)) < 0 && errno != EAGAIN)
+						LogError("Error reading a timerfd, err: %d", errno);
+				}
+			}
+		}
+
+		return;
+	}
+#endif
+
+	// Sleep for up to 5 ms, less if a timer is due sooner
+	unsigned long long now = CStopWatch::monotonic();
+	unsigned long long delay = 5000ULL;
+	for (std::vector<unsigned long long>::const_iterator it = m_deadlines.begin(); it != m_deadlines.end(); ++it) {
+		if (*it <= now)
+			return;
+		if (*it - now < delay)
+			delay = *it - now;
+	}
+
+	CThread::sleep((unsigned int)((delay + 999ULL) / 1000ULL));
+}
+
+unsigned long long CEventLoop::getDeadline() const
+{
+	unsigned long long deadline = NO_DEADLINE;
+	for (std::vector<unsigned long long>::const_iterator it = m_deadlines.begin(); it != m_deadlines.end(); ++it) {
+		if (*it < deadline)
+			deadline = *it;
+	}
+
+	return deadline;
+}
+
+unsigned int CEventLoop::getWakeups() const
+{
+	return m_wakeups;
+}
+
+void CEventLoop::close()
+{
+#if defined(__linux__)
+	for (std::vector<int>::const_iterator it = m_timerFds.begin(); it != m_timerFds.end(); ++it) {
+		if (*it >= 0)
+			::close(*it);
+	}
+
+	if (m_fd >= 0)
+		::close(m_fd);
+
+	m_fd = -1;
+#endif
+
+	m_timerFds.clear();
+	m_deadlines.clear();
+}
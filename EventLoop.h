@@ -0,0 +1,66 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(EVENTLOOP_H)
+#define	EVENTLOOP_H
+
+#include <vector>
+
+// A deadline that never comes, setting it disarms the timer
+const unsigned long long NO_DEADLINE = 0xFFFFFFFFFFFFFFFFULL;
+
+// Waits for the network sockets and the frame deadlines. On Linux this is an
+// epoll set holding the socket fds and one timerfd per deadline, elsewhere it
+// falls back to the old 5 ms sleep.
+class CEventLoop {
+public:
+	CEventLoop();
+	~CEventLoop();
+
+	bool open();
+
+	// Add a socket to the set, safe to call again after the socket has been reopened
+	void watch(int fd);
+
+	// Take a socket that is still open out of the set
+	void unwatch(int fd);
+
+	// Add a one shot timer, returns its index
+	int  addTimer();
+
+	// Arm the timer for an absolute CStopWatch::monotonic() time, or NO_DEADLINE
+	void setTimer(int timer, unsigned long long deadline);
+
+	// Block until a watched socket is readable or a timer has fired
+	void wait();
+
+	// Earliest timer deadline, NO_DEADLINE if none is armed
+	unsigned long long getDeadline() const;
+
+	unsigned int getWakeups() const;
+
+	void close();
+
+private:
+	int                       m_fd;
+	std::vector<int>          m_timerFds;
+	std::vector<unsigned long long> m_deadlines;
+	unsigned int              m_wakeups;
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "FramePacer.h"
+#include "StopWatch.h"
+#include "Log.h"
+
+#include <cassert>
+
+CFramePacer::CFramePacer(const std::string& name, unsigned int periodMS, unsigned int maxCatchUp) :
+m_name(name),
+m_period(periodMS * 1000ULL),
+m_maxLate(maxCatchUp * periodMS * 1000ULL),
+m_t0(0ULL),
+m_n(0ULL),
+m_frames(0U),
+m_totalLateness(0ULL),
+m_maxLateness(0U),
+m_lateFrames(0U),
+m_resyncs(0U)
+{
+	assert(periodMS > 0U);
+
+	start();
+}
+
+CFramePacer::~CFramePacer()
+{
+}
+
+void CFramePacer::start()
+{
+	m_t0 = CStopWatch::monotonic();
+	m_n  = 0ULL;
+}
+
+bool CFramePacer::isDue() const
+{
+	return CStopWatch::monotonic() >= getDeadline();
+}
+
+unsigned long long CFramePacer::getDeadline() const
+{
+	return m_t0 + m_n * m_period;
+}
+
+void CFramePacer::next()
+{
+	unsigned long long now = CStopWatch::monotonic();
+	unsigned long long deadline = getDeadline();
+
+	unsigned int lateness = now > deadline ? (unsigned int)(now - deadline) : 0U;
+
+	m_frames++;
+	m_totalLateness += lateness;
+	if (lateness > m_maxLateness)
+		m_maxLateness = lateness;
+	if (lateness >= m_period)
+		m_lateFrames++;
+
+	advance();
+}
+
+void CFramePacer::skip()
+{
+	advance();
+}
+
+void CFramePacer::advance()
+{
+	m_n++;
+
+	// Too far behind to catch up, restart the schedule from now
+	unsigned long long now = CStopWatch::monotonic();
+	if (now > getDeadline() + m_maxLate) {
+		m_resyncs++;
+		m_t0 = now;
+		m_n  = 0ULL;
+	}
+}
+
+unsigned int CFramePacer::getFrames() const
+{
+	return m_frames;
+}
+
+unsigned int CFramePacer::getAverageLateness() const
+{
+	if (m_frames == 0U)
+		return 0U;
+
+	return (unsigned int)(m_totalLateness / m_frames);
+}
+
+unsigned int CFramePacer::getMaxLateness() const
+{
+	return m_maxLateness;
+}
+
+unsigned int CFramePacer::getResyncs() const
+{
+	return m_resyncs;
+}
+
+void CFramePacer::logStats()
+{
+	if (m_frames > 0U)
+		LogDebug("%s, %u frames, lateness avg %uus max %uus, %u over one period, %u resyncs", m_name.c_str(), m_frames, getAverageLateness(), m_maxLateness, m_lateFrames, m_resyncs);
+
+	resetStats();
+}
+
+void CFramePacer::resetStats()
+{
+	m_frames        = 0U;
+	m_totalLateness = 0ULL;
+	m_maxLateness   = 0U;
+	m_lateFrames    = 0U;
+	m_resyncs       = 0U;
+}
@@ -0,0 +1,70 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(FRAMEPACER_H)
+#define	FRAMEPACER_H
+
+#include <string>
+
+// Schedules frame N of a stream at t0 + N x period on the monotonic clock so
+// that the time spent between frames never accumulates as drift. After a
+// stall the missed frames are sent back to back, up to a limit, beyond which
+// the schedule is restarted from the current time.
+class CFramePacer {
+public:
+	CFramePacer(const std::string& name, unsigned int periodMS, unsigned int maxCatchUp);
+	~CFramePacer();
+
+	void start();
+
+	// True when the current frame deadline has been reached
+	bool isDue() const;
+
+	// Absolute deadline of the current frame in microseconds
+	unsigned long long getDeadline() const;
+
+	// A frame has been sent for the current deadline
+	void next();
+
+	// Nothing was available for the current deadline
+	void skip();
+
+	unsigned int getFrames() const;
+	unsigned int getAverageLateness() const;
+	unsigned int getMaxLateness() const;
+	unsigned int getResyncs() const;
+
+	void logStats();
+	void resetStats();
+
+private:
+	std::string        m_name;
+	unsigned long long m_period;
+	unsigned long long m_maxLate;
+	unsigned long long m_t0;
+	unsigned long long m_n;
+	unsigned int       m_frames;
+	unsigned long long m_totalLateness;
+	unsigned int       m_maxLateness;
+	unsigned int       m_lateFrames;
+	unsigned int       m_resyncs;
+
+	void advance();
+};
+
+#endif
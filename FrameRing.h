@@ -0,0 +1,132 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(FRAMERING_H)
+#define	FRAMERING_H
+
+#include "Log.h"
+
+#include <atomic>
+#include <cassert>
+
+// One AMBE frame with its tag and the monotonic time it was queued
+template<unsigned int LENGTH> class CTaggedFrame {
+public:
+	unsigned char      m_tag;
+	unsigned long long m_time;
+	unsigned char      m_data[LENGTH];
+};
+
+// Bounded queue of whole frames between one producer thread and one consumer
+// thread, which may be the same one. The length is rounded up to a power of
+// two. Frames are written and read where they lie in the ring, a frame is
+// only seen by the consumer once it has been committed, and a frame that
+// does not fit is dropped on its own.
+template<unsigned int LENGTH> class CFrameRing {
+public:
+	CFrameRing(unsigned int length, const char* name) :
+	m_length(1U),
+	m_name(name),
+	m_buffer(NULL),
+	m_head(0U),
+	m_tail(0U)
+	{
+		assert(length > 0U);
+		assert(name != NULL);
+
+		while (m_length < length)
+			m_length <<= 1;
+
+		m_buffer = new CTaggedFrame<LENGTH>[m_length];
+	}
+
+	~CFrameRing()
+	{
+		delete[] m_buffer;
+	}
+
+	// Producer side, the slot for the next frame for the caller to fill in
+	// and commit(), NULL when full
+	CTaggedFrame<LENGTH>* reserve(unsigned char tag, unsigned long long time)
+	{
+		if (!hasSpace(1U)) {
+			LogError("%s ring overflow, dropping a frame", m_name);
+			return NULL;
+		}
+
+		CTaggedFrame<LENGTH>* frame = &m_buffer[m_head.load(std::memory_order_relaxed) & (m_length - 1U)];
+		frame->m_tag  = tag;
+		frame->m_time = time;
+
+		return frame;
+	}
+
+	void commit()
+	{
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1U, std::memory_order_release);
+	}
+
+	bool hasSpace(unsigned int frames) const
+	{
+		return m_length - (m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire)) >= frames;
+	}
+
+	// Consumer side, the n'th oldest frame, NULL if there are not that many
+	const CTaggedFrame<LENGTH>* peek(unsigned int n = 0U) const
+	{
+		if (n >= dataSize())
+			return NULL;
+
+		return &m_buffer[(m_tail.load(std::memory_order_relaxed) + n) & (m_length - 1U)];
+	}
+
+	// The same for an n already checked against dataSize()
+	const CTaggedFrame<LENGTH>& at(unsigned int n) const
+	{
+		assert(n < dataSize());
+
+		return m_buffer[(m_tail.load(std::memory_order_relaxed) + n) & (m_length - 1U)];
+	}
+
+	// Drops the oldest frames once they have been read
+	void pop(unsigned int frames = 1U)
+	{
+		assert(frames <= dataSize());
+
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + frames, std::memory_order_release);
+	}
+
+	unsigned int dataSize() const
+	{
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+
+	bool isEmpty() const
+	{
+		return dataSize() == 0U;
+	}
+
+private:
+	unsigned int              m_length;
+	const char*               m_name;
+	CTaggedFrame<LENGTH>*     m_buffer;
+	std::atomic<unsigned int> m_head;
+	std::atomic<unsigned int> m_tail;
+};
+
+#endif
@@ -33,8 +33,8 @@ const unsigned char NULL_GPS[] = {0x47U, 0x63U};
 const unsigned char SHRT_GPS[] = {0x22U, 0x62U};
 const unsigned char LONG_GPS[] = {0x47U, 0x64U};
 
-CGPS::CGPS(const std::string& callsign, const std::string& suffix, const std::string& password, const std::string& address, unsigned int port) :
-m_writer(callsign, suffix, password, address, port),
+CGPS::CGPS(CTimerWheel& wheel, const std::string& callsign, const std::string& suffix, const std::string& password, const std::string& address, unsigned int port) :
+m_writer(wheel, callsign, suffix, password, address, port),
 m_buffer(NULL),
 m_sent(false)
 {
@@ -324,11 +324,6 @@ void CGPS::transmitGPS(const unsigned char* source)
 	m_sent = true;
 }
 
-void CGPS::clock(unsigned int ms)
-{
-	m_writer.clock(ms);
-}
-
 void CGPS::close()
 {
 	m_writer.close();
@@ -27,7 +27,7 @@
 
 class CGPS {
 public:
-	CGPS(const std::string& callsign, const std::string& suffix, const std::string& password, const std::string& address, unsigned int port);
+	CGPS(CTimerWheel& wheel, const std::string& callsign, const std::string& suffix, const std::string& password, const std::string& address, unsigned int port);
 	~CGPS();
 
 	void setInfo(unsigned int txFrequency, unsigned int rxFrequency, float latitude, float longitude, int height, const std::string& desc);
@@ -36,8 +36,6 @@ public:
 
 	void data(const unsigned char* source, const unsigned char* data, unsigned char fi, unsigned char dt, unsigned char fn, unsigned char ft, unsigned int tg_qrv);
 
-	void clock(unsigned int ms);
-
 	void reset();
 
 	void close();
@@ -0,0 +1,844 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "Gateway.h"
+#include "StallDetector.h"
+#include "EventLoop.h"
+#include "StopWatch.h"
+#include "Version.h"
+#include "Thread.h"
+#include "Log.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <unistd.h>
+#include <pwd.h>
+#endif
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <clocale>
+#include <thread>
+
+const char* HEADER1 = "This software is for use on amateur radio networks only,";
+const char* HEADER2 = "it is to be used for educational purposes only. Its use on";
+const char* HEADER3 = "commercial networks is strictly prohibited.";
+const char* HEADER4 = "Copyright(C) 2018,2019 by CA6JAU, EA7EE, G4KLX, AD8DP and others";
+
+// How long the new binary has to take over on an upgrade, in ms
+#define UPGRADE_TIMEOUT     10000U
+
+// How often the main loop looks at the workers when nothing else wakes it, in ms
+#define WORKER_CHECK        250U
+
+// Set by the signal handlers in YSF2DMR.cpp
+extern int end;
+extern int reload;
+extern int upgrade;
+
+CGateway::CGateway(const std::string& configFile) :
+m_configFile(configFile),
+m_conf(configFile),
+m_wheel(),
+m_simulation(NULL),
+m_argv(NULL),
+m_upgrade(NULL),
+m_daemon(false),
+m_lookup(NULL),
+m_APRS(NULL),
+m_reflectors(),
+m_sessions(),
+m_scheduled(),
+m_workers(),
+m_converter(NULL)
+{
+}
+
+CGateway::~CGateway()
+{
+	// Not taken over, the old process carries on
+	delete m_upgrade;
+}
+
+void CGateway::setSimulation(CSimulation* simulation)
+{
+	m_simulation = simulation;
+}
+
+void CGateway::setArguments(char** argv)
+{
+	m_argv = argv;
+}
+
+void CGateway::setUpgrade(CUpgrade* upgrade)
+{
+	m_upgrade = upgrade;
+}
+
+int CGateway::run()
+{
+	bool ret = m_conf.read();
+	if (!ret) {
+		::fprintf(stderr, "YSF2DMR: cannot read the .ini file\n");
+		return 1;
+	}
+
+	setlocale(LC_ALL, "C");
+
+	unsigned int logDisplayLevel = m_conf.getLogDisplayLevel();
+
+#if !defined(_WIN32) && !defined(_WIN64)
+	m_daemon = m_conf.getDaemon() && m_simulation == NULL;
+	if (m_daemon)
+		logDisplayLevel = 0U;
+
+	// The old process of an upgrade has done all this already
+	if (m_daemon && m_upgrade == NULL) {
+		// Create new process
+		pid_t pid = ::fork();
+		if (pid == -1) {
+			::fprintf(stderr, "Couldn't fork() , exiting\n");
+			return -1;
+		} else if (pid != 0)
+			exit(EXIT_SUCCESS);
+
+		// Create new session and process group
+		if (::setsid() == -1) {
+			::fprintf(stderr, "Couldn't setsid(), exiting\n");
+			return -1;
+		}
+
+		// Set the working directory to the root directory
+		if (::chdir("/") == -1) {
+			::fprintf(stderr, "Couldn't cd /, exiting\n");
+			return -1;
+		}
+
+		// If we are currently root...
+		if (getuid() == 0) {
+			struct passwd* user = ::getpwnam("mmdvm");
+			if (user == NULL) {
+				::fprintf(stderr, "Could not get the mmdvm user, exiting\n");
+				return -1;
+			}
+
+			uid_t mmdvm_uid = user->pw_uid;
+			gid_t mmdvm_gid = user->pw_gid;
+
+			// Set user and group ID's to mmdvm:mmdvm
+			if (setgid(mmdvm_gid) != 0) {
+				::fprintf(stderr, "Could not set mmdvm GID, exiting\n");
+				return -1;
+			}
+
+			if (setuid(mmdvm_uid) != 0) {
+				::fprintf(stderr, "Could not set mmdvm UID, exiting\n");
+				return -1;
+			}
+
+			// Double check it worked (AKA Paranoia) 
+			if (setuid(0) != -1) {
+				::fprintf(stderr, "It's possible to regain root - something is wrong!, exiting\n");
+				return -1;
+			}
+		}
+	}
+#endif
+
+	ret = ::LogInitialise(m_conf.getLogFilePath(), m_conf.getLogFileRoot(), m_conf.getLogFileLevel(), logDisplayLevel);
+	if (!ret) {
+		::fprintf(stderr, "YSF2DMR: unable to open the log file\n");
+		return 1;
+	}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (m_daemon && m_upgrade == NULL) {
+		::close(STDIN_FILENO);
+		::close(STDOUT_FILENO);
+		::close(STDERR_FILENO);
+	}
+#endif
+
+	LogInfo(HEADER1);
+	LogInfo(HEADER2);
+	LogInfo(HEADER3);
+	LogInfo(HEADER4);
+
+	std::vector<CConf> sessions = m_conf.getSessions();
+
+	// The scenario only has the one pair of networks
+	if (m_simulation != NULL && sessions.size() > 1U) {
+		::LogError("A simulation can only run one session");
+		::LogFinalise();
+		return 1;
+	}
+
+	m_lookup = new CDMRLookup(m_conf.getDMRIdLookupFile(), m_conf.getDMRIdLookupTime(), m_conf.getDMRIdLookupImage());
+	m_lookup->read();
+
+	createAPRS(sessions);
+
+	for (std::vector<CConf>::const_iterator it = sessions.begin(); it != sessions.end(); ++it)
+		createSession(*it);
+
+	// The owner of a shared login has to know both slots before logging in
+	if (!pairSessions(sessions)) {
+		close();
+		::LogFinalise();
+		return 1;
+	}
+
+	for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+		if (!openSession(*it)) {
+			close();
+			::LogFinalise();
+			return 1;
+		}
+	}
+
+	if (m_sessions.size() > 1U)
+		LogMessage("Running %u sessions", (unsigned int)m_sessions.size());
+
+	setRealTime();
+
+	// Before the sessions are first clocked, by the workers or below
+	if (!startConverter() || !startWorkers()) {
+		stopWorkers();
+		stopConverter();
+		close();
+		::LogFinalise();
+		return 1;
+	}
+
+	// A simulation only needs the loop to collect the deadlines
+	CEventLoop loop;
+	if (m_simulation == NULL) {
+		ret = loop.open();
+		if (!ret) {
+			::LogError("Cannot open the event loop");
+			close();
+			::LogFinalise();
+			return 1;
+		}
+	}
+
+	int clock = loop.addTimer();
+
+	LogMessage("Starting YSF2DMR-%s", VERSION);
+
+	CStallDetector stall(m_conf.getWatchdogLoopBudget());
+	stall.open(m_upgrade != NULL);
+
+	if (m_upgrade != NULL) {
+		m_upgrade->complete(true);
+		delete m_upgrade;
+		m_upgrade = NULL;
+	}
+
+	bool deferred = false;
+	bool upgraded = false;
+
+	for (; end == 0;) {
+		unsigned long long deadline = m_wheel.getDeadline();
+
+		if (m_workers.empty()) {
+			for (std::vector<CYSF2DMR*>::const_iterator it = m_scheduled.begin(); it != m_scheduled.end(); ++it) {
+				(*it)->watch(loop);
+
+				unsigned long long next = (*it)->getDeadline();
+				if (next < deadline)
+					deadline = next;
+			}
+		} else {
+			// Only the shared timers and the signals are left, but the workers need watching
+			unsigned long long check = CStopWatch::monotonic() + WORKER_CHECK * 1000ULL;
+			if (check < deadline)
+				deadline = check;
+		}
+
+		loop.setTimer(clock, deadline);
+
+		if (m_simulation != NULL) {
+			if (!m_simulation->advance(loop.getDeadline()))
+				break;
+		} else {
+			loop.wait();
+		}
+
+		stall.begin();
+
+		stall.stage("shared timers");
+		m_wheel.clock();
+
+		if (m_workers.empty()) {
+			for (std::vector<CYSF2DMR*>::const_iterator it = m_scheduled.begin(); it != m_scheduled.end(); ++it) {
+				::LogSetContext((*it)->getName().empty() ? NULL : (*it)->getName().c_str());
+				(*it)->clock(stall);
+			}
+
+			::LogSetContext(NULL);
+		} else {
+			// A stuck worker keeps the systemd watchdog from being fed
+			stall.stage("workers");
+			for (std::vector<CWorker*>::const_iterator it = m_workers.begin(); it != m_workers.end(); ++it) {
+				if ((*it)->isStalled())
+					stall.hold();
+			}
+		}
+
+		// Only reload or upgrade between calls so that no stream is cut short
+		if (reload != 0 || upgrade != 0) {
+			if (!pauseWorkers()) {
+				if (!deferred)
+					LogMessage("Waiting for the current call to end before the %s", reload != 0 ? "configuration reload" : "upgrade");
+				deferred = true;
+			} else {
+				deferred = false;
+
+				if (reload != 0) {
+					reload = 0;
+
+					stall.stage("configuration reload");
+					if (!reloadConfig())
+						break;
+
+					stall.setBudget(m_conf.getWatchdogLoopBudget());
+					for (std::vector<CWorker*>::const_iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+						(*it)->setBudget(m_conf.getWatchdogLoopBudget());
+				}
+
+				if (upgrade != 0) {
+					upgrade = 0;
+
+					stall.stage("upgrade");
+					if (handOver()) {
+						upgraded = true;
+						break;
+					}
+				}
+
+				resumeWorkers();
+			}
+		}
+
+		stall.end();
+	}
+
+	stopWorkers();
+	stopConverter();
+
+	::LogSetContext(NULL);
+
+	stall.logStats();
+
+	// The new process has told systemd it is the main one now
+	if (!upgraded)
+		stall.close();
+
+	if (m_simulation != NULL)
+		m_simulation->stop();
+	else
+		LogMessage("Event loop woke up %u times", loop.getWakeups());
+
+	loop.close();
+
+	close();
+
+	::LogFinalise();
+
+	return 0;
+}
+
+void CGateway::createSession(const CConf& conf)
+{
+	CYSF2DMR* session = new CYSF2DMR(conf);
+	session->setSimulation(m_simulation);
+	session->setLookup(m_lookup);
+	session->setReflectors(getReflectors(conf.getDMRXLXFile()));
+	session->setAPRS(conf.getAPRSEnabled() ? m_APRS : NULL);
+
+	m_sessions.push_back(session);
+}
+
+bool CGateway::pairSessions(const std::vector<CConf>& sessions)
+{
+	assert(sessions.size() == m_sessions.size());
+
+	m_scheduled.clear();
+
+	std::vector<bool> paired(sessions.size(), false);
+
+	for (unsigned int i = 0U; i < sessions.size(); i++) {
+		const CConf& conf = sessions[i];
+
+		if (conf.getDMRNetworkSlot() != 1U && conf.getDMRNetworkSlot() != 2U) {
+			LogError("Session %s: the Slot can only be 1 or 2", conf.getSessionName().c_str());
+			return false;
+		}
+
+		// The master only keeps one login per Id, so the same Id on the same
+		// master has to be the other slot of an earlier session
+		unsigned int j = 0U;
+		while (j < i && (sessions[j].getDMRNetworkAddress() != conf.getDMRNetworkAddress() ||
+			sessions[j].getDMRNetworkPort() != conf.getDMRNetworkPort() || sessions[j].getDMRId() != conf.getDMRId()))
+			j++;
+
+		if (j == i) {
+			m_scheduled.push_back(m_sessions[i]);
+			continue;
+		}
+
+		const CConf& owner = sessions[j];
+
+		if (paired[j] || owner.getDMRNetworkSlot() == conf.getDMRNetworkSlot()) {
+			LogError("Sessions %s and %s are both on slot %u of DMR Id %u", owner.getSessionName().c_str(), conf.getSessionName().c_str(),
+				conf.getDMRNetworkSlot(), conf.getDMRId());
+			return false;
+		}
+
+		if (!owner.getDMRXLXModule().empty() || !conf.getDMRXLXModule().empty()) {
+			LogError("Sessions %s and %s cannot share a login to an XLX reflector", owner.getSessionName().c_str(), conf.getSessionName().c_str());
+			return false;
+		}
+
+		m_sessions[j]->setPartner(m_sessions[i]);
+		paired[j] = true;
+		paired[i] = true;
+
+		LogMessage("Sessions %s and %s share the login of DMR Id %u, on slots %u and %u", owner.getSessionName().c_str(), conf.getSessionName().c_str(),
+			conf.getDMRId(), owner.getDMRNetworkSlot(), conf.getDMRNetworkSlot());
+	}
+
+	return true;
+}
+
+bool CGateway::openSession(CYSF2DMR* session)
+{
+	assert(session != NULL);
+
+	::LogSetContext(session->getName().empty() ? NULL : session->getName().c_str());
+
+	if (!session->getName().empty())
+		LogMessage("Opening the session");
+
+	// Each session hands over under its own name
+	if (m_upgrade != NULL)
+		m_upgrade->setScope(session->getName().empty() ? "" : session->getName() + ".");
+
+	bool ret = session->open(m_upgrade);
+
+	if (m_upgrade != NULL)
+		m_upgrade->setScope("");
+
+	::LogSetContext(NULL);
+
+	return ret;
+}
+
+CReflectors* CGateway::getReflectors(const std::string& fileName)
+{
+	std::map<std::string, CReflectors*>::const_iterator it = m_reflectors.find(fileName);
+	if (it != m_reflectors.end())
+		return it->second;
+
+	CReflectors* reflectors = new CReflectors(m_wheel, fileName, 60U);
+	reflectors->load();
+
+	m_reflectors[fileName] = reflectors;
+
+	return reflectors;
+}
+
+void CGateway::pruneReflectors()
+{
+	std::map<std::string, CReflectors*>::iterator it = m_reflectors.begin();
+	while (it != m_reflectors.end()) {
+		bool used = false;
+		for (std::vector<CYSF2DMR*>::const_iterator it2 = m_sessions.begin(); it2 != m_sessions.end(); ++it2) {
+			if ((*it2)->getReflectors() == it->second)
+				used = true;
+		}
+
+		if (used) {
+			++it;
+		} else {
+			delete it->second;
+			m_reflectors.erase(it++);
+		}
+	}
+}
+
+void CGateway::createAPRS(const std::vector<CConf>& sessions)
+{
+	// One aprs.fi cache for all, set up by the first session that wants it
+	for (std::vector<CConf>::const_iterator it = sessions.begin(); it != sessions.end(); ++it) {
+		if (it->getAPRSEnabled()) {
+			m_APRS = new CAPRSReader(it->getAPRSAPIKey(), it->getAPRSRefresh());
+			return;
+		}
+	}
+}
+
+bool CGateway::startConverter()
+{
+	if (!m_conf.getSchedulerConverter())
+		return true;
+
+	if (m_simulation != NULL) {
+		LogWarning("A simulation runs on the main loop, the converter is not used");
+		return true;
+	}
+
+	unsigned int priority = m_conf.getRealTimeEnabled() ? m_conf.getRealTimePriority() : 0U;
+	int cpu = m_conf.getRealTimeEnabled() ? m_conf.getRealTimeConverterCPU() : -1;
+
+	LogInfo("Converter Parameters");
+	LogInfo("    Converter CPU: %d", cpu);
+
+	m_converter = new CConvertThread;
+	m_converter->setScheduling(priority, cpu);
+
+	// The other slot of a shared login converts here too
+	for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+		(*it)->setConverter(m_converter);
+		m_converter->add(*it);
+	}
+
+	if (!m_converter->start()) {
+		LogError("Cannot start the converter");
+		return false;
+	}
+
+	return true;
+}
+
+void CGateway::stopConverter()
+{
+	if (m_converter == NULL)
+		return;
+
+	m_converter->stop();
+
+	for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it)
+		(*it)->setConverter(NULL);
+
+	delete m_converter;
+	m_converter = NULL;
+}
+
+bool CGateway::startWorkers()
+{
+	int workers = m_conf.getSchedulerWorkers();
+	if (workers < 0)
+		workers = int(std::thread::hardware_concurrency());
+
+	// More workers than sessions would have nothing to do
+	if (workers > int(m_scheduled.size()))
+		workers = int(m_scheduled.size());
+
+	if (workers <= 0)
+		return true;
+
+	if (m_simulation != NULL) {
+		LogWarning("A simulation runs on the main loop, the workers are not used");
+		return true;
+	}
+
+	unsigned int priority = m_conf.getRealTimeEnabled() ? m_conf.getRealTimePriority() : 0U;
+	int cpu = m_conf.getRealTimeEnabled() ? m_conf.getRealTimeWorkerCPU() : -1;
+
+	LogInfo("Scheduler Parameters");
+	LogInfo("    Workers: %d", workers);
+	LogInfo("    Balance: %u ms", m_conf.getSchedulerBalance());
+	if (cpu >= 0)
+		LogInfo("    Worker CPUs: %d to %d", cpu, cpu + workers - 1);
+
+	for (int i = 0; i < workers; i++) {
+		CWorker* worker = new CWorker(i + 1U, m_conf.getWatchdogLoopBudget(), m_conf.getSchedulerBalance());
+		worker->setScheduling(priority, cpu >= 0 ? cpu + i : -1);
+		m_workers.push_back(worker);
+	}
+
+	// Dealt out in turn, the balancing sorts out the rest
+	for (unsigned int i = 0U; i < m_scheduled.size(); i++)
+		m_workers[i % m_workers.size()]->add(m_scheduled[i]);
+
+	for (std::vector<CWorker*>::const_iterator it = m_workers.begin(); it != m_workers.end(); ++it) {
+		(*it)->setPeers(m_workers);
+
+		if (!(*it)->start()) {
+			LogError("Cannot start the workers");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CGateway::pauseWorkers()
+{
+	// Ask without stopping them first, most of the time one of them is in a call
+	for (std::vector<CWorker*>::const_iterator it = m_workers.begin(); it != m_workers.end(); ++it) {
+		if (!(*it)->isIdle())
+			return false;
+	}
+
+	for (std::vector<CWorker*>::const_iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+		(*it)->pause();
+
+	// A call may have started after they last looked
+	if (!isIdle()) {
+		resumeWorkers();
+		return false;
+	}
+
+	return true;
+}
+
+void CGateway::resumeWorkers()
+{
+	for (std::vector<CWorker*>::const_iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+		(*it)->resume();
+}
+
+void CGateway::stopWorkers()
+{
+	for (std::vector<CWorker*>::const_iterator it = m_workers.begin(); it != m_workers.end(); ++it) {
+		(*it)->stop();
+		delete *it;
+	}
+
+	m_workers.clear();
+}
+
+bool CGateway::isIdle() const
+{
+	for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+		if (!(*it)->isIdle())
+			return false;
+	}
+
+	return true;
+}
+
+bool CGateway::reloadConfig()
+{
+	CConf conf(m_configFile);
+	if (!conf.read()) {
+		LogError("Cannot read %s, keeping the current configuration", m_configFile.c_str());
+		return true;
+	}
+
+	CConf old = m_conf;
+	m_conf = conf;
+
+	if (conf.getLogFilePath() != old.getLogFilePath() || conf.getLogFileRoot() != old.getLogFileRoot() ||
+		conf.getLogFileLevel() != old.getLogFileLevel() || conf.getLogDisplayLevel() != old.getLogDisplayLevel()) {
+		unsigned int logDisplayLevel = m_daemon ? 0U : conf.getLogDisplayLevel();
+
+		::LogFinalise();
+		if (!::LogInitialise(conf.getLogFilePath(), conf.getLogFileRoot(), conf.getLogFileLevel(), logDisplayLevel))
+			::fprintf(stderr, "YSF2DMR: unable to open the log file\n");
+	}
+
+	LogMessage("Reloading the configuration from %s", m_configFile.c_str());
+
+	if (conf.getDaemon() != old.getDaemon() ||
+		conf.getRealTimeEnabled() != old.getRealTimeEnabled() || conf.getRealTimePriority() != old.getRealTimePriority() ||
+		conf.getRealTimeMainCPU() != old.getRealTimeMainCPU() || conf.getRealTimeLockMemory() != old.getRealTimeLockMemory() ||
+		conf.getRealTimeBusyPoll() != old.getRealTimeBusyPoll() || conf.getRealTimeIOUring() != old.getRealTimeIOUring())
+		LogWarning("The Daemon and RealTime settings only change on a restart");
+
+	if (conf.getDMRIdLookupFile() != old.getDMRIdLookupFile() || conf.getDMRIdLookupTime() != old.getDMRIdLookupTime() ||
+		conf.getDMRIdLookupImage() != old.getDMRIdLookupImage()) {
+		CDMRLookup* lookup = new CDMRLookup(conf.getDMRIdLookupFile(), conf.getDMRIdLookupTime(), conf.getDMRIdLookupImage());
+		lookup->read();
+
+		for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it)
+			(*it)->setLookup(lookup);
+
+		m_lookup->stop();
+		m_lookup = lookup;
+	}
+
+	std::vector<CConf> sessions    = conf.getSessions();
+	std::vector<CConf> oldSessions = old.getSessions();
+
+	// The cache is only rebuilt when the session that sets it up changes its settings
+	CAPRSReader* aprs = m_APRS;
+	m_APRS = NULL;
+	createAPRS(sessions);
+	if (m_APRS != NULL && aprs != NULL) {
+		CConf* next = NULL;
+		for (std::vector<CConf>::iterator it = sessions.begin(); it != sessions.end() && next == NULL; ++it) {
+			if (it->getAPRSEnabled())
+				next = &(*it);
+		}
+
+		CConf* prev = NULL;
+		for (std::vector<CConf>::iterator it = oldSessions.begin(); it != oldSessions.end() && prev == NULL; ++it) {
+			if (it->getAPRSEnabled())
+				prev = &(*it);
+		}
+
+		if (prev != NULL && next->getAPRSAPIKey() == prev->getAPRSAPIKey() && next->getAPRSRefresh() == prev->getAPRSRefresh()) {
+			m_APRS->stop();
+			delete m_APRS;
+			m_APRS = aprs;
+			aprs   = NULL;
+		}
+	}
+
+	for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+		CYSF2DMR* session = *it;
+
+		std::vector<CConf>::const_iterator it2 = sessions.begin();
+		while (it2 != sessions.end() && it2->getSessionName() != session->getName())
+			++it2;
+
+		if (it2 == sessions.end()) {
+			LogWarning("Session %s is no longer in the configuration, it stops on a restart", session->getName().c_str());
+			session->setAPRS(NULL);
+			continue;
+		}
+
+		::LogSetContext(session->getName().empty() ? NULL : session->getName().c_str());
+
+		session->setAPRS(it2->getAPRSEnabled() ? m_APRS : NULL);
+
+		bool ret = session->reloadConfig(*it2, getReflectors(it2->getDMRXLXFile()));
+
+		::LogSetContext(NULL);
+
+		if (!ret)
+			return false;
+	}
+
+	for (std::vector<CConf>::const_iterator it = sessions.begin(); it != sessions.end(); ++it) {
+		std::vector<CYSF2DMR*>::const_iterator it2 = m_sessions.begin();
+		while (it2 != m_sessions.end() && (*it2)->getName() != it->getSessionName())
+			++it2;
+
+		if (it2 == m_sessions.end())
+			LogWarning("Session %s is new, it starts on a restart", it->getSessionName().c_str());
+	}
+
+	if (aprs != NULL) {
+		aprs->stop();
+		delete aprs;
+	}
+
+	pruneReflectors();
+
+	LogMessage("Configuration reloaded");
+
+	return true;
+}
+
+bool CGateway::handOver()
+{
+	if (m_simulation != NULL || m_argv == NULL) {
+		LogWarning("Upgrades are not available in a simulation");
+		return false;
+	}
+
+	LogMessage("Upgrading, handing over to a new %s", m_argv[0U]);
+
+	CUpgrade upgrade;
+	if (!upgrade.start(m_argv))
+		return false;
+
+	for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+		upgrade.setScope((*it)->getName().empty() ? "" : (*it)->getName() + ".");
+		(*it)->handOver(upgrade);
+	}
+
+	upgrade.setScope("");
+
+	if (!upgrade.send(UPGRADE_TIMEOUT)) {
+		LogError("Upgrade failed, carrying on with this process");
+
+		for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it)
+			(*it)->resume();
+
+		return false;
+	}
+
+	LogMessage("The new process has taken over, exiting");
+
+	return true;
+}
+
+void CGateway::setRealTime()
+{
+	if (!m_conf.getRealTimeEnabled())
+		return;
+
+	unsigned int priority = m_conf.getRealTimePriority();
+	int mainCPU           = m_conf.getRealTimeMainCPU();
+	bool lockMemory       = m_conf.getRealTimeLockMemory();
+
+	LogInfo("Real Time Parameters");
+	LogInfo("    Priority: %u", priority);
+	LogInfo("    Main CPU: %d", mainCPU);
+	LogInfo("    YSF Network CPU: %d", m_conf.getRealTimeYSFNetworkCPU());
+	LogInfo("    DMR Network CPU: %d", m_conf.getRealTimeDMRNetworkCPU());
+	LogInfo("    Lock Memory: %s", lockMemory ? "yes" : "no");
+	LogInfo("    Busy Poll: %u us", m_conf.getRealTimeBusyPoll());
+	LogInfo("    io_uring: %s", m_conf.getRealTimeIOUring() ? "yes" : "no");
+
+	if (lockMemory)
+		CThread::lockMemory();
+
+	CThread::setAffinity(mainCPU);
+
+	if (priority > 0U)
+		CThread::setPriority(priority);
+}
+
+void CGateway::close()
+{
+	for (std::vector<CYSF2DMR*>::const_iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+		::LogSetContext((*it)->getName().empty() ? NULL : (*it)->getName().c_str());
+		(*it)->close();
+		delete *it;
+	}
+
+	::LogSetContext(NULL);
+
+	m_sessions.clear();
+	m_scheduled.clear();
+
+	if (m_APRS != NULL) {
+		m_APRS->stop();
+		delete m_APRS;
+		m_APRS = NULL;
+	}
+
+	if (m_lookup != NULL) {
+		m_lookup->stop();
+		m_lookup = NULL;
+	}
+
+	for (std::map<std::string, CReflectors*>::const_iterator it = m_reflectors.begin(); it != m_reflectors.end(); ++it)
+		delete it->second;
+
+	m_reflectors.clear();
+}
@@ -0,0 +1,99 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(GATEWAY_H)
+#define	GATEWAY_H
+
+#include "YSF2DMR.h"
+#include "APRSReader.h"
+#include "DMRLookup.h"
+#include "Reflectors.h"
+#include "Simulation.h"
+#include "TimerWheel.h"
+#include "ConvertThread.h"
+#include "Upgrade.h"
+#include "Worker.h"
+#include "Conf.h"
+
+#include <string>
+#include <vector>
+#include <map>
+
+// The process around the bridges: the daemon, the log, the event loop and
+// the signals. Each [Session] of the .ini file is one CYSF2DMR, they share
+// the DMR Id lookup, the XLX host lists and the aprs.fi cache, and two of
+// them can share a DMR login, one on each slot. The sessions
+// run on the main loop, or on worker threads when the Scheduler asks for
+// them, in which case the main loop only keeps the shared timers, the
+// signals and the watchdog. The AMBE conversion can have a thread of its own
+// as well.
+class CGateway
+{
+public:
+	CGateway(const std::string& configFile);
+	~CGateway();
+
+	// Run against a scenario instead of the network, call before run()
+	void setSimulation(CSimulation* simulation);
+
+	// The command line, to start the new binary on an upgrade
+	void setArguments(char** argv);
+
+	// Take over from the process being upgraded, call before run()
+	void setUpgrade(CUpgrade* upgrade);
+
+	int run();
+
+private:
+	std::string            m_configFile;
+	CConf                  m_conf;
+	CTimerWheel            m_wheel;
+	CSimulation*           m_simulation;
+	char**                 m_argv;
+	CUpgrade*              m_upgrade;
+	bool                   m_daemon;
+	CDMRLookup*            m_lookup;
+	CAPRSReader*           m_APRS;
+	std::map<std::string, CReflectors*> m_reflectors;
+	std::vector<CYSF2DMR*> m_sessions;
+	std::vector<CYSF2DMR*> m_scheduled;		// Less those clocked by the other slot of their login
+	std::vector<CWorker*>  m_workers;
+	CConvertThread*        m_converter;
+
+	void createSession(const CConf& conf);
+	// Sessions on the same master with the same Id become the two slots of one login
+	bool pairSessions(const std::vector<CConf>& sessions);
+	bool openSession(CYSF2DMR* session);
+	CReflectors* getReflectors(const std::string& fileName);
+	void pruneReflectors();
+	void createAPRS(const std::vector<CConf>& sessions);
+	bool startConverter();
+	void stopConverter();
+	bool startWorkers();
+	// False, with the workers carrying on, unless every session is between calls
+	bool pauseWorkers();
+	void resumeWorkers();
+	void stopWorkers();
+	bool isIdle() const;
+	bool reloadConfig();
+	bool handOver();
+	void setRealTime();
+	void close();
+};
+
+#endif
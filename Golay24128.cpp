@@ -1079,6 +1079,16 @@ unsigned int CGolay24128::encode24128(unsigned int data)
     return ENCODING_TABLE_24128[data];
 }
 
+const unsigned int* CGolay24128::getEncodingTable23127()
+{
+	return ENCODING_TABLE_23127;
+}
+
+const unsigned int* CGolay24128::getEncodingTable24128()
+{
+	return ENCODING_TABLE_24128;
+}
+
 unsigned int CGolay24128::decode23127(unsigned int code)
 {
 	unsigned int syndrome = ::get_syndrome_23127(code);
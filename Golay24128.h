@@ -27,6 +27,10 @@ public:
 	static unsigned int decode23127(unsigned int code);
 	static unsigned int decode24128(unsigned int code);
 	static unsigned int decode24128(unsigned char* bytes);
+
+	// The encodings of every data word, for looking many up at once
+	static const unsigned int* getEncodingTable23127();
+	static const unsigned int* getEncodingTable24128();
 };
 
 #endif
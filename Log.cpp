@@ -17,12 +17,8 @@
  */
 
 #include "Log.h"
-
-#if defined(_WIN32) || defined(_WIN64)
-#include <Windows.h>
-#else
-#include <sys/time.h>
-#endif
+#include "Clock.h"
+#include "Mutex.h"
 
 #include <cstdio>
 #include <cstdlib>
@@ -41,6 +37,11 @@ static unsigned int m_displayLevel = 2U;
 
 static struct tm m_tm;
 
+static thread_local const char* m_context = NULL;
+
+// The workers and the I/O threads log at the same time as the main thread
+static CMutex m_mutex;
+
 static char LEVELS[] = " DMIWEF";
 
 static bool LogOpen()
@@ -48,8 +49,7 @@ static bool LogOpen()
 	if (m_fileLevel == 0U)
 		return true;
 
-	time_t now;
-	::time(&now);
+	time_t now = time_t(CClock::get()->realtime() / 1000000ULL);
 
 	struct tm* tm = ::gmtime(&now);
 
@@ -76,17 +76,34 @@ static bool LogOpen()
 
 bool LogInitialise(const std::string& filePath, const std::string& fileRoot, unsigned int fileLevel, unsigned int displayLevel)
 {
+	m_mutex.lock();
+
 	m_filePath     = filePath;
 	m_fileRoot     = fileRoot;
 	m_fileLevel    = fileLevel;
 	m_displayLevel = displayLevel;
-    return ::LogOpen();
+	bool ret = ::LogOpen();
+
+	m_mutex.unlock();
+
+    return ret;
 }
 
 void LogFinalise()
 {
+	m_mutex.lock();
+
     if (m_fpLog != NULL)
         ::fclose(m_fpLog);
+
+    m_fpLog = NULL;
+
+	m_mutex.unlock();
+}
+
+void LogSetContext(const char* context)
+{
+	m_context = context;
 }
 
 void Log(unsigned int level, const char* fmt, ...)
@@ -94,19 +111,18 @@ void Log(unsigned int level, const char* fmt, ...)
     assert(fmt != NULL);
 
 	char buffer[300U];
-#if defined(_WIN32) || defined(_WIN64)
-	SYSTEMTIME st;
-	::GetSystemTime(&st);
 
-	::sprintf(buffer, "%c: %04u-%02u-%02u %02u:%02u:%02u.%03u ", LEVELS[level], st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
-#else
-	struct timeval now;
-	::gettimeofday(&now, NULL);
+	unsigned long long now = CClock::get()->realtime();
 
-	struct tm* tm = ::gmtime(&now.tv_sec);
+	m_mutex.lock();
 
-	::sprintf(buffer, "%c: %04d-%02d-%02d %02d:%02d:%02d.%03lu ", LEVELS[level], tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec, now.tv_usec / 1000U);
-#endif
+	time_t secs = time_t(now / 1000000ULL);
+	struct tm* tm = ::gmtime(&secs);
+
+	::sprintf(buffer, "%c: %04d-%02d-%02d %02d:%02d:%02d.%03u ", LEVELS[level], tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec, (unsigned int)((now / 1000ULL) % 1000ULL));
+
+	if (m_context != NULL)
+		::sprintf(buffer + ::strlen(buffer), "%s: ", m_context);
 
 	va_list vl;
 	va_start(vl, fmt);
@@ -117,8 +133,10 @@ void Log(unsigned int level, const char* fmt, ...)
 
 	if (level >= m_fileLevel && m_fileLevel != 0U) {
 		bool ret = ::LogOpen();
-		if (!ret)
+		if (!ret) {
+			m_mutex.unlock();
 			return;
+		}
 
 		::fprintf(m_fpLog, "%s\n", buffer);
 		::fflush(m_fpLog);
@@ -133,4 +151,6 @@ void Log(unsigned int level, const char* fmt, ...)
         ::fclose(m_fpLog);
         exit(1);
     }
+
+	m_mutex.unlock();
 }
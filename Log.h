@@ -33,4 +33,7 @@ extern void Log(unsigned int level, const char* fmt, ...);
 extern bool LogInitialise(const std::string& filePath, const std::string& fileRoot, unsigned int fileLevel, unsigned int displayLevel);
 extern void LogFinalise();
 
+// Prefixes what the calling thread logs, such as the name of a session, NULL for nothing
+extern void LogSetContext(const char* context);
+
 #endif
@@ -0,0 +1,319 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Compares the main loop before the event loop, which polled the sockets
+// and slept 5 ms at a time, with the one driven by epoll and a frame
+// deadline, over the loopback interface:
+//
+//   make loopbench && ./loopbench [seconds] [port]
+//
+// A peer thread sends one datagram per DMR frame, 60 ms apart with up to
+// 10 ms of network jitter, each carrying the time it was sent. Each loop
+// reads them and sends one frame out per frame period. The table has the
+// wakeups per second of each loop idle and with traffic, how long a
+// datagram waited to be read, how long it took to go out, and how far the
+// gaps between the frames out were from 60 ms. The old loop sends a frame
+// out as soon as it can, jitter and all, the event loop holds it for the
+// next slot of its frame grid, so its time to go out depends on where the
+// datagrams fall in that grid.
+
+#include "EventLoop.h"
+#include "FramePacer.h"
+#include "StopWatch.h"
+#include "UDPSocket.h"
+#include "Thread.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include <unistd.h>
+
+// As in the gateway before and after the event loop
+const unsigned int OLD_FRAME_PER = 55U;
+const unsigned int DMR_FRAME_PER = 60U;
+const unsigned int MAX_CATCH_UP  = 5U;
+
+const unsigned int SEND_JITTER_US = 10000U;
+
+class CBenchPeer : public CThread {
+public:
+	CBenchPeer(unsigned int port, unsigned int seconds) :
+	CThread(),
+	m_port(port),
+	m_seconds(seconds),
+	m_socket("127.0.0.1", port + 1U)
+	{
+	}
+
+	bool start()
+	{
+		if (!m_socket.open())
+			return false;
+
+		return run();
+	}
+
+	virtual void entry()
+	{
+		in_addr address = CUDPSocket::lookup("127.0.0.1");
+
+		unsigned long long start = CStopWatch::monotonic();
+		unsigned int frames = m_seconds * 1000U / DMR_FRAME_PER;
+
+		for (unsigned int n = 0U; n < frames; n++) {
+			unsigned long long time = start + n * DMR_FRAME_PER * 1000ULL + (unsigned int)::rand() % SEND_JITTER_US;
+			unsigned long long now = CStopWatch::monotonic();
+			if (time > now)
+				::usleep(useconds_t(time - now));
+
+			unsigned char buffer[8U];
+			now = CStopWatch::monotonic();
+			::memcpy(buffer, &now, 8U);
+			m_socket.write(buffer, 8U, address, m_port);
+		}
+
+		m_socket.close();
+	}
+
+private:
+	unsigned int m_port;
+	unsigned int m_seconds;
+	CUDPSocket   m_socket;
+};
+
+class CLoopResult {
+public:
+	CLoopResult() :
+	m_wakeups(0U),
+	m_reads(0U),
+	m_totalRead(0ULL),
+	m_maxRead(0U),
+	m_latencies(),
+	m_gaps(),
+	m_lastOut(0ULL)
+	{
+	}
+
+	unsigned int                    m_wakeups;
+	unsigned int                    m_reads;
+	unsigned long long              m_totalRead;
+	unsigned int                    m_maxRead;
+	std::vector<unsigned int>       m_latencies;
+	std::vector<unsigned int>       m_gaps;
+	unsigned long long              m_lastOut;
+};
+
+static void receive(CUDPSocket& socket, std::deque<unsigned long long>& queue, CLoopResult& result)
+{
+	for (;;) {
+		unsigned char buffer[100U];
+		in_addr address;
+		unsigned int port;
+		int len = socket.read(buffer, 100U, address, port);
+		if (len != 8)
+			return;
+
+		unsigned long long sent;
+		::memcpy(&sent, buffer, 8U);
+
+		unsigned int wait = (unsigned int)(CStopWatch::monotonic() - sent);
+		result.m_reads++;
+		result.m_totalRead += wait;
+		if (wait > result.m_maxRead)
+			result.m_maxRead = wait;
+
+		queue.push_back(sent);
+	}
+}
+
+static void send(std::deque<unsigned long long>& queue, CLoopResult& result)
+{
+	unsigned long long now = CStopWatch::monotonic();
+
+	result.m_latencies.push_back((unsigned int)(now - queue.front()));
+	queue.pop_front();
+
+	if (result.m_lastOut != 0ULL) {
+		unsigned int gap = (unsigned int)(now - result.m_lastOut);
+		result.m_gaps.push_back(gap > DMR_FRAME_PER * 1000U ? gap - DMR_FRAME_PER * 1000U : DMR_FRAME_PER * 1000U - gap);
+	}
+
+	result.m_lastOut = now;
+}
+
+// The loop before the event loop, a frame went out once the stopwatch of
+// the last one had passed the frame period
+static void runOld(CUDPSocket& socket, unsigned int seconds, CLoopResult& result)
+{
+	std::deque<unsigned long long> queue;
+
+	CStopWatch dmrWatch;
+	dmrWatch.start();
+
+	unsigned long long end = CStopWatch::monotonic() + seconds * 1000000ULL;
+
+	while (CStopWatch::monotonic() < end) {
+		result.m_wakeups++;
+
+		receive(socket, queue, result);
+
+		if (dmrWatch.elapsed() > OLD_FRAME_PER && !queue.empty()) {
+			send(queue, result);
+			dmrWatch.start();
+		}
+
+		CThread::sleep(5U);
+	}
+}
+
+// The event loop, woken by the socket or by the deadline of the next frame
+static bool runNew(CUDPSocket& socket, unsigned int seconds, CLoopResult& result)
+{
+	std::deque<unsigned long long> queue;
+
+	CEventLoop loop;
+	if (!loop.open())
+		return false;
+
+	loop.watch(socket.getFd());
+	int timer = loop.addTimer();
+
+	CFramePacer pacer("DMR pacer", DMR_FRAME_PER, MAX_CATCH_UP);
+	pacer.start();
+
+	unsigned long long end = CStopWatch::monotonic() + seconds * 1000000ULL;
+
+	while (CStopWatch::monotonic() < end) {
+		loop.setTimer(timer, pacer.getDeadline());
+		loop.wait();
+
+		receive(socket, queue, result);
+
+		while (pacer.isDue()) {
+			if (queue.empty()) {
+				pacer.skip();
+			} else {
+				send(queue, result);
+				pacer.next();
+			}
+		}
+	}
+
+	result.m_wakeups = loop.getWakeups();
+
+	loop.close();
+
+	return true;
+}
+
+static unsigned int percentile(std::vector<unsigned int> values, unsigned int percent)
+{
+	if (values.empty())
+		return 0U;
+
+	std::sort(values.begin(), values.end());
+
+	return values[(values.size() - 1U) * percent / 100U];
+}
+
+static unsigned int average(const std::vector<unsigned int>& values)
+{
+	if (values.empty())
+		return 0U;
+
+	unsigned long long total = 0ULL;
+	for (std::vector<unsigned int>::const_iterator it = values.begin(); it != values.end(); ++it)
+		total += *it;
+
+	return (unsigned int)(total / values.size());
+}
+
+static bool bench(bool event, bool traffic, unsigned int seconds, unsigned int port)
+{
+	CUDPSocket socket("127.0.0.1", port);
+	if (!socket.open())
+		return false;
+
+	CBenchPeer peer(port, seconds);
+	if (traffic && !peer.start()) {
+		socket.close();
+		return false;
+	}
+
+	CLoopResult result;
+	bool ok = true;
+	if (event)
+		ok = runNew(socket, seconds, result);
+	else
+		runOld(socket, seconds, result);
+
+	if (traffic)
+		peer.wait();
+
+	socket.close();
+
+	if (!ok)
+		return false;
+
+	unsigned int read = result.m_reads > 0U ? (unsigned int)(result.m_totalRead / result.m_reads) : 0U;
+
+	::fprintf(stdout, "%-12s %-8s %10.1f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+		event ? "epoll" : "5 ms sleep", traffic ? "60 ms" : "idle",
+		double(result.m_wakeups) / double(seconds),
+		double(read) / 1000.0, double(result.m_maxRead) / 1000.0,
+		double(average(result.m_latencies)) / 1000.0, double(percentile(result.m_latencies, 99U)) / 1000.0, double(percentile(result.m_latencies, 100U)) / 1000.0,
+		double(average(result.m_gaps)) / 1000.0, double(percentile(result.m_gaps, 100U)) / 1000.0);
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int seconds = 10U;
+	unsigned int port    = 42890U;
+
+	if (argc > 1)
+		seconds = (unsigned int)::atoi(argv[1]);
+	if (argc > 2)
+		port = (unsigned int)::atoi(argv[2]);
+
+	if (seconds == 0U || port == 0U) {
+		::fprintf(stderr, "Usage: loopbench [seconds] [port]\n");
+		return 1;
+	}
+
+	::LogInitialise(".", "loopbench", 0U, 4U);
+
+	::fprintf(stdout, "%-12s %-8s %10s %19s %29s %19s\n", "", "", "", "read (ms)", "in to out (ms)", "gap - 60 (ms)");
+	::fprintf(stdout, "%-12s %-8s %10s %9s %9s %9s %9s %9s %9s %9s\n", "loop", "traffic", "wakeups/s", "avg", "max", "avg", "p99", "max", "avg", "max");
+
+	bool ok = true;
+	ok = bench(false, false, seconds, port) && ok;
+	ok = bench(true,  false, seconds, port) && ok;
+	ok = bench(false, true,  seconds, port) && ok;
+	ok = bench(true,  true,  seconds, port) && ok;
+
+	::LogFinalise();
+
+	return ok ? 0 : 1;
+}
@@ -23,16 +23,19 @@
 #include "YSFConvolution.h"
 #include "CRC.h"
 #include "Utils.h"
+#include "StopWatch.h"
 
 #include "Log.h"
 
 #include <cstdio>
+#include <cstring>
 #include <cassert>
+#include <cstdint>
 
-const unsigned char BIT_MASK_TABLE[] = {0x80U, 0x40U, 0x20U, 0x10U, 0x08U, 0x04U, 0x02U, 0x01U};
-
-#define WRITE_BIT(p,i,b) p[(i)>>3] = (b) ? (p[(i)>>3] | BIT_MASK_TABLE[(i)&7]) : (p[(i)>>3] & ~BIT_MASK_TABLE[(i)&7])
-#define READ_BIT(p,i)    (p[(i)>>3] & BIT_MASK_TABLE[(i)&7])
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MODECONV_AVX2
+#endif
 
 const unsigned int PRNG_TABLE[] = {
 	0x42CC47U, 0x19D6FEU, 0x304729U, 0x6B2CD0U, 0x60BF47U, 0x39650EU, 0x7354F1U, 0xEACF60U, 0x819C9FU, 0xDE25CEU, 
@@ -446,30 +449,89 @@ const unsigned int PRNG_TABLE[] = {
 	0xECDB0FU, 0xB542DAU, 0x9E5131U, 0xC7ABA5U, 0x8C38FEU, 0x97010BU, 0xDED290U, 0xA4CC7DU, 0xAD3D2EU, 0xF6B6B3U, 
 	0xF9A540U, 0x205ED9U, 0x634EB6U, 0x5A9567U, 0x11A6D8U, 0x0B3F09U};
 
-const unsigned int DMR_A_TABLE[] = {0U,  4U,  8U, 12U, 16U, 20U, 24U, 28U, 32U, 36U, 40U, 44U,
-									48U, 52U, 56U, 60U, 64U, 68U,  1U,  5U,  9U, 13U, 17U, 21U};
-const unsigned int DMR_B_TABLE[] = {25U, 29U, 33U, 37U, 41U, 45U, 49U, 53U, 57U, 61U, 65U, 69U,
-									 2U,  6U, 10U, 14U, 18U, 22U, 26U, 30U, 34U, 38U, 42U};
-const unsigned int DMR_C_TABLE[] = {46U, 50U, 54U, 58U, 62U, 66U, 70U,  3U,  7U, 11U, 15U, 19U, 23U,
-									27U, 31U, 35U, 39U, 43U, 47U, 51U, 55U, 59U, 63U, 67U, 71U};
-
-const unsigned int INTERLEAVE_TABLE_26_4[] = {
-	0U, 4U,  8U, 12U, 16U, 20U, 24U, 28U, 32U, 36U, 40U, 44U, 48U, 52U, 56U, 60U, 64U, 68U, 72U, 76U, 80U, 84U, 88U, 92U, 96U, 100U,
-	1U, 5U,  9U, 13U, 17U, 21U, 25U, 29U, 33U, 37U, 41U, 45U, 49U, 53U, 57U, 61U, 65U, 69U, 73U, 77U, 81U, 85U, 89U, 93U, 97U, 101U,
-	2U, 6U, 10U, 14U, 18U, 22U, 26U, 30U, 34U, 38U, 42U, 46U, 50U, 54U, 58U, 62U, 66U, 70U, 74U, 78U, 82U, 86U, 90U, 94U, 98U, 102U,
-	3U, 7U, 11U, 15U, 19U, 23U, 27U, 31U, 35U, 39U, 43U, 47U, 51U, 55U, 59U, 63U, 67U, 71U, 75U, 79U, 83U, 87U, 91U, 95U, 99U, 103U};
-
-const unsigned char WHITENING_DATA[] = {0x93U, 0xD7U, 0x51U, 0x21U, 0x9CU, 0x2FU, 0x6CU, 0xD0U, 0xEFU, 0x0FU,
-										0xF8U, 0x3DU, 0xF1U, 0x73U, 0x20U, 0x94U, 0xEDU, 0x1EU, 0x7CU, 0xD8U};
+// A DMR AMBE frame of 72 bits and an interleaved YSF VCH of 104 bits are
+// both read as four lanes, bit 4k + r of the frame being bit k of lane r.
+// Every byte holds two bits of each lane, so a whole byte is moved in or
+// out of the lanes at a time, the two bits of lane 0 at the top of the
+// index. In a DMR frame the lanes one after the other are the A, B and C
+// words, and in a VCH they are the deinterleaved bits.
+const unsigned int GATHER_TABLE[] = {
+	0x00U, 0x01U, 0x04U, 0x05U, 0x10U, 0x11U, 0x14U, 0x15U, 0x40U, 0x41U, 0x44U, 0x45U, 0x50U, 0x51U, 0x54U, 0x55U,
+	0x02U, 0x03U, 0x06U, 0x07U, 0x12U, 0x13U, 0x16U, 0x17U, 0x42U, 0x43U, 0x46U, 0x47U, 0x52U, 0x53U, 0x56U, 0x57U,
+	0x08U, 0x09U, 0x0CU, 0x0DU, 0x18U, 0x19U, 0x1CU, 0x1DU, 0x48U, 0x49U, 0x4CU, 0x4DU, 0x58U, 0x59U, 0x5CU, 0x5DU,
+	0x0AU, 0x0BU, 0x0EU, 0x0FU, 0x1AU, 0x1BU, 0x1EU, 0x1FU, 0x4AU, 0x4BU, 0x4EU, 0x4FU, 0x5AU, 0x5BU, 0x5EU, 0x5FU,
+	0x20U, 0x21U, 0x24U, 0x25U, 0x30U, 0x31U, 0x34U, 0x35U, 0x60U, 0x61U, 0x64U, 0x65U, 0x70U, 0x71U, 0x74U, 0x75U,
+	0x22U, 0x23U, 0x26U, 0x27U, 0x32U, 0x33U, 0x36U, 0x37U, 0x62U, 0x63U, 0x66U, 0x67U, 0x72U, 0x73U, 0x76U, 0x77U,
+	0x28U, 0x29U, 0x2CU, 0x2DU, 0x38U, 0x39U, 0x3CU, 0x3DU, 0x68U, 0x69U, 0x6CU, 0x6DU, 0x78U, 0x79U, 0x7CU, 0x7DU,
+	0x2AU, 0x2BU, 0x2EU, 0x2FU, 0x3AU, 0x3BU, 0x3EU, 0x3FU, 0x6AU, 0x6BU, 0x6EU, 0x6FU, 0x7AU, 0x7BU, 0x7EU, 0x7FU,
+	0x80U, 0x81U, 0x84U, 0x85U, 0x90U, 0x91U, 0x94U, 0x95U, 0xC0U, 0xC1U, 0xC4U, 0xC5U, 0xD0U, 0xD1U, 0xD4U, 0xD5U,
+	0x82U, 0x83U, 0x86U, 0x87U, 0x92U, 0x93U, 0x96U, 0x97U, 0xC2U, 0xC3U, 0xC6U, 0xC7U, 0xD2U, 0xD3U, 0xD6U, 0xD7U,
+	0x88U, 0x89U, 0x8CU, 0x8DU, 0x98U, 0x99U, 0x9CU, 0x9DU, 0xC8U, 0xC9U, 0xCCU, 0xCDU, 0xD8U, 0xD9U, 0xDCU, 0xDDU,
+	0x8AU, 0x8BU, 0x8EU, 0x8FU, 0x9AU, 0x9BU, 0x9EU, 0x9FU, 0xCAU, 0xCBU, 0xCEU, 0xCFU, 0xDAU, 0xDBU, 0xDEU, 0xDFU,
+	0xA0U, 0xA1U, 0xA4U, 0xA5U, 0xB0U, 0xB1U, 0xB4U, 0xB5U, 0xE0U, 0xE1U, 0xE4U, 0xE5U, 0xF0U, 0xF1U, 0xF4U, 0xF5U,
+	0xA2U, 0xA3U, 0xA6U, 0xA7U, 0xB2U, 0xB3U, 0xB6U, 0xB7U, 0xE2U, 0xE3U, 0xE6U, 0xE7U, 0xF2U, 0xF3U, 0xF6U, 0xF7U,
+	0xA8U, 0xA9U, 0xACU, 0xADU, 0xB8U, 0xB9U, 0xBCU, 0xBDU, 0xE8U, 0xE9U, 0xECU, 0xEDU, 0xF8U, 0xF9U, 0xFCU, 0xFDU,
+	0xAAU, 0xABU, 0xAEU, 0xAFU, 0xBAU, 0xBBU, 0xBEU, 0xBFU, 0xEAU, 0xEBU, 0xEEU, 0xEFU, 0xFAU, 0xFBU, 0xFEU, 0xFFU};
+
+const unsigned int SCATTER_TABLE[] = {
+	0x00U, 0x01U, 0x10U, 0x11U, 0x02U, 0x03U, 0x12U, 0x13U, 0x20U, 0x21U, 0x30U, 0x31U, 0x22U, 0x23U, 0x32U, 0x33U,
+	0x04U, 0x05U, 0x14U, 0x15U, 0x06U, 0x07U, 0x16U, 0x17U, 0x24U, 0x25U, 0x34U, 0x35U, 0x26U, 0x27U, 0x36U, 0x37U,
+	0x40U, 0x41U, 0x50U, 0x51U, 0x42U, 0x43U, 0x52U, 0x53U, 0x60U, 0x61U, 0x70U, 0x71U, 0x62U, 0x63U, 0x72U, 0x73U,
+	0x44U, 0x45U, 0x54U, 0x55U, 0x46U, 0x47U, 0x56U, 0x57U, 0x64U, 0x65U, 0x74U, 0x75U, 0x66U, 0x67U, 0x76U, 0x77U,
+	0x08U, 0x09U, 0x18U, 0x19U, 0x0AU, 0x0BU, 0x1AU, 0x1BU, 0x28U, 0x29U, 0x38U, 0x39U, 0x2AU, 0x2BU, 0x3AU, 0x3BU,
+	0x0CU, 0x0DU, 0x1CU, 0x1DU, 0x0EU, 0x0FU, 0x1EU, 0x1FU, 0x2CU, 0x2DU, 0x3CU, 0x3DU, 0x2EU, 0x2FU, 0x3EU, 0x3FU,
+	0x48U, 0x49U, 0x58U, 0x59U, 0x4AU, 0x4BU, 0x5AU, 0x5BU, 0x68U, 0x69U, 0x78U, 0x79U, 0x6AU, 0x6BU, 0x7AU, 0x7BU,
+	0x4CU, 0x4DU, 0x5CU, 0x5DU, 0x4EU, 0x4FU, 0x5EU, 0x5FU, 0x6CU, 0x6DU, 0x7CU, 0x7DU, 0x6EU, 0x6FU, 0x7EU, 0x7FU,
+	0x80U, 0x81U, 0x90U, 0x91U, 0x82U, 0x83U, 0x92U, 0x93U, 0xA0U, 0xA1U, 0xB0U, 0xB1U, 0xA2U, 0xA3U, 0xB2U, 0xB3U,
+	0x84U, 0x85U, 0x94U, 0x95U, 0x86U, 0x87U, 0x96U, 0x97U, 0xA4U, 0xA5U, 0xB4U, 0xB5U, 0xA6U, 0xA7U, 0xB6U, 0xB7U,
+	0xC0U, 0xC1U, 0xD0U, 0xD1U, 0xC2U, 0xC3U, 0xD2U, 0xD3U, 0xE0U, 0xE1U, 0xF0U, 0xF1U, 0xE2U, 0xE3U, 0xF2U, 0xF3U,
+	0xC4U, 0xC5U, 0xD4U, 0xD5U, 0xC6U, 0xC7U, 0xD6U, 0xD7U, 0xE4U, 0xE5U, 0xF4U, 0xF5U, 0xE6U, 0xE7U, 0xF6U, 0xF7U,
+	0x88U, 0x89U, 0x98U, 0x99U, 0x8AU, 0x8BU, 0x9AU, 0x9BU, 0xA8U, 0xA9U, 0xB8U, 0xB9U, 0xAAU, 0xABU, 0xBAU, 0xBBU,
+	0x8CU, 0x8DU, 0x9CU, 0x9DU, 0x8EU, 0x8FU, 0x9EU, 0x9FU, 0xACU, 0xADU, 0xBCU, 0xBDU, 0xAEU, 0xAFU, 0xBEU, 0xBFU,
+	0xC8U, 0xC9U, 0xD8U, 0xD9U, 0xCAU, 0xCBU, 0xDAU, 0xDBU, 0xE8U, 0xE9U, 0xF8U, 0xF9U, 0xEAU, 0xEBU, 0xFAU, 0xFBU,
+	0xCCU, 0xCDU, 0xDCU, 0xDDU, 0xCEU, 0xCFU, 0xDEU, 0xDFU, 0xECU, 0xEDU, 0xFCU, 0xFDU, 0xEEU, 0xEFU, 0xFEU, 0xFFU};
+
+// Each bit of a 6 bit index three times over
+const unsigned int TRIPLE_TABLE[] = {
+	0x00000U, 0x00007U, 0x00038U, 0x0003FU, 0x001C0U, 0x001C7U, 0x001F8U, 0x001FFU,
+	0x00E00U, 0x00E07U, 0x00E38U, 0x00E3FU, 0x00FC0U, 0x00FC7U, 0x00FF8U, 0x00FFFU,
+	0x07000U, 0x07007U, 0x07038U, 0x0703FU, 0x071C0U, 0x071C7U, 0x071F8U, 0x071FFU,
+	0x07E00U, 0x07E07U, 0x07E38U, 0x07E3FU, 0x07FC0U, 0x07FC7U, 0x07FF8U, 0x07FFFU,
+	0x38000U, 0x38007U, 0x38038U, 0x3803FU, 0x381C0U, 0x381C7U, 0x381F8U, 0x381FFU,
+	0x38E00U, 0x38E07U, 0x38E38U, 0x38E3FU, 0x38FC0U, 0x38FC7U, 0x38FF8U, 0x38FFFU,
+	0x3F000U, 0x3F007U, 0x3F038U, 0x3F03FU, 0x3F1C0U, 0x3F1C7U, 0x3F1F8U, 0x3F1FFU,
+	0x3FE00U, 0x3FE07U, 0x3FE38U, 0x3FE3FU, 0x3FFC0U, 0x3FFC7U, 0x3FFF8U, 0x3FFFFU};
+
+// The middle bits of the three triples in a 9 bit index
+const unsigned int MIDDLE_TABLE[] = {
+	0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U,
+	0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U,
+	0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U,
+	0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U,
+	4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U,
+	4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U,
+	4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U,
+	4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U,
+	0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U,
+	0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U,
+	0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U,
+	0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 0U, 0U, 1U, 1U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U, 2U, 2U, 3U, 3U,
+	4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U,
+	4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U,
+	4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U,
+	4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 4U, 4U, 5U, 5U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U, 6U, 6U, 7U, 7U};
+
+// The VCH whitening, as lanes
+const unsigned int WHITENING_LANES[] = {0x24F5D44U, 0x219C2F6U, 0x3343BC3U, 0x3F83DF1U};
 
 const unsigned char DMR_SILENCE[] = {0xB9U, 0xE8U, 0x81U, 0x52U, 0x61U, 0x73U, 0x00U, 0x2AU, 0x6BU};
 const unsigned char YSF_SILENCE[] = {0x7BU, 0xB2U, 0x8EU, 0x43U, 0x36U, 0xE4U, 0xA2U, 0x39U, 0x78U, 0x49U, 0x33U, 0x68U, 0x33U};
 
 CModeConv::CModeConv() :
-m_ysfN(0U),
-m_dmrN(0U),
-m_YSF(5000U, "DMR2YSF"),
-m_DMR(5000U, "YSF2DMR")
+m_YSF(512U, "DMR2YSF"),
+m_DMR(512U, "YSF2DMR"),
+m_ysfData(0U),
+m_dmrData(0U)
 {
 }
 
@@ -477,72 +539,105 @@ CModeConv::~CModeConv()
 {
 }
 
-void CModeConv::putDMR(unsigned char* bytes)
+#if defined(MODECONV_AVX2)
+// Asked on first use, a static initialiser may run before the CPU model
+// has been set up
+static bool hasAVX2()
 {
-	assert(bytes != NULL);
+	static const bool avx2 = []() {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+	}();
 
-	unsigned int a1 = 0U, a2 = 0U, a3 = 0U;
-	unsigned int MASK = 0x800000U;
-	for (unsigned int i = 0U; i < 24U; i++, MASK >>= 1) {
-		unsigned int a1Pos = DMR_A_TABLE[i];
-		unsigned int a2Pos = a1Pos + 72U;
-		if (a2Pos >= 108U)
-			a2Pos += 48U;
-		unsigned int a3Pos = a1Pos + 192U;
-
-		if (READ_BIT(bytes, a1Pos))
-			a1 |= MASK;
-		if (READ_BIT(bytes, a2Pos))
-			a2 |= MASK;
-		if (READ_BIT(bytes, a3Pos))
-			a3 |= MASK;
+	return avx2;
+}
+#endif
+
+static bool s_simd = true;
+
+static void gather(const unsigned char* in, unsigned int length, unsigned int* lanes)
+{
+	unsigned int l0 = 0U, l1 = 0U, l2 = 0U, l3 = 0U;
+	for (unsigned int i = 0U; i < length; i++) {
+		unsigned int g = GATHER_TABLE[in[i]];
+		l0 = (l0 << 2) | (g >> 6);
+		l1 = (l1 << 2) | ((g >> 4) & 0x03U);
+		l2 = (l2 << 2) | ((g >> 2) & 0x03U);
+		l3 = (l3 << 2) | (g & 0x03U);
 	}
 
-	unsigned int b1 = 0U, b2 = 0U, b3 = 0U;
-	MASK = 0x400000U;
-	for (unsigned int i = 0U; i < 23U; i++, MASK >>= 1) {
-		unsigned int b1Pos = DMR_B_TABLE[i];
-		unsigned int b2Pos = b1Pos + 72U;
-		if (b2Pos >= 108U)
-			b2Pos += 48U;
-		unsigned int b3Pos = b1Pos + 192U;
-
-		if (READ_BIT(bytes, b1Pos))
-			b1 |= MASK;
-		if (READ_BIT(bytes, b2Pos))
-			b2 |= MASK;
-		if (READ_BIT(bytes, b3Pos))
-			b3 |= MASK;
+	lanes[0U] = l0;
+	lanes[1U] = l1;
+	lanes[2U] = l2;
+	lanes[3U] = l3;
+}
+
+static void scatter(const unsigned int* lanes, unsigned int length, unsigned char* out)
+{
+	for (unsigned int i = 0U; i < length; i++) {
+		unsigned int shift = 2U * (length - 1U - i);
+		unsigned int g = (((lanes[0U] >> shift) & 0x03U) << 6) | (((lanes[1U] >> shift) & 0x03U) << 4) |
+						 (((lanes[2U] >> shift) & 0x03U) << 2) | ((lanes[3U] >> shift) & 0x03U);
+		out[i] = SCATTER_TABLE[g];
 	}
+}
+
+// The middle bits of six triples, from the 18 bits of a VCH
+static unsigned int middle(unsigned int value)
+{
+	return (MIDDLE_TABLE[value >> 9] << 3) | MIDDLE_TABLE[value & 0x1FFU];
+}
+
+template<unsigned int LENGTH> static void putFrame(CFrameRing<LENGTH>& ring, unsigned char tag, const unsigned char* data)
+{
+	CTaggedFrame<LENGTH>* frame = ring.reserve(tag, CStopWatch::monotonic());
+	if (frame == NULL)
+		return;
+
+	::memcpy(frame->m_data, data, LENGTH);
 
-	unsigned int c1 = 0U, c2 = 0U, c3 = 0U;
-	MASK = 0x1000000U;
-	for (unsigned int i = 0U; i < 25U; i++, MASK >>= 1) {
-		unsigned int c1Pos = DMR_C_TABLE[i];
-		unsigned int c2Pos = c1Pos + 72U;
-		if (c2Pos >= 108U)
-			c2Pos += 48U;
-		unsigned int c3Pos = c1Pos + 192U;
-
-		if (READ_BIT(bytes, c1Pos))
-			c1 |= MASK;
-		if (READ_BIT(bytes, c2Pos))
-			c2 |= MASK;
-		if (READ_BIT(bytes, c3Pos))
-			c3 |= MASK;
+	ring.commit();
+}
+
+void CModeConv::putDMR(unsigned char* bytes)
+{
+	assert(bytes != NULL);
+
+	// All three or none, so that the VCHs stay in step with the YSF frames,
+	// and no conversion for a frame that would only be dropped
+	if (!m_YSF.hasSpace(3U)) {
+		LogError("DMR2YSF ring overflow, dropping a DMR frame");
+		return;
 	}
 
-	putAMBE2YSF(a1, b1, c1);
-	putAMBE2YSF(a2, b2, c2);
-	putAMBE2YSF(a3, b3, c3);
+	// The second frame is either side of the sync
+	unsigned char frames[27U];
+	::memcpy(frames, bytes, 9U);
+	::memcpy(frames + 9U, bytes + 9U, 4U);
+	frames[13U] = (bytes[13U] & 0xF0U) | (bytes[19U] & 0x0FU);
+	::memcpy(frames + 14U, bytes + 20U, 4U);
+	::memcpy(frames + 18U, bytes + 24U, 9U);
+
+	unsigned char vch[3U * 13U];
+	convertDMRtoYSF(frames, 3U, vch);
+
+	for (unsigned int i = 0U; i < 3U; i++)
+		putFrame(m_YSF, TAG_DATA, vch + i * 13U);
+
+	m_ysfData += 3U;
 }
 
-void CModeConv::putAMBE2YSF(unsigned int a, unsigned int b, unsigned int dat_c)
+void CModeConv::convertDMR(const unsigned char* in, unsigned char* out)
 {
-	unsigned char vch[13U];
-	unsigned char ysfFrame[13U];
-	::memset(vch, 0U, 13U);
-	::memset(ysfFrame, 0, 13U);
+	assert(in != NULL);
+	assert(out != NULL);
+
+	unsigned int lanes[4U];
+	gather(in, 9U, lanes);
+
+	unsigned int a = (lanes[0U] << 6) | (lanes[1U] >> 12);
+	unsigned int b = ((lanes[1U] & 0xFFFU) << 11) | (lanes[2U] >> 7);
+	unsigned int c = ((lanes[2U] & 0x7FU) << 18) | lanes[3U];
 
 	unsigned int dat_a = a >> 12;
 
@@ -551,151 +646,312 @@ void CModeConv::putAMBE2YSF(unsigned int a, unsigned int b, unsigned int dat_c)
 
 	unsigned int dat_b = b >> 11;
 
-	for (unsigned int i = 0U; i < 12U; i++) {
-		bool s = (dat_a << (20U + i)) & 0x80000000U;
-		WRITE_BIT(vch, 3*i + 0U, s);
-		WRITE_BIT(vch, 3*i + 1U, s);
-		WRITE_BIT(vch, 3*i + 2U, s);
-	}
-	
-	for (unsigned int i = 0U; i < 12U; i++) {
-		bool s = (dat_b << (20U + i)) & 0x80000000U;
-		WRITE_BIT(vch, 3*(i + 12U) + 0U, s);
-		WRITE_BIT(vch, 3*(i + 12U) + 1U, s);
-		WRITE_BIT(vch, 3*(i + 12U) + 2U, s);
-	}
-	
-	for (unsigned int i = 0U; i < 3U; i++) {
-		bool s = (dat_c << (7U + i)) & 0x80000000U;
-		WRITE_BIT(vch, 3*(i + 24U) + 0U, s);
-		WRITE_BIT(vch, 3*(i + 24U) + 1U, s);
-		WRITE_BIT(vch, 3*(i + 24U) + 2U, s);
-	}
+	// The VCH has dat_a, dat_b and the top three bits of C each three times,
+	// then the rest of C and a zero
+	unsigned int tah = TRIPLE_TABLE[dat_a >> 6];
+	unsigned int tal = TRIPLE_TABLE[dat_a & 0x3FU];
+	unsigned int tbh = TRIPLE_TABLE[dat_b >> 6];
+	unsigned int tbl = TRIPLE_TABLE[dat_b & 0x3FU];
+	unsigned int tc  = TRIPLE_TABLE[(c >> 22) & 0x07U];
+
+	// Scramble and interleave
+	lanes[0U] = ((tah << 8) | (tal >> 10)) ^ WHITENING_LANES[0U];
+	lanes[1U] = (((tal & 0x3FFU) << 16) | (tbh >> 2)) ^ WHITENING_LANES[1U];
+	lanes[2U] = (((tbh & 0x03U) << 24) | (tbl << 6) | (tc >> 3)) ^ WHITENING_LANES[2U];
+	lanes[3U] = (((tc & 0x07U) << 23) | ((c & 0x3FFFFFU) << 1)) ^ WHITENING_LANES[3U];
+
+	scatter(lanes, 13U, out);
+}
 
-	for (unsigned int i = 0U; i < 22U; i++) {
-		bool s = (dat_c << (10U + i)) & 0x80000000U;
-		WRITE_BIT(vch, i + 81U, s);
+void CModeConv::putYSF(unsigned char* data)
+{
+	assert(data != NULL);
+
+	if (!m_DMR.hasSpace(5U)) {
+		LogError("YSF2DMR ring overflow, dropping a YSF frame");
+		return;
 	}
-	
-	WRITE_BIT(vch, 103U, 0U);
 
-	// Scramble
-	for (unsigned int i = 0U; i < 13U; i++)
-		vch[i] ^= WHITENING_DATA[i];
+	// We have a total of 5 VCH sections, after DCH(0) and 18 bytes apart
+	data += YSF_SYNC_LENGTH_BYTES + YSF_FICH_LENGTH_BYTES + 5U;
 
-	// Interleave
-	for (unsigned int i = 0U; i < 104U; i++) {
-		unsigned int n = INTERLEAVE_TABLE_26_4[i];
-		bool s = READ_BIT(vch, i);
-		WRITE_BIT(ysfFrame, n, s);
-	}
+	unsigned char vch[5U * 13U];
+	for (unsigned int j = 0U; j < 5U; j++)
+		::memcpy(vch + j * 13U, data + j * 18U, 13U);
 
-	m_YSF.addData(&TAG_DATA, 1U);
-	m_YSF.addData(ysfFrame, 13U);
-	//CUtils::dump(1U, "VCH V/D type 2:", ysfFrame, 13U);
-	
-	m_ysfN += 1U;
+	unsigned char frames[5U * 9U];
+	convertYSFtoDMR(vch, 5U, frames);
+
+	for (unsigned int j = 0U; j < 5U; j++)
+		putFrame(m_DMR, TAG_DATA, frames + j * 9U);
+
+	m_dmrData += 5U;
 }
 
-void CModeConv::putYSF(unsigned char* data)
+void CModeConv::convertYSF(const unsigned char* in, unsigned char* out)
 {
-	assert(data != NULL);
+	assert(in != NULL);
+	assert(out != NULL);
 
-	data += YSF_SYNC_LENGTH_BYTES + YSF_FICH_LENGTH_BYTES;
+	// Deinterleave and "un-whiten" (descramble)
+	unsigned int lanes[4U];
+	gather(in, 13U, lanes);
 
-	unsigned int offset = 40U; // DCH(0)
+	lanes[0U] ^= WHITENING_LANES[0U];
+	lanes[1U] ^= WHITENING_LANES[1U];
+	lanes[2U] ^= WHITENING_LANES[2U];
+	lanes[3U] ^= WHITENING_LANES[3U];
 
-	// We have a total of 5 VCH sections, iterate through each
-	for (unsigned int j = 0U; j < 5U; j++, offset += 144U) {
+	unsigned int tah = lanes[0U] >> 8;
+	unsigned int tal = ((lanes[0U] & 0xFFU) << 10) | (lanes[1U] >> 16);
+	unsigned int tbh = ((lanes[1U] & 0xFFFFU) << 2) | (lanes[2U] >> 24);
+	unsigned int tbl = (lanes[2U] >> 6) & 0x3FFFFU;
+	unsigned int tc  = ((lanes[2U] & 0x3FU) << 3) | (lanes[3U] >> 23);
 
-		unsigned char vch[13U];
-		unsigned int dat_a = 0U;
-		unsigned int dat_b = 0U;
-		unsigned int dat_c = 0U;
+	unsigned int dat_a = (middle(tah) << 6) | middle(tal);
+	unsigned int dat_b = (middle(tbh) << 6) | middle(tbl);
+	unsigned int dat_c = (MIDDLE_TABLE[tc] << 22) | ((lanes[3U] >> 1) & 0x3FFFFFU);
 
-		// Deinterleave
-		for (unsigned int i = 0U; i < 104U; i++) {
-			unsigned int n = INTERLEAVE_TABLE_26_4[i];
-			bool s = READ_BIT(data, offset + n);
-			WRITE_BIT(vch, i, s);
-		}
+	unsigned int a = CGolay24128::encode24128(dat_a);
+	unsigned int p = PRNG_TABLE[dat_a] >> 1;
+	unsigned int b = CGolay24128::encode23127(dat_b) >> 1;
+	b ^= p;
 
-		// "Un-whiten" (descramble)
-		for (unsigned int i = 0U; i < 13U; i++)
-			vch[i] ^= WHITENING_DATA[i];
-	
-		for (unsigned int i = 0U; i < 12U; i++) {
-			dat_a <<= 1U;
-			if (READ_BIT(vch, 3U*i + 1U))
-				dat_a |= 0x01U;;
-		}
-		
-		for (unsigned int i = 0U; i < 12U; i++) {
-			dat_b <<= 1U;
-			if (READ_BIT(vch, 3U*(i + 12U) + 1U))
-				dat_b |= 0x01U;;
-		}
-		
-		for (unsigned int i = 0U; i < 3U; i++) {
-			dat_c <<= 1U;
-			if (READ_BIT(vch, 3U*(i + 24U) + 1U))
-				dat_c |= 0x01U;;
-		}
+	lanes[0U] = (a >> 6) & 0x3FFFFU;
+	lanes[1U] = ((a & 0x3FU) << 12) | ((b >> 11) & 0xFFFU);
+	lanes[2U] = ((b & 0x7FFU) << 7) | ((dat_c >> 18) & 0x7FU);
+	lanes[3U] = dat_c & 0x3FFFFU;
+
+	scatter(lanes, 9U, out);
+}
+
+#if defined(MODECONV_AVX2)
+// The same conversions for eight frames at a time, one in each 32 bit
+// element. The frames are read and written a dword at a time, from offsets
+// that stay inside each frame, and the masked loads leave the elements past
+// the last frame at zero.
+
+__attribute__((target("avx2")))
+static void loadAVX2(const unsigned char* in, unsigned int length, unsigned int count, __m256i* bytes)
+{
+	__m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(int(length)));
+	__m256i mask  = _mm256_cmpgt_epi32(_mm256_set1_epi32(int(count)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+	__m256i dwords[4U];
+	unsigned int n = (length + 3U) / 4U;
+	for (unsigned int k = 0U; k < n; k++) {
+		unsigned int offset = k < n - 1U ? 4U * k : length - 4U;
+		dwords[k] = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)(in + offset), index, mask, 1);
+	}
 
-		for (unsigned int i = 0U; i < 22U; i++) {
-			dat_c <<= 1U;
-			if (READ_BIT(vch, i + 81U))
-				dat_c |= 0x01U;;
+	__m256i byteMask = _mm256_set1_epi32(0xFF);
+	for (unsigned int i = 0U; i < length; i++) {
+		unsigned int k = i / 4U < n - 1U ? i / 4U : n - 1U;
+		unsigned int offset = k < n - 1U ? 4U * k : length - 4U;
+		bytes[i] = _mm256_and_si256(_mm256_srli_epi32(dwords[k], int(8U * (i - offset))), byteMask);
+	}
+}
+
+__attribute__((target("avx2")))
+static void storeAVX2(const __m256i* bytes, unsigned int length, unsigned int count, unsigned char* out)
+{
+	unsigned int n = (length + 3U) / 4U;
+
+	uint32_t dwords[4U][8U];
+	for (unsigned int k = 0U; k < n; k++) {
+		unsigned int offset = k < n - 1U ? 4U * k : length - 4U;
+		__m256i dword = bytes[offset];
+		dword = _mm256_or_si256(dword, _mm256_slli_epi32(bytes[offset + 1U], 8));
+		dword = _mm256_or_si256(dword, _mm256_slli_epi32(bytes[offset + 2U], 16));
+		dword = _mm256_or_si256(dword, _mm256_slli_epi32(bytes[offset + 3U], 24));
+		_mm256_storeu_si256((__m256i*)dwords[k], dword);
+	}
+
+	for (unsigned int f = 0U; f < count; f++, out += length) {
+		for (unsigned int k = 0U; k < n; k++) {
+			unsigned int offset = k < n - 1U ? 4U * k : length - 4U;
+			::memcpy(out + offset, &dwords[k][f], 4U);
 		}
-		
-		putAMBE2DMR(dat_a, dat_b, dat_c);
 	}
 }
 
-void CModeConv::putAMBE2DMR(unsigned int dat_a, unsigned int dat_b, unsigned int dat_c)
+__attribute__((target("avx2")))
+static void gatherAVX2(const __m256i* bytes, unsigned int length, __m256i* lanes)
 {
-	unsigned char v_dmr[9U];
+	const int* table = (const int*)GATHER_TABLE;
+	__m256i three = _mm256_set1_epi32(0x03);
+
+	__m256i l0 = _mm256_setzero_si256(), l1 = _mm256_setzero_si256(), l2 = _mm256_setzero_si256(), l3 = _mm256_setzero_si256();
+	for (unsigned int i = 0U; i < length; i++) {
+		__m256i g = _mm256_i32gather_epi32(table, bytes[i], 4);
+		l0 = _mm256_or_si256(_mm256_slli_epi32(l0, 2), _mm256_srli_epi32(g, 6));
+		l1 = _mm256_or_si256(_mm256_slli_epi32(l1, 2), _mm256_and_si256(_mm256_srli_epi32(g, 4), three));
+		l2 = _mm256_or_si256(_mm256_slli_epi32(l2, 2), _mm256_and_si256(_mm256_srli_epi32(g, 2), three));
+		l3 = _mm256_or_si256(_mm256_slli_epi32(l3, 2), _mm256_and_si256(g, three));
+	}
 
-	unsigned int a = CGolay24128::encode24128(dat_a);
-	unsigned int p = PRNG_TABLE[dat_a] >> 1;
-	unsigned int b = CGolay24128::encode23127(dat_b) >> 1;
-	b ^= p;
+	lanes[0U] = l0;
+	lanes[1U] = l1;
+	lanes[2U] = l2;
+	lanes[3U] = l3;
+}
 
-	unsigned int MASK = 0x800000U;
-	for (unsigned int i = 0U; i < 24U; i++, MASK >>= 1) {
-		unsigned int aPos = DMR_A_TABLE[i];
-		WRITE_BIT(v_dmr, aPos, a & MASK);
+__attribute__((target("avx2")))
+static void scatterAVX2(const __m256i* lanes, unsigned int length, __m256i* bytes)
+{
+	const int* table = (const int*)SCATTER_TABLE;
+	__m256i three = _mm256_set1_epi32(0x03);
+
+	for (unsigned int i = 0U; i < length; i++) {
+		__m128i shift = _mm_cvtsi32_si128(int(2U * (length - 1U - i)));
+		__m256i g = _mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(lanes[0U], shift), three), 6);
+		g = _mm256_or_si256(g, _mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(lanes[1U], shift), three), 4));
+		g = _mm256_or_si256(g, _mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(lanes[2U], shift), three), 2));
+		g = _mm256_or_si256(g, _mm256_and_si256(_mm256_srl_epi32(lanes[3U], shift), three));
+		bytes[i] = _mm256_i32gather_epi32(table, g, 4);
 	}
+}
+
+__attribute__((target("avx2")))
+static __m256i middleAVX2(__m256i value)
+{
+	const int* table = (const int*)MIDDLE_TABLE;
+
+	__m256i hi = _mm256_i32gather_epi32(table, _mm256_srli_epi32(value, 9), 4);
+	__m256i lo = _mm256_i32gather_epi32(table, _mm256_and_si256(value, _mm256_set1_epi32(0x1FF)), 4);
+
+	return _mm256_or_si256(_mm256_slli_epi32(hi, 3), lo);
+}
+
+__attribute__((target("avx2")))
+static void convertDMRAVX2(const unsigned char* in, unsigned int count, unsigned char* out)
+{
+	__m256i bytes[13U];
+	loadAVX2(in, 9U, count, bytes);
+
+	__m256i lanes[4U];
+	gatherAVX2(bytes, 9U, lanes);
+
+	__m256i a = _mm256_or_si256(_mm256_slli_epi32(lanes[0U], 6), _mm256_srli_epi32(lanes[1U], 12));
+	__m256i b = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(lanes[1U], _mm256_set1_epi32(0xFFF)), 11), _mm256_srli_epi32(lanes[2U], 7));
+	__m256i c = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(lanes[2U], _mm256_set1_epi32(0x7F)), 18), lanes[3U]);
+
+	__m256i dat_a = _mm256_srli_epi32(a, 12);
+
+	b = _mm256_xor_si256(b, _mm256_srli_epi32(_mm256_i32gather_epi32((const int*)PRNG_TABLE, dat_a, 4), 1));
+
+	__m256i dat_b = _mm256_srli_epi32(b, 11);
 
-	MASK = 0x400000U;
-	for (unsigned int i = 0U; i < 23U; i++, MASK >>= 1) {
-		unsigned int bPos = DMR_B_TABLE[i];
-		WRITE_BIT(v_dmr, bPos, b & MASK);
+	const int* triple = (const int*)TRIPLE_TABLE;
+	__m256i six = _mm256_set1_epi32(0x3F);
+	__m256i tah = _mm256_i32gather_epi32(triple, _mm256_srli_epi32(dat_a, 6), 4);
+	__m256i tal = _mm256_i32gather_epi32(triple, _mm256_and_si256(dat_a, six), 4);
+	__m256i tbh = _mm256_i32gather_epi32(triple, _mm256_srli_epi32(dat_b, 6), 4);
+	__m256i tbl = _mm256_i32gather_epi32(triple, _mm256_and_si256(dat_b, six), 4);
+	__m256i tc  = _mm256_i32gather_epi32(triple, _mm256_and_si256(_mm256_srli_epi32(c, 22), _mm256_set1_epi32(0x07)), 4);
+
+	lanes[0U] = _mm256_or_si256(_mm256_slli_epi32(tah, 8), _mm256_srli_epi32(tal, 10));
+	lanes[1U] = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(tal, _mm256_set1_epi32(0x3FF)), 16), _mm256_srli_epi32(tbh, 2));
+	lanes[2U] = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(tbh, _mm256_set1_epi32(0x03)), 24), _mm256_slli_epi32(tbl, 6)), _mm256_srli_epi32(tc, 3));
+	lanes[3U] = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(tc, _mm256_set1_epi32(0x07)), 23), _mm256_slli_epi32(_mm256_and_si256(c, _mm256_set1_epi32(0x3FFFFF)), 1));
+
+	for (unsigned int r = 0U; r < 4U; r++)
+		lanes[r] = _mm256_xor_si256(lanes[r], _mm256_set1_epi32(int(WHITENING_LANES[r])));
+
+	scatterAVX2(lanes, 13U, bytes);
+	storeAVX2(bytes, 13U, count, out);
+}
+
+__attribute__((target("avx2")))
+static void convertYSFAVX2(const unsigned char* in, unsigned int count, unsigned char* out)
+{
+	__m256i bytes[13U];
+	loadAVX2(in, 13U, count, bytes);
+
+	__m256i lanes[4U];
+	gatherAVX2(bytes, 13U, lanes);
+
+	for (unsigned int r = 0U; r < 4U; r++)
+		lanes[r] = _mm256_xor_si256(lanes[r], _mm256_set1_epi32(int(WHITENING_LANES[r])));
+
+	__m256i tah = _mm256_srli_epi32(lanes[0U], 8);
+	__m256i tal = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(lanes[0U], _mm256_set1_epi32(0xFF)), 10), _mm256_srli_epi32(lanes[1U], 16));
+	__m256i tbh = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(lanes[1U], _mm256_set1_epi32(0xFFFF)), 2), _mm256_srli_epi32(lanes[2U], 24));
+	__m256i tbl = _mm256_and_si256(_mm256_srli_epi32(lanes[2U], 6), _mm256_set1_epi32(0x3FFFF));
+	__m256i tc  = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(lanes[2U], _mm256_set1_epi32(0x3F)), 3), _mm256_srli_epi32(lanes[3U], 23));
+
+	__m256i dat_a = _mm256_or_si256(_mm256_slli_epi32(middleAVX2(tah), 6), middleAVX2(tal));
+	__m256i dat_b = _mm256_or_si256(_mm256_slli_epi32(middleAVX2(tbh), 6), middleAVX2(tbl));
+	__m256i dat_c = _mm256_or_si256(_mm256_slli_epi32(_mm256_i32gather_epi32((const int*)MIDDLE_TABLE, tc, 4), 22),
+									_mm256_and_si256(_mm256_srli_epi32(lanes[3U], 1), _mm256_set1_epi32(0x3FFFFF)));
+
+	__m256i a = _mm256_i32gather_epi32((const int*)CGolay24128::getEncodingTable24128(), dat_a, 4);
+	__m256i p = _mm256_srli_epi32(_mm256_i32gather_epi32((const int*)PRNG_TABLE, dat_a, 4), 1);
+	__m256i b = _mm256_srli_epi32(_mm256_i32gather_epi32((const int*)CGolay24128::getEncodingTable23127(), dat_b, 4), 1);
+	b = _mm256_xor_si256(b, p);
+
+	lanes[0U] = _mm256_and_si256(_mm256_srli_epi32(a, 6), _mm256_set1_epi32(0x3FFFF));
+	lanes[1U] = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(a, _mm256_set1_epi32(0x3F)), 12), _mm256_and_si256(_mm256_srli_epi32(b, 11), _mm256_set1_epi32(0xFFF)));
+	lanes[2U] = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(b, _mm256_set1_epi32(0x7FF)), 7), _mm256_and_si256(_mm256_srli_epi32(dat_c, 18), _mm256_set1_epi32(0x7F)));
+	lanes[3U] = _mm256_and_si256(dat_c, _mm256_set1_epi32(0x3FFFF));
+
+	scatterAVX2(lanes, 9U, bytes);
+	storeAVX2(bytes, 9U, count, out);
+}
+#endif
+
+void CModeConv::convertDMRtoYSF(const unsigned char* in, unsigned int frames, unsigned char* out)
+{
+	assert(in != NULL);
+	assert(out != NULL);
+
+#if defined(MODECONV_AVX2)
+	if (s_simd && hasAVX2()) {
+		for (unsigned int i = 0U; i < frames; i += 8U)
+			convertDMRAVX2(in + i * 9U, frames - i < 8U ? frames - i : 8U, out + i * 13U);
+		return;
 	}
+#endif
 
-	MASK = 0x1000000U;
-	for (unsigned int i = 0U; i < 25U; i++, MASK >>= 1) {
-		unsigned int cPos = DMR_C_TABLE[i];
-		WRITE_BIT(v_dmr, cPos, dat_c & MASK);
+	for (unsigned int i = 0U; i < frames; i++)
+		convertDMR(in + i * 9U, out + i * 13U);
+}
+
+void CModeConv::convertYSFtoDMR(const unsigned char* in, unsigned int frames, unsigned char* out)
+{
+	assert(in != NULL);
+	assert(out != NULL);
+
+#if defined(MODECONV_AVX2)
+	if (s_simd && hasAVX2()) {
+		for (unsigned int i = 0U; i < frames; i += 8U)
+			convertYSFAVX2(in + i * 13U, frames - i < 8U ? frames - i : 8U, out + i * 9U);
+		return;
 	}
+#endif
 
-	m_DMR.addData(&TAG_DATA, 1U);
-	m_DMR.addData(v_dmr, 9U);
+	for (unsigned int i = 0U; i < frames; i++)
+		convertYSF(in + i * 13U, out + i * 9U);
+}
 
-	//CUtils::dump(1U, "DMR Voice:", v_dmr, 9U);
-	
-	m_dmrN += 1U;
+bool CModeConv::setSIMD(bool enabled)
+{
+	s_simd = enabled;
+
+#if defined(MODECONV_AVX2)
+	return s_simd && hasAVX2();
+#else
+	return false;
+#endif
 }
 
 void CModeConv::putDummyYSF()
 {
 	// We have a total of 5 VCH sections
-	for (unsigned int j = 0U; j < 5U; j++) {
-		m_DMR.addData(&TAG_DATA, 1U);
-		m_DMR.addData(DMR_SILENCE, 9U);
+	for (unsigned int j = 0U; j < 5U; j++)
+		putFrame(m_DMR, TAG_DATA, DMR_SILENCE);
 
-		m_dmrN += 1U;
-	}
+	m_dmrData += 5U;
 }
 
 void CModeConv::putDMRHeader()
@@ -704,9 +960,9 @@ void CModeConv::putDMRHeader()
 
 	::memset(vch, 0, 13U);
 
-	m_YSF.addData(&TAG_HEADER, 1U);
-	m_YSF.addData(vch, 13U);
-	m_ysfN += 1U;
+	putFrame(m_YSF, TAG_HEADER, vch);
+
+	m_ysfData = 0U;
 }
 
 void CModeConv::putDMREOT()
@@ -715,16 +971,14 @@ void CModeConv::putDMREOT()
 
 	::memset(vch, 0, 13U);
 	
-	unsigned int fill = 5U - (m_ysfN % 5U);
-	for (unsigned int i = 0U; i < fill; i++) {
-		m_YSF.addData(&TAG_DATA, 1U);
-		m_YSF.addData(YSF_SILENCE, 13U);
-		m_ysfN += 1U;
-	}
+	// Counted here rather than from the ring, which the other side may be emptying
+	unsigned int fill = 5U - (m_ysfData % 5U);
+	for (unsigned int i = 0U; i < fill; i++)
+		putFrame(m_YSF, TAG_DATA, YSF_SILENCE);
+
+	putFrame(m_YSF, TAG_EOT, vch);
 
-	m_YSF.addData(&TAG_EOT, 1U);
-	m_YSF.addData(vch, 13U);
-	m_ysfN += 1U;
+	m_ysfData = 0U;
 }
 
 void CModeConv::putYSFHeader()
@@ -733,9 +987,9 @@ void CModeConv::putYSFHeader()
 
 	::memset(v_dmr, 0U, 9U);
 
-	m_DMR.addData(&TAG_HEADER, 1U);
-	m_DMR.addData(v_dmr, 9U);
-	m_dmrN += 1U;
+	putFrame(m_DMR, TAG_HEADER, v_dmr);
+
+	m_dmrData = 0U;
 }
 
 void CModeConv::putYSFEOT()
@@ -744,107 +998,100 @@ void CModeConv::putYSFEOT()
 
 	::memset(v_dmr, 0U, 9U);
 	
-	unsigned int fill = 3U - (m_dmrN % 3U);
-	for (unsigned int i = 0U; i < fill; i++) {
-		m_DMR.addData(&TAG_DATA, 1U);
-		m_DMR.addData(DMR_SILENCE, 9U);
-		m_dmrN += 1U;
-	}
+	unsigned int fill = 3U - (m_dmrData % 3U);
+	for (unsigned int i = 0U; i < fill; i++)
+		putFrame(m_DMR, TAG_DATA, DMR_SILENCE);
+
+	putFrame(m_DMR, TAG_EOT, v_dmr);
 
-	m_DMR.addData(&TAG_EOT, 1U);
-	m_DMR.addData(v_dmr, 9U);
-	m_dmrN += 1U;
+	m_dmrData = 0U;
 }
 
-unsigned int CModeConv::getDMR(unsigned char* data)
+unsigned int CModeConv::peekDMR(const CTaggedFrame<9U>** frames) const
 {
-	unsigned char tmp[9U];
-	unsigned char tag[1U];
+	assert(frames != NULL);
 
-	tag[0U] = TAG_NODATA;
-
-	if (m_dmrN >= 1U) {
-		m_DMR.peek(tag, 1U);
+	const CTaggedFrame<9U>* frame = m_DMR.peek();
+	if (frame == NULL)
+		return TAG_NODATA;
 
-		if (tag[0U] != TAG_DATA) {
-			m_DMR.getData(tag, 1U);
-			m_DMR.getData(data, 9U);
-			m_dmrN -= 1U;
-			return tag[0U];
-		}
+	if (frame->m_tag != TAG_DATA) {
+		frames[0U] = frame;
+		return frame->m_tag;
 	}
 
-	if (m_dmrN >= 3U) {
-		m_DMR.getData(tag, 1U);
-		m_DMR.getData(data, 9U);
-		m_dmrN -= 1U;
+	if (m_DMR.dataSize() < 3U)
+		return TAG_NODATA;
 
-		m_DMR.getData(tag, 1U);
-		m_DMR.getData(tmp, 9U);
-		m_dmrN -= 1U;
+	frames[0U] = frame;
+	frames[1U] = &m_DMR.at(1U);
+	frames[2U] = &m_DMR.at(2U);
 
-		::memcpy(data + 9U, tmp, 4U);
-		data[13U] = tmp[4U] & 0xF0U;
-		data[19U] = tmp[4U] & 0x0FU;
-		::memcpy(data + 20U, tmp + 5U, 4U);
+	return TAG_DATA;
+}
 
-		m_DMR.getData(tag, 1U);
-		m_DMR.getData(data + 24U, 9U);
-		m_dmrN -= 1U;
+void CModeConv::popDMR()
+{
+	const CTaggedFrame<9U>* frame = m_DMR.peek();
+	if (frame == NULL)
+		return;
 
-		return TAG_DATA;
-	}
-	else
-		return TAG_NODATA;
+	// The slots are the producer's again once popped
+	m_DMR.pop(frame->m_tag == TAG_DATA ? 3U : 1U);
 }
 
 unsigned int CModeConv::getYSF(unsigned char* data)
 {
-	unsigned char tag[1U];
-
-	tag[0U] = TAG_NODATA;
-
 	data += YSF_SYNC_LENGTH_BYTES + YSF_FICH_LENGTH_BYTES;
 	
-	if (m_ysfN >= 1U) {
-		m_YSF.peek(tag, 1U);
-
-		if (tag[0U] != TAG_DATA) {
-			m_YSF.getData(tag, 1U);
-			m_YSF.getData(data, 13U);
-			m_ysfN -= 1U;
-			return tag[0U];
-		}
-	}
+	const CTaggedFrame<13U>* frame = m_YSF.peek();
+	if (frame == NULL)
+		return TAG_NODATA;
 
-	if (m_ysfN >= 5U) {
-		data += 5U;
-		m_YSF.getData(tag, 1U);
-		m_YSF.getData(data, 13U);
-		m_ysfN -= 1U;
-
-		data += 18U;
-		m_YSF.getData(tag, 1U);
-		m_YSF.getData(data, 13U);
-		m_ysfN -= 1U;
-
-		data += 18U;
-		m_YSF.getData(tag, 1U);
-		m_YSF.getData(data, 13U);
-		m_ysfN -= 1U;
-
-		data += 18U;
-		m_YSF.getData(tag, 1U);
-		m_YSF.getData(data, 13U);
-		m_ysfN -= 1U;
-
-		data += 18U;
-		m_YSF.getData(tag, 1U);
-		m_YSF.getData(data, 13U);
-		m_ysfN -= 1U;
-
-		return TAG_DATA;
+	if (frame->m_tag != TAG_DATA) {
+		unsigned int tag = frame->m_tag;
+		::memcpy(data, frame->m_data, 13U);
+		m_YSF.pop();
+		return tag;
 	}
-	else
+
+	if (m_YSF.dataSize() < 5U)
 		return TAG_NODATA;
+
+	// The VCHs follow DCH(0) and are 18 bytes apart
+	data += 5U;
+	for (unsigned int j = 0U; j < 5U; j++, data += 18U)
+		::memcpy(data, m_YSF.at(j).m_data, 13U);
+
+	m_YSF.pop(5U);
+
+	return TAG_DATA;
+}
+
+unsigned int CModeConv::getYSFFrames() const
+{
+	return m_YSF.dataSize() / 5U;
+}
+
+unsigned int CModeConv::getDMRFrames() const
+{
+	return m_DMR.dataSize() / 3U;
+}
+
+unsigned long long CModeConv::getYSFAge() const
+{
+	const CTaggedFrame<13U>* frame = m_YSF.peek();
+	if (frame == NULL)
+		return 0ULL;
+
+	return CStopWatch::monotonic() - frame->m_time;
+}
+
+unsigned long long CModeConv::getDMRAge() const
+{
+	const CTaggedFrame<9U>* frame = m_DMR.peek();
+	if (frame == NULL)
+		return 0ULL;
+
+	return CStopWatch::monotonic() - frame->m_time;
 }
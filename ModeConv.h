@@ -19,11 +19,12 @@
 
 #include "Defines.h"
 #include "YSFDefines.h"
-#include "RingBuffer.h"
+#include "FrameRing.h"
 
 #if !defined(MODECONV_H)
 #define MODECONV_H
 
+// The put functions may run on one thread and the get functions on another
 class CModeConv {
 public:
 	CModeConv();
@@ -38,16 +39,41 @@ public:
 	void putYSFHeader();
 	void putYSFEOT();
 
+	// The next frame, written straight into the caller's YSF frame where its
+	// VCHs lie between the DCHs
 	unsigned int getYSF(unsigned char* bytes);
-	unsigned int getDMR(unsigned char* bytes);
+
+	// The next DMR frame where it lies in the ring, the three AMBE frames of
+	// a burst or the one of a header or EOT, left there until popDMR()
+	unsigned int peekDMR(const CTaggedFrame<9U>** frames) const;
+	void         popDMR();
+
+	// Converted frames waiting to be collected
+	unsigned int getYSFFrames() const;
+	unsigned int getDMRFrames() const;
+
+	// How long the oldest converted frame has waited in microseconds, 0 if none
+	unsigned long long getYSFAge() const;
+	unsigned long long getDMRAge() const;
+
+	// One AMBE frame, from the 9 bytes of DMR to the 13 of a YSF VCH and back
+	static void convertDMR(const unsigned char* in, unsigned char* out);
+	static void convertYSF(const unsigned char* in, unsigned char* out);
+
+	// Many AMBE frames one after the other, eight at a time with AVX2 when
+	// the CPU has it and one at a time with the functions above otherwise,
+	// with the same results
+	static void convertDMRtoYSF(const unsigned char* in, unsigned int frames, unsigned char* out);
+	static void convertYSFtoDMR(const unsigned char* in, unsigned int frames, unsigned char* out);
+
+	// AVX2 is used when enabled and available, returns whether it is used
+	static bool setSIMD(bool enabled);
 
 private:
-	void putAMBE2YSF(unsigned int a, unsigned int b, unsigned int dat_c);
-	void putAMBE2DMR(unsigned int dat_a, unsigned int dat_b, unsigned int dat_c);
-	unsigned int m_ysfN;
-	unsigned int m_dmrN;
-	CRingBuffer<unsigned char> m_YSF;
-	CRingBuffer<unsigned char> m_DMR;
+	CFrameRing<13U> m_YSF;
+	CFrameRing<9U>  m_DMR;
+	unsigned int    m_ysfData;		// Frames put since the last header or EOT
+	unsigned int    m_dmrData;
 
 };
 
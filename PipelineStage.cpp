@@ -0,0 +1,114 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "PipelineStage.h"
+#include "StopWatch.h"
+#include "Log.h"
+
+CPipelineStage::CPipelineStage(const std::string& name) :
+m_name(name),
+m_start(0ULL),
+m_frames(0U),
+m_runs(0U),
+m_maxDepth(0U),
+m_totalService(0ULL),
+m_maxService(0U),
+m_dropped(0U)
+{
+}
+
+CPipelineStage::~CPipelineStage()
+{
+}
+
+void CPipelineStage::begin(unsigned int depth)
+{
+	m_start = CStopWatch::monotonic();
+
+	if (depth > m_maxDepth)
+		m_maxDepth = depth;
+}
+
+void CPipelineStage::end(unsigned int frames)
+{
+	// Idle runs would only dilute the service time
+	if (frames == 0U)
+		return;
+
+	unsigned int service = (unsigned int)(CStopWatch::monotonic() - m_start);
+
+	m_frames += frames;
+	m_runs++;
+	m_totalService += service;
+	if (service > m_maxService)
+		m_maxService = service;
+}
+
+void CPipelineStage::drop(unsigned int frames)
+{
+	m_dropped += frames;
+}
+
+unsigned int CPipelineStage::getFrames() const
+{
+	return m_frames;
+}
+
+unsigned int CPipelineStage::getMaxDepth() const
+{
+	return m_maxDepth;
+}
+
+unsigned int CPipelineStage::getAverageService() const
+{
+	if (m_runs == 0U)
+		return 0U;
+
+	return (unsigned int)(m_totalService / m_runs);
+}
+
+unsigned int CPipelineStage::getMaxService() const
+{
+	return m_maxService;
+}
+
+unsigned int CPipelineStage::getDropped() const
+{
+	return m_dropped;
+}
+
+void CPipelineStage::logStats()
+{
+	if (m_frames > 0U)
+		LogDebug("%s, %u frames, queue max %u, service avg %uus max %uus", m_name.c_str(), m_frames, m_maxDepth, getAverageService(), m_maxService);
+
+	if (m_dropped > 0U)
+		LogWarning("%s, %u frames dropped, the next queue was full", m_name.c_str(), m_dropped);
+
+	resetStats();
+}
+
+void CPipelineStage::resetStats()
+{
+	m_frames       = 0U;
+	m_runs         = 0U;
+	m_maxDepth     = 0U;
+	m_totalService = 0ULL;
+	m_maxService   = 0U;
+	m_dropped      = 0U;
+}
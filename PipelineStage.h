@@ -0,0 +1,70 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(PIPELINESTAGE_H)
+#define	PIPELINESTAGE_H
+
+#include <string>
+
+// Large enough for any datagram handed over by the network threads
+const unsigned int PIPELINE_FRAME_LENGTH = 512U;
+
+// One entry of the queues between the stages on the YSF side and between
+// the decode and conversion stages of both directions
+class CPipelineFrame {
+public:
+	unsigned char m_tag;
+	unsigned int  m_count;
+	unsigned int  m_length;
+	unsigned char m_data[PIPELINE_FRAME_LENGTH];
+};
+
+// Throughput, input queue depth and service time of one stage of the frame
+// pipeline. The stage brackets each run with begin() and end().
+class CPipelineStage {
+public:
+	CPipelineStage(const std::string& name);
+	~CPipelineStage();
+
+	void begin(unsigned int depth);
+	void end(unsigned int frames);
+
+	// Frames the next queue had no room for
+	void drop(unsigned int frames = 1U);
+
+	unsigned int getFrames() const;
+	unsigned int getMaxDepth() const;
+	unsigned int getAverageService() const;
+	unsigned int getMaxService() const;
+	unsigned int getDropped() const;
+
+	void logStats();
+	void resetStats();
+
+private:
+	std::string        m_name;
+	unsigned long long m_start;
+	unsigned int       m_frames;
+	unsigned int       m_runs;
+	unsigned int       m_maxDepth;
+	unsigned long long m_totalService;
+	unsigned int       m_maxService;
+	unsigned int       m_dropped;
+};
+
+#endif
@@ -0,0 +1,281 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Measures the frame loop with CPU hogs in the background, with and without
+// the real time mode, over the loopback interface:
+//
+//   make rtbench && sudo ./rtbench [-t seconds] [-H hogs] [-p priority] [-c cpu] [-b busypoll]
+//
+// The loop is the event loop and frame pacer of the gateway. A peer thread
+// sends it one datagram per DMR frame, 60 ms apart, and runs at a real time
+// priority throughout as it stands for the network. The hogs are processes
+// spinning on the CPU, one per CPU by default. The real time case gives the
+// loop the same treatment as [RealTime] gives the gateway: SCHED_FIFO, a
+// pinned CPU, locked memory and optionally SO_BUSY_POLL. The table has how
+// long the datagrams waited to be read and how late the frames went out
+// against their deadlines.
+
+#include "EventLoop.h"
+#include "FramePacer.h"
+#include "StopWatch.h"
+#include "UDPSocket.h"
+#include "Thread.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+const unsigned int DMR_FRAME_PER = 60U;
+const unsigned int MAX_CATCH_UP  = 5U;
+const unsigned int PEER_PRIORITY = 90U;
+const unsigned int PORT          = 42880U;
+
+class CBenchPeer : public CThread {
+public:
+	CBenchPeer(unsigned int seconds) :
+	CThread(),
+	m_seconds(seconds),
+	m_socket("127.0.0.1", PORT + 1U)
+	{
+	}
+
+	bool start()
+	{
+		if (!m_socket.open())
+			return false;
+
+		return run();
+	}
+
+	virtual void entry()
+	{
+		CThread::setPriority(PEER_PRIORITY);
+
+		in_addr address = CUDPSocket::lookup("127.0.0.1");
+
+		unsigned long long start = CStopWatch::monotonic();
+		unsigned int frames = m_seconds * 1000U / DMR_FRAME_PER;
+
+		for (unsigned int n = 0U; n < frames; n++) {
+			unsigned long long time = start + n * DMR_FRAME_PER * 1000ULL;
+			unsigned long long now = CStopWatch::monotonic();
+			if (time > now)
+				::usleep(useconds_t(time - now));
+
+			unsigned char buffer[8U];
+			now = CStopWatch::monotonic();
+			::memcpy(buffer, &now, 8U);
+			m_socket.write(buffer, 8U, address, PORT);
+		}
+
+		m_socket.close();
+	}
+
+private:
+	unsigned int m_seconds;
+	CUDPSocket   m_socket;
+};
+
+static void spin()
+{
+	volatile unsigned long long count = 0ULL;
+	for (;;)
+		count++;
+}
+
+static std::vector<pid_t> startHogs(unsigned int hogs)
+{
+	std::vector<pid_t> pids;
+
+	for (unsigned int i = 0U; i < hogs; i++) {
+		pid_t pid = ::fork();
+		if (pid == 0)
+			spin();
+		else if (pid > 0)
+			pids.push_back(pid);
+	}
+
+	return pids;
+}
+
+static void stopHogs(const std::vector<pid_t>& pids)
+{
+	for (std::vector<pid_t>::const_iterator it = pids.begin(); it != pids.end(); ++it) {
+		::kill(*it, SIGKILL);
+		::waitpid(*it, NULL, 0);
+	}
+}
+
+static unsigned int percentile(std::vector<unsigned int> values, unsigned int percent)
+{
+	if (values.empty())
+		return 0U;
+
+	std::sort(values.begin(), values.end());
+
+	return values[(values.size() - 1U) * percent / 100U];
+}
+
+static bool bench(const char* name, unsigned int seconds, unsigned int hogs, bool realTime, unsigned int priority, int cpu, unsigned int busyPoll)
+{
+	CUDPSocket socket("127.0.0.1", PORT);
+	if (realTime)
+		socket.setBusyPoll(busyPoll);
+
+	if (!socket.open())
+		return false;
+
+	// Before the real time mode, the hogs would inherit it
+	std::vector<pid_t> pids = startHogs(hogs);
+
+	if (realTime) {
+		CThread::setAffinity(cpu);
+		CThread::lockMemory();
+		if (!CThread::setPriority(priority)) {
+			::fprintf(stdout, "%-18s needs CAP_SYS_NICE, not run\n", name);
+			stopHogs(pids);
+			socket.close();
+			return false;
+		}
+	}
+
+	CEventLoop loop;
+	if (!loop.open()) {
+		stopHogs(pids);
+		socket.close();
+		return false;
+	}
+
+	loop.watch(socket.getFd());
+	int timer = loop.addTimer();
+
+	CBenchPeer peer(seconds);
+	if (!peer.start()) {
+		stopHogs(pids);
+		socket.close();
+		return false;
+	}
+
+	CFramePacer pacer("DMR pacer", DMR_FRAME_PER, MAX_CATCH_UP);
+	pacer.start();
+
+	std::deque<unsigned long long> queue;
+	std::vector<unsigned int> reads;
+	std::vector<unsigned int> lateness;
+
+	unsigned long long end = CStopWatch::monotonic() + seconds * 1000000ULL;
+
+	while (CStopWatch::monotonic() < end) {
+		loop.setTimer(timer, pacer.getDeadline());
+		loop.wait();
+
+		for (;;) {
+			unsigned char buffer[100U];
+			in_addr address;
+			unsigned int port;
+			if (socket.read(buffer, 100U, address, port) != 8)
+				break;
+
+			unsigned long long sent;
+			::memcpy(&sent, buffer, 8U);
+
+			reads.push_back((unsigned int)(CStopWatch::monotonic() - sent));
+			queue.push_back(sent);
+		}
+
+		while (pacer.isDue()) {
+			if (queue.empty()) {
+				pacer.skip();
+			} else {
+				unsigned long long now = CStopWatch::monotonic();
+				lateness.push_back((unsigned int)(now - pacer.getDeadline()));
+				queue.pop_front();
+				pacer.next();
+			}
+		}
+	}
+
+	peer.wait();
+	stopHogs(pids);
+	loop.close();
+	socket.close();
+
+	::fprintf(stdout, "%-18s %7u %9.2f %9.2f %9.2f %9.2f %9.2f %7u\n", name, (unsigned int)lateness.size(),
+		double(percentile(reads, 50U)) / 1000.0, double(percentile(reads, 100U)) / 1000.0,
+		double(percentile(lateness, 50U)) / 1000.0, double(percentile(lateness, 99U)) / 1000.0, double(percentile(lateness, 100U)) / 1000.0,
+		pacer.getResyncs());
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int seconds  = 20U;
+	long cpus             = ::sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int hogs     = cpus > 0L ? (unsigned int)cpus : 1U;
+	unsigned int priority = 50U;
+	int cpu               = 0;
+	unsigned int busyPoll = 0U;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-t" && i + 1 < argc)
+			seconds = (unsigned int)::atoi(argv[++i]);
+		else if (arg == "-H" && i + 1 < argc)
+			hogs = (unsigned int)::atoi(argv[++i]);
+		else if (arg == "-p" && i + 1 < argc)
+			priority = (unsigned int)::atoi(argv[++i]);
+		else if (arg == "-c" && i + 1 < argc)
+			cpu = ::atoi(argv[++i]);
+		else if (arg == "-b" && i + 1 < argc)
+			busyPoll = (unsigned int)::atoi(argv[++i]);
+		else {
+			::fprintf(stderr, "Usage: rtbench [-t seconds] [-H hogs] [-p priority] [-c cpu, -1 for none] [-b busy poll us]\n");
+			return 1;
+		}
+	}
+
+	if (seconds == 0U) {
+		::fprintf(stderr, "rtbench: the time has to be at least a second\n");
+		return 1;
+	}
+
+	::LogInitialise(".", "rtbench", 0U, 4U);
+
+	::fprintf(stdout, "%-18s %7s %19s %29s %7s\n", "", "", "read (ms)", "late (ms)", "");
+	::fprintf(stdout, "%-18s %7s %9s %9s %9s %9s %9s %7s\n", "case", "frames", "p50", "max", "p50", "p99", "max", "resyncs");
+
+	bool ok = bench("quiet", seconds, 0U, false, priority, cpu, busyPoll);
+	ok = bench("hogs", seconds, hogs, false, priority, cpu, busyPoll) && ok;
+
+	// Last, the memory stays locked and the thread real time from here on
+	ok = bench("hogs + real time", seconds, hogs, true, priority, cpu, busyPoll) && ok;
+
+	::LogFinalise();
+
+	return ok ? 0 : 1;
+}
@@ -26,11 +26,17 @@
 #include <cstring>
 #include <cctype>
 
-CReflectors::CReflectors(const std::string& hostsFile, unsigned int reloadTime) :
+CReflectors::CReflectors(CTimerWheel& wheel, const std::string& hostsFile, unsigned int reloadTime) :
 m_hostsFile(hostsFile),
 m_reflectors(),
-m_timer(1000U, reloadTime * 60U)
+m_mutex(),
+m_timer(wheel, reloadTime * 60U)
 {
+    m_timer.setCallback([this] {
+        load();
+        m_timer.start();
+    });
+
     if (reloadTime > 0U)
         m_timer.start();
 }
@@ -45,10 +51,8 @@ CReflectors::~CReflectors()
 
 bool CReflectors::load()
 {
-	for (std::vector<CReflector*>::iterator it = m_reflectors.begin(); it != m_reflectors.end(); ++it)
-		delete *it;
-
-	m_reflectors.clear();
+	// Read the file outside the lock, the sessions only wait for the swap
+	std::vector<CReflector*> reflectors;
 
 	FILE* fp = ::fopen(m_hostsFile.c_str(), "rt");
 	if (fp != NULL) {
@@ -57,50 +61,57 @@ bool CReflectors::load()
 			if (buffer[0U] == '#')
 				continue;
 
-			char* p1 = ::strtok(buffer, ";\r\n");
-			char* p2 = ::strtok(NULL, ";\r\n");
-			char* p3 = ::strtok(NULL, "\r\n");
+			char* save = NULL;
+			char* p1 = ::strtok_r(buffer, ";\r\n", &save);
+			char* p2 = ::strtok_r(NULL, ";\r\n", &save);
+			char* p3 = ::strtok_r(NULL, "\r\n", &save);
 
 			if (p1 != NULL && p2 != NULL && p3 != NULL) {
 				CReflector* refl = new CReflector;
 				refl->m_id       = (unsigned int)::atoi(p1);
 				refl->m_address  = std::string(p2);
 				refl->m_startup  = (unsigned int)::atoi(p3);
-				m_reflectors.push_back(refl);
+				reflectors.push_back(refl);
 			}
 		}
 
 		::fclose(fp);
 	}
 
+	m_mutex.lock();
+
+	m_reflectors.swap(reflectors);
+
 	size_t size = m_reflectors.size();
+
+	m_mutex.unlock();
+
+	for (std::vector<CReflector*>::iterator it = reflectors.begin(); it != reflectors.end(); ++it)
+		delete *it;
+
 	LogInfo("Loaded %u XLX reflectors", size);
 
-	size = m_reflectors.size();
 	if (size == 0U)
 		return false;
 
 	return true;
 }
 
-CReflector* CReflectors::find(unsigned int id)
+bool CReflectors::find(unsigned int id, CReflector& reflector)
 {
+	m_mutex.lock();
+
 	for (std::vector<CReflector*>::iterator it = m_reflectors.begin(); it != m_reflectors.end(); ++it) {
-		if (id == (*it)->m_id)
-			return *it;
+		if (id == (*it)->m_id) {
+			reflector = **it;
+			m_mutex.unlock();
+			return true;
+		}
 	}
 
-	LogMessage("Trying to find non existent XLX reflector with an id of %u", id);
+	m_mutex.unlock();
 
-	return NULL;
-}
-
-void CReflectors::clock(unsigned int ms)
-{
-    m_timer.clock(ms);
+	LogMessage("Trying to find non existent XLX reflector with an id of %u", id);
 
-    if (m_timer.isRunning() && m_timer.hasExpired()) {
-        load();
-        m_timer.start();
-    }
+	return false;
 }
@@ -19,7 +19,8 @@
 #if !defined(Reflectors_H)
 #define	Reflectors_H
 
-#include "Timer.h"
+#include "TimerWheel.h"
+#include "Mutex.h"
 
 #include <vector>
 #include <string>
@@ -40,19 +41,19 @@ public:
 
 class CReflectors {
 public:
-	CReflectors(const std::string& hostsFile, unsigned int reloadTime);
+	CReflectors(CTimerWheel& wheel, const std::string& hostsFile, unsigned int reloadTime);
 	~CReflectors();
 
 	bool load();
 
-	CReflector* find(unsigned int id);
-
-    void clock(unsigned int ms);
+	// Copies the reflector out, the list may be reloaded by another thread
+	bool find(unsigned int id, CReflector& reflector);
 
 private:
 	std::string              m_hostsFile;
 	std::vector<CReflector*> m_reflectors;
-    CTimer                   m_timer;
+	CMutex                   m_mutex;
+    CWheelTimer              m_timer;
 };
 
 #endif
@@ -0,0 +1,110 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef SPSCQueue_H
+#define SPSCQueue_H
+
+#include "Log.h"
+
+#include <atomic>
+#include <cassert>
+
+// Bounded lock free queue between exactly one producer thread and one
+// consumer thread. The length is rounded up to a power of two.
+template<class T> class CSPSCQueue {
+public:
+	CSPSCQueue(unsigned int length, const char* name) :
+	m_length(1U),
+	m_name(name),
+	m_buffer(NULL),
+	m_head(0U),
+	m_tail(0U)
+	{
+		assert(length > 0U);
+		assert(name != NULL);
+
+		while (m_length < length)
+			m_length <<= 1;
+
+		m_buffer = new T[m_length];
+	}
+
+	~CSPSCQueue()
+	{
+		delete[] m_buffer;
+	}
+
+	// Producer side
+	bool push(const T& item)
+	{
+		unsigned int head = m_head.load(std::memory_order_relaxed);
+		unsigned int tail = m_tail.load(std::memory_order_acquire);
+
+		if (head - tail >= m_length) {
+			LogError("%s queue overflow, dropping an entry", m_name);
+			return false;
+		}
+
+		m_buffer[head & (m_length - 1U)] = item;
+
+		m_head.store(head + 1U, std::memory_order_release);
+
+		return true;
+	}
+
+	// Room for n more entries, as the producer sees it
+	bool hasSpace(unsigned int n = 1U) const
+	{
+		return m_length - (m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire)) >= n;
+	}
+
+	// Consumer side
+	bool pop(T& item)
+	{
+		unsigned int tail = m_tail.load(std::memory_order_relaxed);
+		unsigned int head = m_head.load(std::memory_order_acquire);
+
+		if (head == tail)
+			return false;
+
+		item = m_buffer[tail & (m_length - 1U)];
+
+		m_tail.store(tail + 1U, std::memory_order_release);
+
+		return true;
+	}
+
+	unsigned int dataSize() const
+	{
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+
+	bool isEmpty() const
+	{
+		return dataSize() == 0U;
+	}
+
+private:
+	unsigned int              m_length;
+	const char*               m_name;
+	T*                        m_buffer;
+	std::atomic<unsigned int> m_head;
+	std::atomic<unsigned int> m_tail;
+};
+
+#endif
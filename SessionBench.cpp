@@ -0,0 +1,434 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Measures how the gateway keeps up as the number of sessions grows, over
+// the loopback interface:
+//
+//   make sessionbench && ./sessionbench [-g gateway] [-w workers] [-c] [-t seconds] [sessions ...]
+//
+// For each session count a .ini with that many [Session]s is written and
+// the gateway started on it, the bench being the YSF peer and the DMR
+// master of all of them. Once every session has logged in, each one gets a
+// call of the given length, the calls starting spread over one YSF frame.
+// The DMR frames coming out are timed against the 60 ms grid of their
+// stream: the lateness of a frame is how far it is behind the place in the
+// grid its stream mostly gives them, the median. The table has the DMR
+// frames per second out of the whole gateway, with the median, 99th
+// percentile and worst lateness. With -c the conversion runs on the
+// converter thread.
+
+#include "StopWatch.h"
+#include "UDPSocket.h"
+#include "YSFDefines.h"
+#include "YSFPayload.h"
+#include "YSFFICH.h"
+#include "Thread.h"
+#include "Sync.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+const unsigned int PEER_PORT     = 42990U;
+const unsigned int MASTER_PORT   = 62190U;
+const unsigned int SESSION_PORT  = 43000U;
+
+const unsigned int YSF_FRAME_US  = 100000U;
+const unsigned int DMR_FRAME_US  = 60000U;
+
+const unsigned int LOGIN_TIMEOUT = 60U;
+const unsigned int DRAIN_TIME    = 3U;
+
+class CBenchStream {
+public:
+	CBenchStream() :
+	m_started(false),
+	m_index(0U),
+	m_seq(0U),
+	m_times(),
+	m_indexes()
+	{
+	}
+
+	bool                            m_started;
+	unsigned int                    m_index;
+	unsigned char                   m_seq;
+	std::vector<unsigned long long> m_times;
+	std::vector<unsigned int>       m_indexes;
+};
+
+// The DMR master of every session, it answers the logins and the pings and
+// times each voice frame as it arrives
+class CBenchMaster : public CThread {
+public:
+	CBenchMaster(CUDPSocket& socket) :
+	CThread(),
+	m_socket(socket),
+	m_stop(false),
+	m_logins(0U),
+	m_streams(),
+	m_logged()
+	{
+	}
+
+	virtual void entry()
+	{
+		unsigned char buffer[600U];
+
+		while (!m_stop) {
+			struct pollfd fds[1U];
+			fds[0U].fd     = m_socket.getFd();
+			fds[0U].events = POLLIN;
+			if (::poll(fds, 1U, 100) <= 0)
+				continue;
+
+			in_addr address;
+			unsigned int port;
+			int length;
+			while ((length = m_socket.read(buffer, 600U, address, port)) > 0) {
+				unsigned long long now = CStopWatch::monotonic();
+
+				if (length >= 53 && ::memcmp(buffer, "DMRD", 4U) == 0) {
+					unsigned int streamId = (buffer[16U] << 24) | (buffer[17U] << 16) | (buffer[18U] << 8) | buffer[19U];
+
+					CBenchStream& stream = m_streams[std::make_pair(port, streamId)];
+					if (!stream.m_started)
+						stream.m_seq = buffer[4U];
+					stream.m_index  += (unsigned char)(buffer[4U] - stream.m_seq);
+					stream.m_seq     = buffer[4U];
+					stream.m_started = true;
+
+					// Only the voice is paced, the headers and terminators go out at once
+					if ((buffer[15U] & 0x20U) == 0x00U) {
+						stream.m_times.push_back(now);
+						stream.m_indexes.push_back(stream.m_index);
+					}
+				} else if (length >= 7 && ::memcmp(buffer, "RPTPING", 7U) == 0) {
+					::memcpy(buffer, "MSTPONG", 7U);
+					m_socket.write(buffer, 11U, address, port);
+				} else if (length >= 5 && ::memcmp(buffer, "RPTCL", 5U) == 0) {
+					// Closing down
+				} else if (length >= 8 && ::memcmp(buffer, "RPTL", 4U) == 0) {
+					unsigned char reply[10U] = {'R', 'P', 'T', 'A', 'C', 'K', 0x01U, 0x02U, 0x03U, 0x04U};
+					m_socket.write(reply, 10U, address, port);
+				} else if (length >= 8 && (::memcmp(buffer, "RPTK", 4U) == 0 || ::memcmp(buffer, "RPTC", 4U) == 0)) {
+					unsigned char reply[10U];
+					::memcpy(reply, "RPTACK", 6U);
+					::memcpy(reply + 6U, buffer + 4U, 4U);
+					m_socket.write(reply, 10U, address, port);
+
+					if (buffer[3U] == 'C' && m_logged.insert(port).second)
+						m_logins++;
+				}
+			}
+		}
+	}
+
+	void stop()
+	{
+		m_stop = true;
+		wait();
+	}
+
+	unsigned int getLogins() const
+	{
+		return m_logins;
+	}
+
+	const std::map<std::pair<unsigned int, unsigned int>, CBenchStream>& getStreams() const
+	{
+		return m_streams;
+	}
+
+private:
+	CUDPSocket&               m_socket;
+	std::atomic<bool>         m_stop;
+	std::atomic<unsigned int> m_logins;
+	std::map<std::pair<unsigned int, unsigned int>, CBenchStream> m_streams;
+	std::set<unsigned int>    m_logged;
+};
+
+static void buildFrame(unsigned char* buffer, unsigned char fi, unsigned int n)
+{
+	::memset(buffer, 0x00U, 155U);
+
+	::memcpy(buffer + 0U,  "YSFD", 4U);
+	::memcpy(buffer + 4U,  "BENCH     ", YSF_CALLSIGN_LENGTH);
+	::memcpy(buffer + 14U, "BENCH     ", YSF_CALLSIGN_LENGTH);
+	::memcpy(buffer + 24U, "ALL       ", YSF_CALLSIGN_LENGTH);
+
+	// The frame counter, with the end of transmission flag on the terminator
+	buffer[34U] = (unsigned char)((n & 0x7FU) << 1) | (fi == YSF_FI_TERMINATOR ? 0x01U : 0x00U);
+
+	CSync::addYSFSync(buffer + 35U);
+
+	unsigned int fn = fi == YSF_FI_COMMUNICATIONS ? (n - 1U) % 7U : 0U;
+
+	CYSFFICH fich;
+	fich.setFI(fi);
+	fich.setCS(2U);
+	fich.setCM(0U);
+	fich.setBN(0U);
+	fich.setBT(0U);
+	fich.setFN(fn);
+	fich.setFT(6U);
+	fich.setDev(0U);
+	fich.setMR(0U);
+	fich.setVoIP(0U);
+	fich.setDT(YSF_DT_VD_MODE2);
+	fich.setSQL(0U);
+	fich.setSQ(0U);
+	fich.encode(buffer + 35U);
+
+	CYSFPayload payload;
+	if (fi == YSF_FI_COMMUNICATIONS) {
+		payload.writeVDMode2Data(buffer + 35U, (const unsigned char*)"          ");
+	} else {
+		unsigned char csd1[20U], csd2[20U];
+		::memset(csd1, '*', YSF_CALLSIGN_LENGTH);
+		::memcpy(csd1 + YSF_CALLSIGN_LENGTH, "BENCH     ", YSF_CALLSIGN_LENGTH);
+		::memset(csd2, ' ', YSF_CALLSIGN_LENGTH + YSF_CALLSIGN_LENGTH);
+		payload.writeHeader(buffer + 35U, csd1, csd2);
+	}
+}
+
+static bool writeConfig(const std::string& fileName, unsigned int sessions, int workers, bool converter)
+{
+	FILE* fp = ::fopen(fileName.c_str(), "wt");
+	if (fp == NULL) {
+		::fprintf(stderr, "sessionbench: cannot create %s\n", fileName.c_str());
+		return false;
+	}
+
+	::fprintf(fp, "[Info]\nRXFrequency=435000000\nTXFrequency=435000000\nPower=1\nLatitude=0.0\nLongitude=0.0\nHeight=0\n");
+	::fprintf(fp, "Location=Bench\nDescription=Bench\nURL=none\n\n");
+	::fprintf(fp, "[YSF Network]\nCallsign=BENCH\nSuffix=ND\nDstAddress=127.0.0.1\nDstPort=%u\nLocalAddress=127.0.0.1\n", PEER_PORT);
+	::fprintf(fp, "EnableWiresX=0\nRemoteGateway=0\nHangTime=1000\nDaemon=0\n\n");
+	::fprintf(fp, "[DMR Network]\nId=1234567\nStartupDstId=9\nStartupPC=0\nAddress=127.0.0.1\nPort=%u\n", MASTER_PORT);
+	::fprintf(fp, "Jitter=500\nEnableUnlink=0\nPassword=PASSWORD\nDebug=0\n\n");
+	::fprintf(fp, "[DMR Id Lookup]\nFile=/dev/null\nTime=0\nDropUnknown=0\n\n");
+	::fprintf(fp, "[Log]\nDisplayLevel=0\nFileLevel=0\nFilePath=/tmp\nFileRoot=sessionbench\n\n");
+	::fprintf(fp, "[aprs.fi]\nEnable=0\n\n");
+	::fprintf(fp, "[Scheduler]\nWorkers=%d\nConverter=%d\n\n", workers, converter ? 1 : 0);
+
+	// Sessions with the same Id would have to share a login, one on each slot
+	for (unsigned int i = 0U; i < sessions; i++)
+		::fprintf(fp, "[Session s%u]\n[YSF Network]\nLocalPort=%u\n[DMR Network]\nId=%u\n\n", i, SESSION_PORT + i, 1234567U + i);
+
+	::fclose(fp);
+
+	return true;
+}
+
+static void sleepUntil(unsigned long long time)
+{
+	unsigned long long now = CStopWatch::monotonic();
+	if (time > now)
+		::usleep(useconds_t(time - now));
+}
+
+static bool bench(const std::string& gateway, unsigned int sessions, int workers, bool converter, unsigned int seconds)
+{
+	char iniFile[100U];
+	::sprintf(iniFile, "/tmp/sessionbench-%d.ini", int(::getpid()));
+	if (!writeConfig(iniFile, sessions, workers, converter))
+		return false;
+
+	CUDPSocket peer("127.0.0.1", PEER_PORT);
+	CUDPSocket master("127.0.0.1", MASTER_PORT);
+	if (!peer.open() || !master.open())
+		return false;
+
+	CBenchMaster thread(master);
+	thread.run();
+
+	pid_t pid = ::fork();
+	if (pid == 0) {
+		int null = ::open("/dev/null", O_WRONLY);
+		::dup2(null, STDOUT_FILENO);
+		::dup2(null, STDERR_FILENO);
+
+		::execl(gateway.c_str(), gateway.c_str(), iniFile, (char*)NULL);
+		::fprintf(stderr, "sessionbench: cannot run %s\n", gateway.c_str());
+		::_exit(1);
+	}
+
+	bool ok = true;
+
+	unsigned long long timeout = CStopWatch::monotonic() + LOGIN_TIMEOUT * 1000000ULL;
+	while (thread.getLogins() < sessions && CStopWatch::monotonic() < timeout)
+		CThread::sleep(100U);
+
+	if (thread.getLogins() < sessions) {
+		::fprintf(stderr, "sessionbench: only %u of %u sessions logged in\n", thread.getLogins(), sessions);
+		ok = false;
+	}
+
+	in_addr address = CUDPSocket::lookup("127.0.0.1");
+
+	// A header, the voice frames and a terminator for every session, each
+	// session a fraction of a frame behind the one before
+	unsigned int frames = seconds * 1000000U / YSF_FRAME_US;
+	unsigned long long start = CStopWatch::monotonic() + 100000ULL;
+	unsigned char buffer[155U];
+
+	for (unsigned int n = 0U; ok && n <= frames + 1U; n++) {
+		unsigned char fi = n == 0U ? YSF_FI_HEADER : (n > frames ? YSF_FI_TERMINATOR : YSF_FI_COMMUNICATIONS);
+		buildFrame(buffer, fi, n);
+
+		for (unsigned int i = 0U; i < sessions; i++) {
+			sleepUntil(start + n * YSF_FRAME_US + i * YSF_FRAME_US / sessions);
+			peer.write(buffer, 155U, address, SESSION_PORT + i);
+		}
+
+		// Nothing comes back on the YSF side, but the polls are thrown away
+		in_addr from;
+		unsigned int fromPort;
+		while (peer.read(buffer, 155U, from, fromPort) > 0)
+			;
+	}
+
+	CThread::sleep(DRAIN_TIME * 1000U);
+
+	::kill(pid, SIGTERM);
+	::waitpid(pid, NULL, 0);
+
+	thread.stop();
+
+	peer.close();
+	master.close();
+	::unlink(iniFile);
+
+	if (!ok)
+		return false;
+
+	// Each frame against where its stream usually puts them, the first frame
+	// goes straight after the header and so comes early
+	std::vector<unsigned long long> lateness;
+	unsigned long long first = 0ULL;
+	unsigned long long last  = 0ULL;
+	unsigned int streams = 0U;
+
+	const std::map<std::pair<unsigned int, unsigned int>, CBenchStream>& all = thread.getStreams();
+	for (std::map<std::pair<unsigned int, unsigned int>, CBenchStream>::const_iterator it = all.begin(); it != all.end(); ++it) {
+		const CBenchStream& stream = it->second;
+		if (stream.m_times.size() < 2U)
+			continue;
+
+		streams++;
+
+		std::vector<unsigned long long> offsets;
+		for (unsigned int i = 0U; i < stream.m_times.size(); i++)
+			offsets.push_back(stream.m_times[i] - stream.m_indexes[i] * (unsigned long long)DMR_FRAME_US);
+
+		std::vector<unsigned long long> sorted = offsets;
+		std::sort(sorted.begin(), sorted.end());
+		unsigned long long origin = sorted[sorted.size() / 2U];
+
+		for (unsigned int i = 0U; i < offsets.size(); i++)
+			lateness.push_back(offsets[i] > origin ? offsets[i] - origin : 0ULL);
+
+		if (first == 0ULL || stream.m_times.front() < first)
+			first = stream.m_times.front();
+		if (stream.m_times.back() > last)
+			last = stream.m_times.back();
+	}
+
+	if (lateness.empty() || last <= first) {
+		::fprintf(stderr, "sessionbench: no DMR frames came out of the gateway\n");
+		return false;
+	}
+
+	std::sort(lateness.begin(), lateness.end());
+
+	double rate = double(lateness.size()) * 1000000.0 / double(last - first);
+
+	::fprintf(stdout, "%8u  %7d  %9s  %7u  %10.0f  %9.2f  %9.2f  %9.2f\n", sessions, workers, converter ? "yes" : "no", streams, rate,
+		double(lateness[lateness.size() / 2U]) / 1000.0,
+		double(lateness[(lateness.size() * 99U) / 100U]) / 1000.0,
+		double(lateness.back()) / 1000.0);
+	::fflush(stdout);
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::string gateway = "./YSF2DMR";
+	int workers = 0;
+	bool converter = false;
+	unsigned int seconds = 10U;
+	std::vector<unsigned int> counts;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-g" && i + 1 < argc)
+			gateway = argv[++i];
+		else if (arg == "-w" && i + 1 < argc)
+			workers = ::atoi(argv[++i]);
+		else if (arg == "-c")
+			converter = true;
+		else if (arg == "-t" && i + 1 < argc)
+			seconds = (unsigned int)::atoi(argv[++i]);
+		else if (arg[0U] != '-' && ::atoi(arg.c_str()) > 0)
+			counts.push_back((unsigned int)::atoi(arg.c_str()));
+		else {
+			::fprintf(stderr, "Usage: sessionbench [-g gateway] [-w workers, -1 for one per CPU] [-c] [-t seconds] [sessions ...]\n");
+			return 1;
+		}
+	}
+
+	if (counts.empty()) {
+		unsigned int defaults[] = {1U, 10U, 50U, 100U, 250U, 500U};
+		counts.assign(defaults, defaults + 6U);
+	}
+
+	// Every session has two sockets and a few eventfds
+	struct rlimit limit;
+	if (::getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		::setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	::LogInitialise(".", "sessionbench", 0U, 4U);
+
+	::fprintf(stdout, "sessions  workers  converter  streams  frames/s    p50 (ms)   p99 (ms)   max (ms)\n");
+
+	bool ok = true;
+	for (std::vector<unsigned int>::const_iterator it = counts.begin(); it != counts.end(); ++it)
+		ok = bench(gateway, *it, workers, converter, seconds) && ok;
+
+	::LogFinalise();
+
+	return ok ? 0 : 1;
+}
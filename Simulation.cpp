@@ -0,0 +1,268 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "Simulation.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+// Virtual wall clock time at the start of a simulation, 2019-01-01 00:00:00 UTC
+const unsigned long long SIM_EPOCH = 1546300800000000ULL;
+
+// How long the gateway keeps running after the last event of a scenario without an end
+const unsigned long long SIM_DRAIN = 5000000ULL;
+
+const unsigned char SIM_SALT[] = {0x12U, 0x34U, 0x56U, 0x78U};
+
+CSimTransport::CSimTransport(const std::string& name, bool master, FILE* output, CVirtualClock& clock) :
+m_name(name),
+m_master(master),
+m_output(output),
+m_clock(clock),
+m_address(),
+m_port(0U),
+m_queue()
+{
+	m_address.s_addr = INADDR_NONE;
+}
+
+CSimTransport::~CSimTransport()
+{
+}
+
+void CSimTransport::setPeer(const in_addr& address, unsigned int port)
+{
+	m_address = address;
+	m_port    = port;
+}
+
+void CSimTransport::add(const std::vector<unsigned char>& data)
+{
+	m_queue.push_back(data);
+}
+
+bool CSimTransport::hasData() const
+{
+	return !m_queue.empty();
+}
+
+int CSimTransport::read(unsigned char* buffer, unsigned int length, in_addr& address, unsigned int& port)
+{
+	assert(buffer != NULL);
+
+	if (m_queue.empty())
+		return 0;
+
+	std::vector<unsigned char> data = m_queue.front();
+	m_queue.pop_front();
+
+	unsigned int n = std::min((unsigned int)data.size(), length);
+	::memcpy(buffer, data.data(), n);
+
+	address = m_address;
+	port    = m_port;
+
+	return int(n);
+}
+
+bool CSimTransport::write(const unsigned char* buffer, unsigned int length, const in_addr&, unsigned int)
+{
+	assert(buffer != NULL);
+
+	unsigned long long now = m_clock.monotonic();
+
+	::fprintf(m_output, "%llu.%03llu %s ", now / 1000ULL, now % 1000ULL, m_name.c_str());
+	for (unsigned int i = 0U; i < length; i++)
+		::fprintf(m_output, "%02X", buffer[i]);
+	::fprintf(m_output, "\n");
+
+	if (!m_master)
+		return true;
+
+	if (length >= 8U && ::memcmp(buffer, "RPTL", 4U) == 0)
+		reply("RPTACK", SIM_SALT, 4U);
+	else if (length >= 11U && ::memcmp(buffer, "RPTPING", 7U) == 0)
+		reply("MSTPONG", buffer + 7U, 4U);
+	else if (length >= 8U && ::memcmp(buffer, "RPTCL", 5U) != 0 && (::memcmp(buffer, "RPTK", 4U) == 0 || ::memcmp(buffer, "RPTC", 4U) == 0 || ::memcmp(buffer, "RPTO", 4U) == 0))
+		reply("RPTACK", buffer + 4U, 4U);
+
+	return true;
+}
+
+void CSimTransport::reply(const char* type, const unsigned char* data, unsigned int length)
+{
+	std::vector<unsigned char> reply(type, type + ::strlen(type));
+	reply.insert(reply.end(), data, data + length);
+
+	m_queue.push_back(reply);
+}
+
+CSimulation::CSimulation(const std::string& scenario, const std::string& output) :
+m_scenario(scenario),
+m_outputName(output),
+m_output(NULL),
+m_clock(SIM_EPOCH),
+m_ysf(NULL),
+m_dmr(NULL),
+m_events(),
+m_next(0U),
+m_end(0ULL)
+{
+}
+
+CSimulation::~CSimulation()
+{
+	if (m_output != NULL && m_output != stdout)
+		::fclose(m_output);
+
+	delete m_ysf;
+	delete m_dmr;
+}
+
+bool CSimulation::open()
+{
+	FILE* fp = ::fopen(m_scenario.c_str(), "rt");
+	if (fp == NULL) {
+		::fprintf(stderr, "YSF2DMR: cannot open the scenario file %s\n", m_scenario.c_str());
+		return false;
+	}
+
+	bool hasEnd = false;
+	unsigned int lineNo = 0U;
+
+	char line[2048U];
+	while (::fgets(line, sizeof(line), fp) != NULL) {
+		lineNo++;
+
+		char* time = ::strtok(line, " \t\r\n");
+		if (time == NULL || time[0U] == '#')
+			continue;
+
+		char* type = ::strtok(NULL, " \t\r\n");
+		char* hex  = ::strtok(NULL, " \t\r\n");
+		if (type == NULL) {
+			::fprintf(stderr, "YSF2DMR: malformed scenario line %u\n", lineNo);
+			::fclose(fp);
+			return false;
+		}
+
+		unsigned long long at = ::strtoull(time, NULL, 10) * 1000ULL;
+
+		if (::strcmp(type, "end") == 0) {
+			m_end  = at;
+			hasEnd = true;
+			continue;
+		}
+
+		if ((::strcmp(type, "ysf") != 0 && ::strcmp(type, "dmr") != 0) || hex == NULL || (::strlen(hex) % 2U) != 0U) {
+			::fprintf(stderr, "YSF2DMR: malformed scenario line %u\n", lineNo);
+			::fclose(fp);
+			return false;
+		}
+
+		CSimDatagram event;
+		event.m_time = at;
+		event.m_dmr  = ::strcmp(type, "dmr") == 0;
+		for (unsigned int i = 0U; hex[i] != '\0'; i += 2U) {
+			char byte[3U] = {hex[i], hex[i + 1U], '\0'};
+			event.m_data.push_back((unsigned char)::strtoul(byte, NULL, 16));
+		}
+
+		m_events.push_back(event);
+	}
+
+	::fclose(fp);
+
+	std::stable_sort(m_events.begin(), m_events.end(), [](const CSimDatagram& a, const CSimDatagram& b) { return a.m_time < b.m_time; });
+
+	if (!hasEnd)
+		m_end = (m_events.empty() ? 0ULL : m_events.back().m_time) + SIM_DRAIN;
+
+	if (m_outputName.empty()) {
+		m_output = stdout;
+	} else {
+		m_output = ::fopen(m_outputName.c_str(), "wt");
+		if (m_output == NULL) {
+			::fprintf(stderr, "YSF2DMR: cannot open the simulation output file %s\n", m_outputName.c_str());
+			return false;
+		}
+	}
+
+	m_ysf = new CSimTransport("ysf", false, m_output, m_clock);
+	m_dmr = new CSimTransport("dmr", true, m_output, m_clock);
+
+	return true;
+}
+
+CVirtualClock& CSimulation::getClock()
+{
+	return m_clock;
+}
+
+CSimTransport& CSimulation::getYSF()
+{
+	assert(m_ysf != NULL);
+
+	return *m_ysf;
+}
+
+CSimTransport& CSimulation::getDMR()
+{
+	assert(m_dmr != NULL);
+
+	return *m_dmr;
+}
+
+bool CSimulation::advance(unsigned long long deadline)
+{
+	unsigned long long now = m_clock.monotonic();
+	if (now >= m_end)
+		return false;
+
+	// Pending datagrams are handled before time moves on, as a readable socket would be
+	if (m_ysf->hasData() || m_dmr->hasData())
+		return true;
+
+	unsigned long long next = std::min(deadline, m_end);
+	if (m_next < m_events.size() && m_events[m_next].m_time < next)
+		next = m_events[m_next].m_time;
+
+	m_clock.advanceTo(next);
+	now = m_clock.monotonic();
+
+	while (m_next < m_events.size() && m_events[m_next].m_time <= now) {
+		const CSimDatagram& event = m_events[m_next++];
+		if (event.m_dmr)
+			m_dmr->add(event.m_data);
+		else
+			m_ysf->add(event.m_data);
+	}
+
+	return true;
+}
+
+void CSimulation::stop()
+{
+	LogMessage("Simulation finished at %llu ms, %u scenario events", m_clock.monotonic() / 1000ULL, (unsigned int)m_events.size());
+
+	// Let any thread waiting on the virtual clock finish
+	m_clock.release();
+}
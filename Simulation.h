@@ -0,0 +1,103 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(SIMULATION_H)
+#define	SIMULATION_H
+
+#include "UDPSocket.h"
+#include "Clock.h"
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+class CSimDatagram {
+public:
+	unsigned long long         m_time;
+	bool                       m_dmr;
+	std::vector<unsigned char> m_data;
+};
+
+// One side of the gateway in a simulation. Datagrams from the scenario are
+// read as if they came from the peer, everything written is recorded with
+// its virtual time. As the DMR master it also answers the login and the
+// keepalives so that scenarios only have to script the traffic.
+class CSimTransport : public CUDPTransport {
+public:
+	CSimTransport(const std::string& name, bool master, FILE* output, CVirtualClock& clock);
+	virtual ~CSimTransport();
+
+	void setPeer(const in_addr& address, unsigned int port);
+
+	void add(const std::vector<unsigned char>& data);
+
+	bool hasData() const;
+
+	virtual int  read(unsigned char* buffer, unsigned int length, in_addr& address, unsigned int& port);
+	virtual bool write(const unsigned char* buffer, unsigned int length, const in_addr& address, unsigned int port);
+
+private:
+	std::string    m_name;
+	bool           m_master;
+	FILE*          m_output;
+	CVirtualClock& m_clock;
+	in_addr        m_address;
+	unsigned int   m_port;
+	std::deque<std::vector<unsigned char> > m_queue;
+
+	void reply(const char* type, const unsigned char* data, unsigned int length);
+};
+
+// Runs the gateway from a scenario file against a virtual clock. Each line
+// of the scenario is "<ms> ysf|dmr <hex datagram>" or "<ms> end", blank
+// lines and lines starting with # are skipped. Time jumps straight to the
+// next scenario event or gateway deadline, so long scenarios run far faster
+// than real time and always give the same output.
+class CSimulation {
+public:
+	CSimulation(const std::string& scenario, const std::string& output);
+	~CSimulation();
+
+	bool open();
+
+	CVirtualClock& getClock();
+
+	CSimTransport& getYSF();
+	CSimTransport& getDMR();
+
+	// Move the virtual time up to the deadline, or to the next scenario
+	// event if that is sooner, returns false when the scenario has ended
+	bool advance(unsigned long long deadline);
+
+	// Lets the gateway shut down, the output stays open for its last datagrams
+	void stop();
+
+private:
+	std::string                m_scenario;
+	std::string                m_outputName;
+	FILE*                      m_output;
+	CVirtualClock              m_clock;
+	CSimTransport*             m_ysf;
+	CSimTransport*             m_dmr;
+	std::vector<CSimDatagram>  m_events;
+	unsigned int               m_next;
+	unsigned long long         m_end;
+};
+
+#endif
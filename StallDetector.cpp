@@ -0,0 +1,215 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "StallDetector.h"
+#include "StopWatch.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Upper bound of each histogram bucket in microseconds, the last one takes the rest
+const unsigned long long STALL_BOUNDS[STALL_BUCKETS - 1U] = {100ULL, 250ULL, 500ULL, 1000ULL, 2500ULL, 5000ULL, 10000ULL,
+	25000ULL, 50000ULL, 100000ULL, 250000ULL, 500000ULL, 1000000ULL};
+
+CStallDetector::CStallDetector(unsigned int budgetMS, const std::string& name) :
+m_name(name),
+m_budget(budgetMS * 1000ULL),
+m_start(0ULL),
+m_stageStart(0ULL),
+m_stage("idle"),
+m_slowStage("idle"),
+m_slowStageTime(0ULL),
+m_histogram(),
+m_passes(0U),
+m_stalls(0U),
+m_maxTime(0ULL),
+m_maxStage("idle"),
+m_notifyFd(-1),
+m_notifyPath(),
+m_watchdogInterval(0ULL),
+m_lastPing(0ULL),
+m_held(false)
+{
+	::memset(m_histogram, 0x00U, sizeof(m_histogram));
+}
+
+CStallDetector::~CStallDetector()
+{
+}
+
+void CStallDetector::open(bool upgraded)
+{
+#if defined(__linux__)
+	const char* path = ::getenv("NOTIFY_SOCKET");
+	if (path == NULL || (path[0U] != '/' && path[0U] != '@'))
+		return;
+
+	m_notifyFd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (m_notifyFd < 0) {
+		LogError("Cannot create the systemd notification socket, err: %d", errno);
+		return;
+	}
+
+	m_notifyPath = path;
+
+	// Ping at twice the rate systemd asks for
+	const char* usec = ::getenv("WATCHDOG_USEC");
+	if (usec != NULL)
+		m_watchdogInterval = ::strtoull(usec, NULL, 10) / 2ULL;
+
+	if (m_watchdogInterval > 0ULL)
+		LogMessage("Feeding the systemd watchdog every %llu ms", m_watchdogInterval / 1000ULL);
+
+	if (upgraded) {
+		char state[40U];
+		::sprintf(state, "MAINPID=%d\nREADY=1", int(::getpid()));
+		notify(state);
+	} else {
+		notify("READY=1");
+	}
+
+	m_lastPing = CStopWatch::monotonic();
+#endif
+}
+
+void CStallDetector::setBudget(unsigned int budgetMS)
+{
+	m_budget = budgetMS * 1000ULL;
+}
+
+void CStallDetector::begin()
+{
+	m_start         = CStopWatch::monotonic();
+	m_stageStart    = m_start;
+	m_stage         = "idle";
+	m_slowStage     = "idle";
+	m_slowStageTime = 0ULL;
+	m_held          = false;
+}
+
+void CStallDetector::stage(const char* name)
+{
+	unsigned long long now = CStopWatch::monotonic();
+
+	if (now - m_stageStart > m_slowStageTime) {
+		m_slowStageTime = now - m_stageStart;
+		m_slowStage     = m_stage;
+	}
+
+	m_stage      = name;
+	m_stageStart = now;
+}
+
+void CStallDetector::end()
+{
+	stage("idle");
+
+	unsigned long long time = m_stageStart - m_start;
+
+	unsigned int bucket = 0U;
+	while (bucket < STALL_BUCKETS - 1U && time > STALL_BOUNDS[bucket])
+		bucket++;
+	m_histogram[bucket]++;
+
+	m_passes++;
+
+	if (time > m_maxTime) {
+		m_maxTime  = time;
+		m_maxStage = m_slowStage;
+	}
+
+	if (m_budget > 0ULL && time > m_budget) {
+		m_stalls++;
+		LogWarning("%s pass took %llu ms, %llu ms of it in %s", m_name.c_str(), time / 1000ULL, m_slowStageTime / 1000ULL, m_slowStage);
+		return;
+	}
+
+	if (m_held)
+		return;
+
+	if (m_watchdogInterval > 0ULL && m_stageStart - m_lastPing >= m_watchdogInterval) {
+		notify("WATCHDOG=1");
+		m_lastPing = m_stageStart;
+	}
+}
+
+void CStallDetector::hold()
+{
+	m_held = true;
+}
+
+void CStallDetector::logStats()
+{
+	LogMessage("%s, %u passes, %u over budget, max %lluus in %s", m_name.c_str(), m_passes, m_stalls, m_maxTime, m_maxStage);
+
+	for (unsigned int i = 0U; i < STALL_BUCKETS; i++) {
+		if (m_histogram[i] == 0U)
+			continue;
+
+		if (i < STALL_BUCKETS - 1U)
+			LogMessage("    up to %lluus: %u", STALL_BOUNDS[i], m_histogram[i]);
+		else
+			LogMessage("    over %lluus: %u", STALL_BOUNDS[i - 1U], m_histogram[i]);
+	}
+}
+
+void CStallDetector::close()
+{
+#if defined(__linux__)
+	if (m_notifyFd < 0)
+		return;
+
+	notify("STOPPING=1");
+
+	::close(m_notifyFd);
+	m_notifyFd = -1;
+#endif
+}
+
+void CStallDetector::notify(const char* state)
+{
+#if defined(__linux__)
+	if (m_notifyFd < 0)
+		return;
+
+	struct sockaddr_un addr;
+	::memset(&addr, 0x00, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+
+	unsigned int length = std::min((unsigned int)m_notifyPath.size(), (unsigned int)sizeof(addr.sun_path));
+	::memcpy(addr.sun_path, m_notifyPath.c_str(), length);
+
+	// A leading @ names a socket in the abstract namespace
+	if (addr.sun_path[0U] == '@')
+		addr.sun_path[0U] = '\0';
+
+	if (::sendto(m_notifyFd, state, ::strlen(state), MSG_NOSIGNAL, (struct sockaddr*)&addr, socklen_t(offsetof(struct sockaddr_un, sun_path) + length)) < 0)
+		LogWarning("Cannot send %s to systemd, err: %d", state, errno);
+#endif
+}
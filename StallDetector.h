@@ -0,0 +1,75 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(STALLDETECTOR_H)
+#define	STALLDETECTOR_H
+
+#include <string>
+
+const unsigned int STALL_BUCKETS = 14U;
+
+// Times each pass of the main loop, from waking up to going back to sleep,
+// and names the stage that took longest when a pass runs over its budget.
+// Under systemd it also feeds the service watchdog, but only from passes
+// that kept to the budget, so a wedged loop gets the service restarted.
+class CStallDetector {
+public:
+	CStallDetector(unsigned int budgetMS, const std::string& name = "Main loop");
+	~CStallDetector();
+
+	// Tells systemd that the gateway is ready, if it is watching. After an
+	// upgrade this process also becomes the main one of the service
+	void open(bool upgraded = false);
+
+	void setBudget(unsigned int budgetMS);
+
+	void begin();
+	void stage(const char* name);
+	void end();
+
+	// Keeps this pass from feeding the watchdog, for a loop that is itself
+	// fine but is watching over one that is stuck
+	void hold();
+
+	void logStats();
+
+	void close();
+
+private:
+	std::string        m_name;
+	unsigned long long m_budget;
+	unsigned long long m_start;
+	unsigned long long m_stageStart;
+	const char*        m_stage;
+	const char*        m_slowStage;
+	unsigned long long m_slowStageTime;
+	unsigned int       m_histogram[STALL_BUCKETS];
+	unsigned int       m_passes;
+	unsigned int       m_stalls;
+	unsigned long long m_maxTime;
+	const char*        m_maxStage;
+	int                m_notifyFd;
+	std::string        m_notifyPath;
+	unsigned long long m_watchdogInterval;
+	unsigned long long m_lastPing;
+	bool               m_held;
+
+	void notify(const char* state);
+};
+
+#endif
@@ -17,53 +17,9 @@
  */
 
 #include "StopWatch.h"
-
-#if defined(_WIN32) || defined(_WIN64)
-
-CStopWatch::CStopWatch() :
-m_frequencyS(),
-m_frequencyMS(),
-m_start()
-{
-	::QueryPerformanceFrequency(&m_frequencyS);
-
-	m_frequencyMS.QuadPart = m_frequencyS.QuadPart / 1000ULL;
-}
-
-CStopWatch::~CStopWatch()
-{
-}
-
-unsigned long long CStopWatch::time() const
-{
-	LARGE_INTEGER now;
-	::QueryPerformanceCounter(&now);
-
-	return (unsigned long long)(now.QuadPart / m_frequencyMS.QuadPart);
-}
-
-unsigned long long CStopWatch::start()
-{
-	::QueryPerformanceCounter(&m_start);
-
-	return (unsigned long long)(m_start.QuadPart / m_frequencyS.QuadPart);
-}
-
-unsigned int CStopWatch::elapsed()
-{
-	LARGE_INTEGER now;
-	::QueryPerformanceCounter(&now);
-
-	LARGE_INTEGER temp;
-	temp.QuadPart = (now.QuadPart - m_start.QuadPart) * 1000;
-
-	return (unsigned int)(temp.QuadPart / m_frequencyS.QuadPart);
-}
-
-#else
+#include "Clock.h"
 
 #include <cstdio>
-#include <ctime>
 
 CStopWatch::CStopWatch() :
 m_startMS(0ULL)
@@ -76,30 +32,24 @@ CStopWatch::~CStopWatch()
 
 unsigned long long CStopWatch::time() const
 {
-	struct timeval now;
-	::gettimeofday(&now, NULL);
-
-	return now.tv_sec * 1000ULL + now.tv_usec / 1000ULL;
+	return CClock::get()->realtime() / 1000ULL;
 }
 
 unsigned long long CStopWatch::start()
 {
-	struct timespec now;
-	::clock_gettime(CLOCK_MONOTONIC, &now);
-
-	m_startMS = now.tv_sec * 1000ULL + now.tv_nsec / 1000000ULL;
+	m_startMS = CClock::get()->monotonic() / 1000ULL;
 
 	return m_startMS;
 }
 
 unsigned int CStopWatch::elapsed()
 {
-	struct timespec now;
-	::clock_gettime(CLOCK_MONOTONIC, &now);
-
-	unsigned long long nowMS = now.tv_sec * 1000ULL + now.tv_nsec / 1000000ULL;
+	unsigned long long nowMS = CClock::get()->monotonic() / 1000ULL;
 
 	return nowMS - m_startMS;
 }
 
-#endif
+unsigned long long CStopWatch::monotonic()
+{
+	return CClock::get()->monotonic();
+}
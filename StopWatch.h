@@ -25,25 +25,24 @@
 #include <sys/time.h>
 #endif
 
+// Reads its time from CClock::get(), so a simulation can drive it
 class CStopWatch
 {
 public:
 	CStopWatch();
 	~CStopWatch();
 
+	// Wall clock time in milliseconds
 	unsigned long long time() const;
 
 	unsigned long long start();
 	unsigned int       elapsed();
 
+	// Monotonic time in microseconds
+	static unsigned long long monotonic();
+
 private:
-#if defined(_WIN32) || defined(_WIN64)
-	LARGE_INTEGER  m_frequencyS;
-	LARGE_INTEGER  m_frequencyMS;
-	LARGE_INTEGER  m_start;
-#else
 	unsigned long long m_startMS;
-#endif
 };
 
 #endif
@@ -0,0 +1,215 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "StreamArbiter.h"
+#include "StopWatch.h"
+#include "Log.h"
+
+#include <cassert>
+
+// A stream not heard for this long has ended without a terminator, in ms
+#define STREAM_TIMEOUT 1000U
+
+static const char* POLICIES[] = {"hold", "priority", "last heard"};
+
+CStreamArbiter::CStreamArbiter(const std::string& name) :
+m_name(name),
+m_policy(ARB_HOLD),
+m_priorityIds(),
+m_streamId(0U),
+m_srcId(0U),
+m_priority(0U),
+m_lastHeard(0ULL),
+m_dropped(0U)
+{
+	for (unsigned int i = 0U; i < ARB_MAX_LOSERS; i++) {
+		m_losers[i]     = 0U;
+		m_loserHeard[i] = 0ULL;
+	}
+}
+
+CStreamArbiter::~CStreamArbiter()
+{
+}
+
+void CStreamArbiter::setPolicy(ARB_POLICY policy, const std::vector<unsigned int>& priorityIds)
+{
+	m_policy      = policy;
+	m_priorityIds = priorityIds;
+
+	// The current stream keeps the slot under the new rules
+	m_priority = getPriority(m_srcId);
+}
+
+bool CStreamArbiter::accept(unsigned int streamId, unsigned int srcId, bool end, bool& preempted)
+{
+	preempted = false;
+
+	// Streams without an id cannot be told apart, they go through as before
+	if (streamId == 0U)
+		return true;
+
+	unsigned long long now = CStopWatch::monotonic();
+
+	if (m_streamId != 0U && now - m_lastHeard > STREAM_TIMEOUT * 1000ULL)
+		release();
+
+	if (streamId == m_streamId) {
+		m_lastHeard = now;
+
+		if (end)
+			release();
+
+		return true;
+	}
+
+	if (isLoser(streamId, now)) {
+		m_dropped++;
+
+		if (end)
+			removeLoser(streamId);
+
+		return false;
+	}
+
+	if (m_streamId == 0U) {
+		// A terminator on its own has nothing to end
+		if (end)
+			return false;
+
+		m_streamId  = streamId;
+		m_srcId     = srcId;
+		m_priority  = getPriority(srcId);
+		m_lastHeard = now;
+		m_dropped   = 0U;
+		return true;
+	}
+
+	unsigned int priority = getPriority(srcId);
+
+	bool wins = m_policy == ARB_LAST_HEARD || (m_policy == ARB_PRIORITY && priority > m_priority);
+	if (!wins) {
+		LogMessage("%s, dropping the stream from %u, %u has the slot (%s)", m_name.c_str(), srcId, m_srcId, POLICIES[m_policy]);
+
+		if (!end)
+			addLoser(streamId, now);
+		m_dropped++;
+		return false;
+	}
+
+	LogMessage("%s, the stream from %u takes the slot from %u (%s)", m_name.c_str(), srcId, m_srcId, POLICIES[m_policy]);
+
+	addLoser(m_streamId, now);
+
+	m_streamId  = streamId;
+	m_srcId     = srcId;
+	m_priority  = priority;
+	m_lastHeard = now;
+
+	preempted = true;
+
+	if (end)
+		release();
+
+	return true;
+}
+
+bool CStreamArbiter::isHeld() const
+{
+	return m_streamId != 0U && CStopWatch::monotonic() - m_lastHeard <= STREAM_TIMEOUT * 1000ULL;
+}
+
+void CStreamArbiter::reset()
+{
+	m_streamId = 0U;
+	m_srcId    = 0U;
+	m_priority = 0U;
+	m_dropped  = 0U;
+
+	for (unsigned int i = 0U; i < ARB_MAX_LOSERS; i++)
+		m_losers[i] = 0U;
+}
+
+unsigned int CStreamArbiter::getPriority(unsigned int srcId) const
+{
+	if (m_policy != ARB_PRIORITY)
+		return 0U;
+
+	// The first in the list is the highest, anyone not in it the lowest
+	for (unsigned int i = 0U; i < m_priorityIds.size(); i++) {
+		if (m_priorityIds[i] == srcId)
+			return (unsigned int)m_priorityIds.size() - i;
+	}
+
+	return 0U;
+}
+
+bool CStreamArbiter::isLoser(unsigned int streamId, unsigned long long now)
+{
+	for (unsigned int i = 0U; i < ARB_MAX_LOSERS; i++) {
+		if (m_losers[i] == 0U)
+			continue;
+
+		if (now - m_loserHeard[i] > STREAM_TIMEOUT * 1000ULL) {
+			m_losers[i] = 0U;
+			continue;
+		}
+
+		if (m_losers[i] == streamId) {
+			m_loserHeard[i] = now;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CStreamArbiter::addLoser(unsigned int streamId, unsigned long long now)
+{
+	// Into a free entry, or over the one not heard for longest
+	unsigned int n = 0U;
+	for (unsigned int i = 0U; i < ARB_MAX_LOSERS; i++) {
+		if (m_losers[i] == 0U) {
+			n = i;
+			break;
+		}
+
+		if (m_loserHeard[i] < m_loserHeard[n])
+			n = i;
+	}
+
+	m_losers[n]     = streamId;
+	m_loserHeard[n] = now;
+}
+
+void CStreamArbiter::removeLoser(unsigned int streamId)
+{
+	for (unsigned int i = 0U; i < ARB_MAX_LOSERS; i++) {
+		if (m_losers[i] == streamId)
+			m_losers[i] = 0U;
+	}
+}
+
+void CStreamArbiter::release()
+{
+	if (m_dropped > 0U)
+		LogMessage("%s, dropped %u frames of other streams during the stream from %u", m_name.c_str(), m_dropped, m_srcId);
+
+	m_streamId = 0U;
+	m_dropped  = 0U;
+}
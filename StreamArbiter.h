@@ -0,0 +1,73 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(STREAMARBITER_H)
+#define	STREAMARBITER_H
+
+#include "Defines.h"
+
+#include <string>
+#include <vector>
+
+// How many losing streams are remembered at once, more than ever overlap
+#define ARB_MAX_LOSERS 8U
+
+// Decides which of the streams arriving on one slot is converted. The
+// other streams are dropped as they arrive, before they reach the delay
+// buffer, and stay dropped until they end, so that two talkers never
+// interleave. With ARB_HOLD the first stream keeps the slot until it ends,
+// with ARB_PRIORITY a stream from a source earlier in the priority list
+// takes the slot from one later in it or not in it, and with
+// ARB_LAST_HEARD every new stream takes the slot.
+class CStreamArbiter {
+public:
+	CStreamArbiter(const std::string& name);
+	~CStreamArbiter();
+
+	void setPolicy(ARB_POLICY policy, const std::vector<unsigned int>& priorityIds);
+
+	// False if the frame is to be dropped. When the stream has just taken
+	// the slot from another, preempted is set and the frames already queued
+	// are the other stream's
+	bool accept(unsigned int streamId, unsigned int srcId, bool end, bool& preempted);
+
+	// True while a stream that has not ended holds the slot
+	bool isHeld() const;
+
+	void reset();
+
+private:
+	std::string               m_name;
+	ARB_POLICY                m_policy;
+	std::vector<unsigned int> m_priorityIds;
+	unsigned int              m_streamId;		// 0 when the slot is free
+	unsigned int              m_srcId;
+	unsigned int              m_priority;
+	unsigned long long        m_lastHeard;
+	unsigned int              m_losers[ARB_MAX_LOSERS];
+	unsigned long long        m_loserHeard[ARB_MAX_LOSERS];
+	unsigned int              m_dropped;		// Frames dropped during the current stream
+
+	unsigned int getPriority(unsigned int srcId) const;
+	bool isLoser(unsigned int streamId, unsigned long long now);
+	void addLoser(unsigned int streamId, unsigned long long now);
+	void removeLoser(unsigned int streamId);
+	void release();
+};
+
+#endif
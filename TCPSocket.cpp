@@ -28,6 +28,7 @@
 typedef int ssize_t;
 #else
 #include <cerrno>
+#include <poll.h>
 #endif
 
 CTCPSocket::CTCPSocket(const std::string& address, unsigned int port) :
@@ -113,13 +114,10 @@ int CTCPSocket::read(unsigned char* buffer, unsigned int length, unsigned int se
 	assert(m_fd != -1);
 
 	// Check that the recv() won't block
+#if defined(_WIN32) || defined(_WIN64)
 	fd_set readFds;
 	FD_ZERO(&readFds);
-#if defined(_WIN32) || defined(_WIN64)
 	FD_SET((unsigned int)m_fd, &readFds);
-#else
-	FD_SET(m_fd, &readFds);
-#endif
 
 	// Return after timeout
 	timeval tv;
@@ -128,19 +126,26 @@ int CTCPSocket::read(unsigned char* buffer, unsigned int length, unsigned int se
 
 	int ret = ::select(m_fd + 1, &readFds, NULL, NULL, &tv);
 	if (ret < 0) {
-#if defined(_WIN32) || defined(_WIN64)
 		LogError("Error returned from TCP client select, err=%d", ::GetLastError());
-#else
-		LogError("Error returned from TCP client select, err=%d", errno);
-#endif
 		return -1;
 	}
 
-#if defined(_WIN32) || defined(_WIN64)
 	if (!FD_ISSET((unsigned int)m_fd, &readFds))
 		return 0;
 #else
-	if (!FD_ISSET(m_fd, &readFds))
+	// As in CUDPSocket, the descriptor can be past FD_SETSIZE
+	struct pollfd fds[1U];
+	fds[0U].fd     = m_fd;
+	fds[0U].events = POLLIN;
+
+	// Return after timeout
+	int ret = ::poll(fds, 1U, int(secs * 1000U + msecs));
+	if (ret < 0) {
+		LogError("Error returned from TCP client poll, err=%d", errno);
+		return -1;
+	}
+
+	if (ret == 0)
 		return 0;
 #endif
 
@@ -17,6 +17,8 @@
  */
 
 #include "Thread.h"
+#include "Clock.h"
+#include "Log.h"
 
 #if defined(_WIN32) || defined(_WIN64)
 
@@ -54,14 +56,49 @@ DWORD CThread::helper(LPVOID arg)
   return 0UL;
 }
 
-void CThread::sleep(unsigned int ms)
+bool CThread::setPriority(unsigned int)
+{
+  if (!::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+    LogError("Cannot set the thread priority, err: %lu", ::GetLastError());
+    return false;
+  }
+
+  return true;
+}
+
+bool CThread::setAffinity(int cpu)
+{
+  if (cpu < 0)
+    return true;
+
+  if (::SetThreadAffinityMask(::GetCurrentThread(), DWORD_PTR(1) << cpu) == 0) {
+    LogError("Cannot pin the thread to CPU %d, err: %lu", cpu, ::GetLastError());
+    return false;
+  }
+
+  return true;
+}
+
+bool CThread::lockMemory()
 {
-	::Sleep(ms);
+  LogWarning("Memory locking is not supported on this platform");
+  return false;
 }
 
 #else
 
 #include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <malloc.h>
+#endif
+
+// Stack touched before mlockall()
+#define PREFAULT_STACK_SIZE (256U * 1024U)
 
 CThread::CThread() :
 m_thread()
@@ -88,14 +125,90 @@ void* CThread::helper(void* arg)
 {
   CThread* p = (CThread*)arg;
 
+  // Leave the signals to the main thread, so that they wake its event loop
+  sigset_t set;
+  ::sigemptyset(&set);
+  ::sigaddset(&set, SIGTERM);
+  ::sigaddset(&set, SIGHUP);
+  ::sigaddset(&set, SIGUSR2);
+  ::pthread_sigmask(SIG_BLOCK, &set, NULL);
+
   p->entry();
 
   return NULL;
 }
 
-void CThread::sleep(unsigned int ms)
+bool CThread::setPriority(unsigned int priority)
+{
+  int min = ::sched_get_priority_min(SCHED_FIFO);
+  int max = ::sched_get_priority_max(SCHED_FIFO);
+
+  struct sched_param param;
+  param.sched_priority = int(priority);
+  if (param.sched_priority < min)
+    param.sched_priority = min;
+  if (param.sched_priority > max)
+    param.sched_priority = max;
+
+  int err = ::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &param);
+  if (err != 0) {
+    LogError("Cannot set SCHED_FIFO priority %d, err: %d", param.sched_priority, err);
+    return false;
+  }
+
+  return true;
+}
+
+bool CThread::setAffinity(int cpu)
+{
+  if (cpu < 0)
+    return true;
+
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+
+  int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set_t), &set);
+  if (err != 0) {
+    LogError("Cannot pin the thread to CPU %d, err: %d", cpu, err);
+    return false;
+  }
+
+  return true;
+#else
+  LogWarning("CPU affinity is not supported on this platform");
+  return false;
+#endif
+}
+
+bool CThread::lockMemory()
 {
-	::usleep(ms * 1000);
+#if defined(__linux__)
+  // Keep freed memory in the heap rather than handing it back and faulting it in again
+  ::mallopt(M_TRIM_THRESHOLD, -1);
+  ::mallopt(M_MMAP_MAX, 0);
+
+  unsigned char stack[PREFAULT_STACK_SIZE];
+  volatile unsigned char* p = stack;
+  for (unsigned int i = 0U; i < PREFAULT_STACK_SIZE; i += 1024U)
+    p[i] = 0U;
+
+  if (::mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+    LogWarning("Cannot lock the process memory, err: %d", errno);
+    return false;
+  }
+
+  return true;
+#else
+  LogWarning("Memory locking is not supported on this platform");
+  return false;
+#endif
 }
 
 #endif
+
+void CThread::sleep(unsigned int ms)
+{
+	CClock::get()->sleep(ms);
+}
@@ -39,6 +39,14 @@ public:
 
   static void sleep(unsigned int ms);
 
+  // These act on the calling thread
+  static bool setPriority(unsigned int priority);
+  static bool setAffinity(int cpu);
+
+  // Locks the memory of the process, with the stack of the calling thread
+  // touched first so that it is resident
+  static bool lockMemory();
+
 private:
 #if defined(_WIN32) || defined(_WIN64)
   HANDLE    m_handle;
@@ -0,0 +1,277 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "TimerWheel.h"
+#include "EventLoop.h"
+#include "StopWatch.h"
+
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+
+CWheelTimer::CWheelTimer(CTimerWheel& wheel, unsigned int secs, unsigned int msecs) :
+m_wheel(wheel),
+m_callback(),
+m_timeout(secs * 1000U + msecs),
+m_expiry(0ULL),
+m_slot(NULL),
+m_prev(NULL),
+m_next(NULL)
+{
+}
+
+CWheelTimer::CWheelTimer(CTimerWheel& wheel, const std::function<void()>& callback, unsigned int secs, unsigned int msecs) :
+m_wheel(wheel),
+m_callback(callback),
+m_timeout(secs * 1000U + msecs),
+m_expiry(0ULL),
+m_slot(NULL),
+m_prev(NULL),
+m_next(NULL)
+{
+}
+
+CWheelTimer::~CWheelTimer()
+{
+	stop();
+}
+
+void CWheelTimer::setCallback(const std::function<void()>& callback)
+{
+	m_callback = callback;
+}
+
+void CWheelTimer::setTimeout(unsigned int secs, unsigned int msecs)
+{
+	m_timeout = secs * 1000U + msecs;
+	if (m_timeout == 0U)
+		stop();
+}
+
+unsigned int CWheelTimer::getTimeout() const
+{
+	return m_timeout / 1000U;
+}
+
+void CWheelTimer::start()
+{
+	if (m_timeout == 0U)
+		return;
+
+	stop();
+
+	// Round the start up to the next tick so that the timer never fires early
+	m_expiry = (CStopWatch::monotonic() + 999ULL) / 1000ULL + m_timeout;
+
+	m_wheel.add(this);
+}
+
+void CWheelTimer::start(unsigned int secs, unsigned int msecs)
+{
+	setTimeout(secs, msecs);
+
+	start();
+}
+
+void CWheelTimer::stop()
+{
+	if (m_slot != NULL)
+		m_wheel.remove(this);
+}
+
+bool CWheelTimer::isRunning() const
+{
+	return m_slot != NULL;
+}
+
+CTimerWheel::CTimerWheel() :
+m_now(0ULL),
+m_count(0U)
+{
+	::memset(m_slots, 0x00, sizeof(m_slots));
+
+	m_now = getTick();
+}
+
+CTimerWheel::~CTimerWheel()
+{
+	for (unsigned int level = 0U; level < WHEEL_LEVELS; level++) {
+		for (unsigned int index = 0U; index < WHEEL_SLOTS; index++) {
+			while (m_slots[level][index] != NULL)
+				remove(m_slots[level][index]);
+		}
+	}
+}
+
+unsigned long long CTimerWheel::getTick()
+{
+	return CStopWatch::monotonic() / 1000ULL;
+}
+
+void CTimerWheel::add(CWheelTimer* timer)
+{
+	assert(timer != NULL);
+	assert(timer->m_slot == NULL);
+
+	if (timer->m_expiry < m_now)
+		timer->m_expiry = m_now;
+
+	unsigned long long delta = timer->m_expiry - m_now;
+
+	// Beyond the top level the timer is parked in its last slot and placed
+	// again when that slot comes round
+	unsigned long long expiry = timer->m_expiry;
+	const unsigned long long range = 1ULL << (WHEEL_BITS * WHEEL_LEVELS);
+	if (delta >= range) {
+		expiry = m_now + range - 1ULL;
+		delta  = range - 1ULL;
+	}
+
+	unsigned int level = 0U;
+	while (level < WHEEL_LEVELS - 1U && delta >= (1ULL << (WHEEL_BITS * (level + 1U))))
+		level++;
+
+	unsigned int index = (unsigned int)(expiry >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1U);
+
+	CWheelTimer** slot = &m_slots[level][index];
+
+	timer->m_slot = slot;
+	timer->m_prev = NULL;
+	timer->m_next = *slot;
+	if (*slot != NULL)
+		(*slot)->m_prev = timer;
+	*slot = timer;
+
+	m_count++;
+}
+
+void CTimerWheel::remove(CWheelTimer* timer)
+{
+	assert(timer != NULL);
+	assert(timer->m_slot != NULL);
+
+	if (timer->m_prev != NULL)
+		timer->m_prev->m_next = timer->m_next;
+	else
+		*timer->m_slot = timer->m_next;
+
+	if (timer->m_next != NULL)
+		timer->m_next->m_prev = timer->m_prev;
+
+	timer->m_slot = NULL;
+	timer->m_prev = NULL;
+	timer->m_next = NULL;
+
+	m_count--;
+}
+
+void CTimerWheel::cascade(unsigned int level, unsigned int index)
+{
+	CWheelTimer* timer = m_slots[level][index];
+	while (timer != NULL) {
+		CWheelTimer* next = timer->m_next;
+		remove(timer);
+		add(timer);
+		timer = next;
+	}
+}
+
+void CTimerWheel::clock()
+{
+	unsigned long long now = getTick();
+
+	if (m_count == 0U) {
+		m_now = now + 1ULL;
+		return;
+	}
+
+	while (m_now <= now) {
+		// Hand the next block of each level down once the level below wraps
+		if ((m_now & (WHEEL_SLOTS - 1U)) == 0ULL) {
+			for (unsigned int level = 1U; level < WHEEL_LEVELS; level++) {
+				unsigned int index = (unsigned int)(m_now >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1U);
+				cascade(level, index);
+				if (index != 0U)
+					break;
+			}
+		}
+
+		// A callback may start or stop any timer, including ones in this slot
+		CWheelTimer** slot = &m_slots[0U][m_now & (WHEEL_SLOTS - 1U)];
+		while (*slot != NULL) {
+			CWheelTimer* timer = *slot;
+			remove(timer);
+			if (timer->m_callback)
+				timer->m_callback();
+		}
+
+		m_now++;
+
+		if (m_count == 0U) {
+			m_now = now + 1ULL;
+			return;
+		}
+	}
+}
+
+unsigned long long CTimerWheel::getDeadline() const
+{
+	if (m_count == 0U)
+		return NO_DEADLINE;
+
+	unsigned long long deadline = NO_DEADLINE;
+
+	for (unsigned int k = 0U; k < WHEEL_SLOTS; k++) {
+		if (m_slots[0U][(m_now + k) & (WHEEL_SLOTS - 1U)] != NULL) {
+			deadline = m_now + k;
+			break;
+		}
+	}
+
+	// The upper levels only need a wake up when their next occupied slot is
+	// handed down, which is never later than its timers expire
+	for (unsigned int level = 1U; level < WHEEL_LEVELS; level++) {
+		unsigned int shift = WHEEL_BITS * level;
+		unsigned long long block = m_now >> shift;
+		bool pending = (m_now & ((1ULL << shift) - 1ULL)) == 0ULL;
+
+		for (unsigned int k = 0U; k <= WHEEL_SLOTS; k++) {
+			if (k == 0U && !pending)
+				continue;
+			if (k == WHEEL_SLOTS && pending)
+				break;
+
+			if (m_slots[level][(block + k) & (WHEEL_SLOTS - 1U)] != NULL) {
+				unsigned long long tick = (block + k) << shift;
+				if (tick < deadline)
+					deadline = tick;
+				break;
+			}
+		}
+	}
+
+	if (deadline == NO_DEADLINE)
+		return NO_DEADLINE;
+
+	return deadline * 1000ULL;
+}
+
+unsigned int CTimerWheel::getCount() const
+{
+	return m_count;
+}
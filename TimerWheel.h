@@ -0,0 +1,95 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(TIMERWHEEL_H)
+#define	TIMERWHEEL_H
+
+#include <functional>
+
+const unsigned int WHEEL_LEVELS = 4U;
+const unsigned int WHEEL_BITS   = 6U;
+const unsigned int WHEEL_SLOTS  = 1U << WHEEL_BITS;
+
+class CTimerWheel;
+
+// A millisecond timer owned by a component and driven by a CTimerWheel. The
+// callback runs from CTimerWheel::clock() on the thread that calls it.
+class CWheelTimer {
+public:
+	CWheelTimer(CTimerWheel& wheel, unsigned int secs = 0U, unsigned int msecs = 0U);
+	CWheelTimer(CTimerWheel& wheel, const std::function<void()>& callback, unsigned int secs = 0U, unsigned int msecs = 0U);
+	~CWheelTimer();
+
+	void setCallback(const std::function<void()>& callback);
+
+	void setTimeout(unsigned int secs, unsigned int msecs = 0U);
+	unsigned int getTimeout() const;
+
+	// (Re)arm the timer for the timeout from now, a zero timeout does nothing
+	void start();
+	void start(unsigned int secs, unsigned int msecs = 0U);
+
+	void stop();
+
+	bool isRunning() const;
+
+private:
+	friend class CTimerWheel;
+
+	CTimerWheel&          m_wheel;
+	std::function<void()> m_callback;
+	unsigned int          m_timeout;
+	unsigned long long    m_expiry;
+	CWheelTimer**         m_slot;
+	CWheelTimer*          m_prev;
+	CWheelTimer*          m_next;
+};
+
+// Hierarchical timer wheel with a 1 ms tick. Level n holds the timers that
+// expire between 64^n and 64^(n + 1) ticks from now and hands them down a
+// level each time the level below wraps, so starting and stopping a timer is
+// O(1) and a tick only touches the timers that are due.
+class CTimerWheel {
+public:
+	CTimerWheel();
+	~CTimerWheel();
+
+	// Fire every timer that is due
+	void clock();
+
+	// Absolute CStopWatch::monotonic() time by which clock() must next be
+	// called, NO_DEADLINE when no timer is running
+	unsigned long long getDeadline() const;
+
+	unsigned int getCount() const;
+
+private:
+	friend class CWheelTimer;
+
+	CWheelTimer*       m_slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	unsigned long long m_now;
+	unsigned int       m_count;
+
+	void add(CWheelTimer* timer);
+	void remove(CWheelTimer* timer);
+	void cascade(unsigned int level, unsigned int index);
+
+	static unsigned long long getTick();
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// Counts the system calls a gateway socket makes per datagram with each of
+// the I/O backends, over the loopback interface:
+//
+//   make udpbench && ./udpbench [frames] [burst] [port]
+//
+// The peer sends bursts of datagrams to the gateway socket, as a network
+// does at the start of a call, then the gateway sends bursts back, the
+// DMR voice header for example goes out twice. The consumer waits on the
+// notification eventfd the same way as the main loop does.
+
+#include "UDPThread.h"
+#include "UDPSocket.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <poll.h>
+
+const unsigned int FRAME_LENGTH = 55U;
+
+static bool waitFor(int fd, unsigned long long& waits)
+{
+	struct pollfd fds[1U];
+	fds[0U].fd     = fd;
+	fds[0U].events = POLLIN;
+
+	waits++;
+
+	return ::poll(fds, 1U, 1000) > 0;
+}
+
+static bool bench(bool ioUring, unsigned int frames, unsigned int burst, unsigned int port)
+{
+	CUDPSocket gateway("127.0.0.1", port);
+	CUDPSocket peer("127.0.0.1", port + 1U);
+
+	if (!gateway.open() || !peer.open())
+		return false;
+
+	in_addr address = CUDPSocket::lookup("127.0.0.1");
+
+	CUDPThread thread(gateway, ioUring ? "io_uring" : "poll");
+	thread.setIOUring(ioUring);
+	if (!thread.start())
+		return false;
+	thread.attach();
+
+	unsigned char frame[FRAME_LENGTH];
+	::memset(frame, 0x55U, FRAME_LENGTH);
+
+	unsigned long long waits = 0ULL;
+	bool ok = true;
+
+	CUDPDatagram datagram;
+
+	for (unsigned int n = 0U; ok && n < frames; n += burst) {
+		for (unsigned int i = 0U; i < burst; i++)
+			peer.write(frame, FRAME_LENGTH, address, port);
+
+		unsigned int count = 0U;
+		while (ok && count < burst) {
+			while (thread.read(datagram))
+				count++;
+
+			if (count < burst)
+				ok = waitFor(thread.getFd(), waits);
+		}
+	}
+
+	for (unsigned int n = 0U; ok && n < frames; n += burst) {
+		for (unsigned int i = 0U; i < burst; i++)
+			thread.write(frame, FRAME_LENGTH, address, port + 1U);
+
+		unsigned int count = 0U;
+		while (ok && count < burst) {
+			in_addr from;
+			unsigned int fromPort;
+			while (peer.read(datagram.m_data, UDP_DATAGRAM_LENGTH, from, fromPort) > 0)
+				count++;
+
+			if (count < burst)
+				ok = waitFor(peer.getFd(), waits);
+		}
+	}
+
+	thread.detach();
+	thread.stop();
+
+	unsigned long long datagrams, syscalls;
+	thread.getStats(datagrams, syscalls);
+
+	gateway.close();
+	peer.close();
+
+	if (!ok) {
+		::fprintf(stderr, "udpbench: timed out waiting for the %s datagrams\n", ioUring ? "io_uring" : "poll");
+		return false;
+	}
+
+	::fprintf(stdout, "%-8s  %8llu datagrams  %8llu system calls  %5.2f per datagram  (%llu waits by the consumer)\n", ioUring ? "io_uring" : "poll", datagrams, syscalls, double(syscalls) / double(datagrams), waits);
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int frames = 10000U;
+	unsigned int burst  = 2U;
+	unsigned int port   = 42010U;
+
+	if (argc > 1)
+		frames = (unsigned int)::atoi(argv[1]);
+	if (argc > 2)
+		burst = (unsigned int)::atoi(argv[2]);
+	if (argc > 3)
+		port = (unsigned int)::atoi(argv[3]);
+
+	if (frames == 0U || burst == 0U || burst > 32U) {
+		::fprintf(stderr, "Usage: udpbench [frames] [burst, 1 to 32] [port]\n");
+		return 1;
+	}
+
+	// Only the warnings, such as falling back from io_uring, are shown
+	::LogInitialise(".", "udpbench", 0U, 4U);
+
+	bool ok = bench(false, frames, burst, port);
+	ok = bench(true, frames, burst, port) && ok;
+
+	::LogFinalise();
+
+	return ok ? 0 : 1;
+}
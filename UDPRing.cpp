@@ -0,0 +1,696 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "UDPRing.h"
+#include "UDPThread.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+#define	HAVE_IO_URING
+#endif
+#endif
+#endif
+
+#if defined(HAVE_IO_URING)
+
+const unsigned int RING_ENTRIES = 128U;
+const unsigned int RING_CQ_ENTRIES = 512U;
+
+// Received datagrams land in these, the kernel writes the recvmsg header and
+// the source address in front of the payload
+const unsigned int RING_BUFFERS = 64U;
+const unsigned int RING_BUFFER_LENGTH = sizeof(struct io_uring_recvmsg_out) + sizeof(sockaddr_in) + UDP_DATAGRAM_LENGTH;
+const unsigned short RING_BUFFER_GROUP = 0U;
+
+const unsigned int RING_SLOTS = 64U;
+
+// Indexes into the registered files
+const int FILE_SOCKET = 0;
+const int FILE_WAKE   = 1;
+const int FILE_NOTIFY = 2;
+
+const unsigned long long DATA_RECEIVE = 1ULL;
+const unsigned long long DATA_WAKE    = 2ULL;
+const unsigned long long DATA_NOTIFY  = 3ULL;
+const unsigned long long DATA_CANCEL  = 4ULL;
+const unsigned long long DATA_SEND    = 0x100ULL;
+
+struct CRingSlot {
+	unsigned char m_data[UDP_DATAGRAM_LENGTH];
+	sockaddr_in   m_addr;
+	struct iovec  m_iov;
+	struct msghdr m_msg;
+	unsigned int  m_next;
+};
+
+#endif
+
+CUDPRing::CUDPRing(const std::string& name) :
+m_name(name),
+m_fd(-1),
+m_sqRing(NULL),
+m_sqRingSize(0U),
+m_cqRing(NULL),
+m_sqes(NULL),
+m_sqesSize(0U),
+m_sqHead(NULL),
+m_sqTail(NULL),
+m_sqMask(0U),
+m_sqArray(NULL),
+m_cqHead(NULL),
+m_cqTail(NULL),
+m_cqMask(0U),
+m_cqes(NULL),
+m_queued(0U),
+m_bufRing(NULL),
+m_bufRingSize(0U),
+m_buffers(NULL),
+m_bufTail(0U),
+m_recvMsg(NULL),
+m_slots(NULL),
+m_slotsFree(0U),
+m_inFlight(0U),
+m_receiving(false),
+m_waking(false),
+m_notifying(false),
+m_cancelled(false),
+m_failed(false),
+m_unsupported(false),
+m_wakeValue(0ULL),
+m_notifyValue(1ULL),
+m_syscalls(0ULL)
+{
+}
+
+CUDPRing::~CUDPRing()
+{
+	close();
+}
+
+#if defined(HAVE_IO_URING)
+
+bool CUDPRing::open(int fd, int wakeFd, int notifyFd)
+{
+	assert(fd >= 0);
+	assert(wakeFd >= 0);
+	assert(notifyFd >= 0);
+
+	close();
+
+	struct io_uring_params params;
+	::memset(&params, 0x00, sizeof(struct io_uring_params));
+	params.cq_entries = RING_CQ_ENTRIES;
+
+	// Completions are only wanted when this thread asks for them, which
+	// saves the kernel interrupting it, older kernels take the plain ring
+#if defined(IORING_SETUP_DEFER_TASKRUN)
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	m_fd = int(::syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+#endif
+	if (m_fd < 0) {
+		::memset(&params, 0x00, sizeof(struct io_uring_params));
+		params.cq_entries = RING_CQ_ENTRIES;
+		params.flags = IORING_SETUP_CQSIZE;
+		m_fd = int(::syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+	}
+
+	if (m_fd < 0) {
+		LogWarning("%s, io_uring is not available, err: %d", m_name.c_str(), errno);
+		return false;
+	}
+
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0U) {
+		LogWarning("%s, the kernel io_uring is too old", m_name.c_str());
+		close();
+		return false;
+	}
+
+	// The submission and completion rings share one mapping
+	m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	unsigned int cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (cqRingSize > m_sqRingSize)
+		m_sqRingSize = cqRingSize;
+
+	void* ring = ::mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED) {
+		LogError("%s, cannot map the io_uring, err: %d", m_name.c_str(), errno);
+		m_sqRingSize = 0U;
+		close();
+		return false;
+	}
+
+	m_sqRing = (unsigned char*)ring;
+	m_cqRing = m_sqRing;
+
+	m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	void* sqes = ::mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		LogError("%s, cannot map the io_uring entries, err: %d", m_name.c_str(), errno);
+		m_sqesSize = 0U;
+		close();
+		return false;
+	}
+
+	m_sqes = (unsigned char*)sqes;
+
+	m_sqHead  = (unsigned int*)(m_sqRing + params.sq_off.head);
+	m_sqTail  = (unsigned int*)(m_sqRing + params.sq_off.tail);
+	m_sqMask  = *(unsigned int*)(m_sqRing + params.sq_off.ring_mask);
+	m_sqArray = (unsigned int*)(m_sqRing + params.sq_off.array);
+	m_cqHead  = (unsigned int*)(m_cqRing + params.cq_off.head);
+	m_cqTail  = (unsigned int*)(m_cqRing + params.cq_off.tail);
+	m_cqMask  = *(unsigned int*)(m_cqRing + params.cq_off.ring_mask);
+	m_cqes    = m_cqRing + params.cq_off.cqes;
+
+	// Registering the files saves looking them up on every operation
+	int fds[3U];
+	fds[FILE_SOCKET] = fd;
+	fds[FILE_WAKE]   = wakeFd;
+	fds[FILE_NOTIFY] = notifyFd;
+	if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_FILES, fds, 3U) < 0) {
+		LogWarning("%s, cannot register the files with io_uring, err: %d", m_name.c_str(), errno);
+		close();
+		return false;
+	}
+
+	// The receive buffers are handed to the kernel once and come back
+	// through a shared ring as they are used, so a multishot receive can
+	// carry on without being armed again for every datagram
+	m_bufRingSize = RING_BUFFERS * sizeof(struct io_uring_buf);
+	void* bufRing = ::mmap(NULL, m_bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (bufRing == MAP_FAILED) {
+		LogError("%s, cannot allocate the io_uring buffer ring, err: %d", m_name.c_str(), errno);
+		m_bufRingSize = 0U;
+		close();
+		return false;
+	}
+
+	m_bufRing = (unsigned char*)bufRing;
+	m_buffers = new unsigned char[RING_BUFFERS * RING_BUFFER_LENGTH];
+
+	struct io_uring_buf_reg reg;
+	::memset(&reg, 0x00, sizeof(struct io_uring_buf_reg));
+	reg.ring_addr    = (unsigned long long)m_bufRing;
+	reg.ring_entries = RING_BUFFERS;
+	reg.bgid         = RING_BUFFER_GROUP;
+	if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING, &reg, 1U) < 0) {
+		LogWarning("%s, cannot register the io_uring buffer ring, err: %d", m_name.c_str(), errno);
+		close();
+		return false;
+	}
+
+	m_bufTail = 0U;
+	for (unsigned int i = 0U; i < RING_BUFFERS; i++)
+		recycle(i);
+
+	struct msghdr* msg = new struct msghdr;
+	::memset(msg, 0x00, sizeof(struct msghdr));
+	msg->msg_namelen = sizeof(sockaddr_in);
+	m_recvMsg = msg;
+
+	CRingSlot* slots = new CRingSlot[RING_SLOTS];
+	for (unsigned int i = 0U; i < RING_SLOTS; i++)
+		slots[i].m_next = i + 1U;
+	m_slots     = slots;
+	m_slotsFree = 0U;
+
+	m_queued      = 0U;
+	m_inFlight    = 0U;
+	m_receiving   = false;
+	m_waking      = false;
+	m_notifying   = false;
+	m_cancelled   = false;
+	m_failed      = false;
+	m_unsupported = false;
+
+	return true;
+}
+
+bool CUDPRing::wait()
+{
+	assert(m_fd >= 0);
+
+	if (!m_cancelled) {
+		if (!m_receiving && !m_unsupported)
+			armReceive();
+		if (!m_waking)
+			armWake();
+	}
+
+	// Completions left over from the last call are handled before blocking
+	unsigned int minComplete = 1U;
+	if (__atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) != *m_cqHead)
+		minComplete = 0U;
+
+	for (;;) {
+		m_syscalls++;
+
+		int ret = int(::syscall(__NR_io_uring_enter, m_fd, m_queued, minComplete, IORING_ENTER_GETEVENTS, NULL, 0U));
+		if (ret >= 0) {
+			m_queued -= (unsigned int)ret;
+			return true;
+		}
+
+		// The completion queue is full, it is emptied by read()
+		if (errno == EBUSY || errno == EAGAIN)
+			return true;
+
+		if (errno != EINTR) {
+			LogError("%s, error returned from io_uring_enter, err: %d", m_name.c_str(), errno);
+			return false;
+		}
+	}
+}
+
+bool CUDPRing::read(CUDPDatagram& datagram)
+{
+	assert(m_fd >= 0);
+
+	unsigned int head = *m_cqHead;
+
+	while (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe* cqe = (struct io_uring_cqe*)(m_cqes + (head & m_cqMask) * sizeof(struct io_uring_cqe));
+
+		unsigned long long userData = cqe->user_data;
+		int res                     = cqe->res;
+		unsigned int flags          = cqe->flags;
+
+		head++;
+		__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+		if (complete(userData, res, flags, datagram))
+			return true;
+	}
+
+	return false;
+}
+
+bool CUDPRing::canWrite() const
+{
+	return m_fd >= 0 && m_slotsFree < RING_SLOTS;
+}
+
+bool CUDPRing::write(const CUDPDatagram& datagram)
+{
+	return write(datagram.m_data, datagram.m_length, datagram.m_address, datagram.m_port);
+}
+
+bool CUDPRing::write(const unsigned char* data, unsigned int length, const in_addr& address, unsigned int port)
+{
+	assert(data != NULL);
+	assert(length <= UDP_DATAGRAM_LENGTH);
+
+	if (!canWrite())
+		return false;
+
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)getSQE();
+	if (sqe == NULL)
+		return false;
+
+	unsigned int n = m_slotsFree;
+	CRingSlot* slot = (CRingSlot*)m_slots + n;
+	m_slotsFree = slot->m_next;
+
+	::memcpy(slot->m_data, data, length);
+
+	::memset(&slot->m_addr, 0x00, sizeof(sockaddr_in));
+	slot->m_addr.sin_family = AF_INET;
+	slot->m_addr.sin_addr   = address;
+	slot->m_addr.sin_port   = htons(port);
+
+	slot->m_iov.iov_base = slot->m_data;
+	slot->m_iov.iov_len  = length;
+
+	::memset(&slot->m_msg, 0x00, sizeof(struct msghdr));
+	slot->m_msg.msg_name    = &slot->m_addr;
+	slot->m_msg.msg_namelen = sizeof(sockaddr_in);
+	slot->m_msg.msg_iov     = &slot->m_iov;
+	slot->m_msg.msg_iovlen  = 1U;
+
+	sqe->opcode    = IORING_OP_SENDMSG;
+	sqe->flags     = IOSQE_FIXED_FILE;
+	sqe->fd        = FILE_SOCKET;
+	sqe->addr      = (unsigned long long)&slot->m_msg;
+	sqe->len       = 1U;
+	sqe->user_data = DATA_SEND + n;
+
+	m_inFlight++;
+
+	return true;
+}
+
+void CUDPRing::notify()
+{
+	if (m_fd < 0 || m_notifying)
+		return;
+
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)getSQE();
+	if (sqe == NULL)
+		return;
+
+	sqe->opcode    = IORING_OP_WRITE;
+	sqe->flags     = IOSQE_FIXED_FILE;
+	sqe->fd        = FILE_NOTIFY;
+	sqe->addr      = (unsigned long long)&m_notifyValue;
+	sqe->len       = sizeof(unsigned long long);
+	sqe->user_data = DATA_NOTIFY;
+
+	m_notifying = true;
+	m_inFlight++;
+}
+
+void CUDPRing::cancel()
+{
+	if (m_fd < 0 || m_cancelled)
+		return;
+
+	m_cancelled = true;
+
+	if (m_receiving) {
+		struct io_uring_sqe* sqe = (struct io_uring_sqe*)getSQE();
+		if (sqe != NULL) {
+			sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+			sqe->fd        = -1;
+			sqe->addr      = DATA_RECEIVE;
+			sqe->user_data = DATA_CANCEL;
+			m_inFlight++;
+		}
+	}
+
+	if (m_waking) {
+		struct io_uring_sqe* sqe = (struct io_uring_sqe*)getSQE();
+		if (sqe != NULL) {
+			sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+			sqe->fd        = -1;
+			sqe->addr      = DATA_WAKE;
+			sqe->user_data = DATA_CANCEL;
+			m_inFlight++;
+		}
+	}
+}
+
+void CUDPRing::close()
+{
+	// Let the kernel finish with the buffers before they are freed
+	if (m_fd >= 0 && m_sqes != NULL && m_inFlight > 0U) {
+		cancel();
+
+		CUDPDatagram datagram;
+		for (unsigned int i = 0U; i < 100U && m_inFlight > 0U; i++) {
+			if (!wait())
+				break;
+			while (read(datagram))
+				;
+		}
+	}
+
+	if (m_sqes != NULL)
+		::munmap(m_sqes, m_sqesSize);
+	if (m_sqRing != NULL)
+		::munmap(m_sqRing, m_sqRingSize);
+	if (m_fd >= 0)
+		::close(m_fd);
+	if (m_bufRing != NULL)
+		::munmap(m_bufRing, m_bufRingSize);
+
+	delete[] m_buffers;
+	delete (struct msghdr*)m_recvMsg;
+	delete[] (CRingSlot*)m_slots;
+
+	m_fd          = -1;
+	m_sqes        = NULL;
+	m_sqesSize    = 0U;
+	m_sqRing      = NULL;
+	m_sqRingSize  = 0U;
+	m_cqRing      = NULL;
+	m_bufRing     = NULL;
+	m_bufRingSize = 0U;
+	m_buffers     = NULL;
+	m_recvMsg     = NULL;
+	m_slots       = NULL;
+	m_queued      = 0U;
+	m_inFlight    = 0U;
+}
+
+void* CUDPRing::getSQE()
+{
+	unsigned int head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+	unsigned int tail = *m_sqTail;
+
+	if (tail - head > m_sqMask) {
+		LogError("%s, the io_uring submission queue is full", m_name.c_str());
+		return NULL;
+	}
+
+	unsigned int index = tail & m_sqMask;
+
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)(m_sqes + index * sizeof(struct io_uring_sqe));
+	::memset(sqe, 0x00, sizeof(struct io_uring_sqe));
+
+	m_sqArray[index] = index;
+
+	__atomic_store_n(m_sqTail, tail + 1U, __ATOMIC_RELEASE);
+
+	m_queued++;
+
+	return sqe;
+}
+
+void CUDPRing::armReceive()
+{
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)getSQE();
+	if (sqe == NULL)
+		return;
+
+	sqe->opcode    = IORING_OP_RECVMSG;
+	sqe->flags     = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->ioprio    = IORING_RECV_MULTISHOT;
+	sqe->fd        = FILE_SOCKET;
+	sqe->addr      = (unsigned long long)m_recvMsg;
+	sqe->len       = 1U;
+	sqe->buf_group = RING_BUFFER_GROUP;
+	sqe->user_data = DATA_RECEIVE;
+
+	m_receiving = true;
+	m_inFlight++;
+}
+
+void CUDPRing::armWake()
+{
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)getSQE();
+	if (sqe == NULL)
+		return;
+
+	sqe->opcode    = IORING_OP_READ;
+	sqe->flags     = IOSQE_FIXED_FILE;
+	sqe->fd        = FILE_WAKE;
+	sqe->addr      = (unsigned long long)&m_wakeValue;
+	sqe->len       = sizeof(unsigned long long);
+	sqe->user_data = DATA_WAKE;
+
+	m_waking = true;
+	m_inFlight++;
+}
+
+void CUDPRing::recycle(unsigned int id)
+{
+	struct io_uring_buf_ring* ring = (struct io_uring_buf_ring*)m_bufRing;
+
+	// Not ring->bufs, the flexible array in the kernel header gains a
+	// padding member when compiled as C++
+	struct io_uring_buf* buf = (struct io_uring_buf*)m_bufRing + (m_bufTail & (RING_BUFFERS - 1U));
+	buf->addr = (unsigned long long)(m_buffers + id * RING_BUFFER_LENGTH);
+	buf->len  = RING_BUFFER_LENGTH;
+	buf->bid  = (unsigned short)id;
+
+	m_bufTail++;
+
+	__atomic_store_n(&ring->tail, m_bufTail, __ATOMIC_RELEASE);
+}
+
+bool CUDPRing::complete(unsigned long long userData, int res, unsigned int flags, CUDPDatagram& datagram)
+{
+	if (userData >= DATA_SEND) {
+		unsigned int n = (unsigned int)(userData - DATA_SEND);
+		assert(n < RING_SLOTS);
+
+		CRingSlot* slot = (CRingSlot*)m_slots + n;
+		slot->m_next = m_slotsFree;
+		m_slotsFree  = n;
+
+		m_inFlight--;
+
+		if (res < 0) {
+			LogError("%s, error returned from sendmsg, err: %d", m_name.c_str(), -res);
+			m_failed = true;
+		}
+
+		return false;
+	}
+
+	if (userData == DATA_RECEIVE) {
+		if ((flags & IORING_CQE_F_MORE) == 0U) {
+			m_receiving = false;
+			m_inFlight--;
+		}
+
+		if ((flags & IORING_CQE_F_BUFFER) == IORING_CQE_F_BUFFER) {
+			unsigned int id = flags >> IORING_CQE_BUFFER_SHIFT;
+			assert(id < RING_BUFFERS);
+
+			bool ret = false;
+
+			if (res > 0) {
+				struct msghdr* msg = (struct msghdr*)m_recvMsg;
+				unsigned char* buffer = m_buffers + id * RING_BUFFER_LENGTH;
+				struct io_uring_recvmsg_out* out = (struct io_uring_recvmsg_out*)buffer;
+
+				const unsigned char* name    = buffer + sizeof(struct io_uring_recvmsg_out);
+				const unsigned char* payload = name + msg->msg_namelen + msg->msg_controllen;
+
+				// Anything past the buffer was dropped by the kernel, as recvfrom() does
+				unsigned int length = out->payloadlen;
+				if (length > UDP_DATAGRAM_LENGTH)
+					length = UDP_DATAGRAM_LENGTH;
+
+				sockaddr_in addr;
+				::memcpy(&addr, name, sizeof(sockaddr_in));
+
+				::memcpy(datagram.m_data, payload, length);
+				datagram.m_length  = length;
+				datagram.m_address = addr.sin_addr;
+				datagram.m_port    = ntohs(addr.sin_port);
+
+				ret = length > 0U;
+			}
+
+			recycle(id);
+
+			return ret;
+		}
+
+		if (res == -EINVAL) {
+			LogWarning("%s, the kernel does not support a multishot io_uring receive", m_name.c_str());
+			m_unsupported = true;
+		} else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+			LogError("Error returned from recvmsg, err: %d", -res);
+			m_failed = true;
+		}
+
+		return false;
+	}
+
+	if (userData == DATA_WAKE) {
+		m_waking = false;
+		m_inFlight--;
+		return false;
+	}
+
+	if (userData == DATA_NOTIFY) {
+		m_notifying = false;
+		m_inFlight--;
+		if (res < 0 && res != -EAGAIN)
+			LogError("%s, cannot signal an eventfd, err: %d", m_name.c_str(), -res);
+		return false;
+	}
+
+	if (userData == DATA_CANCEL)
+		m_inFlight--;
+
+	return false;
+}
+
+#else
+
+bool CUDPRing::open(int, int, int)
+{
+	LogWarning("%s, io_uring is not available on this platform", m_name.c_str());
+	return false;
+}
+
+bool CUDPRing::wait()
+{
+	return false;
+}
+
+bool CUDPRing::read(CUDPDatagram&)
+{
+	return false;
+}
+
+bool CUDPRing::canWrite() const
+{
+	return false;
+}
+
+bool CUDPRing::write(const CUDPDatagram&)
+{
+	return false;
+}
+
+bool CUDPRing::write(const unsigned char*, unsigned int, const in_addr&, unsigned int)
+{
+	return false;
+}
+
+void CUDPRing::notify()
+{
+}
+
+void CUDPRing::cancel()
+{
+}
+
+void CUDPRing::close()
+{
+}
+
+#endif
+
+bool CUDPRing::hasFailed()
+{
+	bool failed = m_failed;
+	m_failed = false;
+	return failed;
+}
+
+bool CUDPRing::isUnsupported() const
+{
+	return m_unsupported;
+}
+
+bool CUDPRing::isIdle() const
+{
+	return m_inFlight == 0U;
+}
+
+unsigned long long CUDPRing::getSyscalls() const
+{
+	return m_syscalls;
+}
@@ -0,0 +1,115 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(UDPRING_H)
+#define	UDPRING_H
+
+#include "UDPSocket.h"
+
+#include <string>
+
+class CUDPDatagram;
+
+// Drives one UDP socket through io_uring. A multishot recvmsg fills a ring
+// of buffers provided to the kernel up front, sends are batched into the
+// same io_uring_enter() that waits for completions, and the eventfds that
+// wake the threads are read and written by the ring too, so a busy socket
+// costs one system call per batch rather than several per datagram. It talks
+// to the kernel directly, liburing is not needed.
+class CUDPRing {
+public:
+	CUDPRing(const std::string& name);
+	~CUDPRing();
+
+	// False when the kernel has no usable io_uring, the caller then keeps to poll()
+	bool open(int fd, int wakeFd, int notifyFd);
+
+	// Submits what has been queued and waits for at least one completion
+	bool wait();
+
+	// Takes the next received datagram from the completions
+	bool read(CUDPDatagram& datagram);
+
+	// Queues a datagram to go out on the next wait()
+	bool canWrite() const;
+	bool write(const CUDPDatagram& datagram);
+	bool write(const unsigned char* data, unsigned int length, const in_addr& address, unsigned int port);
+
+	// Queues a signal of the notify eventfd on the next wait()
+	void notify();
+
+	// True once after the kernel failed a receive or a send
+	bool hasFailed();
+
+	// True if the kernel turned down the multishot receive, only known after
+	// the first wait()
+	bool isUnsupported() const;
+
+	// Stops the receive and the wake up, keep calling wait() and read() until
+	// isIdle() so that nothing already received is lost
+	void cancel();
+	bool isIdle() const;
+
+	void close();
+
+	// io_uring_enter() calls made
+	unsigned long long getSyscalls() const;
+
+private:
+	std::string        m_name;
+	int                m_fd;
+	unsigned char*     m_sqRing;
+	unsigned int       m_sqRingSize;
+	unsigned char*     m_cqRing;
+	unsigned char*     m_sqes;
+	unsigned int       m_sqesSize;
+	unsigned int*      m_sqHead;
+	unsigned int*      m_sqTail;
+	unsigned int       m_sqMask;
+	unsigned int*      m_sqArray;
+	unsigned int*      m_cqHead;
+	unsigned int*      m_cqTail;
+	unsigned int       m_cqMask;
+	unsigned char*     m_cqes;
+	unsigned int       m_queued;
+	unsigned char*     m_bufRing;
+	unsigned int       m_bufRingSize;
+	unsigned char*     m_buffers;
+	unsigned short     m_bufTail;
+	void*              m_recvMsg;
+	void*              m_slots;
+	unsigned int       m_slotsFree;
+	unsigned int       m_inFlight;
+	bool               m_receiving;
+	bool               m_waking;
+	bool               m_notifying;
+	bool               m_cancelled;
+	bool               m_failed;
+	bool               m_unsupported;
+	unsigned long long m_wakeValue;
+	unsigned long long m_notifyValue;
+	unsigned long long m_syscalls;
+
+	void* getSQE();
+	void  armReceive();
+	void  armWake();
+	void  recycle(unsigned int id);
+	bool  complete(unsigned long long userData, int res, unsigned int flags, CUDPDatagram& datagram);
+};
+
+#endif
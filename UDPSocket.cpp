@@ -24,13 +24,27 @@
 #if !defined(_WIN32) && !defined(_WIN64)
 #include <cerrno>
 #include <cstring>
+#include <poll.h>
 #endif
 
+#if defined(__linux__)
+#include <linux/filter.h>
+#endif
+
+CUDPTransport::~CUDPTransport()
+{
+}
 
 CUDPSocket::CUDPSocket(const std::string& address, unsigned int port) :
 m_address(address),
 m_port(port),
-m_fd(-1)
+m_fd(-1),
+m_busyPoll(0U),
+m_transport(NULL),
+m_shards(0U),
+m_shardKey(USK_ADDRESS),
+m_shardOffset(0U),
+m_shardLength(0U)
 {
 	assert(!address.empty());
 
@@ -45,7 +59,13 @@ m_fd(-1)
 CUDPSocket::CUDPSocket(unsigned int port) :
 m_address(),
 m_port(port),
-m_fd(-1)
+m_fd(-1),
+m_busyPoll(0U),
+m_transport(NULL),
+m_shards(0U),
+m_shardKey(USK_ADDRESS),
+m_shardOffset(0U),
+m_shardLength(0U)
 {
 #if defined(_WIN32) || defined(_WIN64)
 	WSAData data;
@@ -104,7 +124,14 @@ in_addr CUDPSocket::lookup(const std::string& hostname)
 
 bool CUDPSocket::open()
 {
-	m_fd = ::socket(PF_INET, SOCK_DGRAM, 0);
+	if (m_transport != NULL)
+		return true;
+
+	// A socket handed over is already bound
+	bool bound = m_fd >= 0;
+
+	if (!bound)
+		m_fd = ::socket(PF_INET, SOCK_DGRAM, 0);
 	if (m_fd < 0) {
 #if defined(_WIN32) || defined(_WIN64)
 		LogError("Cannot create the UDP socket, err: %lu", ::GetLastError());
@@ -114,7 +141,15 @@ bool CUDPSocket::open()
 		return false;
 	}
 
-	if (m_port > 0U) {
+#if defined(SO_BUSY_POLL)
+	if (m_busyPoll > 0U) {
+		int busyPoll = int(m_busyPoll);
+		if (::setsockopt(m_fd, SOL_SOCKET, SO_BUSY_POLL, (char *)&busyPoll, sizeof(busyPoll)) == -1)
+			LogWarning("Cannot set SO_BUSY_POLL on the UDP socket, err: %d", errno);
+	}
+#endif
+
+	if (m_port > 0U && !bound) {
 		sockaddr_in addr;
 		::memset(&addr, 0x00, sizeof(sockaddr_in));
 		addr.sin_family      = AF_INET;
@@ -143,6 +178,18 @@ bool CUDPSocket::open()
 			return false;
 		}
 
+		if (m_shards > 1U) {
+#if defined(SO_REUSEPORT)
+			if (::setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, (char *)&reuse, sizeof(reuse)) == -1) {
+				LogError("Cannot set SO_REUSEPORT on the UDP socket, err: %d", errno);
+				return false;
+			}
+#else
+			LogError("Sharding a UDP port is not supported on this platform");
+			return false;
+#endif
+		}
+
 		if (::bind(m_fd, (sockaddr*)&addr, sizeof(sockaddr_in)) == -1) {
 #if defined(_WIN32) || defined(_WIN64)
 			LogError("Cannot bind the UDP address, err: %lu", ::GetLastError());
@@ -153,22 +200,104 @@ bool CUDPSocket::open()
 		}
 	}
 
+	// A socket handed over keeps its place in the group, the program is
+	// attached again in case the key has changed
+	if (m_shards > 1U && m_port > 0U)
+		setShardFilter();
+
 	return true;
 }
 
+bool CUDPSocket::setShardFilter()
+{
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	// The kernel runs this for each datagram with the UDP header pulled off,
+	// the result is the index of the socket in the group. An index past the
+	// end, while not all the shards are up, falls back to the kernel hash
+	sock_filter filter[8U + 6U * 32U];
+	unsigned int n = 0U;
+
+	if (m_shardKey == USK_ADDRESS) {
+		filter[n++] = (sock_filter)BPF_STMT(BPF_LD  | BPF_W | BPF_ABS, (unsigned int)(SKF_NET_OFF + 12));	// IPv4 source address
+	} else {
+		unsigned int length = m_shardLength > 32U ? 32U : m_shardLength;
+
+		// X = X * 31 + byte, a datagram too short for the key gives shard 0
+		filter[n++] = (sock_filter)BPF_STMT(BPF_LDX | BPF_IMM, 0);
+		for (unsigned int i = 0U; i < length; i++) {
+			filter[n++] = (sock_filter)BPF_STMT(BPF_MISC | BPF_TXA, 0);
+			filter[n++] = (sock_filter)BPF_STMT(BPF_ALU  | BPF_MUL | BPF_K, 31);
+			filter[n++] = (sock_filter)BPF_STMT(BPF_MISC | BPF_TAX, 0);
+			filter[n++] = (sock_filter)BPF_STMT(BPF_LD   | BPF_B | BPF_ABS, m_shardOffset + i);
+			filter[n++] = (sock_filter)BPF_STMT(BPF_ALU  | BPF_ADD | BPF_X, 0);
+			filter[n++] = (sock_filter)BPF_STMT(BPF_MISC | BPF_TAX, 0);
+		}
+		filter[n++] = (sock_filter)BPF_STMT(BPF_MISC | BPF_TXA, 0);
+	}
+
+	// Mix the bits so that keys which differ only at the end spread out
+	filter[n++] = (sock_filter)BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1U);
+	filter[n++] = (sock_filter)BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16);
+	filter[n++] = (sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, m_shards);
+	filter[n++] = (sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+
+	sock_fprog prog;
+	prog.len    = (unsigned short)n;
+	prog.filter = filter;
+
+	if (::setsockopt(m_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1) {
+		LogWarning("Cannot attach the shard program to the UDP socket, the kernel hash is used, err: %d", errno);
+		return false;
+	}
+
+	return true;
+#else
+	LogWarning("Steering a shared UDP port is not supported on this platform, the kernel hash is used");
+	return false;
+#endif
+}
+
+void CUDPSocket::setFd(int fd)
+{
+	m_fd = fd;
+}
+
+void CUDPSocket::setBusyPoll(unsigned int us)
+{
+	m_busyPoll = us;
+}
+
+void CUDPSocket::setReusePort(unsigned int shards, UDP_SHARD_KEY key, unsigned int offset, unsigned int length)
+{
+	m_shards      = shards;
+	m_shardKey    = key;
+	m_shardOffset = offset;
+	m_shardLength = length;
+}
+
+void CUDPSocket::setTransport(CUDPTransport* transport)
+{
+	m_transport = transport;
+}
+
+CUDPTransport* CUDPSocket::getTransport() const
+{
+	return m_transport;
+}
+
 int CUDPSocket::read(unsigned char* buffer, unsigned int length, in_addr& address, unsigned int& port)
 {
 	assert(buffer != NULL);
 	assert(length > 0U);
 
+	if (m_transport != NULL)
+		return m_transport->read(buffer, length, address, port);
+
 	// Check that the readfrom() won't block
+#if defined(_WIN32) || defined(_WIN64)
 	fd_set readFds;
 	FD_ZERO(&readFds);
-#if defined(_WIN32) || defined(_WIN64)
 	FD_SET((unsigned int)m_fd, &readFds);
-#else
-	FD_SET(m_fd, &readFds);
-#endif
 
 	// Return immediately
 	timeval tv;
@@ -177,13 +306,23 @@ int CUDPSocket::read(unsigned char* buffer, unsigned int length, in_addr& addres
 
 	int ret = ::select(m_fd + 1, &readFds, NULL, NULL, &tv);
 	if (ret < 0) {
-#if defined(_WIN32) || defined(_WIN64)
 		LogError("Error returned from UDP select, err: %lu", ::GetLastError());
+		return -1;
+	}
 #else
-		LogError("Error returned from UDP select, err: %d", errno);
-#endif
+	// poll() rather than select(), the descriptors of a gateway with a few
+	// hundred sessions go past FD_SETSIZE
+	struct pollfd fds[1U];
+	fds[0U].fd     = m_fd;
+	fds[0U].events = POLLIN;
+
+	// Return immediately
+	int ret = ::poll(fds, 1U, 0);
+	if (ret < 0) {
+		LogError("Error returned from UDP poll, err: %d", errno);
 		return -1;
 	}
+#endif
 
 	if (ret == 0)
 		return 0;
@@ -215,11 +354,49 @@ int CUDPSocket::read(unsigned char* buffer, unsigned int length, in_addr& addres
 	return len;
 }
 
+bool CUDPSocket::wait(unsigned int ms)
+{
+	if (m_transport != NULL)
+		return true;
+
+#if defined(_WIN32) || defined(_WIN64)
+	fd_set readFds;
+	FD_ZERO(&readFds);
+	FD_SET((unsigned int)m_fd, &readFds);
+
+	timeval tv;
+	tv.tv_sec  = ms / 1000U;
+	tv.tv_usec = (ms % 1000U) * 1000U;
+
+	int ret = ::select(m_fd + 1, &readFds, NULL, NULL, &tv);
+	if (ret < 0) {
+		LogError("Error returned from UDP select, err: %lu", ::GetLastError());
+		return false;
+	}
+#else
+	struct pollfd fds[1U];
+	fds[0U].fd     = m_fd;
+	fds[0U].events = POLLIN;
+
+	int ret = ::poll(fds, 1U, int(ms));
+	if (ret < 0) {
+		if (errno != EINTR)
+			LogError("Error returned from UDP poll, err: %d", errno);
+		return false;
+	}
+#endif
+
+	return ret > 0;
+}
+
 bool CUDPSocket::write(const unsigned char* buffer, unsigned int length, const in_addr& address, unsigned int port)
 {
 	assert(buffer != NULL);
 	assert(length > 0U);
 
+	if (m_transport != NULL)
+		return m_transport->write(buffer, length, address, port);
+
 	sockaddr_in addr;
 	::memset(&addr, 0x00, sizeof(sockaddr_in));
 
@@ -252,11 +429,88 @@ bool CUDPSocket::write(const unsigned char* buffer, unsigned int length, const i
 	return true;
 }
 
+bool CUDPSocket::write(const unsigned char* buffer, unsigned int length, const in_addr* addresses, const unsigned int* ports, unsigned int count)
+{
+	assert(buffer != NULL);
+	assert(length > 0U);
+	assert(addresses != NULL);
+	assert(ports != NULL);
+
+#if defined(__linux__)
+	if (m_transport == NULL) {
+		const unsigned int MAX_BATCH = 64U;
+
+		// Every message points at the one buffer, only the address differs
+		iovec iov;
+		iov.iov_base = (void*)buffer;
+		iov.iov_len  = length;
+
+		bool ok = true;
+
+		for (unsigned int start = 0U; start < count; start += MAX_BATCH) {
+			unsigned int n = count - start;
+			if (n > MAX_BATCH)
+				n = MAX_BATCH;
+
+			sockaddr_in addrs[MAX_BATCH];
+			mmsghdr msgs[MAX_BATCH];
+			::memset(addrs, 0x00, n * sizeof(sockaddr_in));
+			::memset(msgs, 0x00, n * sizeof(mmsghdr));
+
+			for (unsigned int i = 0U; i < n; i++) {
+				addrs[i].sin_family = AF_INET;
+				addrs[i].sin_addr   = addresses[start + i];
+				addrs[i].sin_port   = htons(ports[start + i]);
+
+				msgs[i].msg_hdr.msg_name    = &addrs[i];
+				msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+				msgs[i].msg_hdr.msg_iov     = &iov;
+				msgs[i].msg_hdr.msg_iovlen  = 1U;
+			}
+
+			// A failed destination stops the batch, the rest are sent after it
+			unsigned int sent = 0U;
+			while (sent < n) {
+				int ret = ::sendmmsg(m_fd, msgs + sent, n - sent, 0);
+				if (ret < 0) {
+					if (errno == EINTR)
+						continue;
+
+					LogError("Error returned from sendmmsg, err: %d", errno);
+					ok = false;
+					sent++;
+				} else {
+					sent += ret;
+				}
+			}
+		}
+
+		return ok;
+	}
+#endif
+
+	bool ok = true;
+	for (unsigned int i = 0U; i < count; i++)
+		ok &= write(buffer, length, addresses[i], ports[i]);
+
+	return ok;
+}
+
 void CUDPSocket::close()
 {
+	if (m_fd < 0)
+		return;
+
 #if defined(_WIN32) || defined(_WIN64)
 	::closesocket(m_fd);
 #else
 	::close(m_fd);
 #endif
+
+	m_fd = -1;
+}
+
+int CUDPSocket::getFd() const
+{
+	return m_fd;
 }
@@ -34,25 +34,71 @@
 #include <winsock.h>
 #endif
 
+// What decides which of the processes sharing a port gets a datagram
+enum UDP_SHARD_KEY {
+	USK_ADDRESS,		// The source address, whatever the port
+	USK_PAYLOAD		// Some bytes of the datagram itself
+};
+
+// Replaces the operating system socket, used to run the gateway against
+// in-memory networks
+class CUDPTransport {
+public:
+	virtual ~CUDPTransport();
+
+	virtual int  read(unsigned char* buffer, unsigned int length, in_addr& address, unsigned int& port) = 0;
+	virtual bool write(const unsigned char* buffer, unsigned int length, const in_addr& address, unsigned int port) = 0;
+};
+
 class CUDPSocket {
 public:
 	CUDPSocket(const std::string& address, unsigned int port = 0U);
 	CUDPSocket(unsigned int port = 0U);
 	~CUDPSocket();
 
+	// Busy poll the device queue for this long on a blocking read, takes effect on open()
+	void setBusyPoll(unsigned int us);
+
+	// Bind the port along with other processes using SO_REUSEPORT, each
+	// datagram goes to one of the shards picked by a hash of its key, the
+	// payload key is length bytes from offset, takes effect on open()
+	void setReusePort(unsigned int shards, UDP_SHARD_KEY key, unsigned int offset = 0U, unsigned int length = 0U);
+
+	// Send and receive through the transport instead of a real socket, call before open()
+	void setTransport(CUDPTransport* transport);
+	CUDPTransport* getTransport() const;
+
+	// Use a socket that is already bound, handed over by the process being
+	// upgraded, call before open()
+	void setFd(int fd);
+
 	bool open();
 
 	int  read(unsigned char* buffer, unsigned int length, in_addr& address, unsigned int& port);
+	// Blocks for up to ms for something to read, true when there is
+	bool wait(unsigned int ms);
 	bool write(const unsigned char* buffer, unsigned int length, const in_addr& address, unsigned int port);
+	// The same datagram to several destinations, with one sendmmsg() on Linux
+	bool write(const unsigned char* buffer, unsigned int length, const in_addr* addresses, const unsigned int* ports, unsigned int count);
 
 	void close();
 
+	int  getFd() const;
+
 	static in_addr lookup(const std::string& hostName);
 
 private:
 	std::string    m_address;
 	unsigned short m_port;
 	int            m_fd;
+	unsigned int   m_busyPoll;
+	CUDPTransport* m_transport;
+	unsigned int   m_shards;
+	UDP_SHARD_KEY  m_shardKey;
+	unsigned int   m_shardOffset;
+	unsigned int   m_shardLength;
+
+	bool setShardFilter();
 };
 
 #endif
@@ -0,0 +1,496 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "UDPThread.h"
+#include "StopWatch.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+const unsigned int QUEUE_LENGTH = 64U;
+
+CUDPThread::CUDPThread(CUDPSocket& socket, const std::string& name) :
+CThread(),
+m_socket(socket),
+m_name(name),
+m_rxQueue(QUEUE_LENGTH, name.c_str()),
+m_txQueue(QUEUE_LENGTH, name.c_str()),
+m_fanOutQueue(QUEUE_LENGTH, name.c_str()),
+m_fanOut(),
+m_fanOutNext(0U),
+m_attached(false),
+m_busy(false),
+m_failed(false),
+m_stop(false),
+m_notified(false),
+m_started(false),
+m_priority(0U),
+m_cpu(-1),
+m_notifyFd(-1),
+m_wakeFd(-1),
+m_ring(name),
+m_ioUring(false),
+m_syscalls(0ULL),
+m_received(0ULL),
+m_sent(0ULL)
+{
+#if defined(__linux__)
+	m_notifyFd = ::eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+	m_wakeFd   = ::eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_notifyFd < 0 || m_wakeFd < 0)
+		LogError("%s, cannot create an eventfd, err: %d", m_name.c_str(), errno);
+#endif
+}
+
+CUDPThread::~CUDPThread()
+{
+#if defined(__linux__)
+	if (m_notifyFd >= 0)
+		::close(m_notifyFd);
+	if (m_wakeFd >= 0)
+		::close(m_wakeFd);
+#endif
+}
+
+void CUDPThread::setScheduling(unsigned int priority, int cpu)
+{
+	m_priority = priority;
+	m_cpu      = cpu;
+}
+
+void CUDPThread::setIOUring(bool enabled)
+{
+	m_ioUring = enabled;
+}
+
+bool CUDPThread::start()
+{
+	// An in-memory transport has nothing to block on, so its datagrams are
+	// passed straight through on the caller's thread
+	if (m_started || m_socket.getTransport() != NULL)
+		return true;
+
+	m_started = run();
+
+	return m_started;
+}
+
+void CUDPThread::attach()
+{
+	m_attached = true;
+
+	signal(m_wakeFd);
+}
+
+void CUDPThread::detach()
+{
+	// Let anything already queued, such as a closing message, go out first
+	if (m_started && m_attached) {
+		signal(m_wakeFd);
+
+		while (!m_txQueue.isEmpty() || !m_fanOutQueue.isEmpty())
+			CThread::sleep(1U);
+	}
+
+	m_attached = false;
+
+	signal(m_wakeFd);
+
+	while (m_busy)
+		CThread::sleep(1U);
+}
+
+bool CUDPThread::read(CUDPDatagram& datagram)
+{
+	if (m_socket.getTransport() != NULL) {
+		int length = m_socket.read(datagram.m_data, UDP_DATAGRAM_LENGTH, datagram.m_address, datagram.m_port);
+		if (length <= 0)
+			return false;
+
+		datagram.m_length = length;
+		datagram.m_time   = CStopWatch::monotonic();
+		return true;
+	}
+
+	if (m_rxQueue.pop(datagram))
+		return true;
+
+	// Clear the notification before looking again, anything queued after
+	// this point raises a fresh one. The eventfd is only read when the thread
+	// has raised one, not on every empty poll of the queue.
+	if (!m_notified.exchange(false))
+		return false;
+
+	// The thread may have raised the flag but not written the eventfd yet,
+	// keep the flag so that the late signal is cleared on the next look
+	if (!clear(m_notifyFd))
+		m_notified = true;
+
+	return m_rxQueue.pop(datagram);
+}
+
+bool CUDPThread::write(const unsigned char* data, unsigned int length, const in_addr& address, unsigned int port)
+{
+	assert(data != NULL);
+	assert(length > 0U && length <= UDP_DATAGRAM_LENGTH);
+
+	if (m_socket.getTransport() != NULL)
+		return m_socket.write(data, length, address, port);
+
+	CUDPDatagram datagram;
+	::memcpy(datagram.m_data, data, length);
+	datagram.m_length  = length;
+	datagram.m_address = address;
+	datagram.m_port    = port;
+	datagram.m_time    = CStopWatch::monotonic();
+
+	if (!m_txQueue.push(datagram))
+		return false;
+
+	// The thread empties the queue whenever it wakes, so it only needs waking
+	// for the first datagram, such as the first of the two voice headers
+	if (m_txQueue.dataSize() == 1U)
+		signal(m_wakeFd);
+
+	return true;
+}
+
+bool CUDPThread::write(const unsigned char* data, unsigned int length, const in_addr* addresses, const unsigned int* ports, unsigned int count)
+{
+	assert(data != NULL);
+	assert(length > 0U && length <= UDP_DATAGRAM_LENGTH);
+	assert(addresses != NULL);
+	assert(ports != NULL);
+	assert(count <= UDP_MAX_FANOUT);
+
+	if (count == 0U)
+		return true;
+
+	if (m_socket.getTransport() != NULL)
+		return m_socket.write(data, length, addresses, ports, count);
+
+	CUDPFanOut fanOut;
+	::memcpy(fanOut.m_data, data, length);
+	fanOut.m_length = length;
+	fanOut.m_count  = count;
+	for (unsigned int i = 0U; i < count; i++) {
+		fanOut.m_addresses[i] = addresses[i];
+		fanOut.m_ports[i]     = ports[i];
+	}
+
+	if (!m_fanOutQueue.push(fanOut))
+		return false;
+
+	if (m_fanOutQueue.dataSize() == 1U)
+		signal(m_wakeFd);
+
+	return true;
+}
+
+bool CUDPThread::hasFailed()
+{
+	return m_failed.exchange(false);
+}
+
+bool CUDPThread::hasData() const
+{
+	// An in-memory transport can only be asked by reading it
+	if (m_socket.getTransport() != NULL)
+		return true;
+
+	return !m_rxQueue.isEmpty() || m_notified || m_failed;
+}
+
+int CUDPThread::getFd() const
+{
+	return m_notifyFd;
+}
+
+void CUDPThread::stop()
+{
+	m_stop = true;
+
+	signal(m_wakeFd);
+
+	if (m_started) {
+		wait();
+		logStats();
+	}
+
+	m_started = false;
+}
+
+void CUDPThread::getStats(unsigned long long& datagrams, unsigned long long& syscalls) const
+{
+	datagrams = m_received + m_sent;
+	syscalls  = m_syscalls + m_ring.getSyscalls();
+}
+
+void CUDPThread::logStats() const
+{
+	unsigned long long datagrams, syscalls;
+	getStats(datagrams, syscalls);
+	if (datagrams == 0ULL)
+		return;
+
+	LogInfo("%s I/O, %llu received, %llu sent, %llu system calls, %.2f per datagram (%s)", m_name.c_str(), m_received, m_sent, syscalls, float(syscalls) / float(datagrams), m_ioUring ? "io_uring" : "poll");
+}
+
+void CUDPThread::entry()
+{
+	LogInfo("Started the %s I/O thread", m_name.c_str());
+
+	if (m_cpu >= 0)
+		CThread::setAffinity(m_cpu);
+	if (m_priority > 0U)
+		CThread::setPriority(m_priority);
+
+	CUDPDatagram datagram;
+
+	while (!m_stop) {
+		m_busy = true;
+
+		if (!m_attached) {
+			m_busy = false;
+#if defined(__linux__)
+			struct pollfd fds[1U];
+			fds[0U].fd     = m_wakeFd;
+			fds[0U].events = POLLIN;
+			::poll(fds, 1U, -1);
+#else
+			sleep(5U);
+#endif
+			clear(m_wakeFd);
+			continue;
+		}
+
+		if (m_ioUring) {
+			runRing();
+			m_busy = false;
+			continue;
+		}
+
+		bool readable = true;
+
+#if defined(__linux__)
+		struct pollfd fds[2U];
+		fds[0U].fd      = m_socket.getFd();
+		fds[0U].events  = POLLIN;
+		fds[0U].revents = 0;
+		fds[1U].fd      = m_wakeFd;
+		fds[1U].events  = POLLIN;
+		fds[1U].revents = 0;
+
+		int n = ::poll(fds, 2U, (m_txQueue.isEmpty() && m_fanOutQueue.isEmpty()) ? -1 : 0);
+		if (n < 0 && errno != EINTR)
+			LogError("%s, error returned from poll, err: %d", m_name.c_str(), errno);
+		m_syscalls++;
+
+		if ((fds[1U].revents & POLLIN) == POLLIN)
+			clear(m_wakeFd);
+
+		readable = (fds[0U].revents & POLLIN) == POLLIN;
+#endif
+
+		if (readable) {
+			// A poll() and a recvfrom()
+			int length = m_socket.read(datagram.m_data, UDP_DATAGRAM_LENGTH, datagram.m_address, datagram.m_port);
+			m_syscalls += 2ULL;
+			if (length > 0) {
+				datagram.m_length = length;
+				datagram.m_time   = CStopWatch::monotonic();
+				m_received++;
+
+				if (m_rxQueue.push(datagram))
+					notify();
+			} else if (length < 0) {
+				m_failed = true;
+				notify();
+			}
+
+#if !defined(__linux__)
+			if (length == 0 && m_txQueue.isEmpty() && m_fanOutQueue.isEmpty())
+				sleep(5U);
+#endif
+		}
+
+		flush();
+
+		m_busy = false;
+	}
+
+	LogInfo("Stopped the %s I/O thread", m_name.c_str());
+}
+
+void CUDPThread::flush()
+{
+	CUDPDatagram datagram;
+
+	while (m_txQueue.pop(datagram)) {
+		bool ret = m_socket.write(datagram.m_data, datagram.m_length, datagram.m_address, datagram.m_port);
+		m_syscalls++;
+		m_sent++;
+		if (!ret) {
+			m_failed = true;
+			notify();
+		}
+	}
+
+	CUDPFanOut fanOut;
+
+	while (m_fanOutQueue.pop(fanOut)) {
+		bool ret = m_socket.write(fanOut.m_data, fanOut.m_length, fanOut.m_addresses, fanOut.m_ports, fanOut.m_count);
+		m_syscalls++;
+		m_sent += fanOut.m_count;
+		if (!ret) {
+			m_failed = true;
+			notify();
+		}
+	}
+}
+
+void CUDPThread::runRing()
+{
+	if (!m_ring.open(m_socket.getFd(), m_wakeFd, m_notifyFd)) {
+		LogWarning("%s, falling back to poll()", m_name.c_str());
+		m_ioUring = false;
+		return;
+	}
+
+	CUDPDatagram datagram;
+
+	while (m_attached && !m_stop) {
+		while (m_ring.canWrite() && m_txQueue.pop(datagram)) {
+			m_ring.write(datagram);
+			m_sent++;
+		}
+
+		// Each destination takes a ring slot of its own, a fan out may be
+		// spread over more than one submission when the ring is busy
+		while (m_ring.canWrite()) {
+			if (m_fanOutNext == m_fanOut.m_count) {
+				if (!m_fanOutQueue.pop(m_fanOut))
+					break;
+				m_fanOutNext = 0U;
+			}
+
+			m_ring.write(m_fanOut.m_data, m_fanOut.m_length, m_fanOut.m_addresses[m_fanOutNext], m_fanOut.m_ports[m_fanOutNext]);
+			m_fanOutNext++;
+			m_sent++;
+		}
+
+		if (!m_ring.wait()) {
+			LogWarning("%s, falling back to poll()", m_name.c_str());
+			m_ioUring = false;
+			break;
+		}
+
+		// The notification goes out with the next submission, ahead of the wait
+		if (receiveRing() && !m_notified.exchange(true))
+			m_ring.notify();
+
+		if (m_ring.isUnsupported()) {
+			LogWarning("%s, falling back to poll()", m_name.c_str());
+			m_ioUring = false;
+			break;
+		}
+	}
+
+	// Anything the kernel has already received is still passed on, and the
+	// sends in flight complete before the socket may be closed
+	m_ring.cancel();
+
+	bool queued = false;
+	while (!m_ring.isIdle() && m_ring.wait())
+		queued |= receiveRing();
+
+	m_ring.close();
+
+	if (queued)
+		notify();
+}
+
+bool CUDPThread::receiveRing()
+{
+	CUDPDatagram datagram;
+	bool queued = false;
+
+	while (m_ring.read(datagram)) {
+		datagram.m_time = CStopWatch::monotonic();
+		m_received++;
+
+		if (m_rxQueue.push(datagram))
+			queued = true;
+	}
+
+	if (m_ring.hasFailed()) {
+		m_failed = true;
+		queued   = true;
+	}
+
+	return queued;
+}
+
+void CUDPThread::notify()
+{
+	// Raised once until the consumer has seen it
+	if (!m_notified.exchange(true))
+		signal(m_notifyFd);
+}
+
+void CUDPThread::signal(int fd)
+{
+#if defined(__linux__)
+	if (fd < 0)
+		return;
+
+	m_syscalls++;
+
+	uint64_t value = 1U;
+	if (::write(fd, &value, sizeof(uint64_t)) < 0 && errno != EAGAIN)
+		LogError("%s, cannot signal an eventfd, err: %d", m_name.c_str(), errno);
+#endif
+}
+
+bool CUDPThread::clear(int fd)
+{
+#if defined(__linux__)
+	if (fd < 0)
+		return true;
+
+	m_syscalls++;
+
+	uint64_t value;
+	if (::read(fd, &value, sizeof(uint64_t)) < 0) {
+		if (errno != EAGAIN)
+			LogError("%s, cannot clear an eventfd, err: %d", m_name.c_str(), errno);
+		return false;
+	}
+#endif
+
+	return true;
+}
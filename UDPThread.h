@@ -0,0 +1,135 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(UDPTHREAD_H)
+#define	UDPTHREAD_H
+
+#include "UDPSocket.h"
+#include "SPSCQueue.h"
+#include "UDPRing.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <string>
+
+const unsigned int UDP_DATAGRAM_LENGTH = 512U;
+
+class CUDPDatagram {
+public:
+	unsigned char      m_data[UDP_DATAGRAM_LENGTH];
+	unsigned int       m_length;
+	in_addr            m_address;
+	unsigned int       m_port;
+	unsigned long long m_time;		// CStopWatch::monotonic() at reception
+};
+
+const unsigned int UDP_MAX_FANOUT = 16U;
+
+// One datagram for several destinations, queued and sent as one
+class CUDPFanOut {
+public:
+	unsigned char      m_data[UDP_DATAGRAM_LENGTH];
+	unsigned int       m_length;
+	unsigned int       m_count;
+	in_addr            m_addresses[UDP_MAX_FANOUT];
+	unsigned int       m_ports[UDP_MAX_FANOUT];
+};
+
+// Owns the I/O on one UDP socket. Received datagrams are timestamped and
+// handed to the conversion thread through one queue, datagrams to send come
+// back through another, so neither direction waits for the other thread.
+class CUDPThread : public CThread {
+public:
+	CUDPThread(CUDPSocket& socket, const std::string& name);
+	virtual ~CUDPThread();
+
+	// Applied by the thread when it starts, a priority of 0 and a CPU of -1
+	// leave the default scheduling
+	void setScheduling(unsigned int priority, int cpu);
+
+	// Use io_uring rather than poll() for the socket, the thread falls back
+	// to poll() if the kernel cannot support it, call before start()
+	void setIOUring(bool enabled);
+
+	bool start();
+
+	// Call after the socket has been opened
+	void attach();
+
+	// Call before the socket is closed, returns once the thread has let go of it
+	void detach();
+
+	// Consumer side of the receive queue
+	bool read(CUDPDatagram& datagram);
+
+	// Producer side of the transmit queue
+	bool write(const unsigned char* data, unsigned int length, const in_addr& address, unsigned int port);
+	// The same datagram to up to UDP_MAX_FANOUT destinations, copied into
+	// the queue once and sent with one system call
+	bool write(const unsigned char* data, unsigned int length, const in_addr* addresses, const unsigned int* ports, unsigned int count);
+
+	// True once after a socket error in the thread
+	bool hasFailed();
+
+	// Something for read() or hasFailed() to pick up, without a system call
+	bool hasData() const;
+
+	// Readable whenever the receive queue may hold data, -1 if not supported
+	int  getFd() const;
+
+	void stop();
+
+	// The datagrams received and sent, and the system calls they took so far
+	void getStats(unsigned long long& datagrams, unsigned long long& syscalls) const;
+	void logStats() const;
+
+	virtual void entry();
+
+private:
+	CUDPSocket&                m_socket;
+	std::string                m_name;
+	CSPSCQueue<CUDPDatagram>   m_rxQueue;
+	CSPSCQueue<CUDPDatagram>   m_txQueue;
+	CSPSCQueue<CUDPFanOut>     m_fanOutQueue;
+	CUDPFanOut                 m_fanOut;		// Being queued on the ring
+	unsigned int               m_fanOutNext;
+	std::atomic<bool>          m_attached;
+	std::atomic<bool>          m_busy;
+	std::atomic<bool>          m_failed;
+	std::atomic<bool>          m_stop;
+	std::atomic<bool>          m_notified;
+	bool                       m_started;
+	unsigned int               m_priority;
+	int                        m_cpu;
+	int                        m_notifyFd;
+	int                        m_wakeFd;
+	CUDPRing                   m_ring;
+	bool                       m_ioUring;
+	std::atomic<unsigned long long> m_syscalls;
+	unsigned long long         m_received;
+	unsigned long long         m_sent;
+
+	void notify();
+	void signal(int fd);
+	bool clear(int fd);
+	void flush();
+	void runRing();
+	bool receiveRing();
+};
+
+#endif
@@ -0,0 +1,492 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "Upgrade.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+const char* UPGRADE_FD_ENV = "YSF2DMR_UPGRADE_FD";
+
+// The state goes over in as many messages as it takes, each with a line
+// giving where its text and its sockets start and the totals, then up to
+// UPGRADE_CHUNK_LENGTH bytes of the text and up to UPGRADE_BATCH_FDS sockets.
+// The kernel passes at most 253 descriptors in one message.
+const unsigned int UPGRADE_CHUNK_LENGTH  = 32768U;
+const unsigned int UPGRADE_BATCH_FDS     = 250U;
+const unsigned int UPGRADE_HEADER_LENGTH = 64U;
+
+// Two sockets and a few hundred bytes for each session, far more than any
+// gateway has, only to bound what the new process accepts
+const unsigned int UPGRADE_MAX_LENGTH = 16777216U;
+const unsigned int UPGRADE_MAX_FDS    = 65536U;
+
+// How long the new process has to send its state before it is dropped
+const int UPGRADE_RECEIVE_TIMEOUT = 10000;
+
+CUpgrade::CUpgrade() :
+m_fd(-1),
+#if !defined(_WIN32) && !defined(_WIN64)
+m_pid(-1),
+#endif
+m_scope(),
+m_values(),
+m_fds(),
+m_received(false)
+{
+}
+
+CUpgrade::~CUpgrade()
+{
+	close();
+}
+
+bool CUpgrade::start(char* const* argv)
+{
+	assert(argv != NULL);
+
+#if defined(_WIN32) || defined(_WIN64)
+	LogWarning("Handing over to a new process is not supported on Windows");
+	return false;
+#else
+	int fds[2U];
+	if (::socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0) {
+		LogError("Cannot create the upgrade socket pair, err: %d", errno);
+		return false;
+	}
+
+	// Set up front, the child may not allocate between fork() and exec()
+	char value[20U];
+	::sprintf(value, "%d", fds[1U]);
+	::setenv(UPGRADE_FD_ENV, value, 1);
+
+	long maxFd = ::sysconf(_SC_OPEN_MAX);
+
+	m_pid = ::fork();
+	if (m_pid == 0) {
+		// Only the standard streams and the child end of the pair go across
+		for (int fd = 3; fd < maxFd; fd++) {
+			if (fd != fds[1U])
+				::close(fd);
+		}
+
+		::execvp(argv[0U], argv);
+		::_exit(EXIT_FAILURE);
+	}
+
+	::unsetenv(UPGRADE_FD_ENV);
+	::close(fds[1U]);
+
+	if (m_pid < 0) {
+		LogError("Cannot fork the new process, err: %d", errno);
+		::close(fds[0U]);
+		return false;
+	}
+
+	m_fd = fds[0U];
+	::fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+
+	LogMessage("Started %s as PID %d", argv[0U], int(m_pid));
+
+	return true;
+#endif
+}
+
+bool CUpgrade::send(unsigned int timeout)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	return false;
+#else
+	assert(m_fd >= 0);
+
+	std::string text;
+	for (std::map<std::string, std::string>::const_iterator it = m_values.begin(); it != m_values.end(); ++it)
+		text += it->first + "=" + it->second + "\n";
+
+	if (text.size() > UPGRADE_MAX_LENGTH || m_fds.size() > UPGRADE_MAX_FDS) {
+		LogError("The upgrade state is too large, %u bytes and %u sockets", (unsigned int)text.size(), (unsigned int)m_fds.size());
+		stopChild();
+		return false;
+	}
+
+	unsigned int length = text.size();
+	unsigned int fds    = m_fds.size();
+
+	unsigned int offset = 0U;
+	unsigned int index  = 0U;
+	do {
+		unsigned int chunk = length - offset < UPGRADE_CHUNK_LENGTH ? length - offset : UPGRADE_CHUNK_LENGTH;
+		unsigned int batch = fds - index < UPGRADE_BATCH_FDS ? fds - index : UPGRADE_BATCH_FDS;
+
+		if (!sendBatch(text.data() + offset, offset, chunk, index, batch, length, fds, timeout)) {
+			stopChild();
+			return false;
+		}
+
+		offset += chunk;
+		index  += batch;
+	} while (offset < length || index < fds);
+
+	struct pollfd pfd;
+	pfd.fd      = m_fd;
+	pfd.events  = POLLIN;
+	pfd.revents = 0;
+
+	int n;
+	do {
+		n = ::poll(&pfd, 1U, int(timeout));
+	} while (n < 0 && errno == EINTR);
+
+	char reply[2U];
+	ssize_t len = 0;
+	if (n > 0)
+		len = ::recv(m_fd, reply, 2U, 0);
+
+	if (len == 2 && ::memcmp(reply, "OK", 2U) == 0)
+		return true;
+
+	LogError("The new process has not taken over");
+	stopChild();
+
+	return false;
+#endif
+}
+
+bool CUpgrade::isRequested()
+{
+	return ::getenv(UPGRADE_FD_ENV) != NULL;
+}
+
+bool CUpgrade::receive()
+{
+#if defined(_WIN32) || defined(_WIN64)
+	return false;
+#else
+	const char* value = ::getenv(UPGRADE_FD_ENV);
+	if (value == NULL)
+		return false;
+
+	m_fd = ::atoi(value);
+	::unsetenv(UPGRADE_FD_ENV);
+
+	::fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+
+	char* buffer = new char[UPGRADE_HEADER_LENGTH + UPGRADE_CHUNK_LENGTH];
+
+	std::string text;
+	unsigned int length = 0U;
+	unsigned int fds    = 0U;
+	unsigned int offset = 0U;
+	unsigned int index  = 0U;
+
+	bool ok = true;
+	do {
+		ok = receiveBatch(buffer, text, offset, index, length, fds);
+	} while (ok && (offset < length || index < fds));
+
+	delete[] buffer;
+
+	if (!ok)
+		return false;
+
+	std::string::size_type start = 0U;
+	while (start < text.size()) {
+		std::string::size_type end = text.find('\n', start);
+		if (end == std::string::npos)
+			end = text.size();
+
+		std::string line = text.substr(start, end - start);
+		std::string::size_type pos = line.find('=');
+		if (pos != std::string::npos)
+			m_values[line.substr(0U, pos)] = line.substr(pos + 1U);
+
+		start = end + 1U;
+	}
+
+	LogMessage("Received %u values and %u sockets from the old process", (unsigned int)m_values.size(), (unsigned int)m_fds.size());
+
+	return true;
+#endif
+}
+
+void CUpgrade::complete(bool ok)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (m_fd < 0)
+		return;
+
+	if (::send(m_fd, ok ? "OK" : "NO", 2U, MSG_NOSIGNAL) < 0)
+		LogWarning("Cannot reply to the old process, err: %d", errno);
+#endif
+
+	close();
+}
+
+void CUpgrade::setScope(const std::string& scope)
+{
+	m_scope = scope;
+}
+
+void CUpgrade::set(const std::string& key, const std::string& value)
+{
+	m_values[m_scope + key] = value;
+}
+
+void CUpgrade::set(const std::string& key, unsigned long long value)
+{
+	char text[25U];
+	::sprintf(text, "%llu", value);
+
+	m_values[m_scope + key] = text;
+}
+
+bool CUpgrade::has(const std::string& key) const
+{
+	return m_values.find(m_scope + key) != m_values.end();
+}
+
+std::string CUpgrade::get(const std::string& key) const
+{
+	std::map<std::string, std::string>::const_iterator it = m_values.find(m_scope + key);
+	if (it == m_values.end())
+		return "";
+
+	return it->second;
+}
+
+unsigned long long CUpgrade::getInt(const std::string& key) const
+{
+	return ::strtoull(get(key).c_str(), NULL, 10);
+}
+
+void CUpgrade::setFd(const std::string& name, int fd)
+{
+	assert(!m_received);
+
+	if (fd < 0)
+		return;
+
+	set("fd." + name, m_fds.size());
+	m_fds.push_back(fd);
+}
+
+int CUpgrade::getFd(const std::string& name)
+{
+	if (!m_received || !has("fd." + name))
+		return -1;
+
+	unsigned int index = (unsigned int)getInt("fd." + name);
+	if (index >= m_fds.size())
+		return -1;
+
+	int fd = m_fds[index];
+	m_fds[index] = -1;
+
+	return fd;
+}
+
+void CUpgrade::close()
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (m_fd >= 0)
+		::close(m_fd);
+
+	// Sockets nobody took over, those being sent still belong to their networks
+	if (m_received) {
+		for (std::vector<int>::const_iterator it = m_fds.begin(); it != m_fds.end(); ++it) {
+			if (*it >= 0)
+				::close(*it);
+		}
+	}
+#endif
+
+	m_fd = -1;
+	m_fds.clear();
+}
+
+bool CUpgrade::sendBatch(const char* text, unsigned int offset, unsigned int chunk, unsigned int index, unsigned int batch, unsigned int length, unsigned int fds, unsigned int timeout)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	return false;
+#else
+	char header[UPGRADE_HEADER_LENGTH];
+	int headerLength = ::snprintf(header, UPGRADE_HEADER_LENGTH, "%u %u %u %u\n", offset, index, length, fds);
+
+	struct iovec iov[2U];
+	iov[0U].iov_base = header;
+	iov[0U].iov_len  = headerLength;
+	iov[1U].iov_base = (void*)text;
+	iov[1U].iov_len  = chunk;
+
+	char control[CMSG_SPACE(sizeof(int) * UPGRADE_BATCH_FDS)];
+	::memset(control, 0x00U, sizeof(control));
+
+	struct msghdr msg;
+	::memset(&msg, 0x00U, sizeof(struct msghdr));
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = 2U;
+
+	if (batch > 0U) {
+		msg.msg_control    = control;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * batch);
+
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type  = SCM_RIGHTS;
+		cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * batch);
+		::memcpy(CMSG_DATA(cmsg), &m_fds[index], sizeof(int) * batch);
+	}
+
+	// Not blocked for good by a new process that has stopped reading
+	struct pollfd pfd;
+	pfd.fd      = m_fd;
+	pfd.events  = POLLOUT;
+	pfd.revents = 0;
+
+	int n;
+	do {
+		n = ::poll(&pfd, 1U, int(timeout));
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0 || ::sendmsg(m_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+		LogError("Cannot send the state to the new process, err: %d", n <= 0 ? ETIMEDOUT : errno);
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+bool CUpgrade::receiveBatch(char* buffer, std::string& text, unsigned int& offset, unsigned int& index, unsigned int& length, unsigned int& fds)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	return false;
+#else
+	assert(buffer != NULL);
+
+	struct pollfd pfd;
+	pfd.fd      = m_fd;
+	pfd.events  = POLLIN;
+	pfd.revents = 0;
+
+	if (::poll(&pfd, 1U, UPGRADE_RECEIVE_TIMEOUT) <= 0) {
+		LogError("No state has come from the old process");
+		return false;
+	}
+
+	struct iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len  = UPGRADE_HEADER_LENGTH + UPGRADE_CHUNK_LENGTH;
+
+	char control[CMSG_SPACE(sizeof(int) * UPGRADE_BATCH_FDS)];
+
+	struct msghdr msg;
+	::memset(&msg, 0x00U, sizeof(struct msghdr));
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1U;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+
+	ssize_t len = ::recvmsg(m_fd, &msg, MSG_CMSG_CLOEXEC);
+	if (len <= 0) {
+		LogError("Cannot read the state from the old process, err: %d", errno);
+		return false;
+	}
+
+	std::vector<int> batch;
+	for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		unsigned int n = (cmsg->cmsg_len - CMSG_LEN(0U)) / sizeof(int);
+		for (unsigned int i = 0U; i < n; i++) {
+			int fd;
+			::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+			batch.push_back(fd);
+		}
+	}
+
+	bool valid = (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) == 0;
+
+	const char* end = (const char*)::memchr(buffer, '\n', len < ssize_t(UPGRADE_HEADER_LENGTH) ? len : UPGRADE_HEADER_LENGTH);
+	unsigned int batchOffset = 0U, batchIndex = 0U, batchLength = 0U, batchFds = 0U;
+	if (end == NULL || ::sscanf(buffer, "%u %u %u %u", &batchOffset, &batchIndex, &batchLength, &batchFds) != 4)
+		valid = false;
+
+	// The first message gives the totals, the others have to agree with them
+	if (valid && offset == 0U && index == 0U) {
+		if (batchLength > UPGRADE_MAX_LENGTH || batchFds > UPGRADE_MAX_FDS) {
+			LogError("The upgrade state is too large, %u bytes and %u sockets", batchLength, batchFds);
+			valid = false;
+		} else {
+			length = batchLength;
+			fds    = batchFds;
+			text.reserve(length);
+			m_fds.reserve(fds);
+		}
+	}
+
+	unsigned int chunk = valid ? len - (end + 1 - buffer) : 0U;
+	if (!valid || batchOffset != offset || batchIndex != index || batchLength != length || batchFds != fds ||
+		chunk > length - offset || batch.size() > fds - index) {
+		LogError("Invalid message from the old process");
+
+		for (std::vector<int>::const_iterator it = batch.begin(); it != batch.end(); ++it)
+			::close(*it);
+
+		return false;
+	}
+
+	// Whatever came is ours to close from here on
+	m_received = true;
+	m_fds.insert(m_fds.end(), batch.begin(), batch.end());
+
+	text.append(end + 1, chunk);
+	offset += chunk;
+	index  += batch.size();
+
+	return true;
+#endif
+}
+
+void CUpgrade::stopChild()
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (m_pid <= 0)
+		return;
+
+	// A clean shutdown would log the shared session out of the master
+	::kill(m_pid, SIGKILL);
+	::waitpid(m_pid, NULL, 0);
+
+	m_pid = -1;
+#endif
+}
@@ -0,0 +1,90 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(UPGRADE_H)
+#define	UPGRADE_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/types.h>
+#endif
+
+// Hands the bound sockets and the session state of a running gateway to a
+// freshly started binary over a Unix socket, so that an upgrade needs no new
+// login to the DMR master. The state is sent as key=value text so that it
+// survives a change of the structures between the two versions. It is only
+// done between calls, nothing of a call in progress is handed over.
+class CUpgrade {
+public:
+	CUpgrade();
+	~CUpgrade();
+
+	// Old process, runs the new binary with the same arguments
+	bool start(char* const* argv);
+
+	// Old process, sends the state and the sockets then waits for the new
+	// process to take them over, stopping it if it does not
+	bool send(unsigned int timeout);
+
+	// New process, true when it was started by start() above
+	static bool isRequested();
+
+	// New process, reads the state and the sockets
+	bool receive();
+
+	// New process, lets the old process exit or carry on
+	void complete(bool ok);
+
+	// Prefixed to the keys and socket names below, so that each session of
+	// the gateway keeps to its own
+	void setScope(const std::string& scope);
+
+	void set(const std::string& key, const std::string& value);
+	void set(const std::string& key, unsigned long long value);
+
+	bool               has(const std::string& key) const;
+	std::string        get(const std::string& key) const;
+	unsigned long long getInt(const std::string& key) const;
+
+	// The socket stays open in the old process until it exits
+	void setFd(const std::string& name, int fd);
+
+	// The received socket, -1 if there is none, the caller then owns it
+	int  getFd(const std::string& name);
+
+	void close();
+
+private:
+	int                                m_fd;
+#if !defined(_WIN32) && !defined(_WIN64)
+	pid_t                              m_pid;
+#endif
+	std::string                        m_scope;
+	std::map<std::string, std::string> m_values;
+	std::vector<int>                   m_fds;
+	bool                               m_received;
+
+	bool sendBatch(const char* text, unsigned int offset, unsigned int chunk, unsigned int index, unsigned int batch, unsigned int length, unsigned int fds, unsigned int timeout);
+	bool receiveBatch(char* buffer, std::string& text, unsigned int& offset, unsigned int& index, unsigned int& length, unsigned int& fds);
+	void stopChild();
+};
+
+#endif
@@ -20,6 +20,6 @@
 #if !defined(VERSION_H)
 #define	VERSION_H
 
-const char* VERSION = "20200605";
+const char* const VERSION = "20200605";
 
 #endif
@@ -47,9 +47,11 @@ const unsigned char ALL_RESP[]  = {0x5DU, 0x46U, 0x5FU, 0x26U};
 
 const unsigned char DEFAULT_FICH[] = {0x20U, 0x00U, 0x01U, 0x00U};
 
+const unsigned int WIRESX_TX_INTERVAL = 90U;
+
 const unsigned char NET_HEADER[] = "YSFD                    ALL      ";
 
-CWiresX::CWiresX(const std::string& callsign, const std::string& suffix, CYSFNetwork* network, std::string tgfile, bool makeUpper) :
+CWiresX::CWiresX(CTimerWheel& wheel, const std::string& callsign, const std::string& suffix, CYSFNetwork* network, std::string tgfile, bool makeUpper) :
 m_callsign(callsign),
 m_node(),
 m_id(),
@@ -59,7 +61,7 @@ m_rxFrequency(0U),
 m_dstID(0U),
 m_network(network),
 m_command(NULL),
-m_timer(1000U, 1U),
+m_timer(wheel, 1U),
 m_seqNo(0U),
 m_header(NULL),
 m_csd1(NULL),
@@ -70,6 +72,8 @@ m_start(0U),
 m_search(),
 m_category(),
 m_makeUpper(makeUpper),
+m_txWatch(),
+m_txTimer(wheel, 0U, WIRESX_TX_INTERVAL),
 m_bufferTX(10000U, "YSF Wires-X TX Buffer")
 {
 	assert(network != NULL);
@@ -132,6 +136,9 @@ m_bufferTX(10000U, "YSF Wires-X TX Buffer")
 		::fclose(fp);
 	}
 
+	m_timer.setCallback([this] { replyExpired(); });
+	m_txTimer.setCallback([this] { txExpired(); });
+
 	m_txWatch.start();
 }
 
@@ -309,7 +316,7 @@ void CWiresX::processDX(const unsigned char* source)
 	::LogDebug("Received DX from %10.10s", source);
 
 	m_status = WXSI_DX;
-	m_timer.start();
+	m_timer.start(1U, 100U);
 }
 
 void CWiresX::processCategory(const unsigned char* source, const unsigned char* data)
@@ -409,49 +416,50 @@ void CWiresX::processDisconnect(const unsigned char* source)
 	m_timer.start();
 }
 
-void CWiresX::clock(unsigned int ms)
+void CWiresX::replyExpired()
 {
-	unsigned char buffer[200U];
+	switch (m_status) {
+	case WXSI_DX:
+		sendDXReply();
+		break;
+	case WXSI_ALL:
+		sendAllReply();
+		break;
+	case WXSI_SEARCH:
+		sendSearchReply();
+		break;
+	case WXSI_CONNECT:
+		break;
+	case WXSI_DISCONNECT:
+		break;
+	case WXSI_CATEGORY:
+		sendCategoryReply();
+		break;
+	default:
+		break;
+	}
 
-	m_timer.clock(ms);
-	if (m_timer.isRunning() && m_timer.hasExpired()) {
-		switch (m_status) {
-		case WXSI_DX:
-			CThread::sleep(100U);
-			sendDXReply();
-			break;
-		case WXSI_ALL:
-			sendAllReply();
-			break;
-		case WXSI_SEARCH:
-			sendSearchReply();
-			break;
-		case WXSI_CONNECT:
-			break;
-		case WXSI_DISCONNECT:
-			break;
-		case WXSI_CATEGORY:
-			sendCategoryReply();
-			break;
-		default:
-			break;
-		}
+	m_status = WXSI_NONE;
+	m_timer.setTimeout(1U);
+}
 
-		m_status = WXSI_NONE;
-		m_timer.stop();
-	}
+void CWiresX::txExpired()
+{
+	unsigned char buffer[200U];
 
-	if (m_txWatch.elapsed() > 90U) {
-		if (!m_bufferTX.isEmpty() && m_bufferTX.dataSize() >= 155U) {
-			unsigned char len = 0U;
-			m_bufferTX.getData(&len, 1U);
-			if (len == 155U) {
-				m_bufferTX.getData(buffer, 155U);
-				m_network->write(buffer);
-			}
+	if (m_bufferTX.dataSize() >= 155U) {
+		unsigned char len = 0U;
+		m_bufferTX.getData(&len, 1U);
+		if (len == 155U) {
+			m_bufferTX.getData(buffer, 155U);
+			m_network->write(buffer);
 		}
-		m_txWatch.start();
 	}
+
+	m_txWatch.start();
+
+	if (!m_bufferTX.isEmpty())
+		m_txTimer.start(0U, WIRESX_TX_INTERVAL);
 }
 
 void CWiresX::createReply(const unsigned char* data, unsigned int length)
@@ -576,6 +584,12 @@ void CWiresX::writeData(const unsigned char* buffer)
 	unsigned char len = 155U;
 	m_bufferTX.addData(&len, 1U);
 	m_bufferTX.addData(buffer, len);
+
+	// Keep the replies at least WIRESX_TX_INTERVAL apart
+	if (!m_txTimer.isRunning()) {
+		unsigned int elapsed = m_txWatch.elapsed();
+		m_txTimer.start(0U, elapsed >= WIRESX_TX_INTERVAL ? 1U : WIRESX_TX_INTERVAL - elapsed);
+	}
 }
 
 unsigned char CWiresX::calculateFT(unsigned int length, unsigned int offset) const
@@ -24,7 +24,7 @@
 #include "YSFNetwork.h"
 #include "DMRNetwork.h"
 #include "Thread.h"
-#include "Timer.h"
+#include "TimerWheel.h"
 #include "StopWatch.h"
 #include "RingBuffer.h"
 
@@ -68,7 +68,7 @@ public:
 
 class CWiresX {
 public:
-	CWiresX(const std::string& callsign, const std::string& suffix, CYSFNetwork* network, std::string tgfile, bool makeUpper);
+	CWiresX(CTimerWheel& wheel, const std::string& callsign, const std::string& suffix, CYSFNetwork* network, std::string tgfile, bool makeUpper);
 	~CWiresX();
 
 	bool start();
@@ -87,7 +87,6 @@ public:
 	void setInfo(const std::string& name, unsigned int txFrequency, unsigned int rxFrequency, int reflector);
 	void sendConnectReply(unsigned int reflector);
 	void sendDisconnectReply();
-	void clock(unsigned int ms);
 
 private:
 	std::string          m_callsign;
@@ -100,7 +99,7 @@ private:
 	unsigned int         m_fulldstID;
 	CYSFNetwork*         m_network;
 	unsigned char*       m_command;
-	CTimer               m_timer;
+	CWheelTimer          m_timer;
 	unsigned char        m_seqNo;
 	unsigned char*       m_header;
 	unsigned char*       m_csd1;
@@ -114,6 +113,7 @@ private:
 	std::vector<CTGReg*> m_category;
 	bool                 m_makeUpper;
 	CStopWatch           m_txWatch;
+	CWheelTimer          m_txTimer;
 	CRingBuffer<unsigned char> m_bufferTX;
 
 	WX_STATUS processConnect(const unsigned char* source, const unsigned char* data);
@@ -127,6 +127,9 @@ private:
 	void sendSearchNotFoundReply();
 	void sendCategoryReply();
 
+	void replyExpired();
+	void txExpired();
+
 	void createReply(const unsigned char* data, unsigned int length);
 	void writeData(const unsigned char* data);
 	unsigned char calculateFT(unsigned int length, unsigned int offset) const;
@@ -0,0 +1,406 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "Worker.h"
+#include "StopWatch.h"
+#include "Log.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Smallest difference in load, in per mille of a core, worth moving a session for
+const unsigned int STEAL_MARGIN = 20U;
+
+CWorker::CWorker(unsigned int id, unsigned int budgetMS, unsigned int balanceMS) :
+CThread(),
+m_id(id),
+m_name(),
+m_balance(balanceMS),
+m_peers(),
+m_priority(0U),
+m_cpu(-1),
+m_loop(),
+m_timer(-1),
+m_wakeFd(-1),
+m_started(false),
+m_sessions(),
+m_mutex(),
+m_inbox(),
+m_thief(NULL),
+m_woken(false),
+m_stop(false),
+m_pause(false),
+m_paused(false),
+m_idle(true),
+m_budget(budgetMS),
+m_load(0U),
+m_count(0U),
+m_passStart(0ULL),
+m_busy(0ULL),
+m_balanceTime(0ULL),
+m_taken(0U),
+m_given(0U)
+{
+	char name[20U];
+	::sprintf(name, "Worker %u", id);
+	m_name = name;
+
+#if defined(__linux__)
+	m_wakeFd = ::eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_wakeFd < 0)
+		LogError("%s, cannot create an eventfd, err: %d", m_name.c_str(), errno);
+#endif
+}
+
+CWorker::~CWorker()
+{
+#if defined(__linux__)
+	if (m_wakeFd >= 0)
+		::close(m_wakeFd);
+#endif
+}
+
+void CWorker::setPeers(const std::vector<CWorker*>& peers)
+{
+	m_peers = peers;
+}
+
+void CWorker::setScheduling(unsigned int priority, int cpu)
+{
+	m_priority = priority;
+	m_cpu      = cpu;
+}
+
+void CWorker::setBudget(unsigned int budgetMS)
+{
+	m_budget = budgetMS;
+}
+
+bool CWorker::start()
+{
+	if (!m_loop.open())
+		return false;
+
+	m_timer = m_loop.addTimer();
+	m_loop.watch(m_wakeFd);
+
+	m_started = run();
+
+	return m_started;
+}
+
+void CWorker::add(CYSF2DMR* session, unsigned int load)
+{
+	assert(session != NULL);
+
+	m_mutex.lock();
+	m_inbox.push_back(CWorkerSession(session, load));
+	m_mutex.unlock();
+
+	m_count++;
+	m_load += load;
+
+	wake();
+}
+
+bool CWorker::isIdle() const
+{
+	return m_idle;
+}
+
+bool CWorker::isStalled() const
+{
+	unsigned long long start = m_passStart;
+	if (start == 0ULL || m_budget == 0U)
+		return false;
+
+	return CStopWatch::monotonic() - start > m_budget * 1000ULL;
+}
+
+unsigned int CWorker::getLoad() const
+{
+	return m_load;
+}
+
+unsigned int CWorker::getCount() const
+{
+	return m_count;
+}
+
+void CWorker::pause()
+{
+	m_pause = true;
+
+	wake();
+
+	while (m_started && !m_paused)
+		CThread::sleep(1U);
+}
+
+void CWorker::resume()
+{
+	m_pause = false;
+}
+
+void CWorker::stop()
+{
+	m_stop = true;
+
+	wake();
+
+	if (m_started)
+		wait();
+
+	m_started = false;
+
+	m_loop.close();
+}
+
+void CWorker::entry()
+{
+	CThread::setAffinity(m_cpu);
+
+	if (m_priority > 0U)
+		CThread::setPriority(m_priority);
+
+	LogMessage("Started %s", m_name.c_str());
+
+	CStallDetector stall(m_budget, m_name);
+
+	// The sessions dealt out at the start do not count as taken
+	adopt();
+
+	m_balanceTime = CStopWatch::monotonic();
+
+	while (!m_stop) {
+		adopt();
+
+		unsigned long long deadline = m_balanceTime + m_balance * 1000ULL;
+		for (std::vector<CWorkerSession>::iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+			it->m_session->watch(m_loop);
+
+			if (it->m_deadline < deadline)
+				deadline = it->m_deadline;
+		}
+
+		m_loop.setTimer(m_timer, deadline);
+
+		m_loop.wait();
+
+#if defined(__linux__)
+		// A wake up that has not been written yet is cleared on the next pass
+		if (m_woken.exchange(false)) {
+			uint64_t value;
+			if (::read(m_wakeFd, &value, sizeof(uint64_t)) < 0) {
+				if (errno != EAGAIN)
+					LogError("%s, error reading the eventfd, err: %d", m_name.c_str(), errno);
+				m_woken = true;
+			}
+		}
+#endif
+
+		if (m_stop)
+			break;
+
+		unsigned long long start = CStopWatch::monotonic();
+		m_passStart = start;
+
+		stall.setBudget(m_budget);
+		stall.begin();
+
+		// The sessions with nothing waiting and no deadline due are left alone
+		unsigned long long now = start;
+		bool idle = true;
+		for (std::vector<CWorkerSession>::iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+			CYSF2DMR* session = it->m_session;
+
+			if (it->m_deadline <= now || session->hasData()) {
+				::LogSetContext(session->getName().empty() ? NULL : session->getName().c_str());
+
+				session->clock(stall);
+				it->m_deadline = session->getDeadline();
+
+				unsigned long long end = CStopWatch::monotonic();
+				it->m_busy += end - now;
+				now = end;
+			}
+
+			if (!session->isIdle())
+				idle = false;
+		}
+
+		::LogSetContext(NULL);
+
+		m_idle = idle;
+
+		stall.stage("balance");
+		if (m_thief != NULL)
+			give();
+
+		if (now >= m_balanceTime + m_balance * 1000ULL)
+			balance(now);
+
+		stall.end();
+
+		m_busy += CStopWatch::monotonic() - start;
+		m_passStart = 0ULL;
+
+		if (m_pause)
+			park();
+	}
+
+	stall.logStats();
+
+	LogMessage("%s, %u sessions, %u taken from other workers, %u given away", m_name.c_str(), (unsigned int)m_sessions.size(), m_taken, m_given);
+	LogMessage("Stopped %s", m_name.c_str());
+}
+
+void CWorker::adopt()
+{
+	std::vector<CWorkerSession> inbox;
+
+	m_mutex.lock();
+	inbox.swap(m_inbox);
+	m_mutex.unlock();
+
+	// Clock them straight away, to pick up anything that came in on the way
+	for (std::vector<CWorkerSession>::iterator it = inbox.begin(); it != inbox.end(); ++it) {
+		it->m_deadline = 0ULL;
+		it->m_busy     = 0ULL;
+		m_sessions.push_back(*it);
+
+		if (m_balanceTime != 0ULL)
+			m_taken++;
+	}
+}
+
+void CWorker::give()
+{
+	CWorker* thief = m_thief.exchange(NULL);
+	if (thief == NULL)
+		return;
+
+	unsigned int load   = m_load;
+	unsigned int theirs = thief->getLoad();
+	if (m_sessions.size() < 2U || load <= theirs)
+		return;
+
+	unsigned int half = (load - theirs) / 2U;
+
+	// A session in a call stays here until the call is over
+	std::vector<CWorkerSession>::iterator best = m_sessions.end();
+	for (std::vector<CWorkerSession>::iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+		if (it->m_load > half || !it->m_session->isIdle())
+			continue;
+
+		if (best == m_sessions.end() || it->m_load > best->m_load)
+			best = it;
+	}
+
+	if (best == m_sessions.end())
+		return;
+
+	CYSF2DMR* session = best->m_session;
+	unsigned int sessionLoad = best->m_load;
+
+	session->unwatch(m_loop);
+	m_sessions.erase(best);
+
+	m_count--;
+	m_load -= sessionLoad;
+	m_given++;
+
+	thief->add(session, sessionLoad);
+}
+
+void CWorker::balance(unsigned long long now)
+{
+	unsigned long long elapsed = now - m_balanceTime;
+	m_balanceTime = now;
+
+	if (elapsed == 0ULL)
+		return;
+
+	for (std::vector<CWorkerSession>::iterator it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+		it->m_load = (unsigned int)(it->m_busy * 1000ULL / elapsed);
+		it->m_busy = 0ULL;
+	}
+
+	unsigned int load = (unsigned int)(m_busy * 1000ULL / elapsed);
+	m_busy = 0ULL;
+	m_load = load;
+
+	// Only the busiest worker is asked, and only if it has a session to spare
+	CWorker* victim = NULL;
+	unsigned int busiest = 0U;
+	for (std::vector<CWorker*>::const_iterator it = m_peers.begin(); it != m_peers.end(); ++it) {
+		if (*it == this || (*it)->getCount() < 2U)
+			continue;
+
+		unsigned int theirs = (*it)->getLoad();
+		if (theirs > busiest) {
+			busiest = theirs;
+			victim  = *it;
+		}
+	}
+
+	if (victim == NULL || busiest <= load)
+		return;
+
+	unsigned int gap = busiest - load;
+	if (gap < STEAL_MARGIN || gap < busiest / 4U)
+		return;
+
+	CWorker* expected = NULL;
+	if (victim->m_thief.compare_exchange_strong(expected, this))
+		victim->wake();
+}
+
+void CWorker::park()
+{
+	m_paused = true;
+
+	while (m_pause && !m_stop)
+		CThread::sleep(1U);
+
+	m_paused = false;
+
+	// The sessions may have been reloaded in the meantime
+	for (std::vector<CWorkerSession>::iterator it = m_sessions.begin(); it != m_sessions.end(); ++it)
+		it->m_deadline = 0ULL;
+}
+
+void CWorker::wake()
+{
+#if defined(__linux__)
+	// Only the first wake up since the worker last looked needs the system call
+	if (m_woken.exchange(true))
+		return;
+
+	uint64_t value = 1U;
+	if (::write(m_wakeFd, &value, sizeof(uint64_t)) < 0)
+		LogError("%s, error writing the eventfd, err: %d", m_name.c_str(), errno);
+#endif
+}
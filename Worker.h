@@ -0,0 +1,130 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(WORKER_H)
+#define	WORKER_H
+
+#include "StallDetector.h"
+#include "EventLoop.h"
+#include "YSF2DMR.h"
+#include "Thread.h"
+#include "Mutex.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// A session as its worker sees it
+class CWorkerSession {
+public:
+	CWorkerSession(CYSF2DMR* session = NULL, unsigned int load = 0U) :
+	m_session(session),
+	m_deadline(0ULL),
+	m_busy(0ULL),
+	m_load(load)
+	{
+	}
+
+	CYSF2DMR*          m_session;
+	unsigned long long m_deadline;
+	unsigned long long m_busy;		// Time in clock() since the last balance, in us
+	unsigned int       m_load;		// Per mille of a core over the last balance interval
+};
+
+// Runs a share of the sessions on a thread of its own, with its own event
+// loop, and only clocks the sessions that have datagrams waiting or a
+// deadline due. Every balance interval a worker compares its load with the
+// others and, when it has a lot less to do than the busiest, asks it for a
+// session. The busy worker gives one away at the end of a pass, and only one
+// that is between calls, so that a stream never changes threads. It picks
+// the one that comes closest to halving the difference between them.
+class CWorker : public CThread {
+public:
+	CWorker(unsigned int id, unsigned int budgetMS, unsigned int balanceMS);
+	virtual ~CWorker();
+
+	// All the workers, this one included, call before start()
+	void setPeers(const std::vector<CWorker*>& peers);
+
+	// A priority of 0 and a CPU of -1 leave the default scheduling
+	void setScheduling(unsigned int priority, int cpu);
+
+	void setBudget(unsigned int budgetMS);
+
+	bool start();
+
+	// Hands a session to this worker, from any thread
+	void add(CYSF2DMR* session, unsigned int load = 0U);
+
+	// No call in progress on any of its sessions as of its last pass
+	bool isIdle() const;
+
+	// Inside one pass for longer than the budget
+	bool isStalled() const;
+
+	// Per mille of a core over the last balance interval
+	unsigned int getLoad() const;
+
+	unsigned int getCount() const;
+
+	// Parks the worker between passes so that the caller can use its
+	// sessions, returns once it is parked
+	void pause();
+	void resume();
+
+	void stop();
+
+	virtual void entry();
+
+private:
+	unsigned int                m_id;
+	std::string                 m_name;
+	unsigned int                m_balance;
+	std::vector<CWorker*>       m_peers;
+	unsigned int                m_priority;
+	int                         m_cpu;
+	CEventLoop                  m_loop;
+	int                         m_timer;
+	int                         m_wakeFd;
+	bool                        m_started;
+	std::vector<CWorkerSession> m_sessions;
+	CMutex                      m_mutex;
+	std::vector<CWorkerSession> m_inbox;		// Under m_mutex
+	std::atomic<CWorker*>       m_thief;
+	std::atomic<bool>           m_woken;
+	std::atomic<bool>           m_stop;
+	std::atomic<bool>           m_pause;
+	std::atomic<bool>           m_paused;
+	std::atomic<bool>           m_idle;
+	std::atomic<unsigned int>   m_budget;
+	std::atomic<unsigned int>   m_load;
+	std::atomic<unsigned int>   m_count;
+	std::atomic<unsigned long long> m_passStart;
+	unsigned long long          m_busy;
+	unsigned long long          m_balanceTime;
+	unsigned int                m_taken;
+	unsigned int                m_given;
+
+	void adopt();
+	void give();
+	void balance(unsigned long long now);
+	void park();
+	void wake();
+};
+
+#endif
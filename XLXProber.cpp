@@ -0,0 +1,231 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "XLXProber.h"
+#include "StopWatch.h"
+#include "Log.h"
+
+#include <cassert>
+#include <cstring>
+
+// Time between rounds of probes, in ms
+const unsigned int XLX_PROBE_TIME = 5000U;
+
+// How long the answers to a round are waited for, in ms
+const unsigned int XLX_PROBE_WAIT = 1000U;
+
+// Rounds without an answer before a reflector is no longer healthy
+const unsigned int XLX_PROBE_MISSES = 3U;
+
+CXLXProber::CXLXProber(unsigned int id, unsigned int port) :
+CThread(),
+m_port(port),
+m_socket(),
+m_candidates(),
+m_mutex(),
+m_round(0U),
+m_active(0U),
+m_stop(false),
+m_running(false)
+{
+	assert(port > 0U);
+
+	::memcpy(m_probe + 0U, "RPTL", 4U);
+	m_probe[4U] = id >> 24;
+	m_probe[5U] = id >> 16;
+	m_probe[6U] = id >> 8;
+	m_probe[7U] = id >> 0;
+}
+
+CXLXProber::~CXLXProber()
+{
+}
+
+void CXLXProber::add(const CReflector& reflector)
+{
+	CXLXCandidate candidate;
+	candidate.m_reflector      = reflector;
+	candidate.m_address.s_addr = INADDR_NONE;
+	candidate.m_rtt            = 0U;
+	candidate.m_missed         = XLX_PROBE_MISSES;
+	candidate.m_sent           = 0ULL;
+
+	m_candidates.push_back(candidate);
+}
+
+bool CXLXProber::start()
+{
+	if (!m_socket.open())
+		return false;
+
+	m_running = run();
+
+	return m_running;
+}
+
+void CXLXProber::stop()
+{
+	if (m_running) {
+		m_stop = true;
+		wait();
+		m_running = false;
+	}
+
+	m_socket.close();
+}
+
+void CXLXProber::entry()
+{
+	LogInfo("Started the XLX probe thread");
+
+	// Resolved here, a host name may take a while
+	for (std::vector<CXLXCandidate>::iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+		in_addr address = CUDPSocket::lookup(it->m_reflector.m_address);
+
+		m_mutex.lock();
+		it->m_address = address;
+		m_mutex.unlock();
+	}
+
+	while (!m_stop) {
+		probe();
+
+		for (unsigned int ms = XLX_PROBE_WAIT; ms < XLX_PROBE_TIME && !m_stop; ms += 100U)
+			sleep(100U);
+	}
+
+	LogInfo("Stopped the XLX probe thread");
+}
+
+void CXLXProber::probe()
+{
+	unsigned long long start = CStopWatch::monotonic();
+
+	m_mutex.lock();
+
+	for (std::vector<CXLXCandidate>::iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+		if (it->m_address.s_addr == INADDR_NONE || it->m_reflector.m_id == m_active)
+			continue;
+
+		it->m_sent = CStopWatch::monotonic();
+		m_socket.write(m_probe, 8U, it->m_address, m_port);
+	}
+
+	m_mutex.unlock();
+
+	// The reflectors answer with an RPTACK, or an MSTNAK if they refuse the
+	// login, either will do. Nothing is set up for a login until the
+	// password is sent, so it is not closed again
+	for (;;) {
+		unsigned long long elapsed = (CStopWatch::monotonic() - start) / 1000ULL;
+		if (m_stop || elapsed >= XLX_PROBE_WAIT)
+			break;
+
+		// At most 100ms at a time so that stop() is not held up
+		unsigned int ms = XLX_PROBE_WAIT - (unsigned int)elapsed;
+		if (!m_socket.wait(ms < 100U ? ms : 100U))
+			continue;
+
+		unsigned char buffer[100U];
+		in_addr address;
+		unsigned int port;
+		int len = m_socket.read(buffer, 100U, address, port);
+		if (len <= 0)
+			continue;
+
+		unsigned long long now = CStopWatch::monotonic();
+
+		m_mutex.lock();
+
+		for (std::vector<CXLXCandidate>::iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+			if (it->m_address.s_addr != address.s_addr || port != m_port || it->m_sent == 0ULL)
+				continue;
+
+			unsigned int rtt = (unsigned int)(now - it->m_sent);
+			it->m_rtt    = it->m_rtt == 0U ? rtt : (7U * it->m_rtt + rtt) / 8U;
+			it->m_missed = 0U;
+			it->m_sent   = 0ULL;
+		}
+
+		m_mutex.unlock();
+	}
+
+	m_mutex.lock();
+
+	for (std::vector<CXLXCandidate>::iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+		if (it->m_sent != 0ULL) {
+			if (it->m_missed < XLX_PROBE_MISSES)
+				it->m_missed++;
+			it->m_sent = 0ULL;
+		}
+	}
+
+	m_round++;
+
+	m_mutex.unlock();
+}
+
+bool CXLXProber::getBest(CReflector& reflector, unsigned int& rtt)
+{
+	m_mutex.lock();
+
+	const CXLXCandidate* best = NULL;
+	for (std::vector<CXLXCandidate>::const_iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+		if (it->m_missed >= XLX_PROBE_MISSES || it->m_rtt == 0U)
+			continue;
+
+		if (best == NULL || it->m_rtt < best->m_rtt)
+			best = &(*it);
+	}
+
+	if (best != NULL) {
+		reflector = best->m_reflector;
+		rtt       = best->m_rtt;
+	}
+
+	m_mutex.unlock();
+
+	return best != NULL;
+}
+
+void CXLXProber::setActive(unsigned int id, unsigned int rtt)
+{
+	m_mutex.lock();
+
+	m_active = id;
+
+	// Not logged in is as good as not answering
+	for (std::vector<CXLXCandidate>::iterator it = m_candidates.begin(); it != m_candidates.end(); ++it) {
+		if (it->m_reflector.m_id == id) {
+			it->m_rtt    = rtt > 0U ? rtt : it->m_rtt;
+			it->m_missed = rtt > 0U ? 0U : XLX_PROBE_MISSES;
+			it->m_sent   = 0ULL;
+		}
+	}
+
+	m_mutex.unlock();
+}
+
+unsigned int CXLXProber::getRound()
+{
+	m_mutex.lock();
+	unsigned int round = m_round;
+	m_mutex.unlock();
+
+	return round;
+}
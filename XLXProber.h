@@ -0,0 +1,83 @@
+/*
+ *   Copyright (C) 2019 by Andy Uribe CA6JAU
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#if !defined(XLXPROBER_H)
+#define	XLXPROBER_H
+
+#include "Reflectors.h"
+#include "UDPSocket.h"
+#include "Thread.h"
+#include "Mutex.h"
+
+#include <vector>
+#include <string>
+
+// How a reflector that carries the module has been answering the probes
+class CXLXCandidate {
+public:
+	CReflector         m_reflector;
+	in_addr            m_address;
+	unsigned int       m_rtt;			// Smoothed, in us, 0 until it answers
+	unsigned int       m_missed;		// Rounds in a row without an answer
+	unsigned long long m_sent;			// Of the probe not yet answered
+};
+
+// Probes XLX reflectors mirroring the same module from a thread of its
+// own, with a login request that any of them answers straight away, and
+// keeps a table of how quickly each answers. The reflector the gateway is
+// logged into is not probed, a login request would upset its login, its
+// time comes from the pings of the session instead. The sessions only
+// ever read the table.
+class CXLXProber : public CThread {
+public:
+	CXLXProber(unsigned int id, unsigned int port);
+	virtual ~CXLXProber();
+
+	// Call before start()
+	void add(const CReflector& reflector);
+
+	bool start();
+	void stop();
+
+	virtual void entry();
+
+	// The healthy reflector with the lowest round trip time, false until one has answered
+	bool getBest(CReflector& reflector, unsigned int& rtt);
+
+	// The reflector in use and the round trip time of its pings in us, 0
+	// while it is not answering
+	void setActive(unsigned int id, unsigned int rtt);
+
+	// Goes up by one after each round of probes
+	unsigned int getRound();
+
+private:
+	unsigned char              m_probe[8U];
+	unsigned int               m_port;
+	CUDPSocket                 m_socket;
+	std::vector<CXLXCandidate> m_candidates;
+	CMutex                     m_mutex;
+	unsigned int               m_round;
+	unsigned int               m_active;
+	bool                       m_stop;
+	bool                       m_running;
+
+	void probe();
+};
+
+#endif
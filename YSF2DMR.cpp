@@ -19,6 +19,8 @@
 */
 
 #include "YSF2DMR.h"
+#include "ConvertThread.h"
+#include "Gateway.h"
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <Windows.h>
@@ -27,15 +29,29 @@
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
-#include <pwd.h>
 #endif
 
 // DT1 and DT2, suggested by Manuel EA7EE
 const unsigned char dt1_temp[] = {0x31, 0x22, 0x62, 0x5F, 0x29, 0x00, 0x00, 0x00, 0x00, 0x00};
 const unsigned char dt2_temp[] = {0x00, 0x00, 0x00, 0x00, 0x6C, 0x20, 0x1C, 0x20, 0x03, 0x08};
 
-#define DMR_FRAME_PER       55U
-#define YSF_FRAME_PER       90U
+// Three AMBE frames of 20 ms to a DMR frame and five to a YSF frame. The
+// loop used to sleep 5 ms at a time and aimed 5 and 10 ms short to make up
+// for it, the frames now go out on deadlines at the real periods
+#define DMR_FRAME_PER       60U
+#define YSF_FRAME_PER       100U
+
+// Frames that may be sent back to back after a stall before the pacing restarts
+#define MAX_CATCH_UP        5U
+
+// How often a Wires-X TG change is moved on while it is in progress, in ms
+#define TG_POLL             10U
+
+// How soon the ingress tries again after a full queue held it back, in ms
+#define HELD_BACK_POLL      1U
+
+// Most voice queue entries one datagram gives, a run of lost frames and the EOT
+#define DECODE_VOICE_MAX    2U
 
 #define XLX_SLOT            2U
 #define XLX_COLOR_CODE      3U
@@ -46,20 +62,18 @@ const char* DEFAULT_INI_FILE = "YSF2DMR.ini";
 const char* DEFAULT_INI_FILE = "/etc/YSF2DMR.ini";
 #endif
 
-const char* HEADER1 = "This software is for use on amateur radio networks only,";
-const char* HEADER2 = "it is to be used for educational purposes only. Its use on";
-const char* HEADER3 = "commercial networks is strictly prohibited.";
-const char* HEADER4 = "Copyright(C) 2018,2019 by CA6JAU, EA7EE, G4KLX, AD8DP and others";
-
 #include <functional>
 #include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cassert>
 #include <clocale>
 #include <cctype>
 
 int end = 0;
+int reload = 0;
+int upgrade = 0;
 
 #if !defined(_WIN32) && !defined(_WIN64)
 void sig_handler(int signo)
@@ -67,6 +81,12 @@ void sig_handler(int signo)
 	if (signo == SIGTERM) {
 		end = 1;
 		::fprintf(stdout, "Received SIGTERM\n");
+	} else if (signo == SIGHUP) {
+		reload = 1;
+		::fprintf(stdout, "Received SIGHUP\n");
+	} else if (signo == SIGUSR2) {
+		upgrade = 1;
+		::fprintf(stdout, "Received SIGUSR2\n");
 	}
 }
 #endif
@@ -74,14 +94,20 @@ void sig_handler(int signo)
 int main(int argc, char** argv)
 {
 	const char* iniFile = DEFAULT_INI_FILE;
+	std::string scenario;
+	std::string output;
 	if (argc > 1) {
 		for (int currentArg = 1; currentArg < argc; ++currentArg) {
 			std::string arg = argv[currentArg];
 			if ((arg == "-v") || (arg == "--version")) {
 				::fprintf(stdout, "YSF2DMR version %s\n", VERSION);
 				return 0;
+			} else if (((arg == "-s") || (arg == "--simulate")) && (currentArg + 1) < argc) {
+				scenario = argv[++currentArg];
+			} else if (((arg == "-o") || (arg == "--output")) && (currentArg + 1) < argc) {
+				output = argv[++currentArg];
 			} else if (arg.substr(0, 1) == "-") {
-				::fprintf(stderr, "Usage: YSF2DMR [-v|--version] [filename]\n");
+				::fprintf(stderr, "Usage: YSF2DMR [-v|--version] [-s|--simulate scenario [-o|--output file]] [filename]\n");
 				return 1;
 			} else {
 				iniFile = argv[currentArg];
@@ -93,26 +119,75 @@ int main(int argc, char** argv)
 	// Capture SIGTERM to finish gracelessly
 	if (signal(SIGTERM, sig_handler) == SIG_ERR) 
 		::fprintf(stdout, "Can't catch SIGTERM\n");
+
+	// Capture SIGHUP to reload the .ini file between calls
+	if (signal(SIGHUP, sig_handler) == SIG_ERR)
+		::fprintf(stdout, "Can't catch SIGHUP\n");
+
+	// Capture SIGUSR2 to hand over to a new binary between calls
+	if (signal(SIGUSR2, sig_handler) == SIG_ERR)
+		::fprintf(stdout, "Can't catch SIGUSR2\n");
 #endif
 
-	CYSF2DMR* gateway = new CYSF2DMR(std::string(iniFile));
+	// Started by an older process handing over its sockets
+	CUpgrade* upgrade = NULL;
+	if (CUpgrade::isRequested()) {
+		upgrade = new CUpgrade;
+		if (!upgrade->receive()) {
+			delete upgrade;
+			return 1;
+		}
+	}
+
+	// The virtual clock has to be in place before anything reads the time
+	CSimulation* simulation = NULL;
+	if (!scenario.empty()) {
+		simulation = new CSimulation(scenario, output);
+		if (!simulation->open()) {
+			delete simulation;
+			return 1;
+		}
+
+		CClock::set(&simulation->getClock());
+	}
+
+	CGateway* gateway = new CGateway(std::string(iniFile));
+	gateway->setSimulation(simulation);
+	gateway->setArguments(argv);
+	gateway->setUpgrade(upgrade);
 
 	int ret = gateway->run();
 
 	delete gateway;
 
+	if (simulation != NULL) {
+		CClock::set(NULL);
+		delete simulation;
+	}
+
 	return ret;
 }
 
-CYSF2DMR::CYSF2DMR(const std::string& configFile) :
+CYSF2DMR::CYSF2DMR(const CConf& conf) :
+m_name(conf.getSessionName()),
 m_callsign(),
 m_suffix(),
-m_conf(configFile),
+m_conf(conf),
+m_wheel(),
+m_simulation(NULL),
+m_upgrade(NULL),
 m_wiresX(NULL),
 m_dmrNetwork(NULL),
+m_dmrTargets(),
 m_ysfNetwork(NULL),
+m_dmrFd(-1),
+m_ysfFd(-1),
+m_slot(conf.getDMRNetworkSlot()),
+m_owner(NULL),
+m_partner(NULL),
 m_lookup(NULL),
 m_conv(),
+m_converter(NULL),
 m_colorcode(1U),
 m_srcHS(1U),
 m_srcid(1U),
@@ -132,7 +207,7 @@ m_dtmf(NULL),
 m_APRS(NULL),
 m_dmrFrames(0U),
 m_ysfFrames(0U),
-m_EmbeddedLC(),
+m_dmrAssembler(),
 m_TGList(),
 m_dmrflco(FLCO_GROUP),
 m_dmrinfo(false),
@@ -143,15 +218,46 @@ m_xlxmodule(),
 m_xlxConnected(false),
 m_xlxReflectors(NULL),
 m_xlxrefl(0U),
+m_xlxProber(NULL),
+m_xlxRound(0U),
+m_xlxStartup(false),
 m_remoteGateway(false),
 m_hangTime(1000U),
-m_firstSync(false)
+m_firstSync(false),
+m_dropUnknown(false),
+m_enableUnlink(false),
+m_unlinkReceived(false),
+m_tgConnectState(NONE),
+m_TGChange(),
+m_networkWatchdog(m_wheel, [this] { networkWatchdogExpired(); }, 0U, 1500U),
+m_ysfWatchdog(m_wheel, [this] { ysfWatchdogExpired(); }, 0U, 500U),
+m_pollTimer(m_wheel, [this] { pollExpired(); }, 5U),
+m_ysfCnt(0U),
+m_dmrPacer("DMR pacer", DMR_FRAME_PER, MAX_CATCH_UP),
+m_ysfPacer("YSF pacer", YSF_FRAME_PER, MAX_CATCH_UP),
+m_ysfRxQueue(64U, "YSF ingress"),
+m_ysfVoiceQueue(128U, "YSF voice"),
+m_dmrTxQueue(64U, "DMR egress"),
+m_dmrRxQueue(64U, "DMR ingress"),
+m_dmrVoiceQueue(128U, "DMR voice"),
+m_ysfTxQueue(16U, "YSF egress"),
+m_ysfIngressStage("YSF ingress"),
+m_ysfDecodeStage("YSF decode"),
+m_ysfConvertStage("YSF to DMR conversion"),
+m_dmrAssembleStage("DMR assembly"),
+m_dmrEgressStage("DMR egress"),
+m_dmrIngressStage("DMR ingress"),
+m_dmrDecodeStage("DMR decode"),
+m_dmrConvertStage("DMR to YSF conversion"),
+m_ysfAssembleStage("YSF assembly"),
+m_ysfEgressStage("YSF egress")
 {
 	m_ysfFrame = new unsigned char[200U];
 	m_dmrFrame = new unsigned char[50U];
 
 	::memset(m_ysfFrame, 0U, 200U);
 	::memset(m_dmrFrame, 0U, 50U);
+	::memset(m_gpsBuffer, 0U, 20U);
 }
 
 CYSF2DMR::~CYSF2DMR()
@@ -160,95 +266,60 @@ CYSF2DMR::~CYSF2DMR()
 	delete[] m_dmrFrame;
 }
 
-int CYSF2DMR::run()
+void CYSF2DMR::setSimulation(CSimulation* simulation)
 {
-	bool ret = m_conf.read();
-	if (!ret) {
-		::fprintf(stderr, "YSF2DMR: cannot read the .ini file\n");
-		return 1;
-	}
-
-	setlocale(LC_ALL, "C");
-
-	unsigned int logDisplayLevel = m_conf.getLogDisplayLevel();
+	m_simulation = simulation;
+}
 
-#if !defined(_WIN32) && !defined(_WIN64)
-	if(m_conf.getDaemon())
-		logDisplayLevel = 0U;
-#endif
+void CYSF2DMR::setConverter(CConvertThread* converter)
+{
+	m_converter = converter;
+}
 
-#if !defined(_WIN32) && !defined(_WIN64)
-	bool m_daemon = m_conf.getDaemon();
-	if (m_daemon) {
-		// Create new process
-		pid_t pid = ::fork();
-		if (pid == -1) {
-			::fprintf(stderr, "Couldn't fork() , exiting\n");
-			return -1;
-		} else if (pid != 0)
-			exit(EXIT_SUCCESS);
-
-		// Create new session and process group
-		if (::setsid() == -1) {
-			::fprintf(stderr, "Couldn't setsid(), exiting\n");
-			return -1;
-		}
+void CYSF2DMR::setLookup(CDMRLookup* lookup)
+{
+	m_lookup = lookup;
+}
 
-		// Set the working directory to the root directory
-		if (::chdir("/") == -1) {
-			::fprintf(stderr, "Couldn't cd /, exiting\n");
-			return -1;
-		}
+void CYSF2DMR::setReflectors(CReflectors* reflectors)
+{
+	m_xlxReflectors = reflectors;
+}
 
-		// If we are currently root...
-		if (getuid() == 0) {
-			struct passwd* user = ::getpwnam("mmdvm");
-			if (user == NULL) {
-				::fprintf(stderr, "Could not get the mmdvm user, exiting\n");
-				return -1;
-			}
+void CYSF2DMR::setAPRS(CAPRSReader* aprs)
+{
+	m_APRS = aprs;
+}
 
-			uid_t mmdvm_uid = user->pw_uid;
-			gid_t mmdvm_gid = user->pw_gid;
+void CYSF2DMR::setPartner(CYSF2DMR* partner)
+{
+	assert(partner != NULL);
 
-			// Set user and group ID's to mmdvm:mmdvm
-			if (setgid(mmdvm_gid) != 0) {
-				::fprintf(stderr, "Could not set mmdvm GID, exiting\n");
-				return -1;
-			}
+	m_partner = partner;
+	partner->m_owner = this;
+}
 
-			if (setuid(mmdvm_uid) != 0) {
-				::fprintf(stderr, "Could not set mmdvm UID, exiting\n");
-				return -1;
-			}
+CYSF2DMR* CYSF2DMR::getOwner() const
+{
+	return m_owner;
+}
 
-			// Double check it worked (AKA Paranoia) 
-			if (setuid(0) != -1) {
-				::fprintf(stderr, "It's possible to regain root - something is wrong!, exiting\n");
-				return -1;
-			}
-		}
-	}
-#endif
+const std::string& CYSF2DMR::getName() const
+{
+	return m_name;
+}
 
-	ret = ::LogInitialise(m_conf.getLogFilePath(), m_conf.getLogFileRoot(), m_conf.getLogFileLevel(), logDisplayLevel);
-	if (!ret) {
-		::fprintf(stderr, "YSF2DMR: unable to open the log file\n");
-		return 1;
-	}
+CReflectors* CYSF2DMR::getReflectors() const
+{
+	return m_xlxReflectors;
+}
 
-#if !defined(_WIN32) && !defined(_WIN64)
-	if (m_daemon) {
-		::close(STDIN_FILENO);
-		::close(STDOUT_FILENO);
-		::close(STDERR_FILENO);
-	}
-#endif
+bool CYSF2DMR::open(CUpgrade* upgrade)
+{
+	assert(m_lookup != NULL);
+	assert(m_xlxReflectors != NULL);
 
-	LogInfo(HEADER1);
-	LogInfo(HEADER2);
-	LogInfo(HEADER3);
-	LogInfo(HEADER4);
+	m_upgrade = upgrade;
 
 	m_callsign = m_conf.getCallsign();
 	m_suffix   = m_conf.getSuffix();
@@ -256,42 +327,29 @@ int CYSF2DMR::run()
 	m_remoteGateway = m_conf.getRemoteGateway();
 	m_hangTime = m_conf.getHangTime();
 
-	bool debug               = m_conf.getDMRNetworkDebug();
-	in_addr dstAddress       = CUDPSocket::lookup(m_conf.getDstAddress());
-	unsigned int dstPort     = m_conf.getDstPort();
-	std::string localAddress = m_conf.getLocalAddress();
-	unsigned int localPort   = m_conf.getLocalPort();
-
-	std::string fileName    = m_conf.getDMRXLXFile();
-	m_xlxReflectors = new CReflectors(fileName, 60U);
-	m_xlxReflectors->load();
-
-	m_ysfNetwork = new CYSFNetwork(localAddress, localPort, m_callsign, debug);
-	m_ysfNetwork->setDestination(dstAddress, dstPort);
-
 	LogInfo("General Parameters");
 	LogInfo("    Remote Gateway: %s", m_remoteGateway ? "yes" : "no");
 	LogInfo("    Hang Time: %u ms", m_hangTime);
 
-	ret = m_ysfNetwork->open();
+	bool ret = createYSFNetwork();
 	if (!ret) {
 		::LogError("Cannot open the YSF network port");
-		::LogFinalise();
-		return 1;
+		m_upgrade = NULL;
+		return false;
 	}
 
+	createXLXProber();
+
 	ret = createDMRNetwork();
 	if (!ret) {
 		::LogError("Cannot open DMR Network");
-		::LogFinalise();
-		return 1;
+		deleteXLXProber();
+		m_upgrade = NULL;
+		return false;
 	}
-	
-	std::string lookupFile  = m_conf.getDMRIdLookupFile();
-	unsigned int reloadTime = m_conf.getDMRIdLookupTime();
 
-	m_lookup = new CDMRLookup(lookupFile, reloadTime);
-	m_lookup->read();
+	createDMRTargets();
+
 	m_dropUnknown = m_conf.getDMRDropUnknown();
 
 	if (m_dmrpc)
@@ -299,527 +357,612 @@ int CYSF2DMR::run()
 	else
 		m_dmrflco = FLCO_GROUP;
 
-	CTimer networkWatchdog(100U, 0U, 1500U);
-	CTimer pollTimer(1000U, 5U);
-	CTimer ysfWatchdog(1000U, 0U, 500U);
-
 	// CWiresX Control Object
-	if (m_enableWiresX) {
-		bool makeUpper = m_conf.getWiresXMakeUpper();
-		m_wiresX = new CWiresX(m_callsign, m_suffix, m_ysfNetwork, m_TGList, makeUpper);
-		m_dtmf = new CDTMF;
+	createWiresX();
+
+	createGPS();
+
+	m_pollTimer.start();
+	m_ysfWatchdog.stop();
+
+	m_enableUnlink = m_conf.getDMRNetworkEnableUnlink();
+
+	if (m_upgrade != NULL)
+		takeOver();
+
+	m_upgrade = NULL;
+
+	return true;
+}
+
+void CYSF2DMR::watch(CEventLoop& loop)
+{
+	// The fds only change when the networks are created again
+	if (m_ysfNetwork->getFd() != m_ysfFd) {
+		m_ysfFd = m_ysfNetwork->getFd();
+		loop.watch(m_ysfFd);
 	}
 
-	std::string name = m_conf.getDescription();
-	unsigned int rxFrequency = m_conf.getRxFrequency();
-	unsigned int txFrequency = m_conf.getTxFrequency();
-	int reflector = m_conf.getDMRDstId();
+	// A shared login is watched by its owner
+	if (m_owner == NULL && m_dmrNetwork->getFd() != m_dmrFd) {
+		m_dmrFd = m_dmrNetwork->getFd();
+		loop.watch(m_dmrFd);
+	}
 
-	if (m_wiresX != NULL)
-		m_wiresX->setInfo(name, txFrequency, rxFrequency, reflector);
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it)
+		(*it)->watch(loop);
 
-	if (m_conf.getAPRSEnabled()) {
-		createGPS();
-		m_APRS = new CAPRSReader(m_conf.getAPRSAPIKey(), m_conf.getAPRSRefresh());
+	if (m_partner != NULL)
+		m_partner->watch(loop);
+}
+
+void CYSF2DMR::unwatch(CEventLoop& loop)
+{
+	loop.unwatch(m_ysfFd);
+	if (m_owner == NULL)
+		loop.unwatch(m_dmrFd);
+
+	m_ysfFd = -1;
+	m_dmrFd = -1;
+
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it)
+		(*it)->unwatch(loop);
+
+	if (m_partner != NULL)
+		m_partner->unwatch(loop);
+}
+
+bool CYSF2DMR::hasData() const
+{
+	if (m_partner != NULL && m_partner->hasData())
+		return true;
+
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it) {
+		if ((*it)->hasData())
+			return true;
 	}
-	
-	CStopWatch TGChange;
-	CStopWatch stopWatch;
-	CStopWatch ysfWatch;
-	CStopWatch dmrWatch;
-	stopWatch.start();
-	ysfWatch.start();
-	dmrWatch.start();
-	pollTimer.start();
-	ysfWatchdog.stop();
 
-	unsigned char ysf_cnt = 0;
-	unsigned char dmr_cnt = 0;
+	return m_ysfNetwork->hasData() || m_dmrNetwork->hasData();
+}
 
-	LogMessage("Starting YSF2DMR-%s", VERSION);
+unsigned long long CYSF2DMR::getDeadline() const
+{
+	unsigned long long deadline = m_wheel.getDeadline();
 
-	bool enableUnlink = m_conf.getDMRNetworkEnableUnlink();
-	bool unlinkReceived = false;
+	if (m_dmrPacer.getDeadline() < deadline)
+		deadline = m_dmrPacer.getDeadline();
+	if (m_ysfPacer.getDeadline() < deadline)
+		deadline = m_ysfPacer.getDeadline();
 
-	TG_STATUS TG_connect_state = NONE;
-	unsigned char gps_buffer[20U];
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it) {
+		unsigned long long next = (*it)->getDeadline();
+		if (next < deadline)
+			deadline = next;
+	}
 
-	unsigned int tglistOpt = 0; 
+	// The TG change steps run on stopwatches rather than wheel timers
+	if (m_tgConnectState != NONE) {
+		unsigned long long poll = CStopWatch::monotonic() + TG_POLL * 1000ULL;
+		if (poll < deadline)
+			deadline = poll;
+	}
 
-	for (; end == 0;) {
-		unsigned char buffer[2000U];
+	// Only the converter falling behind leaves datagrams that decode had no room for
+	if (!m_ysfRxQueue.isEmpty() || !m_dmrRxQueue.isEmpty()) {
+		unsigned long long poll = CStopWatch::monotonic() + HELD_BACK_POLL * 1000ULL;
+		if (poll < deadline)
+			deadline = poll;
+	}
 
-		CDMRData tx_dmrdata;
-		unsigned int ms = stopWatch.elapsed();
+	if (m_partner != NULL) {
+		unsigned long long next = m_partner->getDeadline();
+		if (next < deadline)
+			deadline = next;
+	}
 
-		if (m_dmrNetwork->isConnected() && !m_xlxmodule.empty() && !m_xlxConnected) {
-			writeXLXLink(m_srcid, m_dstid, m_dmrNetwork);
-			LogMessage("XLX, Linking to reflector XLX%03u, module %s", m_xlxrefl, m_xlxmodule.c_str());
-			m_xlxConnected = true;
-		}
-		else if (!m_dmrNetwork->isConnected() && !m_xlxmodule.empty() && m_xlxConnected) {
-			LogMessage("XLX, Disconnected from reflector XLX%03u, module %s", m_xlxrefl, m_xlxmodule.c_str());
-			m_xlxConnected = false;
+	return deadline;
+}
+
+void CYSF2DMR::clock(CStallDetector& stall)
+{
+	stall.stage("timers");
+	m_wheel.clock();
+
+	// The owner of a shared login runs it for both slots
+	if (m_owner == NULL) {
+		stall.stage("DMR network");
+		m_dmrNetwork->clock();
+
+		if (m_xlxProber != NULL)
+			checkXLXMirrors();
+	}
+
+	stall.stage("links");
+	if (m_dmrNetwork->isConnected() && !m_xlxmodule.empty() && !m_xlxConnected) {
+		writeXLXLink(m_srcid, m_dstid, m_dmrNetwork);
+		LogMessage("XLX, Linking to reflector XLX%03u, module %s", m_xlxrefl, m_xlxmodule.c_str());
+		m_xlxConnected = true;
+	}
+	else if (!m_dmrNetwork->isConnected() && !m_xlxmodule.empty() && m_xlxConnected) {
+		LogMessage("XLX, Disconnected from reflector XLX%03u, module %s", m_xlxrefl, m_xlxmodule.c_str());
+		m_xlxConnected = false;
+	}
+
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it) {
+		if ((*it)->isLinkDue()) {
+			writeXLXLink(m_srcid, (*it)->getDstId(), &(*it)->getNetwork());
+			LogMessage("XLX, Linking DMR target %s to module %u", (*it)->getName().c_str(), (*it)->getDstId());
 		}
+	}
 
-		if (m_wiresX != NULL) {
-			switch (TG_connect_state) {
-				case WAITING_UNLINK:
-					if (unlinkReceived) {
-						//LogMessage("Unlink Received");
-						TGChange.start();
-						TG_connect_state = SEND_REPLY;
-						unlinkReceived = false;
-					}
-					break;
-				case SEND_REPLY:
-					if (TGChange.elapsed() > 600) {
-						TGChange.start();
-						TG_connect_state = SEND_PTT;
-						m_wiresX->sendConnectReply(m_dstid);
-					}
-					break;
-				case SEND_PTT:
-					if (TGChange.elapsed() > 600) {
-						TGChange.start();
-						TG_connect_state = NONE;
-						if (m_ptt_dstid) {
-							LogMessage("Sending PTT: Src: %s Dst: %s%d", m_ysfSrc.c_str(), m_ptt_pc ? "" : "TG ", m_ptt_dstid);
-							SendDummyDMR(m_srcid, m_ptt_dstid, m_ptt_pc ? FLCO_USER_USER : FLCO_GROUP);
-						}
+	if (m_wiresX != NULL) {
+		switch (m_tgConnectState) {
+			case WAITING_UNLINK:
+				if (m_unlinkReceived) {
+					//LogMessage("Unlink Received");
+					m_TGChange.start();
+					m_tgConnectState = SEND_REPLY;
+					m_unlinkReceived = false;
+				}
+				break;
+			case SEND_REPLY:
+				if (m_TGChange.elapsed() > 600) {
+					m_TGChange.start();
+					m_tgConnectState = SEND_PTT;
+					m_wiresX->sendConnectReply(m_dstid);
+				}
+				break;
+			case SEND_PTT:
+				if (m_TGChange.elapsed() > 600) {
+					m_TGChange.start();
+					m_tgConnectState = NONE;
+					if (m_ptt_dstid) {
+						LogMessage("Sending PTT: Src: %s Dst: %s%d", m_ysfSrc.c_str(), m_ptt_pc ? "" : "TG ", m_ptt_dstid);
+						SendDummyDMR(m_srcid, m_ptt_dstid, m_ptt_pc ? FLCO_USER_USER : FLCO_GROUP);
 					}
-					break;
-				default: 
-					break;
-			}
+				}
+				break;
+			default: 
+				break;
+		}
 
-			if ((TG_connect_state != NONE) && (TGChange.elapsed() > 12000)) {
-				LogMessage("Timeout changing TG");
-				TG_connect_state = NONE;
-			}
+		if ((m_tgConnectState != NONE) && (m_TGChange.elapsed() > 12000)) {
+			LogMessage("Timeout changing TG");
+			m_tgConnectState = NONE;
 		}
+	}
 
-		while (m_ysfNetwork->read(buffer) > 0U) {
-			CYSFFICH fich;
-			bool valid = fich.decode(buffer + 35U);
+	// YSF to DMR, round again while a full queue held the ingress back
+	bool more;
+	do {
+		stall.stage("YSF ingress");
+		more = ysfIngress();
+		stall.stage("YSF decode");
+		ysfDecode();
+		if (m_converter == NULL) {
+			stall.stage("YSF to DMR conversion");
+			ysfConvert();
+		} else if (!m_ysfVoiceQueue.isEmpty()) {
+			m_converter->wake();
+		}
+	} while (more && m_ysfRxQueue.hasSpace());
+	stall.stage("DMR assembly");
+	dmrAssemble();
+	stall.stage("DMR egress");
+	dmrEgress();
+	stall.stage("DMR targets");
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it)
+		(*it)->clock();
+
+	// DMR to YSF
+	do {
+		stall.stage("DMR ingress");
+		more = dmrIngress();
+		stall.stage("DMR decode");
+		dmrDecode();
+		if (m_converter == NULL) {
+			stall.stage("DMR to YSF conversion");
+			dmrConvert();
+		} else if (!m_dmrVoiceQueue.isEmpty()) {
+			m_converter->wake();
+		}
+	} while (more && m_dmrRxQueue.hasSpace());
+	stall.stage("YSF assembly");
+	ysfAssemble();
+	stall.stage("YSF egress");
+	ysfEgress();
+
+	if (m_partner != NULL) {
+		::LogSetContext(m_partner->m_name.c_str());
+		m_partner->clock(stall);
+		::LogSetContext(m_name.empty() ? NULL : m_name.c_str());
+	}
+}
 
-			if (valid) {
-				unsigned char fi = fich.getFI();
-				unsigned char dt = fich.getDT();
-				unsigned char fn = fich.getFN();
-				unsigned char ft = fich.getFT();
-				
-				if (m_wiresX != NULL) {
-					WX_STATUS status = m_wiresX->process(buffer + 35U, buffer + 14U, fi, dt, fn, ft);
-					m_ysfSrc = getSrcYSF(buffer);
-
-					switch (status) {
-						case WXS_CONNECT:
-							m_srcid = findYSFID(m_ysfSrc, false);
-
-							m_ptt_dstid = m_wiresX->getDstID();
-							tglistOpt = m_wiresX->getOpt(m_ptt_dstid);
-
-							switch (tglistOpt) {
-								case 0:
-									m_ptt_pc = false;
-									m_dstid = m_wiresX->getFullDstID();
-									m_ptt_dstid = m_dstid;
-									m_dmrflco = FLCO_GROUP;
-									LogMessage("Connect to TG %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
-									break;
-							
-								case 1:
-									m_ptt_pc = true;
-									m_dstid = 9U;
-									m_dmrflco = FLCO_GROUP;
-									LogMessage("Connect to REF %d has been requested by %s", m_ptt_dstid, m_ysfSrc.c_str());
-									break;
-								
-								case 2:
-									m_ptt_dstid = 0;
-									m_ptt_pc = true;
-									m_dstid = m_wiresX->getFullDstID();
-									m_dmrflco = FLCO_USER_USER;
-									LogMessage("Connect to %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
-									break;
-							
-								default:
-									m_ptt_pc = false;
-									m_dstid = m_wiresX->getFullDstID();
-									m_ptt_dstid = m_dstid;
-									m_dmrflco = FLCO_GROUP;
-									LogMessage("Connect to TG %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
-									break;
-							}
-
-							if (enableUnlink && (tglistOpt != 2) && (m_ptt_dstid != m_idUnlink) && (m_ptt_dstid != 5000)) {
-								LogMessage("Sending DMR Disconnect: Src: %s Dst: %s%d", m_ysfSrc.c_str(), m_flcoUnlink == FLCO_GROUP ? "TG " : "", m_idUnlink);
-
-								SendDummyDMR(m_srcid, m_idUnlink, m_flcoUnlink);
-
-								unlinkReceived = false;
-								TG_connect_state = WAITING_UNLINK;
-							} else 
-								TG_connect_state = SEND_REPLY;
-
-							TGChange.start();
-							break;
-
-						case WXS_DX:
-							break;
-
-						case WXS_DISCONNECT:
-							LogMessage("Disconnect has been requested by %s", m_ysfSrc.c_str());
-
-							m_srcid = findYSFID(m_ysfSrc, false);
-							m_ptt_dstid = 9U;
-							m_ptt_pc = false;
-							m_dstid = 9U;
-							m_dmrflco = FLCO_GROUP;
-
-							SendDummyDMR(m_srcid, m_idUnlink, m_flcoUnlink);
-
-							TG_connect_state = WAITING_UNLINK;
-
-							TGChange.start();
-							break;
-
-						default:
-							break;
-					}
+void CYSF2DMR::convert()
+{
+	ysfConvert();
+	dmrConvert();
+}
 
-					status = WXS_NONE;
-
-					if (dt == YSF_DT_VD_MODE2)
-						status = m_dtmf->decodeVDMode2(buffer + 35U, (buffer[34U] & 0x01U) == 0x01U);
-
-					switch (status) {
-						case WXS_CONNECT:
-							m_srcid = findYSFID(m_ysfSrc, false);
-
-							m_ptt_dstid = m_dtmf->getDstID();
-							tglistOpt = m_wiresX->getOpt(m_ptt_dstid);
-
-							switch (tglistOpt) {
-								case 0:
-									m_ptt_pc = false;
-									m_dstid = m_wiresX->getFullDstID();
-									m_ptt_dstid = m_dstid;
-									m_dmrflco = FLCO_GROUP;
-									LogMessage("Connect to TG %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
-									break;
-							
-								case 1:
-									m_ptt_pc = true;
-									m_dstid = 9U;
-									m_dmrflco = FLCO_GROUP;
-									LogMessage("Connect to REF %d has been requested by %s", m_ptt_dstid, m_ysfSrc.c_str());
-									break;
-								
-								case 2:
-									m_ptt_dstid = 0;
-									m_ptt_pc = true;
-									m_dstid = m_wiresX->getFullDstID();
-									m_dmrflco = FLCO_USER_USER;
-									LogMessage("Connect to %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
-									break;
-							
-								default:
-									m_ptt_pc = false;
-									m_dstid = m_wiresX->getFullDstID();
-									m_ptt_dstid = m_dstid;
-									m_dmrflco = FLCO_GROUP;
-									LogMessage("Connect to TG %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
-									break;
-							}
-
-							LogMessage("Connect to %s%d via DTMF has been requested by %s", m_ptt_pc ? "" : "TG ", m_ptt_dstid, m_ysfSrc.c_str());
-
-							if (enableUnlink && (tglistOpt != 2) && (m_ptt_dstid != m_idUnlink) && (m_ptt_dstid != 5000)) {
-								LogMessage("Sending DMR Disconnect: Src: %s Dst: %s%d", m_ysfSrc.c_str(), m_flcoUnlink == FLCO_GROUP ? "TG " : "", m_idUnlink);
-
-								SendDummyDMR(m_srcid, m_idUnlink, m_flcoUnlink);
-							
-								unlinkReceived = false;
-								TG_connect_state = WAITING_UNLINK;
-							} else
-								TG_connect_state = SEND_REPLY;
-
-							TGChange.start();
-							break;
-
-						case WXS_DISCONNECT:
-							LogMessage("Disconnect via DTMF has been requested by %s", m_ysfSrc.c_str());
-
-							m_srcid = findYSFID(m_ysfSrc, false);
-							m_ptt_dstid = 9U;
-							m_ptt_pc = false;
-							m_dstid = 9U;
-							m_dmrflco = FLCO_GROUP;
-
-							SendDummyDMR(m_srcid, m_idUnlink, m_flcoUnlink);
-
-							TG_connect_state = WAITING_UNLINK;
-							TGChange.start();
-							break;
-
-						default:
-							break;
-					}
-				}
+void CYSF2DMR::close()
+{
+	// A shared login goes with its owner
+	if (m_owner != NULL)
+		m_dmrNetwork = NULL;
 
-				if ((::memcmp(buffer, "YSFD", 4U) == 0U) && (dt == YSF_DT_VD_MODE2)) {
-					CYSFPayload ysfPayload;
-
-					if (fi == YSF_FI_HEADER) {
-						if (ysfPayload.processHeaderData(buffer + 35U)) {
-							ysfWatchdog.start();
-							std::string ysfSrc = ysfPayload.getSource();
-							std::string ysfDst = ysfPayload.getDest();
-							LogMessage("Received YSF Header: Src: %s Dst: %s", ysfSrc.c_str(), ysfDst.c_str());
-							
-							m_dmrNetwork->reset(2U);	// OE1KBC fix
-							
-							m_srcid = findYSFID(ysfSrc, true);
-							if (m_dropUnknown == 0 || m_srcid != 0) {
-								ysfWatchdog.start();
-								m_dmrNetwork->reset(2U);	// OE1KBC fix
-								 m_conv.putYSFHeader();
-								m_ysfFrames = 0U;
-							}
-							else
-							{
-								LogMessage("Dropped source without DMR ID: %s", ysfSrc.c_str());
-							}
-						}
-					} else if (fi == YSF_FI_TERMINATOR) {
+	if (m_ysfNetwork != NULL) {
+		// Unlinked from the reflectors of the fan out rather than left to time out
+		m_ysfNetwork->clearSubscribers();
+		m_ysfNetwork->close();
+	}
+	if (m_dmrNetwork != NULL)
+		m_dmrNetwork->close();
+
+	deleteXLXProber();
+
+	closeDMRTargets();
+
+	if (m_gps != NULL) {
+		m_gps->close();
+		delete m_gps;
+		m_gps = NULL;
+	}
+
+	if (m_wiresX != NULL) {
+		delete m_wiresX;
+		delete m_dtmf;
+		m_wiresX = NULL;
+		m_dtmf   = NULL;
+	}
+
+	delete m_dmrNetwork;
+	delete m_ysfNetwork;
+	m_dmrNetwork = NULL;
+	m_ysfNetwork = NULL;
+}
+
+bool CYSF2DMR::ysfIngress()
+{
+	m_ysfIngressStage.begin(0U);
+
+	unsigned int frames = 0U;
+	bool more = true;
+
+	// The rest wait in the network thread until decode has made room
+	CPipelineFrame frame;
+	while (m_ysfRxQueue.hasSpace()) {
+		frame.m_length = m_ysfNetwork->read(frame.m_data);
+		if (frame.m_length == 0U) {
+			more = false;
+			break;
+		}
+
+		frame.m_tag   = TAG_DATA;
+		frame.m_count = 1U;
+		if (m_ysfRxQueue.push(frame))
+			frames++;
+		else
+			m_ysfIngressStage.drop();
+	}
+
+	m_ysfIngressStage.end(frames);
+
+	return more;
+}
+
+void CYSF2DMR::ysfDecode()
+{
+	m_ysfDecodeStage.begin(m_ysfRxQueue.dataSize());
+
+	unsigned int frames = 0U;
+
+	CPipelineFrame frame;
+	while (m_ysfVoiceQueue.hasSpace(DECODE_VOICE_MAX) && m_ysfRxQueue.pop(frame)) {
+		unsigned char* buffer = frame.m_data;
+
+		CYSFFICH fich;
+		bool valid = fich.decode(buffer + 35U);
+
+		if (valid) {
+			unsigned char fi = fich.getFI();
+			unsigned char dt = fich.getDT();
+			unsigned char fn = fich.getFN();
+			unsigned char ft = fich.getFT();
+
+			if (m_wiresX != NULL)
+				processWiresX(buffer, fi, dt, fn, ft);
+
+			if ((::memcmp(buffer, "YSFD", 4U) == 0U) && (dt == YSF_DT_VD_MODE2)) {
+				CYSFPayload ysfPayload;
+
+				if (fi == YSF_FI_HEADER) {
+					if (ysfPayload.processHeaderData(buffer + 35U)) {
+						m_ysfWatchdog.start();
+						std::string ysfSrc = ysfPayload.getSource();
+						std::string ysfDst = ysfPayload.getDest();
+						LogMessage("Received YSF Header: Src: %s Dst: %s", ysfSrc.c_str(), ysfDst.c_str());
+						
+						m_dmrNetwork->reset(m_slot);	// OE1KBC fix
+						
+						m_srcid = findYSFID(ysfSrc, true);
 						if (m_dropUnknown == 0 || m_srcid != 0) {
-							ysfWatchdog.stop();
-							int extraFrames = (m_hangTime / 100U) - m_ysfFrames - 2U;
-							for (int i = 0U; i < extraFrames; i++)
-								m_conv.putDummyYSF();
-							LogMessage("YSF received end of voice transmission, %.1f seconds", float(m_ysfFrames) / 10.0F);
-							m_conv.putYSFEOT();
+							m_ysfWatchdog.start();
+							m_dmrNetwork->reset(m_slot);	// OE1KBC fix
+							if (!writeVoice(m_ysfVoiceQueue, TAG_HEADER))
+								m_ysfDecodeStage.drop();
 							m_ysfFrames = 0U;
 						}
-					} else if (fi == YSF_FI_COMMUNICATIONS) {
-						if (m_dropUnknown == 0 || m_srcid != 0) {
-							ysfWatchdog.start();
-							m_conv.putYSF(buffer + 35U);
-							m_ysfFrames++;
+						else
+						{
+							LogMessage("Dropped source without DMR ID: %s", ysfSrc.c_str());
 						}
 					}
+				} else if (fi == YSF_FI_TERMINATOR) {
+					if (m_dropUnknown == 0 || m_srcid != 0) {
+						m_ysfWatchdog.stop();
+						int extraFrames = (m_hangTime / 100U) - m_ysfFrames - 2U;
+						if (extraFrames > 0 && !writeVoice(m_ysfVoiceQueue, TAG_LOST, NULL, 0U, extraFrames))
+							m_ysfDecodeStage.drop();
+						LogMessage("YSF received end of voice transmission, %.1f seconds", float(m_ysfFrames) / 10.0F);
+						if (!writeVoice(m_ysfVoiceQueue, TAG_EOT))
+							m_ysfDecodeStage.drop();
+						m_ysfFrames = 0U;
+					}
+				} else if (fi == YSF_FI_COMMUNICATIONS) {
+					if (m_dropUnknown == 0 || m_srcid != 0) {
+						m_ysfWatchdog.start();
+						if (!writeVoice(m_ysfVoiceQueue, TAG_DATA, buffer + 35U, YSF_FRAME_LENGTH_BYTES))
+							m_ysfDecodeStage.drop();
+						m_ysfFrames++;
+					}
 				}
-
-				if (m_gps != NULL)
-					m_gps->data(buffer + 14U, buffer + 35U, fi, dt, fn, ft, m_dstid);
-				
 			}
 
-			if ((buffer[34U] & 0x01U) == 0x01U) {
-				if (m_gps != NULL)
-					m_gps->reset();
-				if (m_dtmf != NULL)
-					m_dtmf->reset();
-			}
+			if (m_gps != NULL)
+				m_gps->data(buffer + 14U, buffer + 35U, fi, dt, fn, ft, m_dstid);
+			
 		}
 
-		if (dmrWatch.elapsed() > DMR_FRAME_PER) {
-			unsigned int dmrFrameType = m_conv.getDMR(m_dmrFrame);
-
-			if(dmrFrameType == TAG_HEADER) {
-				CDMRData rx_dmrdata;
-				dmr_cnt = 0U;
-
-				rx_dmrdata.setSlotNo(2U);
-				rx_dmrdata.setSrcId(m_srcid);
-				rx_dmrdata.setDstId(m_dstid);
-				rx_dmrdata.setFLCO(m_dmrflco);
-				rx_dmrdata.setN(0U);
-				rx_dmrdata.setSeqNo(0U);
-				rx_dmrdata.setBER(0U);
-				rx_dmrdata.setRSSI(0U);
-				rx_dmrdata.setDataType(DT_VOICE_LC_HEADER);
-
-				// Add sync
-				CSync::addDMRDataSync(m_dmrFrame, 0);
-
-				// Add SlotType
-				CDMRSlotType slotType;
-				slotType.setColorCode(m_colorcode);
-				slotType.setDataType(DT_VOICE_LC_HEADER);
-				slotType.getData(m_dmrFrame);
-	
-				// Full LC
-				CDMRLC dmrLC = CDMRLC(m_dmrflco, m_srcid, m_dstid);
-				CDMRFullLC fullLC;
-				fullLC.encode(dmrLC, m_dmrFrame, DT_VOICE_LC_HEADER);
-				m_EmbeddedLC.setLC(dmrLC);
-				
-				rx_dmrdata.setData(m_dmrFrame);
-				//CUtils::dump(1U, "DMR data:", m_dmrFrame, 33U);
+		if ((buffer[34U] & 0x01U) == 0x01U) {
+			if (m_gps != NULL)
+				m_gps->reset();
+			if (m_dtmf != NULL)
+				m_dtmf->reset();
+		}
 
-				for (unsigned int i = 0U; i < 3U; i++) {
-					rx_dmrdata.setSeqNo(dmr_cnt);
-					m_dmrNetwork->write(rx_dmrdata);
-					dmr_cnt++;
-				}
+		frames++;
+	}
 
-				dmrWatch.start();
-			}
-			else if(dmrFrameType == TAG_EOT) {
-				CDMRData rx_dmrdata;
-				unsigned int n_dmr = (dmr_cnt - 3U) % 6U;
-				unsigned int fill = (6U - n_dmr);
-				
-				if (n_dmr) {
-					for (unsigned int i = 0U; i < fill; i++) {
+	m_ysfDecodeStage.end(frames);
+}
+
+void CYSF2DMR::ysfConvert()
+{
+	m_ysfConvertStage.begin(m_ysfVoiceQueue.dataSize());
+
+	unsigned int frames = 0U;
+
+	CPipelineFrame frame;
+	while (m_ysfVoiceQueue.pop(frame)) {
+		switch (frame.m_tag) {
+			case TAG_HEADER:
+				m_conv.putYSFHeader();
+				break;
+			case TAG_DATA:
+				m_conv.putYSF(frame.m_data);
+				break;
+			case TAG_LOST:
+				for (unsigned int i = 0U; i < frame.m_count; i++)
+					m_conv.putDummyYSF();
+				break;
+			case TAG_EOT:
+				m_conv.putYSFEOT();
+				break;
+			default:
+				break;
+		}
 
-						CDMREMB emb;
-						CDMRData rx_dmrdata;
+		frames++;
 
-						rx_dmrdata.setSlotNo(2U);
-						rx_dmrdata.setSrcId(m_srcid);
-						rx_dmrdata.setDstId(m_dstid);
-						rx_dmrdata.setFLCO(m_dmrflco);
-						rx_dmrdata.setN(n_dmr);
-						rx_dmrdata.setSeqNo(dmr_cnt);
-						rx_dmrdata.setBER(0U);
-						rx_dmrdata.setRSSI(0U);
-						rx_dmrdata.setDataType(DT_VOICE);
+		// Here rather than with the rest of the call, this may be the converter thread
+		if (frame.m_tag == TAG_EOT) {
+			m_ysfConvertStage.end(frames);
+			frames = 0U;
 
-						::memcpy(m_dmrFrame, DMR_SILENCE_DATA, DMR_FRAME_LENGTH_BYTES);
+			m_ysfConvertStage.logStats();
 
-						// Generate the Embedded LC
-						unsigned char lcss = m_EmbeddedLC.getData(m_dmrFrame, n_dmr);
+			m_ysfConvertStage.begin(m_ysfVoiceQueue.dataSize());
+		}
+	}
 
-						// Generate the EMB
-						emb.setColorCode(m_colorcode);
-						emb.setLCSS(lcss);
-						emb.getData(m_dmrFrame);
+	m_ysfConvertStage.end(frames);
+}
 
-						rx_dmrdata.setData(m_dmrFrame);
-				
-						//CUtils::dump(1U, "DMR data:", m_dmrFrame, 33U);
-						m_dmrNetwork->write(rx_dmrdata);
+void CYSF2DMR::dmrAssemble()
+{
+	m_dmrAssembleStage.begin(m_conv.getDMRFrames());
 
-						n_dmr++;
-						dmr_cnt++;
-					}
-				}
+	unsigned int frames = 0U;
 
-				rx_dmrdata.setSlotNo(2U);
-				rx_dmrdata.setSrcId(m_srcid);
-				rx_dmrdata.setDstId(m_dstid);
-				rx_dmrdata.setFLCO(m_dmrflco);
-				rx_dmrdata.setN(n_dmr);
-				rx_dmrdata.setSeqNo(dmr_cnt);
-				rx_dmrdata.setBER(0U);
-				rx_dmrdata.setRSSI(0U);
-				rx_dmrdata.setDataType(DT_TERMINATOR_WITH_LC);
-
-				// Add sync
-				CSync::addDMRDataSync(m_dmrFrame, 0);
-
-				// Add SlotType
-				CDMRSlotType slotType;
-				slotType.setColorCode(m_colorcode);
-				slotType.setDataType(DT_TERMINATOR_WITH_LC);
-				slotType.getData(m_dmrFrame);
-	
-				// Full LC
-				CDMRLC dmrLC = CDMRLC(m_dmrflco, m_srcid, m_dstid);
-				CDMRFullLC fullLC;
-				fullLC.encode(dmrLC, m_dmrFrame, DT_TERMINATOR_WITH_LC);
-				
-				rx_dmrdata.setData(m_dmrFrame);
-				//CUtils::dump(1U, "DMR data:", m_dmrFrame, 33U);
-				m_dmrNetwork->write(rx_dmrdata);
+	// A frame waits for the egress to make room for all its bursts
+	while (m_dmrPacer.isDue() && m_dmrTxQueue.hasSpace(DMR_ASSEMBLER_BURSTS)) {
+		const CTaggedFrame<9U>* dmrFrames[3U];
+		unsigned int dmrFrameType = m_conv.peekDMR(dmrFrames);
 
-				dmrWatch.start();
-			}
-			else if(dmrFrameType == TAG_DATA) {
-				CDMREMB emb;
-				CDMRData rx_dmrdata;
-				unsigned int n_dmr = (dmr_cnt - 3U) % 6U;
-
-				rx_dmrdata.setSlotNo(2U);
-				rx_dmrdata.setSrcId(m_srcid);
-				rx_dmrdata.setDstId(m_dstid);
-				rx_dmrdata.setFLCO(m_dmrflco);
-				rx_dmrdata.setN(n_dmr);
-				rx_dmrdata.setSeqNo(dmr_cnt);
-				rx_dmrdata.setBER(0U);
-				rx_dmrdata.setRSSI(0U);
-			
-				if (!n_dmr) {
-					rx_dmrdata.setDataType(DT_VOICE_SYNC);
-					// Add sync
-					CSync::addDMRAudioSync(m_dmrFrame, 0U);
-					// Prepare Full LC data
-					CDMRLC dmrLC = CDMRLC(m_dmrflco, m_srcid, m_dstid);
-					// Configure the Embedded LC
-					m_EmbeddedLC.setLC(dmrLC);
-				}
-				else {
-					rx_dmrdata.setDataType(DT_VOICE);
-					// Generate the Embedded LC
-					unsigned char lcss = m_EmbeddedLC.getData(m_dmrFrame, n_dmr);
-					// Generate the EMB
-					emb.setColorCode(m_colorcode);
-					emb.setLCSS(lcss);
-					emb.getData(m_dmrFrame);
-				}
+		if (dmrFrameType == TAG_NODATA) {
+			m_dmrPacer.skip();
+			continue;
+		}
 
-				rx_dmrdata.setData(m_dmrFrame);
-				
-				//CUtils::dump(1U, "DMR data:", m_dmrFrame, 33U);
-				m_dmrNetwork->write(rx_dmrdata);
+		// The other targets get the AMBE before the bursts are made around it here
+		for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it) {
+			if (!(*it)->put(dmrFrameType, dmrFrames, m_srcid))
+				m_dmrAssembleStage.drop();
+		}
 
-				dmr_cnt++;
-				dmrWatch.start();
-			}
+		if (!m_dmrAssembler.assemble(dmrFrameType, dmrFrames, m_srcid, m_dstid, m_dmrflco, m_dmrTxQueue))
+			m_dmrAssembleStage.drop();
+
+		m_conv.popDMR();
+
+		m_dmrPacer.next();
+		if (dmrFrameType == TAG_EOT)
+			m_dmrPacer.logStats();
+		frames++;
+	}
+
+	m_dmrAssembleStage.end(frames);
+}
+
+void CYSF2DMR::dmrEgress()
+{
+	m_dmrEgressStage.begin(m_dmrTxQueue.dataSize());
+
+	unsigned int frames = 0U;
+
+	CDMRData dmrData;
+	while (m_dmrTxQueue.pop(dmrData)) {
+		m_dmrNetwork->write(dmrData);
+		frames++;
+
+		if (dmrData.getDataType() == DT_TERMINATOR_WITH_LC) {
+			m_dmrEgressStage.end(frames);
+			frames = 0U;
+
+			m_ysfIngressStage.logStats();
+			m_ysfDecodeStage.logStats();
+			m_dmrAssembleStage.logStats();
+			m_dmrEgressStage.logStats();
+
+			m_dmrEgressStage.begin(m_dmrTxQueue.dataSize());
 		}
+	}
 
-		while (m_dmrNetwork->read(tx_dmrdata) > 0U) {
-			unsigned int SrcId = tx_dmrdata.getSrcId();
-			unsigned int DstId = tx_dmrdata.getDstId();
-			
-			FLCO netflco = tx_dmrdata.getFLCO();
-			unsigned char DataType = tx_dmrdata.getDataType();
-
-			if (!tx_dmrdata.isMissing()) {
-				networkWatchdog.start();
-
-				if(DataType == DT_TERMINATOR_WITH_LC) {
-					if (m_dmrFrames == 0U) {
-						m_dmrNetwork->reset(2U);
-						networkWatchdog.stop();
-						m_dmrinfo = false;
-						m_firstSync = false;
-						break;
-					}
+	m_dmrEgressStage.end(frames);
+}
+
+bool CYSF2DMR::dmrIngress()
+{
+	m_dmrIngressStage.begin(0U);
+
+	unsigned int frames = 0U;
+	bool more = true;
 
-					LogMessage("DMR received end of voice transmission, %.1f seconds", float(m_dmrFrames) / 16.667F);
+	CDMRData dmrData;
+	while (m_dmrRxQueue.hasSpace()) {
+		if (!m_dmrNetwork->read(m_slot, dmrData)) {
+			more = false;
+			break;
+		}
+
+		if (m_dmrRxQueue.push(dmrData))
+			frames++;
+		else
+			m_dmrIngressStage.drop();
+	}
+
+	m_dmrIngressStage.end(frames);
+
+	return more;
+}
+
+void CYSF2DMR::dmrDecode()
+{
+	m_dmrDecodeStage.begin(m_dmrRxQueue.dataSize());
+
+	unsigned int frames = 0U;
+
+	CDMRData dmrData;
+	while (m_dmrVoiceQueue.hasSpace(DECODE_VOICE_MAX) && m_dmrRxQueue.pop(dmrData)) {
+		frames++;
+
+		unsigned int SrcId = dmrData.getSrcId();
+		unsigned int DstId = dmrData.getDstId();
+		
+		FLCO netflco = dmrData.getFLCO();
+		unsigned char DataType = dmrData.getDataType();
 
-					if (SrcId == 4000)
-						unlinkReceived = true;
+		if (!dmrData.isMissing()) {
+			m_networkWatchdog.start();
 
-					m_conv.putDMREOT();
-					m_dmrNetwork->reset(2U);
-					networkWatchdog.stop();
-					m_dmrFrames = 0U;
+			if(DataType == DT_TERMINATOR_WITH_LC) {
+				// A header already written still needs its end of transmission
+				if (m_dmrFrames == 0U && !m_dmrinfo) {
+					m_dmrNetwork->endOfStream(m_slot);
+					m_networkWatchdog.stop();
 					m_dmrinfo = false;
 					m_firstSync = false;
+					continue;
 				}
 
-				if((DataType == DT_VOICE_LC_HEADER) && (DataType != m_dmrLastDT)) {
-					
-					// DT1 & DT2 without GPS info
-					::memcpy(gps_buffer, dt1_temp, 10U);
-					::memcpy(gps_buffer + 10U, dt2_temp, 10U);
+				LogMessage("DMR received end of voice transmission, %.1f seconds", float(m_dmrFrames) / 16.667F);
 
+				if (SrcId == 4000)
+					m_unlinkReceived = true;
+
+				if (!writeVoice(m_dmrVoiceQueue, TAG_EOT))
+					m_dmrDecodeStage.drop();
+				m_dmrNetwork->endOfStream(m_slot);
+				m_networkWatchdog.stop();
+				m_dmrFrames = 0U;
+				m_dmrinfo = false;
+				m_firstSync = false;
+			}
+
+			if((DataType == DT_VOICE_LC_HEADER) && (DataType != m_dmrLastDT)) {
+				
+				// DT1 & DT2 without GPS info
+				::memcpy(m_gpsBuffer, dt1_temp, 10U);
+				::memcpy(m_gpsBuffer + 10U, dt2_temp, 10U);
+
+				if (SrcId == 9990U)
+					m_netSrc = "PARROT";
+				else if (SrcId == 9U)
+					m_netSrc = "LOCAL";
+				else if (SrcId == 4000U)
+					m_netSrc = "UNLINK";
+				else
+					m_netSrc = m_lookup->findCS(SrcId);
+
+				m_netDst = (netflco == FLCO_GROUP ? "TG " : "") + m_lookup->findCS(DstId);
+
+				if (!writeVoice(m_dmrVoiceQueue, TAG_HEADER))
+					m_dmrDecodeStage.drop();
+				LogMessage("DMR audio received from %s to %s", m_netSrc.c_str(), m_netDst.c_str());
+
+				m_dmrinfo = true;
+
+				if (m_lookup->exists(SrcId) && (m_APRS != NULL)) {
+					int lat, lon, resp;
+					resp = m_APRS->findCall(m_netSrc, &lat, &lon);
+
+					//LogMessage("Searching GPS Position of %s in aprs.fi", m_netSrc.c_str());
+
+					if (resp) {
+						LogMessage("GPS Position of %s Lat: %0.3f, Lon: %0.3f", m_netSrc.c_str(), (float)lat / 1000.0, (float)lon / 1000.0);
+						m_APRS->formatGPS(m_gpsBuffer, lat, lon);
+					}
+					// else
+					//	LogMessage("GPS Position not available");
+				}
+
+				m_netSrc.resize(YSF_CALLSIGN_LENGTH, ' ');
+				m_netDst.resize(YSF_CALLSIGN_LENGTH, ' ');
+				
+				m_dmrFrames = 0U;
+				m_firstSync = false;
+			}
+
+			if(DataType == DT_VOICE_SYNC)
+				m_firstSync = true;
+
+			if((DataType == DT_VOICE_SYNC || DataType == DT_VOICE) && m_firstSync) {
+				unsigned char dmr_frame[50];
+
+				dmrData.getData(dmr_frame);
+
+				if (!m_dmrinfo) {
 					if (SrcId == 9990U)
 						m_netSrc = "PARROT";
 					else if (SrcId == 9U)
@@ -831,10 +974,7 @@ int CYSF2DMR::run()
 
 					m_netDst = (netflco == FLCO_GROUP ? "TG " : "") + m_lookup->findCS(DstId);
 
-					m_conv.putDMRHeader();
-					LogMessage("DMR audio received from %s to %s", m_netSrc.c_str(), m_netDst.c_str());
-
-					m_dmrinfo = true;
+					LogMessage("DMR audio late entry received from %s to %s", m_netSrc.c_str(), m_netDst.c_str());
 
 					if (m_lookup->exists(SrcId) && (m_APRS != NULL)) {
 						int lat, lon, resp;
@@ -844,7 +984,7 @@ int CYSF2DMR::run()
 
 						if (resp) {
 							LogMessage("GPS Position of %s Lat: %0.3f, Lon: %0.3f", m_netSrc.c_str(), (float)lat / 1000.0, (float)lon / 1000.0);
-							m_APRS->formatGPS(gps_buffer, lat, lon);
+							m_APRS->formatGPS(m_gpsBuffer, lat, lon);
 						}
 						// else
 						//	LogMessage("GPS Position not available");
@@ -852,300 +992,503 @@ int CYSF2DMR::run()
 
 					m_netSrc.resize(YSF_CALLSIGN_LENGTH, ' ');
 					m_netDst.resize(YSF_CALLSIGN_LENGTH, ' ');
-					
-					m_dmrFrames = 0U;
-					m_firstSync = false;
+
+					m_dmrinfo = true;
 				}
 
-				if(DataType == DT_VOICE_SYNC)
-					m_firstSync = true;
+				if (!writeVoice(m_dmrVoiceQueue, TAG_DATA, dmr_frame, DMR_FRAME_LENGTH_BYTES)) // Add DMR frame for YSF conversion
+					m_dmrDecodeStage.drop();
+				m_dmrFrames++;
+			}
+		}
+		else {
+			if(DataType == DT_VOICE_SYNC || DataType == DT_VOICE) {
+				unsigned char dmr_frame[50];
+				dmrData.getData(dmr_frame);
+				if (!writeVoice(m_dmrVoiceQueue, TAG_DATA, dmr_frame, DMR_FRAME_LENGTH_BYTES)) // Add DMR frame for YSF conversion
+					m_dmrDecodeStage.drop();
+				m_dmrFrames++;
+			}
+		}
+		
+		m_dmrLastDT = DataType;
+	}
 
-				if((DataType == DT_VOICE_SYNC || DataType == DT_VOICE) && m_firstSync) {
-					unsigned char dmr_frame[50];
+	m_dmrDecodeStage.end(frames);
+}
 
-					tx_dmrdata.getData(dmr_frame);
+void CYSF2DMR::dmrConvert()
+{
+	m_dmrConvertStage.begin(m_dmrVoiceQueue.dataSize());
+
+	unsigned int frames = 0U;
+
+	CPipelineFrame frame;
+	while (m_dmrVoiceQueue.pop(frame)) {
+		switch (frame.m_tag) {
+			case TAG_HEADER:
+				m_conv.putDMRHeader();
+				break;
+			case TAG_DATA:
+				m_conv.putDMR(frame.m_data);
+				break;
+			case TAG_EOT:
+				m_conv.putDMREOT();
+				break;
+			default:
+				break;
+		}
 
-					if (!m_dmrinfo) {
-						if (SrcId == 9990U)
-							m_netSrc = "PARROT";
-						else if (SrcId == 9U)
-							m_netSrc = "LOCAL";
-						else if (SrcId == 4000U)
-							m_netSrc = "UNLINK";
-						else
-							m_netSrc = m_lookup->findCS(SrcId);
+		frames++;
 
-						m_netDst = (netflco == FLCO_GROUP ? "TG " : "") + m_lookup->findCS(DstId);
+		if (frame.m_tag == TAG_EOT) {
+			m_dmrConvertStage.end(frames);
+			frames = 0U;
 
-						LogMessage("DMR audio late entry received from %s to %s", m_netSrc.c_str(), m_netDst.c_str());
+			m_dmrConvertStage.logStats();
 
-						if (m_lookup->exists(SrcId) && (m_APRS != NULL)) {
-							int lat, lon, resp;
-							resp = m_APRS->findCall(m_netSrc, &lat, &lon);
+			m_dmrConvertStage.begin(m_dmrVoiceQueue.dataSize());
+		}
+	}
 
-							//LogMessage("Searching GPS Position of %s in aprs.fi", m_netSrc.c_str());
+	m_dmrConvertStage.end(frames);
+}
 
-							if (resp) {
-								LogMessage("GPS Position of %s Lat: %0.3f, Lon: %0.3f", m_netSrc.c_str(), (float)lat / 1000.0, (float)lon / 1000.0);
-								m_APRS->formatGPS(gps_buffer, lat, lon);
-							}
-							// else
-							//	LogMessage("GPS Position not available");
-						}
+void CYSF2DMR::ysfAssemble()
+{
+	m_ysfAssembleStage.begin(m_conv.getYSFFrames());
 
-						m_netSrc.resize(YSF_CALLSIGN_LENGTH, ' ');
-						m_netDst.resize(YSF_CALLSIGN_LENGTH, ' ');
+	unsigned int frames = 0U;
 
-						m_dmrinfo = true;
-					}
+	while (m_ysfPacer.isDue() && m_ysfTxQueue.hasSpace()) {
+		unsigned int ysfFrameType = m_conv.getYSF(m_ysfFrame + 35U);
 
-					m_conv.putDMR(dmr_frame); // Add DMR frame for YSF conversion
-					m_dmrFrames++;
-				}
-			}
-			else {
-				if(DataType == DT_VOICE_SYNC || DataType == DT_VOICE) {
-					unsigned char dmr_frame[50];
-					tx_dmrdata.getData(dmr_frame);
-					m_conv.putDMR(dmr_frame); // Add DMR frame for YSF conversion
-					m_dmrFrames++;
-				}
+		if(ysfFrameType == TAG_HEADER) {
+			m_ysfCnt = 0U;
 
-				networkWatchdog.clock(ms);
-				if (networkWatchdog.hasExpired()) {
-					LogDebug("Network watchdog has expired, %.1f seconds", float(m_dmrFrames) / 16.667F);
-					m_dmrNetwork->reset(2U);
-					networkWatchdog.stop();
-					m_dmrFrames = 0U;
-					m_dmrinfo = false;
-				}
-			}
-			
-			m_dmrLastDT = DataType;
+			::memcpy(m_ysfFrame + 0U, "YSFD", 4U);
+			::memcpy(m_ysfFrame + 4U, m_ysfNetwork->getCallsign().c_str(), YSF_CALLSIGN_LENGTH);
+			::memcpy(m_ysfFrame + 14U, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
+			::memcpy(m_ysfFrame + 24U, "ALL       ", YSF_CALLSIGN_LENGTH);
+			m_ysfFrame[34U] = 0U; // Net frame counter
+
+			CSync::addYSFSync(m_ysfFrame + 35U);
+
+			// Set the FICH
+			CYSFFICH fich;
+			fich.setFI(YSF_FI_HEADER);
+			fich.setCS(m_conf.getFICHCallSign());
+ 			fich.setCM(m_conf.getFICHCallMode());
+ 			fich.setBN(0U);
+ 			fich.setBT(0U);
+ 			fich.setFN(0U);
+			fich.setFT(m_conf.getFICHFrameTotal());
+ 			fich.setDev(0U);
+			fich.setMR(m_conf.getFICHMessageRoute());
+ 			fich.setVoIP(m_conf.getFICHVOIP());
+ 			fich.setDT(m_conf.getFICHDataType());
+ 			fich.setSQL(m_conf.getFICHSQLType());
+ 			fich.setSQ(m_conf.getFICHSQLCode());
+			fich.encode(m_ysfFrame + 35U);
+
+			unsigned char csd1[20U], csd2[20U];
+			memset(csd1, '*', YSF_CALLSIGN_LENGTH/2);
+ 			memcpy(csd1 + YSF_CALLSIGN_LENGTH/2, m_conf.getYsfRadioID().c_str(), YSF_CALLSIGN_LENGTH/2);
+			memcpy(csd1 + YSF_CALLSIGN_LENGTH, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
+			memset(csd2, ' ', YSF_CALLSIGN_LENGTH + YSF_CALLSIGN_LENGTH);
+
+			CYSFPayload payload;
+			payload.writeHeader(m_ysfFrame + 35U, csd1, csd2);
+
+			if (!writeYSF(ysfFrameType))
+				m_ysfAssembleStage.drop();
+
+			m_ysfCnt++;
 		}
-		
-		if (ysfWatch.elapsed() > YSF_FRAME_PER) {
-			unsigned int ysfFrameType = m_conv.getYSF(m_ysfFrame + 35U);
-
-			if(ysfFrameType == TAG_HEADER) {
-				ysf_cnt = 0U;
-
-				::memcpy(m_ysfFrame + 0U, "YSFD", 4U);
-				::memcpy(m_ysfFrame + 4U, m_ysfNetwork->getCallsign().c_str(), YSF_CALLSIGN_LENGTH);
-				::memcpy(m_ysfFrame + 14U, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
-				::memcpy(m_ysfFrame + 24U, "ALL       ", YSF_CALLSIGN_LENGTH);
-				m_ysfFrame[34U] = 0U; // Net frame counter
-
-				CSync::addYSFSync(m_ysfFrame + 35U);
-
-				// Set the FICH
-				CYSFFICH fich;
-				fich.setFI(YSF_FI_HEADER);
-				fich.setCS(m_conf.getFICHCallSign());
- 				fich.setCM(m_conf.getFICHCallMode());
- 				fich.setBN(0U);
- 				fich.setBT(0U);
- 				fich.setFN(0U);
-				fich.setFT(m_conf.getFICHFrameTotal());
- 				fich.setDev(0U);
-				fich.setMR(m_conf.getFICHMessageRoute());
- 				fich.setVoIP(m_conf.getFICHVOIP());
- 				fich.setDT(m_conf.getFICHDataType());
- 				fich.setSQL(m_conf.getFICHSQLType());
- 				fich.setSQ(m_conf.getFICHSQLCode());
-				fich.encode(m_ysfFrame + 35U);
-
-				unsigned char csd1[20U], csd2[20U];
-				memset(csd1, '*', YSF_CALLSIGN_LENGTH/2);
- 				memcpy(csd1 + YSF_CALLSIGN_LENGTH/2, m_conf.getYsfRadioID().c_str(), YSF_CALLSIGN_LENGTH/2);
-				memcpy(csd1 + YSF_CALLSIGN_LENGTH, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
-				memset(csd2, ' ', YSF_CALLSIGN_LENGTH + YSF_CALLSIGN_LENGTH);
-
-				CYSFPayload payload;
-				payload.writeHeader(m_ysfFrame + 35U, csd1, csd2);
-
-				m_ysfNetwork->write(m_ysfFrame);
-
-				ysf_cnt++;
-				ysfWatch.start();
-			}
-			else if (ysfFrameType == TAG_EOT) {
-				::memcpy(m_ysfFrame + 0U, "YSFD", 4U);
-				::memcpy(m_ysfFrame + 4U, m_ysfNetwork->getCallsign().c_str(), YSF_CALLSIGN_LENGTH);
-				::memcpy(m_ysfFrame + 14U, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
-				::memcpy(m_ysfFrame + 24U, "ALL       ", YSF_CALLSIGN_LENGTH);
-				m_ysfFrame[34U] = ysf_cnt; // Net frame counter
-
-				CSync::addYSFSync(m_ysfFrame + 35U);
-
-				// Set the FICH
-				CYSFFICH fich;
-				fich.setFI(YSF_FI_TERMINATOR);
-				fich.setCS(m_conf.getFICHCallSign());
- 				fich.setCM(m_conf.getFICHCallMode());
- 				fich.setBN(0U);
- 				fich.setBT(0U);
- 				fich.setFN(0U);
-				fich.setFT(m_conf.getFICHFrameTotal());
- 				fich.setDev(0U);
-				fich.setMR(m_conf.getFICHMessageRoute());
- 				fich.setVoIP(m_conf.getFICHVOIP());
- 				fich.setDT(m_conf.getFICHDataType());
- 				fich.setSQL(m_conf.getFICHSQLType());
- 				fich.setSQ(m_conf.getFICHSQLCode());
-				fich.encode(m_ysfFrame + 35U);
-
-				unsigned char csd1[20U], csd2[20U];
-				memset(csd1, '*', YSF_CALLSIGN_LENGTH/2);
- 				memcpy(csd1 + YSF_CALLSIGN_LENGTH/2, m_conf.getYsfRadioID().c_str(), YSF_CALLSIGN_LENGTH/2);
-				memcpy(csd1 + YSF_CALLSIGN_LENGTH, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
-				memset(csd2, ' ', YSF_CALLSIGN_LENGTH + YSF_CALLSIGN_LENGTH);
-
-				CYSFPayload payload;
-				payload.writeHeader(m_ysfFrame + 35U, csd1, csd2);
-
-				m_ysfNetwork->write(m_ysfFrame);
-			}
-			else if (ysfFrameType == TAG_DATA) {
-				CYSFFICH fich;
-				CYSFPayload ysfPayload;
-				unsigned char dch[10U];
-
-				unsigned int fn = (ysf_cnt - 1U) % (m_conf.getFICHFrameTotal() + 1);
-
-				::memcpy(m_ysfFrame + 0U, "YSFD", 4U);
-				::memcpy(m_ysfFrame + 4U, m_ysfNetwork->getCallsign().c_str(), YSF_CALLSIGN_LENGTH);
-				::memcpy(m_ysfFrame + 14U, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
-				::memcpy(m_ysfFrame + 24U, "ALL       ", YSF_CALLSIGN_LENGTH);
-
-				// Add the YSF Sync
-				CSync::addYSFSync(m_ysfFrame + 35U);
-
-				switch (fn) {
-					case 0:
-						memset(dch, '*', YSF_CALLSIGN_LENGTH/2);
- 						memcpy(dch + YSF_CALLSIGN_LENGTH/2, m_conf.getYsfRadioID().c_str(), YSF_CALLSIGN_LENGTH/2);
- 						ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, dch);
-						break;
-					case 1:
-						ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, (unsigned char*)m_netSrc.c_str());
-						break;
-					case 2:
-						ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, (unsigned char*)m_netDst.c_str());
-						break;
-					case 5:
-						memset(dch, ' ', YSF_CALLSIGN_LENGTH/2);
- 						memcpy(dch + YSF_CALLSIGN_LENGTH/2, m_conf.getYsfRadioID().c_str(), YSF_CALLSIGN_LENGTH/2);
- 						ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, dch);	// Rem3/4
- 						break;
-					case 6: {
-							unsigned char dt1[10U] = {0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U};
-							for (unsigned int i = 0U; i < m_conf.getYsfDT1().size() && i < 10U; i++)
-								dt1[i] = m_conf.getYsfDT1()[i];
-							ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, dt1);
-						}
-						break;
-					case 7: {
-							unsigned char dt2[10U] = {0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U};
-							for (unsigned int i = 0U; i < m_conf.getYsfDT2().size() && i < 10U; i++)
-								dt2[i] = m_conf.getYsfDT2()[i];
-							ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, dt2);
-						}
-						break;
-					default:
-						ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, (const unsigned char*)"          ");
-				}
+		else if (ysfFrameType == TAG_EOT) {
+			::memcpy(m_ysfFrame + 0U, "YSFD", 4U);
+			::memcpy(m_ysfFrame + 4U, m_ysfNetwork->getCallsign().c_str(), YSF_CALLSIGN_LENGTH);
+			::memcpy(m_ysfFrame + 14U, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
+			::memcpy(m_ysfFrame + 24U, "ALL       ", YSF_CALLSIGN_LENGTH);
+			m_ysfFrame[34U] = m_ysfCnt; // Net frame counter
 
-				// Set the FICH
-				fich.setFI(YSF_FI_COMMUNICATIONS);
-				fich.setCS(m_conf.getFICHCallSign());
- 				fich.setCM(m_conf.getFICHCallMode());
- 				fich.setBN(0U);
- 				fich.setBT(0U);
- 				fich.setFN(fn);
-				fich.setFT(m_conf.getFICHFrameTotal());
- 				fich.setDev(0U);
-				fich.setMR(m_conf.getFICHMessageRoute());
- 				fich.setVoIP(m_conf.getFICHVOIP());
- 				fich.setDT(m_conf.getFICHDataType());
- 				fich.setSQL(m_conf.getFICHSQLType());
- 				fich.setSQ(m_conf.getFICHSQLCode());
- 				fich.encode(m_ysfFrame + 35U);
-
-				// Net frame counter
-				m_ysfFrame[34U] = (ysf_cnt & 0x7FU) << 1;
-
-				// Send data to MMDVMHost
-				m_ysfNetwork->write(m_ysfFrame);
-
-				ysf_cnt++;
-				ysfWatch.start();
-			}
+			CSync::addYSFSync(m_ysfFrame + 35U);
+
+			// Set the FICH
+			CYSFFICH fich;
+			fich.setFI(YSF_FI_TERMINATOR);
+			fich.setCS(m_conf.getFICHCallSign());
+ 			fich.setCM(m_conf.getFICHCallMode());
+ 			fich.setBN(0U);
+ 			fich.setBT(0U);
+ 			fich.setFN(0U);
+			fich.setFT(m_conf.getFICHFrameTotal());
+ 			fich.setDev(0U);
+			fich.setMR(m_conf.getFICHMessageRoute());
+ 			fich.setVoIP(m_conf.getFICHVOIP());
+ 			fich.setDT(m_conf.getFICHDataType());
+ 			fich.setSQL(m_conf.getFICHSQLType());
+ 			fich.setSQ(m_conf.getFICHSQLCode());
+			fich.encode(m_ysfFrame + 35U);
+
+			unsigned char csd1[20U], csd2[20U];
+			memset(csd1, '*', YSF_CALLSIGN_LENGTH/2);
+ 			memcpy(csd1 + YSF_CALLSIGN_LENGTH/2, m_conf.getYsfRadioID().c_str(), YSF_CALLSIGN_LENGTH/2);
+			memcpy(csd1 + YSF_CALLSIGN_LENGTH, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
+			memset(csd2, ' ', YSF_CALLSIGN_LENGTH + YSF_CALLSIGN_LENGTH);
+
+			CYSFPayload payload;
+			payload.writeHeader(m_ysfFrame + 35U, csd1, csd2);
+
+			if (!writeYSF(ysfFrameType))
+				m_ysfAssembleStage.drop();
 		}
+		else if (ysfFrameType == TAG_DATA) {
+			CYSFFICH fich;
+			CYSFPayload ysfPayload;
+			unsigned char dch[10U];
 
-		stopWatch.start();
+			unsigned int fn = (m_ysfCnt - 1U) % (m_conf.getFICHFrameTotal() + 1);
 
-		m_ysfNetwork->clock(ms);
-		m_dmrNetwork->clock(ms);
+			::memcpy(m_ysfFrame + 0U, "YSFD", 4U);
+			::memcpy(m_ysfFrame + 4U, m_ysfNetwork->getCallsign().c_str(), YSF_CALLSIGN_LENGTH);
+			::memcpy(m_ysfFrame + 14U, m_netSrc.c_str(), YSF_CALLSIGN_LENGTH);
+			::memcpy(m_ysfFrame + 24U, "ALL       ", YSF_CALLSIGN_LENGTH);
 
-		if (m_wiresX != NULL)
-			m_wiresX->clock(ms);
+			// Add the YSF Sync
+			CSync::addYSFSync(m_ysfFrame + 35U);
 
-		if (m_gps != NULL)
-			m_gps->clock(ms);
+			switch (fn) {
+				case 0:
+					memset(dch, '*', YSF_CALLSIGN_LENGTH/2);
+ 					memcpy(dch + YSF_CALLSIGN_LENGTH/2, m_conf.getYsfRadioID().c_str(), YSF_CALLSIGN_LENGTH/2);
+ 					ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, dch);
+					break;
+				case 1:
+					ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, (unsigned char*)m_netSrc.c_str());
+					break;
+				case 2:
+					ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, (unsigned char*)m_netDst.c_str());
+					break;
+				case 5:
+					memset(dch, ' ', YSF_CALLSIGN_LENGTH/2);
+ 					memcpy(dch + YSF_CALLSIGN_LENGTH/2, m_conf.getYsfRadioID().c_str(), YSF_CALLSIGN_LENGTH/2);
+ 					ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, dch);	// Rem3/4
+ 					break;
+				case 6: {
+						unsigned char dt1[10U] = {0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U};
+						for (unsigned int i = 0U; i < m_conf.getYsfDT1().size() && i < 10U; i++)
+							dt1[i] = m_conf.getYsfDT1()[i];
+						ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, dt1);
+					}
+					break;
+				case 7: {
+						unsigned char dt2[10U] = {0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U};
+						for (unsigned int i = 0U; i < m_conf.getYsfDT2().size() && i < 10U; i++)
+							dt2[i] = m_conf.getYsfDT2()[i];
+						ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, dt2);
+					}
+					break;
+				default:
+					ysfPayload.writeVDMode2Data(m_ysfFrame + 35U, (const unsigned char*)"          ");
+			}
 
-		pollTimer.clock(ms);
-		if (pollTimer.isRunning() && pollTimer.hasExpired()) {
-			m_ysfNetwork->writePoll();
-			pollTimer.start();
+			// Set the FICH
+			fich.setFI(YSF_FI_COMMUNICATIONS);
+			fich.setCS(m_conf.getFICHCallSign());
+ 			fich.setCM(m_conf.getFICHCallMode());
+ 			fich.setBN(0U);
+ 			fich.setBT(0U);
+ 			fich.setFN(fn);
+			fich.setFT(m_conf.getFICHFrameTotal());
+ 			fich.setDev(0U);
+			fich.setMR(m_conf.getFICHMessageRoute());
+ 			fich.setVoIP(m_conf.getFICHVOIP());
+ 			fich.setDT(m_conf.getFICHDataType());
+ 			fich.setSQL(m_conf.getFICHSQLType());
+ 			fich.setSQ(m_conf.getFICHSQLCode());
+ 			fich.encode(m_ysfFrame + 35U);
+
+			// Net frame counter
+			m_ysfFrame[34U] = (m_ysfCnt & 0x7FU) << 1;
+
+			// Send data to MMDVMHost
+			if (!writeYSF(ysfFrameType))
+				m_ysfAssembleStage.drop();
+
+			m_ysfCnt++;
 		}
-
-		ysfWatchdog.clock(ms);
-		if (ysfWatchdog.isRunning() && ysfWatchdog.hasExpired()) {
-			int extraFrames = (m_hangTime / 100U) - m_ysfFrames;
-			for (int i = 0U; i < extraFrames; i++)
-				m_conv.putDummyYSF();
-			ysfWatchdog.stop();
+		if (ysfFrameType == TAG_NODATA) {
+			m_ysfPacer.skip();
+		} else {
+			m_ysfPacer.next();
+			if (ysfFrameType == TAG_EOT)
+				m_ysfPacer.logStats();
+			frames++;
 		}
+	}
 
-		if (m_xlxReflectors != NULL)
-			m_xlxReflectors->clock(ms);
+	m_ysfAssembleStage.end(frames);
+}
 
-		if (ms < 5U)
-			CThread::sleep(5U);
-	}
+void CYSF2DMR::ysfEgress()
+{
+	m_ysfEgressStage.begin(m_ysfTxQueue.dataSize());
 
-	m_ysfNetwork->close();
-	m_dmrNetwork->close();
-	
-	if (m_APRS != NULL) {
-		m_APRS->stop();
-		delete m_APRS;
+	unsigned int frames = 0U;
+
+	CPipelineFrame frame;
+	while (m_ysfTxQueue.pop(frame)) {
+		m_ysfNetwork->writeCall(frame.m_data, frame.m_tag == TAG_EOT);
+		frames++;
+
+		if (frame.m_tag == TAG_EOT) {
+			m_ysfEgressStage.end(frames);
+			frames = 0U;
+
+			m_dmrIngressStage.logStats();
+			m_dmrDecodeStage.logStats();
+			m_ysfAssembleStage.logStats();
+			m_ysfEgressStage.logStats();
+
+			m_ysfEgressStage.begin(m_ysfTxQueue.dataSize());
+		}
 	}
-	
-	if (m_gps != NULL) {
-		m_gps->close();
-		delete m_gps;
+
+	m_ysfEgressStage.end(frames);
+}
+
+bool CYSF2DMR::writeYSF(unsigned char tag)
+{
+	CPipelineFrame frame;
+	frame.m_tag    = tag;
+	frame.m_count  = 1U;
+	frame.m_length = 155U;
+	::memcpy(frame.m_data, m_ysfFrame, 155U);
+
+	return m_ysfTxQueue.push(frame);
+}
+
+bool CYSF2DMR::writeVoice(CSPSCQueue<CPipelineFrame>& queue, unsigned char tag, const unsigned char* data, unsigned int length, unsigned int count)
+{
+	assert(length <= PIPELINE_FRAME_LENGTH);
+
+	CPipelineFrame frame;
+	frame.m_tag    = tag;
+	frame.m_count  = count;
+	frame.m_length = length;
+	if (data != NULL)
+		::memcpy(frame.m_data, data, length);
+
+	return queue.push(frame);
+}
+
+void CYSF2DMR::networkWatchdogExpired()
+{
+	LogDebug("Network watchdog has expired, %.1f seconds", float(m_dmrFrames) / 16.667F);
+	m_dmrNetwork->reset(m_slot);
+	m_dmrFrames = 0U;
+	m_dmrinfo = false;
+}
+
+void CYSF2DMR::ysfWatchdogExpired()
+{
+	int extraFrames = (m_hangTime / 100U) - m_ysfFrames;
+	if (extraFrames > 0 && !writeVoice(m_ysfVoiceQueue, TAG_LOST, NULL, 0U, extraFrames))
+		m_ysfDecodeStage.drop();
+}
+
+void CYSF2DMR::pollExpired()
+{
+	m_ysfNetwork->writePoll();
+	m_pollTimer.start();
+}
+
+void CYSF2DMR::processWiresX(const unsigned char* buffer, unsigned char fi, unsigned char dt, unsigned char fn, unsigned char ft)
+{
+	unsigned int tglistOpt = 0U;
+
+	WX_STATUS status = m_wiresX->process(buffer + 35U, buffer + 14U, fi, dt, fn, ft);
+	m_ysfSrc = getSrcYSF(buffer);
+
+	switch (status) {
+		case WXS_CONNECT:
+			m_srcid = findYSFID(m_ysfSrc, false);
+
+			m_ptt_dstid = m_wiresX->getDstID();
+			tglistOpt = m_wiresX->getOpt(m_ptt_dstid);
+
+			switch (tglistOpt) {
+				case 0:
+					m_ptt_pc = false;
+					m_dstid = m_wiresX->getFullDstID();
+					m_ptt_dstid = m_dstid;
+					m_dmrflco = FLCO_GROUP;
+					LogMessage("Connect to TG %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
+					break;
+			
+				case 1:
+					m_ptt_pc = true;
+					m_dstid = 9U;
+					m_dmrflco = FLCO_GROUP;
+					LogMessage("Connect to REF %d has been requested by %s", m_ptt_dstid, m_ysfSrc.c_str());
+					break;
+				
+				case 2:
+					m_ptt_dstid = 0;
+					m_ptt_pc = true;
+					m_dstid = m_wiresX->getFullDstID();
+					m_dmrflco = FLCO_USER_USER;
+					LogMessage("Connect to %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
+					break;
+			
+				default:
+					m_ptt_pc = false;
+					m_dstid = m_wiresX->getFullDstID();
+					m_ptt_dstid = m_dstid;
+					m_dmrflco = FLCO_GROUP;
+					LogMessage("Connect to TG %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
+					break;
+			}
+
+			if (m_enableUnlink && (tglistOpt != 2) && (m_ptt_dstid != m_idUnlink) && (m_ptt_dstid != 5000)) {
+				LogMessage("Sending DMR Disconnect: Src: %s Dst: %s%d", m_ysfSrc.c_str(), m_flcoUnlink == FLCO_GROUP ? "TG " : "", m_idUnlink);
+
+				SendDummyDMR(m_srcid, m_idUnlink, m_flcoUnlink);
+
+				m_unlinkReceived = false;
+				m_tgConnectState = WAITING_UNLINK;
+			} else 
+				m_tgConnectState = SEND_REPLY;
+
+			m_TGChange.start();
+			break;
+
+		case WXS_DX:
+			break;
+
+		case WXS_DISCONNECT:
+			LogMessage("Disconnect has been requested by %s", m_ysfSrc.c_str());
+
+			m_srcid = findYSFID(m_ysfSrc, false);
+			m_ptt_dstid = 9U;
+			m_ptt_pc = false;
+			m_dstid = 9U;
+			m_dmrflco = FLCO_GROUP;
+
+			SendDummyDMR(m_srcid, m_idUnlink, m_flcoUnlink);
+
+			m_tgConnectState = WAITING_UNLINK;
+
+			m_TGChange.start();
+			break;
+
+		default:
+			break;
 	}
-	
-	delete m_dmrNetwork;
-	delete m_ysfNetwork;
 
-	if (m_wiresX != NULL) {
-		delete m_wiresX;
-		delete m_dtmf;
+	status = WXS_NONE;
+
+	if (dt == YSF_DT_VD_MODE2)
+		status = m_dtmf->decodeVDMode2(buffer + 35U, (buffer[34U] & 0x01U) == 0x01U);
+
+	switch (status) {
+		case WXS_CONNECT:
+			m_srcid = findYSFID(m_ysfSrc, false);
+
+			m_ptt_dstid = m_dtmf->getDstID();
+			tglistOpt = m_wiresX->getOpt(m_ptt_dstid);
+
+			switch (tglistOpt) {
+				case 0:
+					m_ptt_pc = false;
+					m_dstid = m_wiresX->getFullDstID();
+					m_ptt_dstid = m_dstid;
+					m_dmrflco = FLCO_GROUP;
+					LogMessage("Connect to TG %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
+					break;
+			
+				case 1:
+					m_ptt_pc = true;
+					m_dstid = 9U;
+					m_dmrflco = FLCO_GROUP;
+					LogMessage("Connect to REF %d has been requested by %s", m_ptt_dstid, m_ysfSrc.c_str());
+					break;
+				
+				case 2:
+					m_ptt_dstid = 0;
+					m_ptt_pc = true;
+					m_dstid = m_wiresX->getFullDstID();
+					m_dmrflco = FLCO_USER_USER;
+					LogMessage("Connect to %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
+					break;
+			
+				default:
+					m_ptt_pc = false;
+					m_dstid = m_wiresX->getFullDstID();
+					m_ptt_dstid = m_dstid;
+					m_dmrflco = FLCO_GROUP;
+					LogMessage("Connect to TG %d has been requested by %s", m_dstid, m_ysfSrc.c_str());
+					break;
+			}
+
+			LogMessage("Connect to %s%d via DTMF has been requested by %s", m_ptt_pc ? "" : "TG ", m_ptt_dstid, m_ysfSrc.c_str());
+
+			if (m_enableUnlink && (tglistOpt != 2) && (m_ptt_dstid != m_idUnlink) && (m_ptt_dstid != 5000)) {
+				LogMessage("Sending DMR Disconnect: Src: %s Dst: %s%d", m_ysfSrc.c_str(), m_flcoUnlink == FLCO_GROUP ? "TG " : "", m_idUnlink);
+
+				SendDummyDMR(m_srcid, m_idUnlink, m_flcoUnlink);
+			
+				m_unlinkReceived = false;
+				m_tgConnectState = WAITING_UNLINK;
+			} else
+				m_tgConnectState = SEND_REPLY;
+
+			m_TGChange.start();
+			break;
+
+		case WXS_DISCONNECT:
+			LogMessage("Disconnect via DTMF has been requested by %s", m_ysfSrc.c_str());
+
+			m_srcid = findYSFID(m_ysfSrc, false);
+			m_ptt_dstid = 9U;
+			m_ptt_pc = false;
+			m_dstid = 9U;
+			m_dmrflco = FLCO_GROUP;
+
+			SendDummyDMR(m_srcid, m_idUnlink, m_flcoUnlink);
+
+			m_tgConnectState = WAITING_UNLINK;
+			m_TGChange.start();
+			break;
+
+		default:
+			break;
 	}
+}
+
+void CYSF2DMR::createWiresX()
+{
+	if (!m_enableWiresX)
+		return;
 
-	if (m_xlxReflectors != NULL)
-		delete m_xlxReflectors;
+	bool makeUpper = m_conf.getWiresXMakeUpper();
+	m_wiresX = new CWiresX(m_wheel, m_callsign, m_suffix, m_ysfNetwork, m_TGList, makeUpper);
+	m_dtmf = new CDTMF;
 
-	::LogFinalise();
+	std::string name = m_conf.getDescription();
+	unsigned int rxFrequency = m_conf.getRxFrequency();
+	unsigned int txFrequency = m_conf.getTxFrequency();
+	int reflector = m_conf.getDMRDstId();
 
-	return 0;
+	m_wiresX->setInfo(name, txFrequency, rxFrequency, reflector);
 }
 
 void CYSF2DMR::createGPS()
 {
+	if (!m_conf.getAPRSEnabled())
+		return;
+
 	std::string hostname = m_conf.getAPRSServer();
 	unsigned int port    = m_conf.getAPRSPort();
 	std::string password = m_conf.getAPRSPassword();
@@ -1162,7 +1505,7 @@ void CYSF2DMR::createGPS()
 	LogMessage("    Passworwd: %s", password.c_str());
 	LogMessage("    Description: %s", desc.c_str());
 
-	m_gps = new CGPS(callsign, m_suffix, password, hostname, port);
+	m_gps = new CGPS(m_wheel, callsign, m_suffix, password, hostname, port);
 
 	unsigned int txFrequency = m_conf.getTxFrequency();
 	unsigned int rxFrequency = m_conf.getRxFrequency();
@@ -1192,7 +1535,7 @@ void CYSF2DMR::SendDummyDMR(unsigned int srcid,unsigned int dstid, FLCO dmr_flco
 	CDMRLC dmrLC = CDMRLC(dmr_flco, srcid, dstid);
 
 	// Build DMR header
-	dmrdata.setSlotNo(2U);
+	dmrdata.setSlotNo(m_slot);
 	dmrdata.setSrcId(srcid);
 	dmrdata.setDstId(dstid);
 	dmrdata.setFLCO(dmr_flco);
@@ -1301,6 +1644,93 @@ std::string CYSF2DMR::getSrcYSF(const unsigned char* buffer)
 	return trimmed;
 }
 
+bool CYSF2DMR::createYSFNetwork()
+{
+	bool debug               = m_conf.getDMRNetworkDebug();
+	in_addr dstAddress       = CUDPSocket::lookup(m_conf.getDstAddress());
+	unsigned int dstPort     = m_conf.getDstPort();
+	std::string localAddress = m_conf.getLocalAddress();
+	unsigned int localPort   = m_conf.getLocalPort();
+
+	m_ysfNetwork = new CYSFNetwork(localAddress, localPort, m_callsign, debug);
+	m_ysfFd = -1;
+	m_ysfNetwork->setDestination(dstAddress, dstPort);
+	m_ysfNetwork->setOpenFanOut(m_conf.getFanOutOpen());
+
+	if (m_simulation != NULL) {
+		m_simulation->getYSF().setPeer(dstAddress, dstPort);
+		m_ysfNetwork->setTransport(&m_simulation->getYSF());
+	}
+
+	if (m_conf.getRealTimeEnabled())
+		m_ysfNetwork->setRealTime(m_conf.getRealTimePriority(), m_conf.getRealTimeYSFNetworkCPU(), m_conf.getRealTimeBusyPoll(), m_conf.getRealTimeIOUring());
+
+	unsigned int shards = m_conf.getShards();
+	if (shards > 1U && m_simulation != NULL) {
+		LogWarning("Sharding is not used in a simulation");
+	} else if (shards > 1U) {
+		LogMessage("    Shards: %u", shards);
+		m_ysfNetwork->setSharding(shards, getShardKey(m_conf));
+	}
+
+	// Keep the socket of the old process if it is bound where we would bind
+	char local[80U];
+	::sprintf(local, "%s:%u", localAddress.c_str(), localPort);
+
+	bool ret;
+	if (m_upgrade != NULL && m_upgrade->get("ysf.local") == local)
+		ret = m_ysfNetwork->takeOver(*m_upgrade);
+	else
+		ret = m_ysfNetwork->open();
+	if (!ret) {
+		delete m_ysfNetwork;
+		m_ysfNetwork = NULL;
+		return false;
+	}
+
+	setFanOut(m_conf.getFanOut(), std::vector<std::string>());
+
+	return true;
+}
+
+void CYSF2DMR::setFanOut(const std::vector<std::string>& fanOut, const std::vector<std::string>& oldFanOut)
+{
+	// Those still listed keep their counters
+	for (std::vector<std::string>::const_iterator it = oldFanOut.begin(); it != oldFanOut.end(); ++it) {
+		if (std::find(fanOut.begin(), fanOut.end(), *it) != fanOut.end())
+			continue;
+
+		in_addr address;
+		unsigned int port;
+		if (getAddressPort(*it, address, port))
+			m_ysfNetwork->removeSubscriber(address, port);
+	}
+
+	for (std::vector<std::string>::const_iterator it = fanOut.begin(); it != fanOut.end(); ++it) {
+		in_addr address;
+		unsigned int port;
+		if (getAddressPort(*it, address, port))
+			m_ysfNetwork->addSubscriber(address, port);
+		else
+			LogWarning("Invalid FanOut entry \"%s\", it should be host:port", it->c_str());
+	}
+}
+
+bool CYSF2DMR::getAddressPort(const std::string& entry, in_addr& address, unsigned int& port) const
+{
+	std::string::size_type pos = entry.rfind(':');
+	if (pos == std::string::npos || pos == 0U)
+		return false;
+
+	port = (unsigned int)::atoi(entry.substr(pos + 1U).c_str());
+	if (port == 0U || port > 65535U)
+		return false;
+
+	address = CUDPSocket::lookup(entry.substr(0U, pos));
+
+	return address.s_addr != INADDR_NONE;
+}
+
 bool CYSF2DMR::createDMRNetwork()
 {
 	std::string address  = m_conf.getDMRNetworkAddress();
@@ -1311,32 +1741,38 @@ bool CYSF2DMR::createDMRNetwork()
 	std::string password = m_conf.getDMRNetworkPassword();
 	bool debug           = m_conf.getDMRNetworkDebug();
 	unsigned int jitter  = m_conf.getDMRNetworkJitter();
-	bool slot1           = false;
-	bool slot2           = true;
-	bool duplex          = false;
 	HW_TYPE hwType       = HWT_MMDVM;
 
+	// Slot 2 alone logs in as a simplex hotspot, as it always has, anything
+	// else as a duplex repeater
+	bool slot1  = m_slot == 1U || (m_partner != NULL && m_partner->m_slot == 1U);
+	bool slot2  = m_slot == 2U || (m_partner != NULL && m_partner->m_slot == 2U);
+	bool duplex = slot1;
+
 	m_srcHS = m_conf.getDMRId();
 	m_colorcode = 1U;
+	m_dmrAssembler.setSlot(m_slot);
+	m_dmrAssembler.setColorCode(m_colorcode);
 	m_TGList = m_conf.getDMRTGListFile();
 	m_idUnlink = m_conf.getDMRNetworkIDUnlink();
 	bool pcUnlink = m_conf.getDMRNetworkPCUnlink();
 	m_enableWiresX = m_conf.getEnableWiresX();
 
-	if (m_xlxmodule.empty()) {
-		m_dstid = m_conf.getDMRDstId();
-		m_dmrpc = m_conf.getDMRPC();
-	}
-	else {
-		const char *xlxmod = m_xlxmodule.c_str();
-		m_dstid = 4000 + xlxmod[0] - 64;
-		m_dmrpc = 0;
+	getStartupDst(m_conf, m_dstid, m_dmrpc);
 
-		CReflector* reflector = m_xlxReflectors->find(m_xlxrefl);
-		if (reflector == NULL)
+	if (!m_xlxmodule.empty()) {
+		// The new process of an upgrade stays with the reflector it was handed
+		CReflector reflector;
+		unsigned int rtt;
+		if (m_upgrade != NULL && m_upgrade->has("link.xlxrefl"))
+			m_xlxrefl = (unsigned int)m_upgrade->getInt("link.xlxrefl");
+		else if (m_xlxProber != NULL && m_xlxProber->getBest(reflector, rtt))
+			m_xlxrefl = reflector.m_id;
+
+		if (!m_xlxReflectors->find(m_xlxrefl, reflector))
 			return false;
 		
-		address = reflector->m_address;
+		address = reflector.m_address;
 	}
 
 	if (pcUnlink)
@@ -1366,6 +1802,7 @@ bool CYSF2DMR::createDMRNetwork()
 		LogMessage("    Address: %s", address.c_str());
 	}
 	LogMessage("    Port: %u", port);
+	LogMessage("    Slot: %u", m_slot);
 	LogMessage("    Send %s%u Disconect: %s", pcUnlink ? "" : "TG ", m_idUnlink, (enableUnlink) ? "Yes":"No");
 	LogMessage("    TGList file: %s", m_TGList.c_str());
 	if (local > 0U)
@@ -1374,7 +1811,20 @@ bool CYSF2DMR::createDMRNetwork()
 		LogMessage("    Local: random");
 	LogMessage("    Jitter: %ums", jitter);
 
-	m_dmrNetwork = new CDMRNetwork(address, port, local, m_srcHS, password, duplex, VERSION, debug, slot1, slot2, hwType, jitter);
+	if (m_owner != NULL) {
+		LogMessage("    Sharing the login of session %s", m_owner->m_name.c_str());
+		m_dmrNetwork = m_owner->m_dmrNetwork;
+		m_dmrFd = -1;
+		return m_dmrNetwork != NULL;
+	}
+
+	m_dmrNetwork = new CDMRNetwork(m_wheel, address, port, local, m_srcHS, password, duplex, VERSION, debug, slot1, slot2, hwType, jitter);
+	m_dmrFd = -1;
+
+	if (m_simulation != NULL) {
+		m_simulation->getDMR().setPeer(CUDPSocket::lookup(address), port);
+		m_dmrNetwork->setTransport(&m_simulation->getDMR());
+	}
 
 	std::string options = m_conf.getDMRNetworkOptions();
 	if (!options.empty()) {
@@ -1382,6 +1832,25 @@ bool CYSF2DMR::createDMRNetwork()
 		m_dmrNetwork->setOptions(options);
 	}
 
+	std::vector<std::string> standby = m_conf.getDMRNetworkStandby();
+	if (!standby.empty() && m_simulation != NULL) {
+		LogWarning("Standby masters are not used in a simulation");
+	} else if (!standby.empty()) {
+		for (std::vector<std::string>::const_iterator it = standby.begin(); it != standby.end(); ++it) {
+			in_addr addr;
+			unsigned int standbyPort;
+			if (getAddressPort(*it, addr, standbyPort)) {
+				LogMessage("    Standby: %s", it->c_str());
+				m_dmrNetwork->addStandby(::inet_ntoa(addr), standbyPort);
+			} else {
+				LogWarning("Invalid Standby entry \"%s\", it should be host:port", it->c_str());
+			}
+		}
+
+		LogMessage("    Failover Time: %ums", m_conf.getDMRNetworkFailoverTime());
+		m_dmrNetwork->setFailoverTime(m_conf.getDMRNetworkFailoverTime());
+	}
+
 	unsigned int rxFrequency = m_conf.getRxFrequency();
 	unsigned int txFrequency = m_conf.getTxFrequency();
 	unsigned int power       = m_conf.getPower();
@@ -1406,7 +1875,16 @@ bool CYSF2DMR::createDMRNetwork()
 
 	m_dmrNetwork->setConfig(m_callsign, rxFrequency, txFrequency, power, m_colorcode, latitude, longitude, height, location, description, url);
 
-	bool ret = m_dmrNetwork->open();
+	m_dmrNetwork->setArbitration(getArbitration(m_conf), m_conf.getDMRNetworkPriorityIds());
+
+	if (m_conf.getRealTimeEnabled())
+		m_dmrNetwork->setRealTime(m_conf.getRealTimePriority(), m_conf.getRealTimeDMRNetworkCPU(), m_conf.getRealTimeBusyPoll(), m_conf.getRealTimeIOUring());
+
+	bool ret;
+	if (m_upgrade != NULL)
+		ret = m_dmrNetwork->takeOver(*m_upgrade);
+	else
+		ret = m_dmrNetwork->open();
 	if (!ret) {
 		delete m_dmrNetwork;
 		m_dmrNetwork = NULL;
@@ -1418,6 +1896,413 @@ bool CYSF2DMR::createDMRNetwork()
 	return true;
 }
 
+void CYSF2DMR::createDMRTargets()
+{
+	std::vector<CDMRTargetConf> targets = m_conf.getDMRTargets();
+	if (targets.empty())
+		return;
+
+	if (m_simulation != NULL) {
+		LogWarning("The DMR targets are not used in a simulation");
+		return;
+	}
+
+	unsigned int rxFrequency = m_conf.getRxFrequency();
+	unsigned int txFrequency = m_conf.getTxFrequency();
+	unsigned int power       = m_conf.getPower();
+	float latitude           = m_conf.getLatitude();
+	float longitude          = m_conf.getLongitude();
+	int height               = m_conf.getHeight();
+	std::string location     = m_conf.getLocation();
+	std::string description  = m_conf.getDescription();
+	std::string url          = m_conf.getURL();
+
+	for (std::vector<CDMRTargetConf>::const_iterator it = targets.begin(); it != targets.end(); ++it) {
+		unsigned int id = it->m_id != 0U ? it->m_id : m_srcHS;
+
+		CDMRTarget* target = new CDMRTarget(m_wheel, *it, id, m_colorcode, DMR_FRAME_PER, MAX_CATCH_UP, m_conf.getDMRNetworkJitter(), m_conf.getDMRNetworkDebug());
+
+		LogMessage("DMR Target %s", it->m_name.c_str());
+		LogMessage("    ID: %u", id);
+		LogMessage("    Address: %s", it->m_address.c_str());
+		LogMessage("    Port: %u", it->m_port);
+		LogMessage("    Slot: %u", it->m_slot);
+		if (!it->m_xlxModule.empty())
+			LogMessage("    XLX Module: %s (%u)", it->m_xlxModule.c_str(), target->getDstId());
+		else
+			LogMessage("    DstID: %s%u", it->m_pc ? "" : "TG ", it->m_dstId);
+
+		target->getNetwork().setConfig(m_callsign, rxFrequency, txFrequency, power, m_colorcode, latitude, longitude, height, location, description, url);
+
+		if (m_conf.getRealTimeEnabled())
+			target->getNetwork().setRealTime(m_conf.getRealTimePriority(), m_conf.getRealTimeDMRNetworkCPU(), m_conf.getRealTimeBusyPoll(), m_conf.getRealTimeIOUring());
+
+		if (!target->open()) {
+			LogError("Cannot open the DMR network of target %s", it->m_name.c_str());
+			delete target;
+			continue;
+		}
+
+		m_dmrTargets.push_back(target);
+	}
+}
+
+void CYSF2DMR::closeDMRTargets()
+{
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it) {
+		(*it)->close();
+		delete *it;
+	}
+
+	m_dmrTargets.clear();
+}
+
+ARB_POLICY CYSF2DMR::getArbitration(const CConf& conf) const
+{
+	std::string name = conf.getDMRNetworkArbitration();
+	std::vector<unsigned int> ids = conf.getDMRNetworkPriorityIds();
+
+	ARB_POLICY policy = ARB_HOLD;
+	if (name == "priority")
+		policy = ARB_PRIORITY;
+	else if (name == "last")
+		policy = ARB_LAST_HEARD;
+	else if (name != "hold")
+		LogWarning("Unknown Arbitration \"%s\", the first stream holds the slot", name.c_str());
+
+	LogMessage("    Arbitration: %s", policy == ARB_PRIORITY ? "priority" : (policy == ARB_LAST_HEARD ? "last heard" : "hold"));
+
+	if (policy == ARB_PRIORITY) {
+		std::string list;
+		for (std::vector<unsigned int>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+			char id[20U];
+			::sprintf(id, list.empty() ? "%u" : ", %u", *it);
+			list += id;
+		}
+
+		LogMessage("    Priority Ids: %s", list.empty() ? "none" : list.c_str());
+	}
+
+	return policy;
+}
+
+SHARD_KEY CYSF2DMR::getShardKey(const CConf& conf) const
+{
+	std::string name = conf.getShardKey();
+
+	SHARD_KEY key = SHARD_ADDRESS;
+	if (name == "callsign")
+		key = SHARD_CALLSIGN;
+	else if (name != "address")
+		LogWarning("Unknown ShardKey \"%s\", the source address is used", name.c_str());
+
+	LogMessage("    Shard Key: %s", key == SHARD_CALLSIGN ? "callsign" : "address");
+
+	return key;
+}
+
+void CYSF2DMR::getStartupDst(const CConf& conf, unsigned int& dstId, bool& pc) const
+{
+	std::string xlxmodule = conf.getDMRXLXModule();
+
+	if (xlxmodule.empty()) {
+		dstId = conf.getDMRDstId();
+		pc    = conf.getDMRPC();
+	} else {
+		dstId = 4000U + xlxmodule[0U] - 64U;
+		pc    = false;
+	}
+}
+
+bool CYSF2DMR::isIdle() const
+{
+	if (m_partner != NULL && !m_partner->isIdle())
+		return false;
+
+	if (m_ysfWatchdog.isRunning() || m_networkWatchdog.isRunning() || m_tgConnectState != NONE)
+		return false;
+
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it) {
+		if (!(*it)->isIdle())
+			return false;
+	}
+
+	// Hang time and jitter frames still waiting to be paced out belong to the last call
+	if (!m_ysfRxQueue.isEmpty() || !m_ysfVoiceQueue.isEmpty() || !m_dmrRxQueue.isEmpty() || !m_dmrVoiceQueue.isEmpty())
+		return false;
+
+	return m_conv.getDMRFrames() == 0U && m_conv.getYSFFrames() == 0U && m_dmrTxQueue.isEmpty() && m_ysfTxQueue.isEmpty();
+}
+
+bool CYSF2DMR::reloadConfig(const CConf& conf, CReflectors* reflectors)
+{
+	assert(reflectors != NULL);
+
+	CConf old = m_conf;
+	m_conf = conf;
+
+	CReflectors* oldReflectors = m_xlxReflectors;
+	m_xlxReflectors = reflectors;
+
+	if (conf.getDMRNetworkDebug() != old.getDMRNetworkDebug() || conf.getRealTimeYSFNetworkCPU() != old.getRealTimeYSFNetworkCPU() ||
+		conf.getRealTimeDMRNetworkCPU() != old.getRealTimeDMRNetworkCPU())
+		LogWarning("The Debug and network CPU settings only change on a restart");
+
+	if (conf.getDMRNetworkSlot() != old.getDMRNetworkSlot())
+		LogWarning("The Slot only changes on a restart");
+
+	bool ysfChanged = conf.getCallsign() != old.getCallsign() || conf.getSuffix() != old.getSuffix() ||
+		conf.getLocalAddress() != old.getLocalAddress() || conf.getLocalPort() != old.getLocalPort() ||
+		conf.getShards() != old.getShards() || conf.getShardKey() != old.getShardKey();
+
+	bool infoChanged = conf.getRxFrequency() != old.getRxFrequency() || conf.getTxFrequency() != old.getTxFrequency() ||
+		conf.getPower() != old.getPower() || conf.getLatitude() != old.getLatitude() || conf.getLongitude() != old.getLongitude() ||
+		conf.getHeight() != old.getHeight() || conf.getLocation() != old.getLocation() ||
+		conf.getDescription() != old.getDescription() || conf.getURL() != old.getURL();
+
+	// Only a different master or different credentials need a new login
+	bool loginChanged = conf.getDMRNetworkAddress() != old.getDMRNetworkAddress() || conf.getDMRNetworkPort() != old.getDMRNetworkPort() ||
+		conf.getDMRNetworkLocal() != old.getDMRNetworkLocal() || conf.getDMRId() != old.getDMRId() ||
+		conf.getDMRNetworkPassword() != old.getDMRNetworkPassword() || conf.getDMRXLXFile() != old.getDMRXLXFile() ||
+		conf.getDMRXLXReflector() != old.getDMRXLXReflector() || conf.getDMRXLXModule().empty() != old.getDMRXLXModule().empty() ||
+		conf.getDMRNetworkStandby() != old.getDMRNetworkStandby() || conf.getDMRNetworkFailoverTime() != old.getDMRNetworkFailoverTime();
+
+	// The owner of a shared login decides where it goes
+	if (m_owner != NULL && loginChanged) {
+		LogWarning("The DMR login is shared with session %s, it follows the settings there", m_owner->m_name.c_str());
+		loginChanged = false;
+	}
+
+	bool wiresXChanged = ysfChanged || conf.getEnableWiresX() != old.getEnableWiresX() ||
+		conf.getDMRTGListFile() != old.getDMRTGListFile() || conf.getWiresXMakeUpper() != old.getWiresXMakeUpper();
+
+	bool gpsChanged = ysfChanged || infoChanged || conf.getAPRSEnabled() != old.getAPRSEnabled() ||
+		conf.getAPRSServer() != old.getAPRSServer() || conf.getAPRSPort() != old.getAPRSPort() ||
+		conf.getAPRSPassword() != old.getAPRSPassword() || conf.getAPRSCallsign() != old.getAPRSCallsign() ||
+		conf.getAPRSDescription() != old.getAPRSDescription();
+
+	m_remoteGateway = conf.getRemoteGateway();
+	m_hangTime      = conf.getHangTime();
+	m_dropUnknown   = conf.getDMRDropUnknown();
+	m_enableUnlink  = conf.getDMRNetworkEnableUnlink();
+
+	// Both hold a pointer to the YSF network, so they go before it does
+	if (wiresXChanged && m_wiresX != NULL) {
+		delete m_wiresX;
+		delete m_dtmf;
+		m_wiresX = NULL;
+		m_dtmf   = NULL;
+	}
+
+	if (gpsChanged && m_gps != NULL) {
+		m_gps->close();
+		delete m_gps;
+		m_gps = NULL;
+	}
+
+	if (ysfChanged) {
+		LogMessage("Reopening the YSF network");
+
+		m_ysfNetwork->close();
+		delete m_ysfNetwork;
+		m_ysfNetwork = NULL;
+
+		m_callsign = conf.getCallsign();
+		m_suffix   = conf.getSuffix();
+
+		if (!createYSFNetwork()) {
+			LogError("Cannot open the YSF network port, keeping the previous YSF settings");
+
+			m_conf     = old;
+			m_callsign = old.getCallsign();
+			m_suffix   = old.getSuffix();
+
+			bool ret = createYSFNetwork();
+
+			m_conf = conf;
+
+			if (!ret) {
+				LogError("Cannot reopen the YSF network port");
+				return false;
+			}
+		}
+	} else if (conf.getDstAddress() != old.getDstAddress() || conf.getDstPort() != old.getDstPort()) {
+		in_addr dstAddress   = CUDPSocket::lookup(conf.getDstAddress());
+		unsigned int dstPort = conf.getDstPort();
+
+		m_ysfNetwork->setDestination(dstAddress, dstPort);
+
+		if (m_simulation != NULL)
+			m_simulation->getYSF().setPeer(dstAddress, dstPort);
+	}
+
+	if (!ysfChanged) {
+		if (conf.getFanOut() != old.getFanOut())
+			setFanOut(conf.getFanOut(), old.getFanOut());
+
+		m_ysfNetwork->setOpenFanOut(conf.getFanOutOpen());
+	}
+
+	if (m_owner == NULL && (loginChanged || conf.getDMRXLXMirrors() != old.getDMRXLXMirrors() ||
+		conf.getDMRXLXModule() != old.getDMRXLXModule())) {
+		deleteXLXProber();
+		createXLXProber();
+	}
+
+	if (loginChanged) {
+		LogMessage("Logging in to the new DMR master");
+
+		m_dmrNetwork->close();
+		delete m_dmrNetwork;
+		m_dmrNetwork = NULL;
+
+		m_xlxConnected = false;
+
+		if (!createDMRNetwork()) {
+			LogError("Cannot open the DMR network, keeping the previous DMR settings");
+
+			m_conf          = old;
+			m_xlxReflectors = oldReflectors;
+
+			bool ret = createDMRNetwork();
+
+			m_conf          = conf;
+			m_xlxReflectors = reflectors;
+
+			if (!ret) {
+				LogError("Cannot reopen the DMR network");
+				return false;
+			}
+		}
+
+		m_dmrflco = m_dmrpc ? FLCO_USER_USER : FLCO_GROUP;
+
+		if (m_partner != NULL) {
+			m_partner->m_dmrNetwork   = m_dmrNetwork;
+			m_partner->m_xlxConnected = false;
+		}
+	} else {
+		if (m_owner == NULL && conf.getDMRNetworkJitter() != old.getDMRNetworkJitter()) {
+			LogMessage("    Jitter: %ums", conf.getDMRNetworkJitter());
+			m_dmrNetwork->setJitter(conf.getDMRNetworkJitter());
+		}
+
+		if (m_owner == NULL && (conf.getDMRNetworkArbitration() != old.getDMRNetworkArbitration() ||
+			conf.getDMRNetworkPriorityIds() != old.getDMRNetworkPriorityIds()))
+			m_dmrNetwork->setArbitration(getArbitration(conf), conf.getDMRNetworkPriorityIds());
+
+		// These are only sent to the master when logging in
+		if (m_owner == NULL && conf.getDMRNetworkOptions() != old.getDMRNetworkOptions())
+			m_dmrNetwork->setOptions(conf.getDMRNetworkOptions());
+
+		if (m_owner == NULL && (ysfChanged || infoChanged))
+			m_dmrNetwork->setConfig(m_callsign, conf.getRxFrequency(), conf.getTxFrequency(), conf.getPower(), m_colorcode, conf.getLatitude(),
+				conf.getLongitude(), conf.getHeight(), conf.getLocation(), conf.getDescription(), conf.getURL());
+
+		m_TGList       = conf.getDMRTGListFile();
+		m_idUnlink     = conf.getDMRNetworkIDUnlink();
+		m_flcoUnlink   = conf.getDMRNetworkPCUnlink() ? FLCO_USER_USER : FLCO_GROUP;
+		m_enableWiresX = conf.getEnableWiresX();
+
+		unsigned int oldDstId, newDstId;
+		bool oldPC, newPC;
+		getStartupDst(old, oldDstId, oldPC);
+		getStartupDst(conf, newDstId, newPC);
+
+		if (conf.getDMRXLXModule() != old.getDMRXLXModule()) {
+			// Relinks to the new module on the next pass
+			m_xlxmodule    = conf.getDMRXLXModule();
+			m_dstid        = newDstId;
+			m_dmrpc        = newPC;
+			m_dmrflco      = FLCO_GROUP;
+			m_xlxConnected = false;
+		} else if (newDstId != oldDstId || newPC != oldPC) {
+			// Follow the new startup destination unless Wires-X has moved away from the old one
+			if (m_dstid == oldDstId && (m_dmrflco == FLCO_USER_USER) == oldPC) {
+				m_dstid   = newDstId;
+				m_dmrpc   = newPC;
+				m_dmrflco = m_dmrpc ? FLCO_USER_USER : FLCO_GROUP;
+				LogMessage("    Startup DstID: %s%u", m_dmrpc ? "" : "TG ", m_dstid);
+			} else {
+				LogMessage("    Startup DstID: %s%u, staying on %s%u for now", newPC ? "" : "TG ", newDstId, m_dmrflco == FLCO_USER_USER ? "" : "TG ", m_dstid);
+			}
+		}
+	}
+
+	// Reloads only happen between calls, so the targets simply log in again
+	if (conf.getDMRTargets() != old.getDMRTargets() || ysfChanged || infoChanged || m_srcHS != old.getDMRId()) {
+		if (!m_dmrTargets.empty())
+			LogMessage("Logging in to the DMR targets again");
+
+		closeDMRTargets();
+		createDMRTargets();
+	}
+
+	if (wiresXChanged)
+		createWiresX();
+	else if (m_wiresX != NULL && (infoChanged || conf.getDMRDstId() != old.getDMRDstId()))
+		m_wiresX->setInfo(conf.getDescription(), conf.getTxFrequency(), conf.getRxFrequency(), conf.getDMRDstId());
+
+	if (gpsChanged)
+		createGPS();
+
+	return true;
+}
+
+void CYSF2DMR::handOver(CUpgrade& upgrade)
+{
+	// Datagrams wait in the socket buffers until one of the processes reads them again
+	m_ysfNetwork->handOver(upgrade);
+	if (m_owner == NULL)
+		m_dmrNetwork->handOver(upgrade);
+
+	// The targets log in again from the new process
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it)
+		(*it)->close();
+
+	char local[80U];
+	::sprintf(local, "%s:%u", m_conf.getLocalAddress().c_str(), m_conf.getLocalPort());
+	upgrade.set("ysf.local", local);
+
+	upgrade.set("link.dstid", m_dstid);
+	upgrade.set("link.pc", m_dmrflco == FLCO_USER_USER ? 1U : 0U);
+	upgrade.set("link.srcid", m_srcid);
+	upgrade.set("link.pttdstid", m_ptt_dstid);
+	upgrade.set("link.pttpc", m_ptt_pc ? 1U : 0U);
+	upgrade.set("link.xlxmodule", m_xlxmodule);
+	upgrade.set("link.xlxconnected", m_xlxConnected ? 1U : 0U);
+	upgrade.set("link.xlxrefl", m_xlxrefl);
+}
+
+void CYSF2DMR::resume()
+{
+	m_ysfNetwork->resume();
+	if (m_owner == NULL)
+		m_dmrNetwork->resume();
+
+	for (std::vector<CDMRTarget*>::const_iterator it = m_dmrTargets.begin(); it != m_dmrTargets.end(); ++it) {
+		if (!(*it)->open())
+			LogError("Cannot open the DMR network of target %s", (*it)->getName().c_str());
+	}
+}
+
+void CYSF2DMR::takeOver()
+{
+	assert(m_upgrade != NULL);
+
+	// The talkgroup link only carries over with the login to the master
+	if (m_dmrNetwork->isConnected() && m_upgrade->get("link.xlxmodule") == m_xlxmodule) {
+		m_dstid        = (unsigned int)m_upgrade->getInt("link.dstid");
+		m_dmrflco      = m_upgrade->getInt("link.pc") != 0ULL ? FLCO_USER_USER : FLCO_GROUP;
+		m_srcid        = (unsigned int)m_upgrade->getInt("link.srcid");
+		m_ptt_dstid    = (unsigned int)m_upgrade->getInt("link.pttdstid");
+		m_ptt_pc       = m_upgrade->getInt("link.pttpc") != 0ULL;
+		m_xlxConnected = m_upgrade->getInt("link.xlxconnected") != 0ULL;
+
+		LogMessage("Took over the link to %s%u", m_dmrflco == FLCO_USER_USER ? "" : "TG ", m_dstid);
+	}
+}
+
 void CYSF2DMR::writeXLXLink(unsigned int srcId, unsigned int dstId, CDMRNetwork* network)
 {
 	assert(network != NULL);
@@ -1473,3 +2358,117 @@ void CYSF2DMR::writeXLXLink(unsigned int srcId, unsigned int dstId, CDMRNetwork*
 	}
 }
 
+
+void CYSF2DMR::createXLXProber()
+{
+	std::vector<unsigned int> mirrors = m_conf.getDMRXLXMirrors();
+	if (m_owner != NULL || mirrors.empty() || m_conf.getDMRXLXModule().empty())
+		return;
+
+	if (m_simulation != NULL) {
+		LogWarning("The XLX mirrors are not probed in a simulation");
+		return;
+	}
+
+	mirrors.insert(mirrors.begin(), m_conf.getDMRXLXReflector());
+
+	CXLXProber* prober = new CXLXProber(m_conf.getDMRId(), m_conf.getDMRNetworkPort());
+
+	LogMessage("XLX Mirrors");
+
+	std::vector<unsigned int> added;
+	for (std::vector<unsigned int>::const_iterator it = mirrors.begin(); it != mirrors.end(); ++it) {
+		if (std::find(added.begin(), added.end(), *it) != added.end())
+			continue;
+
+		CReflector reflector;
+		if (!m_xlxReflectors->find(*it, reflector)) {
+			LogWarning("XLX%03u is not in the XLX host list, it is not probed", *it);
+			continue;
+		}
+
+		LogMessage("    XLX%03u: %s", reflector.m_id, reflector.m_address.c_str());
+		prober->add(reflector);
+		added.push_back(*it);
+	}
+
+	if (!prober->start()) {
+		LogError("Cannot start probing the XLX mirrors");
+		delete prober;
+		return;
+	}
+
+	m_xlxProber  = prober;
+	m_xlxRound   = 0U;
+	m_xlxStartup = m_upgrade == NULL;
+}
+
+void CYSF2DMR::deleteXLXProber()
+{
+	if (m_xlxProber == NULL)
+		return;
+
+	m_xlxProber->stop();
+	delete m_xlxProber;
+	m_xlxProber = NULL;
+}
+
+void CYSF2DMR::checkXLXMirrors()
+{
+	assert(m_xlxProber != NULL);
+
+	m_xlxProber->setActive(m_xlxrefl, m_dmrNetwork->getRTT());
+
+	// Only looked at once after each round of probes
+	unsigned int round = m_xlxProber->getRound();
+	if (round == m_xlxRound)
+		return;
+	m_xlxRound = round;
+
+	// The reflector in use has nothing to compare until a ping is answered
+	if (m_xlxStartup && m_dmrNetwork->isConnected() && m_dmrNetwork->getRTT() == 0U)
+		return;
+
+	bool startup = m_xlxStartup;
+	m_xlxStartup = false;
+
+	CReflector best;
+	unsigned int rtt;
+	if (!m_xlxProber->getBest(best, rtt) || best.m_id == m_xlxrefl)
+		return;
+
+	// Once logged in the reflector is kept until it is lost, except that a
+	// faster one found by the first round is still taken up between calls
+	if (m_dmrNetwork->isConnected()) {
+		if (!startup || !isIdle() || (m_partner != NULL && !m_partner->isIdle()))
+			return;
+	}
+
+	LogMessage("XLX, Moving from reflector XLX%03u to XLX%03u, %u.%03ums away", m_xlxrefl, best.m_id, rtt / 1000U, rtt % 1000U);
+
+	CDMRNetwork* network = m_dmrNetwork;
+	unsigned int current = m_xlxrefl;
+
+	network->close();
+
+	m_dmrNetwork   = NULL;
+	m_xlxConnected = false;
+
+	if (!createDMRNetwork()) {
+		LogError("Cannot open the DMR network for XLX%03u, staying with XLX%03u", best.m_id, current);
+
+		m_xlxrefl    = current;
+		m_dmrNetwork = network;
+		m_dmrFd      = -1;
+		m_dmrNetwork->open();
+	} else {
+		delete network;
+	}
+
+	m_dmrflco = m_dmrpc ? FLCO_USER_USER : FLCO_GROUP;
+
+	if (m_partner != NULL) {
+		m_partner->m_dmrNetwork   = m_dmrNetwork;
+		m_partner->m_xlxConnected = false;
+	}
+}
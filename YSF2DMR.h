@@ -25,19 +25,29 @@
 #include "ModeConv.h"
 #include "DMRNetwork.h"
 #include "DMREmbeddedData.h"
+#include "DMRAssembler.h"
+#include "DMRTarget.h"
 #include "DMRLC.h"
 #include "DMRFullLC.h"
 #include "DMREMB.h"
 #include "DMRLookup.h"
 #include "UDPSocket.h"
 #include "StopWatch.h"
+#include "EventLoop.h"
+#include "FramePacer.h"
+#include "PipelineStage.h"
+#include "StallDetector.h"
+#include "SPSCQueue.h"
 #include "Version.h"
 #include "YSFPayload.h"
 #include "YSFNetwork.h"
 #include "YSFFICH.h"
 #include "Reflectors.h"
+#include "XLXProber.h"
+#include "Simulation.h"
 #include "Thread.h"
-#include "Timer.h"
+#include "TimerWheel.h"
+#include "Upgrade.h"
 #include "Sync.h"
 #include "Utils.h"
 #include "Conf.h"
@@ -49,6 +59,9 @@
 #include "APRSReader.h"
 
 #include <string>
+#include <vector>
+
+class CConvertThread;
 
 enum TG_STATUS {
 	NONE,
@@ -57,23 +70,90 @@ enum TG_STATUS {
 	SEND_PTT
 };
 
+// One YSF to DMR bridge, a session of the gateway. It owns its networks,
+// conversion and timers, the lookups it is given are shared with the other
+// sessions and stay owned by the gateway.
 class CYSF2DMR
 {
 public:
-	CYSF2DMR(const std::string& configFile);
+	CYSF2DMR(const CConf& conf);
 	~CYSF2DMR();
 
-	int run();
+	// Run against a scenario instead of the network, call before open()
+	void setSimulation(CSimulation* simulation);
+
+	// Leaves the conversion stages to that thread rather than clock(), call
+	// before the session is first clocked
+	void setConverter(CConvertThread* converter);
+
+	void setLookup(CDMRLookup* lookup);
+	void setReflectors(CReflectors* reflectors);
+	// NULL unless aprs.fi positions are wanted
+	void setAPRS(CAPRSReader* aprs);
+
+	// The bridge on the other slot of the same DMR login, it uses the network
+	// of this one and is clocked along with it. Call before either is opened
+	void setPartner(CYSF2DMR* partner);
+	// The session that clocks this one, NULL unless it shares its login
+	CYSF2DMR* getOwner() const;
+
+	// Takes over from the process being upgraded when there is one
+	bool open(CUpgrade* upgrade);
+
+	// Adds the network sockets to the loop, only when they are new to it
+	void watch(CEventLoop& loop);
+	// Takes them out again, before the session moves to another loop
+	void unwatch(CEventLoop& loop);
+
+	// Datagrams waiting on either network, without a system call
+	bool hasData() const;
+
+	// Earliest of the frame and timer deadlines
+	unsigned long long getDeadline() const;
+
+	// One pass of the event loop
+	void clock(CStallDetector& stall);
+
+	// The conversion stages of both directions, on the converter thread
+	void convert();
+
+	// No call in progress or still being paced out
+	bool isIdle() const;
+
+	// False if the networks could not be opened again with either configuration
+	bool reloadConfig(const CConf& conf, CReflectors* reflectors);
+
+	// Stops reading and passes the sockets and the link to the new process
+	void handOver(CUpgrade& upgrade);
+	// Carries on after a failed hand over
+	void resume();
+
+	void close();
+
+	const std::string& getName() const;
+	// The XLX host list in use, the one before a failed reload included
+	CReflectors* getReflectors() const;
 
 private:
+	std::string      m_name;
 	std::string      m_callsign;
 	std::string      m_suffix;
 	CConf            m_conf;
+	CTimerWheel      m_wheel;
+	CSimulation*     m_simulation;
+	CUpgrade*        m_upgrade;
 	CWiresX*         m_wiresX;
 	CDMRNetwork*     m_dmrNetwork;
+	std::vector<CDMRTarget*> m_dmrTargets;
 	CYSFNetwork*     m_ysfNetwork;
+	int              m_dmrFd;
+	int              m_ysfFd;
+	unsigned int     m_slot;
+	CYSF2DMR*        m_owner;
+	CYSF2DMR*        m_partner;
 	CDMRLookup*      m_lookup;
 	CModeConv        m_conv;
+	CConvertThread*  m_converter;
 	unsigned int     m_colorcode;
 	unsigned int     m_srcHS;
 	unsigned int     m_srcid;
@@ -93,7 +173,7 @@ private:
 	CAPRSReader*     m_APRS;
 	unsigned int     m_dmrFrames;
 	unsigned int     m_ysfFrames;
-	CDMREmbeddedData m_EmbeddedLC;
+	CDMRAssembler    m_dmrAssembler;
 	std::string      m_TGList;
 	FLCO             m_dmrflco;
 	bool             m_dmrinfo;
@@ -104,17 +184,82 @@ private:
 	bool             m_xlxConnected;
 	CReflectors*     m_xlxReflectors;
 	unsigned int     m_xlxrefl;
+	CXLXProber*      m_xlxProber;
+	unsigned int     m_xlxRound;
+	bool             m_xlxStartup;
 	bool             m_remoteGateway;
 	unsigned int     m_hangTime;
 	bool             m_firstSync;
 	bool             m_dropUnknown;
+	bool             m_enableUnlink;
+	bool             m_unlinkReceived;
+	TG_STATUS        m_tgConnectState;
+	CStopWatch       m_TGChange;
+	CWheelTimer      m_networkWatchdog;
+	CWheelTimer      m_ysfWatchdog;
+	CWheelTimer      m_pollTimer;
+	unsigned char    m_ysfCnt;
+	unsigned char    m_gpsBuffer[20U];
+	CFramePacer      m_dmrPacer;
+	CFramePacer      m_ysfPacer;
+	CSPSCQueue<CPipelineFrame> m_ysfRxQueue;
+	CSPSCQueue<CPipelineFrame> m_ysfVoiceQueue;
+	CSPSCQueue<CDMRData>       m_dmrTxQueue;
+	CSPSCQueue<CDMRData>       m_dmrRxQueue;
+	CSPSCQueue<CPipelineFrame> m_dmrVoiceQueue;
+	CSPSCQueue<CPipelineFrame> m_ysfTxQueue;
+	CPipelineStage   m_ysfIngressStage;
+	CPipelineStage   m_ysfDecodeStage;
+	CPipelineStage   m_ysfConvertStage;
+	CPipelineStage   m_dmrAssembleStage;
+	CPipelineStage   m_dmrEgressStage;
+	CPipelineStage   m_dmrIngressStage;
+	CPipelineStage   m_dmrDecodeStage;
+	CPipelineStage   m_dmrConvertStage;
+	CPipelineStage   m_ysfAssembleStage;
+	CPipelineStage   m_ysfEgressStage;
+
+	// YSF to DMR pipeline, ingress is true when it stopped on a full queue
+	bool ysfIngress();
+	void ysfDecode();
+	void ysfConvert();
+	void dmrAssemble();
+	void dmrEgress();
+
+	// DMR to YSF pipeline
+	bool dmrIngress();
+	void dmrDecode();
+	void dmrConvert();
+	void ysfAssemble();
+	void ysfEgress();
+
+	void networkWatchdogExpired();
+	void ysfWatchdogExpired();
+	void pollExpired();
+
+	void processWiresX(const unsigned char* buffer, unsigned char fi, unsigned char dt, unsigned char fn, unsigned char ft);
+	bool writeYSF(unsigned char tag);
+	bool writeVoice(CSPSCQueue<CPipelineFrame>& queue, unsigned char tag, const unsigned char* data = NULL, unsigned int length = 0U, unsigned int count = 1U);
 
+	bool createYSFNetwork();
+	void setFanOut(const std::vector<std::string>& fanOut, const std::vector<std::string>& oldFanOut);
+	bool getAddressPort(const std::string& entry, in_addr& address, unsigned int& port) const;
 	bool createDMRNetwork();
+	void createDMRTargets();
+	void closeDMRTargets();
+	void createWiresX();
+	void getStartupDst(const CConf& conf, unsigned int& dstId, bool& pc) const;
+	ARB_POLICY getArbitration(const CConf& conf) const;
+	SHARD_KEY  getShardKey(const CConf& conf) const;
+	void takeOver();
 	void createGPS();
 	void SendDummyDMR(unsigned int srcid, unsigned int dstid, FLCO dmr_flco);
 	unsigned int findYSFID(std::string cs, bool showdst);
 	std::string getSrcYSF(const unsigned char* source);
 	void writeXLXLink(unsigned int srcId, unsigned int dstId, CDMRNetwork* network);
+	void createXLXProber();
+	void deleteXLXProber();
+	void checkXLXMirrors();
 };
 
 #endif
@@ -59,6 +59,8 @@ CYSFFICH::CYSFFICH() :
 m_fich(NULL)
 {
 	m_fich  = new unsigned char[6U];
+
+	::memset(m_fich, 0x00U, 6U);
 }
 
 CYSFFICH::~CYSFFICH()
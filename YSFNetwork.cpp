@@ -17,6 +17,7 @@
  */
 
 #include "YSFNetwork.h"
+#include "StopWatch.h"
 #include "Utils.h"
 #include "Log.h"
 
@@ -24,8 +25,6 @@
 #include <cassert>
 #include <cstring>
 
-const unsigned int BUFFER_LENGTH = 200U;
-
 CYSFNetwork::CYSFNetwork(const std::string& address, unsigned int port, const std::string& callsign, bool debug) :
 m_socket(address, port),
 m_debug(debug),
@@ -33,7 +32,10 @@ m_address(),
 m_port(0U),
 m_poll(NULL),
 m_unlink(NULL),
-m_buffer(1000U, "YSF Network Buffer")
+m_thread(m_socket, "YSF Network"),
+m_subscribers(),
+m_inCall(false),
+m_open(false)
 {
 	m_poll = new unsigned char[14U];
 	::memcpy(m_poll + 0U, "YSFP", 4U);
@@ -57,7 +59,10 @@ m_address(),
 m_port(0U),
 m_poll(NULL),
 m_unlink(NULL),
-m_buffer(1000U, "YSF Network Buffer")
+m_thread(m_socket, "YSF Network"),
+m_subscribers(),
+m_inCall(false),
+m_open(false)
 {
 	m_poll = new unsigned char[14U];
 	::memcpy(m_poll + 0U, "YSFP", 4U);
@@ -76,7 +81,10 @@ m_buffer(1000U, "YSF Network Buffer")
 
 CYSFNetwork::~CYSFNetwork()
 {
+	m_thread.stop();
+
 	delete[] m_poll;
+	delete[] m_unlink;
 }
 
 std::string CYSFNetwork::getCallsign()
@@ -88,7 +96,36 @@ bool CYSFNetwork::open()
 {
 	LogMessage("Opening YSF network connection");
 
-	return m_socket.open();
+	bool ret = m_socket.open();
+	if (!ret)
+		return false;
+
+	m_thread.attach();
+
+	return m_thread.start();
+}
+
+void CYSFNetwork::handOver(CUpgrade& upgrade)
+{
+	m_thread.detach();
+
+	upgrade.setFd("ysf", m_socket.getFd());
+}
+
+void CYSFNetwork::resume()
+{
+	m_thread.attach();
+}
+
+bool CYSFNetwork::takeOver(CUpgrade& upgrade)
+{
+	int fd = upgrade.getFd("ysf");
+	if (fd >= 0) {
+		LogMessage("Taking over the YSF network connection");
+		m_socket.setFd(fd);
+	}
+
+	return open();
 }
 
 void CYSFNetwork::setDestination(const in_addr& address, unsigned int port)
@@ -97,12 +134,107 @@ void CYSFNetwork::setDestination(const in_addr& address, unsigned int port)
 	m_port    = port;
 }
 
+void CYSFNetwork::setRealTime(unsigned int priority, int cpu, unsigned int busyPoll, bool ioUring)
+{
+	m_thread.setScheduling(priority, cpu);
+	m_thread.setIOUring(ioUring);
+	m_socket.setBusyPoll(busyPoll);
+}
+
+void CYSFNetwork::setSharding(unsigned int shards, SHARD_KEY key)
+{
+	// The callsign of the peer is in the same place in every packet
+	if (key == SHARD_CALLSIGN)
+		m_socket.setReusePort(shards, USK_PAYLOAD, 4U, YSF_CALLSIGN_LENGTH);
+	else
+		m_socket.setReusePort(shards, USK_ADDRESS);
+}
+
+void CYSFNetwork::setTransport(CUDPTransport* transport)
+{
+	m_socket.setTransport(transport);
+}
+
 void CYSFNetwork::clearDestination()
 {
 	m_address.s_addr = INADDR_NONE;
 	m_port           = 0U;
 }
 
+bool CYSFNetwork::addSubscriber(const in_addr& address, unsigned int port)
+{
+	return join(address, port, true);
+}
+
+void CYSFNetwork::setOpenFanOut(bool open)
+{
+	m_open = open;
+}
+
+bool CYSFNetwork::join(const in_addr& address, unsigned int port, bool listed)
+{
+	for (std::vector<CYSFSubscriber>::iterator it = m_subscribers.begin(); it != m_subscribers.end(); ++it) {
+		if (it->m_address.s_addr == address.s_addr && it->m_port == port) {
+			it->m_listed  |= listed;
+			it->m_lastPoll = CStopWatch::monotonic();
+			return true;
+		}
+	}
+
+	if (m_subscribers.size() >= YSF_MAX_SUBSCRIBERS) {
+		LogWarning("YSF fan out, no room for %s:%u, %u subscribers at most", ::inet_ntoa(address), port, YSF_MAX_SUBSCRIBERS);
+		return false;
+	}
+
+	CYSFSubscriber subscriber;
+	subscriber.m_address  = address;
+	subscriber.m_port     = port;
+	subscriber.m_frames   = 0U;
+	subscriber.m_calls    = 0U;
+	subscriber.m_total    = 0ULL;
+	subscriber.m_lateJoin = m_inCall;
+	subscriber.m_listed   = listed;
+	subscriber.m_lastPoll = CStopWatch::monotonic();
+	m_subscribers.push_back(subscriber);
+
+	LogMessage("YSF fan out, %s:%u joined%s", ::inet_ntoa(address), port, m_inCall ? " during a call" : "");
+
+	// A reflector only passes traffic on to peers that have polled it
+	m_thread.write(m_poll, 14U, address, port);
+
+	return true;
+}
+
+void CYSFNetwork::removeSubscriber(const in_addr& address, unsigned int port)
+{
+	for (std::vector<CYSFSubscriber>::iterator it = m_subscribers.begin(); it != m_subscribers.end(); ++it) {
+		if (it->m_address.s_addr == address.s_addr && it->m_port == port) {
+			LogMessage("YSF fan out, %s:%u left after %u calls, %llu frames", ::inet_ntoa(address), port, it->m_calls, it->m_total);
+
+			m_thread.write(m_unlink, 14U, address, port);
+
+			m_subscribers.erase(it);
+			return;
+		}
+	}
+}
+
+bool CYSFNetwork::isSubscriber(const in_addr& address, unsigned int port) const
+{
+	for (std::vector<CYSFSubscriber>::const_iterator it = m_subscribers.begin(); it != m_subscribers.end(); ++it) {
+		if (it->m_address.s_addr == address.s_addr && it->m_port == port)
+			return true;
+	}
+
+	return false;
+}
+
+void CYSFNetwork::clearSubscribers()
+{
+	while (!m_subscribers.empty())
+		removeSubscriber(m_subscribers.front().m_address, m_subscribers.front().m_port);
+}
+
 bool CYSFNetwork::write(const unsigned char* data)
 {
 	assert(data != NULL);
@@ -113,68 +245,146 @@ bool CYSFNetwork::write(const unsigned char* data)
 	if (m_debug)
 		CUtils::dump(1U, "YSF Network Data Sent", data, 155U);
 
-	return m_socket.write(data, 155U, m_address, m_port);
+	return m_thread.write(data, 155U, m_address, m_port);
 }
 
-bool CYSFNetwork::writePoll()
+bool CYSFNetwork::writeCall(const unsigned char* data, bool end)
 {
-	if (m_port == 0U)
+	assert(data != NULL);
+
+	if (m_port == 0U && m_subscribers.empty())
 		return true;
 
-	return m_socket.write(m_poll, 14U, m_address, m_port);
+	if (m_debug)
+		CUtils::dump(1U, "YSF Network Data Sent", data, 155U);
+
+	for (std::vector<CYSFSubscriber>::iterator it = m_subscribers.begin(); it != m_subscribers.end(); ++it) {
+		it->m_frames++;
+		it->m_total++;
+
+		if (end) {
+			if (it->m_lateJoin)
+				LogMessage("YSF fan out, %s:%u joined late and had %u frames of the call", ::inet_ntoa(it->m_address), it->m_port, it->m_frames);
+
+			it->m_calls++;
+			it->m_frames   = 0U;
+			it->m_lateJoin = false;
+		}
+	}
+
+	m_inCall = !end;
+
+	return writeAll(data, 155U);
 }
 
-bool CYSFNetwork::writeUnlink()
+bool CYSFNetwork::writePoll()
 {
-	if (m_port == 0U)
-		return true;
+	unsigned long long now = CStopWatch::monotonic();
+
+	for (unsigned int i = 0U; i < m_subscribers.size(); ) {
+		const CYSFSubscriber& subscriber = m_subscribers.at(i);
+		if (!subscriber.m_listed && (now - subscriber.m_lastPoll) > YSF_SUBSCRIBER_TIMEOUT) {
+			LogMessage("YSF fan out, %s:%u has stopped polling", ::inet_ntoa(subscriber.m_address), subscriber.m_port);
+			removeSubscriber(subscriber.m_address, subscriber.m_port);
+		} else {
+			i++;
+		}
+	}
 
-	return m_socket.write(m_unlink, 14U, m_address, m_port);
+	return writeAll(m_poll, 14U);
 }
 
-void CYSFNetwork::clock(unsigned int ms)
+bool CYSFNetwork::writeUnlink()
 {
-	if (m_port == 0U)
-		return;
+	return writeAll(m_unlink, 14U);
+}
 
-	unsigned char buffer[BUFFER_LENGTH];
+bool CYSFNetwork::writeAll(const unsigned char* data, unsigned int length)
+{
+	if (m_subscribers.empty()) {
+		if (m_port == 0U)
+			return true;
 
-	in_addr address;
-	unsigned int port;
-	int length = m_socket.read(buffer, BUFFER_LENGTH, address, port);
-	if (length <= 0)
-		return;
+		return m_thread.write(data, length, m_address, m_port);
+	}
 
-	if (address.s_addr != m_address.s_addr || port != m_port)
-		return;
+	unsigned int count = 0U;
 
-	if (m_debug)
-		CUtils::dump(1U, "YSF Network Data Received", buffer, length);
+	if (m_port != 0U) {
+		m_fanOutAddresses[count] = m_address;
+		m_fanOutPorts[count]     = m_port;
+		count++;
+	}
 
-	unsigned char len = length;
-	m_buffer.addData(&len, 1U);
+	for (std::vector<CYSFSubscriber>::const_iterator it = m_subscribers.begin(); it != m_subscribers.end(); ++it) {
+		m_fanOutAddresses[count] = it->m_address;
+		m_fanOutPorts[count]     = it->m_port;
+		count++;
+	}
 
-	m_buffer.addData(buffer, length);
+	return m_thread.write(data, length, m_fanOutAddresses, m_fanOutPorts, count);
 }
 
 unsigned int CYSFNetwork::read(unsigned char* data)
 {
 	assert(data != NULL);
 
-	if (m_buffer.isEmpty())
+	if (m_port == 0U)
 		return 0U;
 
-	unsigned char len = 0U;
-	m_buffer.getData(&len, 1U);
+	CUDPDatagram datagram;
+	while (m_thread.read(datagram)) {
+		if (datagram.m_address.s_addr != m_address.s_addr || datagram.m_port != m_port) {
+			peerData(datagram);
+			continue;
+		}
+
+		if (m_debug)
+			CUtils::dump(1U, "YSF Network Data Received", datagram.m_data, datagram.m_length);
 
-	m_buffer.getData(data, len);
+		::memcpy(data, datagram.m_data, datagram.m_length);
 
-	return len;
+		return datagram.m_length;
+	}
+
+	return 0U;
+}
+
+void CYSFNetwork::peerData(const CUDPDatagram& datagram)
+{
+	// Nothing but the polls of the fan out is taken from anyone else
+	if (datagram.m_length != 14U)
+		return;
+
+	if (::memcmp(datagram.m_data, "YSFP", 4U) == 0) {
+		if (m_open || isSubscriber(datagram.m_address, datagram.m_port))
+			join(datagram.m_address, datagram.m_port, false);
+	} else if (::memcmp(datagram.m_data, "YSFU", 4U) == 0) {
+		for (std::vector<CYSFSubscriber>::const_iterator it = m_subscribers.begin(); it != m_subscribers.end(); ++it) {
+			if (it->m_address.s_addr == datagram.m_address.s_addr && it->m_port == datagram.m_port) {
+				if (!it->m_listed)
+					removeSubscriber(datagram.m_address, datagram.m_port);
+				break;
+			}
+		}
+	}
 }
 
 void CYSFNetwork::close()
 {
+	m_thread.detach();
+
 	m_socket.close();
 
 	LogMessage("Closing YSF network connection");
 }
+
+bool CYSFNetwork::hasData() const
+{
+	return m_thread.hasData();
+}
+
+int CYSFNetwork::getFd() const
+{
+	return m_thread.getFd();
+}
@@ -20,11 +20,34 @@
 #define	YSFNETWORK_H
 
 #include "YSFDefines.h"
+#include "Defines.h"
 #include "UDPSocket.h"
-#include "RingBuffer.h"
+#include "UDPThread.h"
+#include "Upgrade.h"
 
 #include <cstdint>
 #include <string>
+#include <vector>
+
+// The destination is the first of the fan out
+const unsigned int YSF_MAX_SUBSCRIBERS = UDP_MAX_FANOUT - 1U;
+
+// A peer that joined by polling is dropped after this long without a poll, in us
+const unsigned long long YSF_SUBSCRIBER_TIMEOUT = 60000000ULL;
+
+// A further YSF reflector or hotspot that is sent everything the
+// destination is sent, but is not listened to
+class CYSFSubscriber {
+public:
+	in_addr            m_address;
+	unsigned int       m_port;
+	unsigned int       m_frames;		// In the current call
+	unsigned int       m_calls;			// Ended since it joined
+	unsigned long long m_total;			// Frames since it joined
+	bool               m_lateJoin;		// Joined during the current call
+	bool               m_listed;		// From the configuration, rather than by polling
+	unsigned long long m_lastPoll;
+};
 
 class CYSFNetwork {
 public:
@@ -32,24 +55,59 @@ public:
 	CYSFNetwork(unsigned int port, const std::string& callsign, bool debug);
 	~CYSFNetwork();
 
+	// Scheduling of the I/O thread, SO_BUSY_POLL time and the io_uring backend, call before open()
+	void setRealTime(unsigned int priority, int cpu, unsigned int busyPoll, bool ioUring);
+
+	// Share the local port with other processes, each peer always reaching
+	// the same one by its address or by its callsign, call before open()
+	void setSharding(unsigned int shards, SHARD_KEY key);
+
+	// Use an in-memory transport instead of a socket, call before open()
+	void setTransport(CUDPTransport* transport);
+
 	bool open();
 
+	// Stops reading and passes the socket to the new process
+	void handOver(CUpgrade& upgrade);
+	// Carries on after a failed hand over
+	void resume();
+	// Opens with the socket of the old process, if it sent one
+	bool takeOver(CUpgrade& upgrade);
+
 	std::string getCallsign();
 
 	void setDestination(const in_addr& address, unsigned int port);
 	void clearDestination();
 
+	// Subscribers can join and leave at any time, during a call too. A
+	// subscriber that leaves is sent an unlink
+	bool addSubscriber(const in_addr& address, unsigned int port);
+	void removeSubscriber(const in_addr& address, unsigned int port);
+	bool isSubscriber(const in_addr& address, unsigned int port) const;
+	void clearSubscribers();
+
+	// Any peer may also join by polling, and leave by unlinking or going
+	// quiet, as on a reflector
+	void setOpenFanOut(bool open);
+
+	// To the destination only
 	bool write(const unsigned char* data);
+	// A frame of a call, to the destination and every subscriber, end is set
+	// on the terminator
+	bool writeCall(const unsigned char* data, bool end);
 
 	bool writePoll();
 	bool writeUnlink();
 
 	unsigned int read(unsigned char* data);
 
-	void clock(unsigned int ms);
-
 	void close();
 
+	int  getFd() const;
+
+	// Datagrams waiting for clock() or read(), without a system call
+	bool hasData() const;
+
 private:
 	std::string                m_callsign;
 	CUDPSocket                 m_socket;
@@ -58,7 +116,16 @@ private:
 	unsigned int               m_port;
 	unsigned char*             m_poll;
 	unsigned char*             m_unlink;
-	CRingBuffer<unsigned char> m_buffer;
+	CUDPThread                 m_thread;
+	std::vector<CYSFSubscriber> m_subscribers;
+	bool                       m_inCall;
+	bool                       m_open;
+	in_addr                    m_fanOutAddresses[UDP_MAX_FANOUT];
+	unsigned int               m_fanOutPorts[UDP_MAX_FANOUT];
+
+	bool writeAll(const unsigned char* data, unsigned int length);
+	bool join(const in_addr& address, unsigned int port, bool listed);
+	void peerData(const CUDPDatagram& datagram);
 };
 
 #endif